@@ -0,0 +1,5 @@
+#include <benchmark/benchmark.h>
+
+// Defined here rather than taken from benchmark_main: livern carries
+// liverun's own main(), and an object file wins over both archives
+BENCHMARK_MAIN();
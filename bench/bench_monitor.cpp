@@ -0,0 +1,78 @@
+#include "process/monitor.h"
+#include "synthetic_tree.h"
+#include <benchmark/benchmark.h>
+
+using livrn::ProcessMonitor;
+using livrn::bench::SyntheticTree;
+
+// Full index build, as on every liverun start
+static void BM_ScanDirectory(benchmark::State &state) {
+  fs::path root = SyntheticTree::get(state.range(0));
+  size_t indexed = 0;
+
+  for (auto _ : state) {
+    ProcessMonitor monitor;
+    monitor.scanDirectory(root);
+    indexed = monitor.fileCount();
+  }
+  state.counters["files"] = static_cast<double>(indexed);
+  state.SetItemsProcessed(state.iterations() * indexed);
+}
+BENCHMARK(BM_ScanDirectory)
+    ->Apply(SyntheticTree::sizes)
+    ->Unit(benchmark::kMillisecond);
+
+// Scan plus one inotify watch per directory. Pinned to inotify, so runs as
+// root do not measure a fanotify mark instead, and nothing logs the
+// fallback between result lines.
+static void BM_ScanWithNotifications(benchmark::State &state) {
+  fs::path root = SyntheticTree::get(state.range(0));
+  size_t indexed = 0;
+
+  for (auto _ : state) {
+    ProcessMonitor monitor;
+    if (!monitor.enableNotifications(false)) {
+      state.SkipWithError("inotify unavailable");
+      break;
+    }
+    monitor.scanDirectory(root);
+    indexed = monitor.fileCount();
+  }
+  state.counters["files"] = static_cast<double>(indexed);
+  state.SetItemsProcessed(state.iterations() * indexed);
+}
+BENCHMARK(BM_ScanWithNotifications)
+    ->Apply(SyntheticTree::sizes)
+    ->Unit(benchmark::kMillisecond);
+
+// One stat per indexed file; the cost of a full poll sweep
+static void BM_HasAnyFileChanged(benchmark::State &state) {
+  fs::path root = SyntheticTree::get(state.range(0));
+  ProcessMonitor monitor;
+  monitor.scanDirectory(root);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(monitor.hasAnyFileChanged());
+  }
+  state.counters["files"] = static_cast<double>(monitor.fileCount());
+  state.SetItemsProcessed(state.iterations() * monitor.fileCount());
+}
+BENCHMARK(BM_HasAnyFileChanged)
+    ->Apply(SyntheticTree::sizes)
+    ->Unit(benchmark::kMillisecond);
+
+// One adaptive poll tick: only the paths the schedule says are due
+static void BM_AdaptivePollTick(benchmark::State &state) {
+  fs::path root = SyntheticTree::get(state.range(0));
+  ProcessMonitor monitor;
+  monitor.scanDirectory(root);
+  monitor.collectChanges();
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(monitor.collectChanges());
+  }
+  state.counters["files"] = static_cast<double>(monitor.fileCount());
+}
+BENCHMARK(BM_AdaptivePollTick)
+    ->Apply(SyntheticTree::sizes)
+    ->Unit(benchmark::kMicrosecond);
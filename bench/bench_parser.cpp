@@ -0,0 +1,59 @@
+#include "cmd/command.h"
+#include "util/parser.h"
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+
+using livrn::Command;
+using livrn::Parser;
+
+namespace {
+fs::path sampleFile(bool binary) {
+  fs::path path = fs::temp_directory_path() /
+                  (binary ? "liverun-bench-binary" : "liverun-bench-text.cpp");
+  std::ofstream file(path, std::ios::binary);
+  for (int i = 0; i < 512; ++i) {
+    if (binary) {
+      file.put(static_cast<char>(i % 256));
+    } else {
+      file << "int f" << i << "() { return " << i << "; }\n";
+    }
+  }
+  return path;
+}
+} // namespace
+
+static void BM_IsBinaryFilePath(benchmark::State &state) {
+  fs::path path = sampleFile(state.range(0) != 0);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Parser::isBinaryFile(path));
+  }
+  fs::remove(path);
+}
+BENCHMARK(BM_IsBinaryFilePath)->ArgName("binary")->Arg(0)->Arg(1);
+
+// The descriptor overload used by the scanner, without the open
+static void BM_IsBinaryFileFd(benchmark::State &state) {
+  fs::path path = sampleFile(state.range(0) != 0);
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Parser::isBinaryFile(fd));
+  }
+  close(fd);
+  fs::remove(path);
+}
+BENCHMARK(BM_IsBinaryFileFd)->ArgName("binary")->Arg(0)->Arg(1);
+
+static void BM_ParseCommand(benchmark::State &state, const char *cmd) {
+  std::string command = cmd;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Command::parseCommand(command));
+  }
+}
+BENCHMARK_CAPTURE(BM_ParseCommand, simple, "g++ -O2 -o app main.cpp");
+BENCHMARK_CAPTURE(BM_ParseCommand, quoted,
+                  "go build -ldflags \"-X 'main.version=1.2 beta'\" ./cmd/app");
+BENCHMARK_CAPTURE(BM_ParseCommand, escaped,
+                  "clang++ src/my\\ file.cpp -DNAME=\\\"x\\\" -o out");
+BENCHMARK_CAPTURE(BM_ParseCommand, many_args,
+                  "cmake --build build -j8 --target app tests docs install "
+                  "--config Release --verbose --parallel 8 -- -k -l4");
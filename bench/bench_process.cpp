@@ -0,0 +1,40 @@
+#include "process/manager.h"
+#include <benchmark/benchmark.h>
+
+using livrn::PreparedCommand;
+using livrn::ProcessManager;
+
+// fork + exec of a prepared command until the child has exited
+static void BM_SpawnExit(benchmark::State &state) {
+  ProcessManager manager;
+  PreparedCommand command({"true"});
+
+  for (auto _ : state) {
+    manager.startProcess(command);
+    waitpid(manager.childProcess(), nullptr, 0);
+    manager.releaseChild();
+  }
+}
+BENCHMARK(BM_SpawnExit)->Unit(benchmark::kMicrosecond)->UseRealTime();
+
+// Start a long-running app and stop it again, as a reload does, minus the
+// restart delay. Arg 0 kills with SIGKILL, 1 with SIGTERM.
+static void BM_SpawnKill(benchmark::State &state) {
+  ProcessManager manager;
+  PreparedCommand command({"sleep", "60"});
+  int signo = state.range(0) ? SIGTERM : SIGKILL;
+
+  for (auto _ : state) {
+    manager.startProcess(command);
+    pid_t pid = manager.childProcess();
+    kill(pid, signo);
+    waitpid(pid, nullptr, 0);
+    manager.releaseChild();
+  }
+}
+BENCHMARK(BM_SpawnKill)
+    ->ArgName("graceful")
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
@@ -0,0 +1,409 @@
+// Save-to-running latency harness. Starts the real liverun binary against a
+// generated sandbox project, replays editor write patterns and measures the
+// time from the last write of each pattern until the new app instance
+// reports that it is up.
+//
+//   liverun_latency [--liverun <path>] [--iterations N] [--files N]
+//                   [--mode interpret|compile|command]...
+//                   [--pattern <name>]...
+//                   [--json <file>]
+//
+// Every app instance writes "up" to a FIFO as its first action, so the
+// numbers include debounce, graceful stop, restart delay, any build step and
+// process startup. Ups that arrive after the measured one are counted as
+// extra restarts; a pattern that restarts the app twice shows up there.
+
+#include "liverun.h"
+#include "logger.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <functional>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const int STARTUP_TIMEOUT_MS = 60000;
+const int RELOAD_TIMEOUT_MS = 30000;
+const int SETTLE_MS = 300;
+
+struct Options {
+  std::string liverun = LIVERUN_BINARY;
+  int iterations = 20;
+  int files = 200;
+  std::vector<std::string> modes;
+  std::vector<std::string> patterns;
+  std::string jsonPath;
+};
+
+struct Result {
+  std::string mode;
+  std::string pattern;
+  std::vector<double> samplesMs;
+  int missed = 0;
+  int extraRestarts = 0;
+
+  double percentile(double p) const {
+    if (samplesMs.empty())
+      return 0;
+    std::vector<double> sorted = samplesMs;
+    std::sort(sorted.begin(), sorted.end());
+    size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+  }
+};
+
+// A generated project plus the FIFO its app reports to
+class Sandbox {
+public:
+  Sandbox(const std::string &mode, int files) : mode(mode), fileCount(files) {
+    std::string pattern =
+        (fs::temp_directory_path() / "liverun-latency-XXXXXX").string();
+    if (!mkdtemp(pattern.data()))
+      throw std::runtime_error("mkdtemp failed");
+    root = pattern;
+    project = root / "project";
+    fs::create_directories(project);
+
+    fifoPath = root / "ready.fifo";
+    if (mkfifo(fifoPath.c_str(), 0600) != 0)
+      throw std::runtime_error("mkfifo failed");
+    // Read-write, so the FIFO never reports EOF between app instances
+    fifoFd = open(fifoPath.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+
+    extension = mode == "compile" ? ".h" : ".py";
+    comment = mode == "compile" ? "// " : "# ";
+    for (int i = 0; i < fileCount; ++i) {
+      write(source(i), "value_" + std::to_string(i) + " = 0\n");
+    }
+
+    if (mode == "compile") {
+      write("main.cpp", "#include <fstream>\n"
+                        "#include <unistd.h>\n"
+                        "int main() {\n"
+                        "  std::ofstream(\"" +
+                            fifoPath.string() +
+                            "\") << \"up\\n\";\n"
+                            "  pause();\n"
+                            "}\n");
+    } else {
+      write("app.py", "import time\n"
+                      "with open('" +
+                          fifoPath.string() +
+                          "', 'w') as fifo:\n"
+                          "    fifo.write('up\\n')\n"
+                          "while True:\n"
+                          "    time.sleep(60)\n");
+    }
+  }
+
+  ~Sandbox() {
+    stop();
+    if (fifoFd >= 0)
+      close(fifoFd);
+    std::error_code ec;
+    fs::remove_all(root, ec);
+  }
+
+  bool start(const std::string &liverun) {
+    std::vector<std::string> args = {liverun};
+    if (mode == "compile") {
+      args.insert(args.end(), {"compile", "./app", "g++ -O0 -o app main.cpp"});
+    } else if (mode == "command") {
+      args.insert(args.end(), {"command", "python3 -m py_compile app.py",
+                               "python3 app.py"});
+    } else {
+      args.insert(args.end(), {"interpret", "python3", "app.py"});
+    }
+
+    pid = fork();
+    if (pid < 0)
+      return false;
+    if (pid == 0) {
+      if (chdir(project.c_str()) != 0)
+        _exit(127);
+      int log = open((root / "liverun.log").c_str(),
+                     O_WRONLY | O_CREAT | O_TRUNC, 0600);
+      dup2(log, STDOUT_FILENO);
+      dup2(log, STDERR_FILENO);
+
+      std::vector<char *> argv;
+      for (auto &arg : args)
+        argv.push_back(arg.data());
+      argv.push_back(nullptr);
+      execv(argv[0], argv.data());
+      _exit(127);
+    }
+    return waitForUps(STARTUP_TIMEOUT_MS, 1) == 1;
+  }
+
+  void stop() {
+    if (pid <= 0)
+      return;
+    kill(pid, SIGINT);
+    for (int i = 0; i < 100; ++i) {
+      if (waitpid(pid, nullptr, WNOHANG) == pid) {
+        pid = -1;
+        return;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    pid = -1;
+  }
+
+  // Counts "up" reports until `wanted` arrived or the timeout passed
+  int waitForUps(int timeoutMs, int wanted) {
+    int ups = 0;
+    auto deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (ups < wanted) {
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      deadline - Clock::now())
+                      .count();
+      if (left <= 0)
+        break;
+      pollfd pfd{fifoFd, POLLIN, 0};
+      if (::poll(&pfd, 1, static_cast<int>(left)) <= 0)
+        continue;
+
+      char buffer[256];
+      ssize_t n = read(fifoFd, buffer, sizeof(buffer));
+      for (ssize_t i = 0; i < n; ++i) {
+        if (buffer[i] == '\n')
+          ++ups;
+      }
+    }
+    return ups;
+  }
+
+  std::string source(int index) const {
+    return "src/m" + std::to_string(index) + extension;
+  }
+
+  // Changes content and size, so even an mtime-only check notices
+  std::string revision(int index) {
+    return "value_" + std::to_string(index) + " = 0\n" + comment + "rev " +
+           std::to_string(++revisions) + "\n";
+  }
+
+  void write(const std::string &relative, const std::string &content) {
+    fs::path path = project / relative;
+    fs::create_directories(path.parent_path());
+    std::ofstream(path) << content;
+  }
+
+  fs::path path(const std::string &relative) const { return project / relative; }
+  int files() const { return fileCount; }
+  const std::string &fileExtension() const { return extension; }
+
+private:
+  std::string mode;
+  int fileCount;
+  fs::path root;
+  fs::path project;
+  fs::path fifoPath;
+  std::string extension;
+  std::string comment;
+  int fifoFd = -1;
+  pid_t pid = -1;
+  int revisions = 0;
+};
+
+// Editor and VCS write patterns. Each returns once its last write is done.
+using Pattern = std::function<void(Sandbox &, int iteration)>;
+
+void renameOver(Sandbox &sandbox, int iteration) {
+  // vim, JetBrains: write a temp file next to the target, rename it over
+  std::string target = sandbox.source(iteration % sandbox.files());
+  fs::path temp = sandbox.path(target + "___jb_tmp___");
+  std::ofstream(temp) << sandbox.revision(iteration);
+  fs::rename(temp, sandbox.path(target));
+}
+
+void truncateWrite(Sandbox &sandbox, int iteration) {
+  // Truncate in place, then write in two chunks as buffered editors do
+  std::string content = sandbox.revision(iteration);
+  int fd = open(sandbox.path(sandbox.source(iteration % sandbox.files())).c_str(),
+                O_WRONLY | O_TRUNC);
+  size_t half = content.size() / 2;
+  ssize_t written = ::write(fd, content.data(), half);
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  written += ::write(fd, content.data() + half, content.size() - half);
+  (void)written;
+  close(fd);
+}
+
+void multiFile(Sandbox &sandbox, int iteration) {
+  // A rename refactor saving ten files one after another
+  for (int i = 0; i < 10; ++i) {
+    int index = (iteration * 10 + i) % sandbox.files();
+    sandbox.write(sandbox.source(index), sandbox.revision(index));
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+}
+
+void branchSwitch(Sandbox &sandbox, int iteration) {
+  // git checkout: half the tree rewritten, files added and removed
+  for (int i = 0; i < sandbox.files() / 2; ++i) {
+    int index = (iteration + i * 2) % sandbox.files();
+    sandbox.write(sandbox.source(index), sandbox.revision(index));
+  }
+  for (int i = 0; i < 5; ++i) {
+    std::string branchFile =
+        "branch/b" + std::to_string(i) + sandbox.fileExtension();
+    if (iteration % 2 == 0) {
+      sandbox.write(branchFile, sandbox.revision(i));
+    } else {
+      fs::remove(sandbox.path(branchFile));
+    }
+  }
+}
+
+const std::vector<std::pair<std::string, Pattern>> PATTERNS = {
+    {"rename_over", renameOver},
+    {"truncate_write", truncateWrite},
+    {"multi_file", multiFile},
+    {"branch_switch", branchSwitch},
+};
+
+bool selected(const std::vector<std::string> &chosen, const std::string &name) {
+  return chosen.empty() ||
+         std::find(chosen.begin(), chosen.end(), name) != chosen.end();
+}
+
+bool runMode(const Options &options, const std::string &mode,
+             std::vector<Result> &results) {
+  Sandbox sandbox(mode, options.files);
+  if (!sandbox.start(options.liverun)) {
+    livrn::Logger::error(mode, ": app did not come up, see liverun.log");
+    return false;
+  }
+
+  for (const auto &entry : PATTERNS) {
+    if (!selected(options.patterns, entry.first))
+      continue;
+
+    Result result;
+    result.mode = mode;
+    result.pattern = entry.first;
+    for (int i = 0; i < options.iterations; ++i) {
+      entry.second(sandbox, i);
+      auto written = Clock::now();
+
+      if (sandbox.waitForUps(RELOAD_TIMEOUT_MS, 1) == 0) {
+        ++result.missed;
+        continue;
+      }
+      result.samplesMs.push_back(
+          std::chrono::duration<double, std::milli>(Clock::now() - written)
+              .count());
+      result.extraRestarts += sandbox.waitForUps(SETTLE_MS, INT_MAX);
+    }
+
+    livrn::Logger::info(mode, " ", entry.first, ": p50 ",
+                        result.percentile(0.5), " ms");
+    results.push_back(std::move(result));
+  }
+  return true;
+}
+
+void printTable(const std::vector<Result> &results) {
+  std::printf("%-10s %-15s %5s %9s %9s %9s %7s %6s\n", "mode", "pattern", "n",
+              "p50 ms", "p99 ms", "max ms", "extra", "missed");
+  for (const auto &result : results) {
+    std::printf("%-10s %-15s %5zu %9.1f %9.1f %9.1f %7d %6d\n",
+                result.mode.c_str(), result.pattern.c_str(),
+                result.samplesMs.size(), result.percentile(0.5),
+                result.percentile(0.99), result.percentile(1.0),
+                result.extraRestarts, result.missed);
+  }
+}
+
+bool writeJson(const std::string &path, const std::vector<Result> &results) {
+  std::ofstream out(path);
+  if (!out)
+    return false;
+
+  out << "{\n  \"results\": [\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const auto &result = results[i];
+    out << "    {\"mode\": \"" << result.mode << "\", \"pattern\": \""
+        << result.pattern << "\", \"p50_ms\": " << result.percentile(0.5)
+        << ", \"p99_ms\": " << result.percentile(0.99)
+        << ", \"max_ms\": " << result.percentile(1.0)
+        << ", \"extra_restarts\": " << result.extraRestarts
+        << ", \"missed\": " << result.missed << ", \"samples_ms\": [";
+    for (size_t j = 0; j < result.samplesMs.size(); ++j) {
+      out << (j ? ", " : "") << result.samplesMs[j];
+    }
+    out << "]}" << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  out << "  ]\n}\n";
+  return true;
+}
+
+bool parseArguments(int argc, char *argv[], Options &options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      livrn::Logger::error("Missing value for ", arg);
+      return false;
+    }
+    std::string value = argv[++i];
+
+    if (arg == "--liverun") {
+      options.liverun = value;
+    } else if (arg == "--iterations") {
+      options.iterations = std::max(1, std::atoi(value.c_str()));
+    } else if (arg == "--files") {
+      options.files = std::max(10, std::atoi(value.c_str()));
+    } else if (arg == "--mode") {
+      options.modes.push_back(value);
+    } else if (arg == "--pattern") {
+      options.patterns.push_back(value);
+    } else if (arg == "--json") {
+      options.jsonPath = value;
+    } else {
+      livrn::Logger::error("Unknown option: ", arg);
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Options options;
+  if (!parseArguments(argc, argv, options))
+    return 1;
+  if (options.modes.empty())
+    options.modes = {"interpret", "compile", "command"};
+
+  std::vector<Result> results;
+  for (const auto &mode : options.modes) {
+    const char *tool = mode == "compile" ? "g++" : "python3";
+    std::string probe = std::string("which ") + tool + " > /dev/null 2>&1";
+    if (system(probe.c_str()) != 0) {
+      livrn::Logger::warn("Skipping ", mode, " mode: ", tool, " not found");
+      continue;
+    }
+    try {
+      runMode(options, mode, results);
+    } catch (const std::exception &e) {
+      livrn::Logger::error(mode, ": ", e.what());
+    }
+  }
+
+  printTable(results);
+  if (!options.jsonPath.empty() && !writeJson(options.jsonPath, results)) {
+    livrn::Logger::error("Cannot write ", options.jsonPath);
+    return 1;
+  }
+  return results.empty() ? 1 : 0;
+}
@@ -0,0 +1,107 @@
+#include "synthetic_tree.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+
+namespace livrn {
+namespace bench {
+
+namespace {
+const char *const EXTENSIONS[] = {".cpp", ".h", ".py", ".go", ".rs",
+                                  ".ts",  ".c", ".hpp", ".js", ".txt"};
+const size_t FILES_PER_DIR = 100;
+const size_t DIRS_PER_DIR = 100;
+
+fs::path benchRoot() {
+  if (const char *dir = std::getenv("LIVERUN_BENCH_DIR"))
+    return dir;
+  return fs::temp_directory_path() / "liverun-bench";
+}
+
+bool writeAll(int fd, const std::string &data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t n = write(fd, data.data() + written, data.size() - written);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n == 0)
+      errno = EIO;
+    if (n <= 0)
+      return false;
+    written += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+// A partial tree would benchmark something other than its name says, and
+// without the marker the next run starts over
+bool generate(const fs::path &root, size_t files) {
+  fs::remove_all(root);
+  fs::create_directories(root);
+
+  std::string content = "int value() { return 0; }\n";
+  int dirFd = -1;
+  for (size_t i = 0; i < files; ++i) {
+    if (i % FILES_PER_DIR == 0) {
+      if (dirFd >= 0)
+        close(dirFd);
+      size_t leaf = i / FILES_PER_DIR;
+      fs::path dir = root / ("d" + std::to_string(leaf / DIRS_PER_DIR)) /
+                     ("d" + std::to_string(leaf % DIRS_PER_DIR));
+      fs::create_directories(dir);
+      dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (dirFd < 0) {
+        std::cerr << dir.string() << ": " << std::strerror(errno) << std::endl;
+        return false;
+      }
+    }
+
+    std::string name = "f" + std::to_string(i) + EXTENSIONS[i % 10];
+    int fd = openat(dirFd, name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool written = fd >= 0 && writeAll(fd, content);
+    int error = errno;
+    if (fd >= 0)
+      close(fd);
+    if (!written) {
+      std::cerr << name << ": " << std::strerror(error) << std::endl;
+      close(dirFd);
+      return false;
+    }
+  }
+  if (dirFd >= 0)
+    close(dirFd);
+
+  std::ofstream(root / ".complete") << files << "\n";
+  return true;
+}
+} // namespace
+
+fs::path SyntheticTree::get(size_t files) {
+  fs::path root = benchRoot() / ("tree-" + std::to_string(files));
+
+  size_t recorded = 0;
+  std::ifstream marker(root / ".complete");
+  if (!(marker >> recorded) || recorded != files) {
+    std::cerr << "Generating " << files << " files under " << root.string()
+              << std::endl;
+    if (!generate(root, files)) {
+      std::cerr << "Cannot generate the benchmark tree" << std::endl;
+      std::exit(1);
+    }
+  }
+  return root;
+}
+
+size_t SyntheticTree::maxFiles() {
+  if (const char *limit = std::getenv("LIVERUN_BENCH_MAX_FILES"))
+    return std::strtoul(limit, nullptr, 10);
+  return 1000000;
+}
+
+void SyntheticTree::sizes(benchmark::internal::Benchmark *benchmark) {
+  for (size_t files = 1000; files <= maxFiles(); files *= 10) {
+    benchmark->Arg(static_cast<int64_t>(files));
+  }
+}
+
+} // namespace bench
+} // namespace livrn
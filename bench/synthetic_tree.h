@@ -0,0 +1,25 @@
+#pragma once
+#include "liverun.h"
+#include <benchmark/benchmark.h>
+
+namespace livrn {
+namespace bench {
+
+// Source trees for the monitor benchmarks. A tree holds `files` files, 100
+// per directory, nested two levels deep; one file in ten has an extension
+// the monitor ignores. Trees are generated once under $LIVERUN_BENCH_DIR
+// (default: <tmp>/liverun-bench) and reused by later runs, since writing
+// the million-file tree takes minutes.
+class SyntheticTree {
+public:
+  static fs::path get(size_t files);
+
+  // Largest tree to benchmark: $LIVERUN_BENCH_MAX_FILES, default 1M
+  static size_t maxFiles();
+
+  // Registers one benchmark argument per tree size, 1k up to maxFiles()
+  static void sizes(benchmark::internal::Benchmark *benchmark);
+};
+
+} // namespace bench
+} // namespace livrn
@@ -0,0 +1,140 @@
+#pragma once
+// Host side of liverun's shared-library swap mode. Header only; link the
+// host with -ldl on glibc older than 2.34.
+//
+//   liverun swap ./host libsim.so "make libsim.so"
+//
+// liverun builds the library, copies it to a versioned path and starts the
+// host with that path in $LIVERUN_LIBRARY. After each rebuild it asks the
+// host to swap to a fresh copy. Keep long-lived state in the host and pass
+// it into library functions; globals inside the library start over on
+// every swap.
+//
+//   liverun::HotLibrary lib("./libsim.so");
+//   auto step = lib.symbol<void (*)(World &)>("sim_step");
+//   lib.onSwap([&](liverun::HotLibrary &next) {
+//     auto fresh = next.symbol<void (*)(World &)>("sim_step");
+//     if (!fresh)
+//       return false; // keep the old code, liverun restarts the host
+//     step = fresh;
+//     return true;
+//   });
+//   while (running) {
+//     lib.poll();
+//     step(world);
+//   }
+
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <functional>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace liverun {
+
+class HotLibrary {
+public:
+  // Loads $LIVERUN_LIBRARY when started by liverun, fallbackPath otherwise
+  explicit HotLibrary(const std::string &fallbackPath) {
+    const char *path = std::getenv("LIVERUN_LIBRARY");
+    current = dlopen(path ? path : fallbackPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!current)
+      loadError = dlerror();
+
+    if (const char *fd = std::getenv("LIVERUN_CONTROL_FD")) {
+      controlFd = std::atoi(fd);
+      send("hello");
+    }
+  }
+
+  ~HotLibrary() {
+    if (current)
+      dlclose(current);
+    if (controlFd >= 0)
+      close(controlFd);
+  }
+
+  HotLibrary(const HotLibrary &) = delete;
+  HotLibrary &operator=(const HotLibrary &) = delete;
+
+  bool loaded() const { return current != nullptr; }
+  const std::string &error() const { return loadError; }
+
+  template <typename T> T symbol(const char *name) const {
+    if (!current)
+      return nullptr;
+    return reinterpret_cast<T>(dlsym(current, name));
+  }
+
+  // Runs after a new version is loaded and before the old one is closed;
+  // symbol() already resolves against the new version. Returning false
+  // keeps the old version and makes liverun restart the host instead.
+  void onSwap(std::function<bool(HotLibrary &)> handler) {
+    swapHandler = std::move(handler);
+  }
+
+  // Readable when liverun has sent a request; for hosts with an event loop
+  int fd() const { return controlFd; }
+
+  // Handles pending requests without blocking. Call it where the host can
+  // safely switch code, e.g. once per frame or tick. Returns true if the
+  // library was swapped.
+  bool poll() {
+    bool swapped = false;
+    char buffer[4096];
+    while (controlFd >= 0) {
+      ssize_t n = recv(controlFd, buffer, sizeof(buffer) - 1, MSG_DONTWAIT);
+      if (n <= 0)
+        break;
+      buffer[n] = '\0';
+
+      char *path = std::strchr(buffer, '\n');
+      if (!path || std::strncmp(buffer, "swap\n", 5) != 0) {
+        send("nack unsupported request");
+        continue;
+      }
+      ++path;
+      if (char *end = std::strchr(path, '\n'))
+        *end = '\0';
+      swapped = swap(path) || swapped;
+    }
+    return swapped;
+  }
+
+private:
+  void *current = nullptr;
+  int controlFd = -1;
+  std::string loadError;
+  std::function<bool(HotLibrary &)> swapHandler;
+
+  bool swap(const char *path) {
+    void *next = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!next) {
+      send((std::string("nack ") + dlerror()).c_str());
+      return false;
+    }
+
+    void *previous = current;
+    current = next;
+    if (swapHandler && !swapHandler(*this)) {
+      current = previous;
+      dlclose(next);
+      send("nack rejected by host");
+      return false;
+    }
+
+    if (previous)
+      dlclose(previous);
+    send("ack");
+    return true;
+  }
+
+  void send(const char *message) {
+    std::string line = std::string(message) + "\n";
+    ::send(controlFd, line.data(), line.size(), MSG_NOSIGNAL);
+  }
+};
+
+} // namespace liverun
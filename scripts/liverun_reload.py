@@ -0,0 +1,77 @@
+"""Application side of liverun's in-process reload protocol.
+
+Start the app with ``liverun --hot interpret python3 app.py`` and call
+``liverun_reload.install()`` once during startup. Changed modules are then
+reloaded with importlib while the process keeps running; if a module fails
+to reload, or the main script itself changed, liverun restarts the process
+as usual.
+
+Reloading happens on a background thread. Pass a ``threading.Lock`` that
+the application also holds while it uses reloadable code to keep the two
+apart, and ``on_reload`` to rebind references held outside the modules.
+Outside liverun (or without ``--hot``) install() does nothing.
+"""
+
+import importlib
+import os
+import socket
+import sys
+import threading
+
+
+def _loaded_module(path):
+    for module in list(sys.modules.values()):
+        filename = getattr(module, "__file__", None)
+        if filename and os.path.realpath(filename) == path:
+            return module
+    return None
+
+
+def _reload(paths, on_reload):
+    modules = []
+    for path in paths:
+        module = _loaded_module(os.path.realpath(path))
+        if module is None:
+            # Nothing imported it yet, so no running code depends on it
+            continue
+        if module.__name__ == "__main__":
+            raise RuntimeError("main script changed")
+        modules.append(module)
+
+    for module in modules:
+        importlib.reload(module)
+    if on_reload is not None:
+        on_reload(modules)
+
+
+def install(on_reload=None, lock=None):
+    fd = os.environ.get("LIVERUN_CONTROL_FD")
+    if fd is None:
+        return False
+    try:
+        channel = socket.socket(fileno=int(fd))
+    except (OSError, ValueError):
+        return False
+
+    def serve():
+        channel.send(b"hello\n")
+        while True:
+            data = channel.recv(65536)
+            if not data:
+                return
+            lines = data.decode().splitlines()
+            if not lines or lines[0] != "reload":
+                continue
+            try:
+                if lock is not None:
+                    with lock:
+                        _reload(lines[1:], on_reload)
+                else:
+                    _reload(lines[1:], on_reload)
+                channel.send(b"ack\n")
+            except Exception as error:
+                reason = " ".join(str(error).split()) or type(error).__name__
+                channel.send(("nack %s\n" % reason).encode())
+
+    threading.Thread(target=serve, name="liverun-reload", daemon=True).start()
+    return True
@@ -1,25 +1,176 @@
 #include "command.h"
+#include <csignal>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/stat.h>
+
+extern char **environ;
 
 namespace livrn {
 
+namespace {
+std::string resolveExecutable(const std::string &name) {
+  if (name.find('/') != std::string::npos)
+    return name;
+
+  const char *path = getenv("PATH");
+  if (!path)
+    return "";
+
+  std::istringstream dirs(path);
+  std::string dir;
+  while (std::getline(dirs, dir, ':')) {
+    std::string candidate = (dir.empty() ? "." : dir) + "/" + name;
+    struct stat st;
+    if (stat(candidate.c_str(), &st) == 0 && S_ISREG(st.st_mode) &&
+        access(candidate.c_str(), X_OK) == 0) {
+      return candidate;
+    }
+  }
+  return "";
+}
+} // namespace
+
 std::vector<std::string> Command::parseCommand(const std::string &cmd) {
   std::vector<std::string> args;
-  std::istringstream iss(cmd);
   std::string arg;
+  bool inWord = false;
 
-  while (iss >> arg) {
-    if (arg.length() > livrn::Config::MAX_ARG_LENGTH) {
-      continue;
+  auto flush = [&]() {
+    if (inWord && arg.length() <= livrn::Config::MAX_ARG_LENGTH) {
+      args.push_back(arg);
     }
+    arg.clear();
+    inWord = false;
+  };
 
-    // Remove quotes if present
-    if (arg.length() >= 2 && arg.front() == '"' && arg.back() == '"') {
-      arg = arg.substr(1, arg.length() - 2);
-    }
+  for (size_t i = 0; i < cmd.size(); ++i) {
+    char c = cmd[i];
 
-    args.push_back(arg);
+    if (std::isspace(static_cast<unsigned char>(c))) {
+      flush();
+    } else if (c == '\'') {
+      size_t end = cmd.find('\'', i + 1);
+      if (end == std::string::npos)
+        return {};
+      arg.append(cmd, i + 1, end - i - 1);
+      inWord = true;
+      i = end;
+    } else if (c == '"') {
+      inWord = true;
+      for (++i; i < cmd.size() && cmd[i] != '"'; ++i) {
+        if (cmd[i] == '\\' && i + 1 < cmd.size() &&
+            std::strchr("\"\\$`", cmd[i + 1])) {
+          ++i;
+        }
+        arg += cmd[i];
+      }
+      if (i >= cmd.size())
+        return {};
+    } else if (c == '\\' && i + 1 < cmd.size()) {
+      arg += cmd[++i];
+      inWord = true;
+    } else {
+      arg += c;
+      inWord = true;
+    }
   }
+  flush();
 
   return args;
 }
+
+PreparedCommand::PreparedCommand(std::vector<std::string> commandArgs)
+    : args(std::move(commandArgs)) {
+  if (args.empty())
+    return;
+
+  for (char **var = environ; var && *var; ++var) {
+    env.emplace_back(*var);
+  }
+
+  for (auto &arg : args) {
+    argvBlock.push_back(arg.data());
+  }
+  argvBlock.push_back(nullptr);
+
+  buildEnvironmentBlock();
+  executable = resolveExecutable(args[0]);
+}
+
+std::string PreparedCommand::programPath() const {
+  if (executable.empty() || executable[0] == '/' || workingDirectory.empty())
+    return executable;
+  return (fs::path(workingDirectory) / executable).string();
+}
+
+void PreparedCommand::buildEnvironmentBlock() {
+  envpBlock.clear();
+  for (auto &var : env) {
+    envpBlock.push_back(var.data());
+  }
+  envpBlock.push_back(nullptr);
+}
+
+void PreparedCommand::setEnvironment(const std::string &name,
+                                     const std::string &value) {
+  std::string entry = name + "=" + value;
+  for (auto &var : env) {
+    if (var.compare(0, name.size() + 1, name + "=") == 0) {
+      var = entry;
+      buildEnvironmentBlock();
+      return;
+    }
+  }
+  env.push_back(std::move(entry));
+  buildEnvironmentBlock();
+}
+
+std::string PreparedCommand::toString() const {
+  std::string text;
+  for (const auto &arg : args) {
+    if (!text.empty())
+      text += ' ';
+    text += arg;
+  }
+  return text;
+}
+
+void PreparedCommand::exec() const {
+  if (args.empty())
+    return;
+
+  // liverun receives its signals through a signalfd; the blocked mask would
+  // otherwise be inherited across exec
+  sigset_t none;
+  sigemptyset(&none);
+  sigprocmask(SIG_SETMASK, &none, nullptr);
+
+  if (!workingDirectory.empty() && chdir(workingDirectory.c_str()) != 0) {
+    return;
+  }
+
+  if (passedFd >= 0) {
+    // dup2 onto itself keeps close-on-exec set, so clear it explicitly
+    if (passedFd == passedTarget) {
+      fcntl(passedFd, F_SETFD, 0);
+    } else if (dup2(passedFd, passedTarget) < 0) {
+      return;
+    }
+  }
+
+  if (cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+  }
+
+  if (!executable.empty()) {
+    execve(executable.c_str(), argvBlock.data(), envpBlock.data());
+  }
+  // Not found at prepare time (e.g. installed since), fall back to a search
+  execvpe(argvBlock[0], argvBlock.data(), envpBlock.data());
+}
+
 } // namespace livrn
@@ -5,6 +5,62 @@
 namespace livrn {
 class Command {
 public:
+  // Splits a command line into words following POSIX shell quoting rules:
+  // single quotes are literal, double quotes allow \ escapes of " \ $ and `,
+  // and a backslash outside quotes escapes the next character. Returns an
+  // empty vector if a quote is left unterminated.
   static std::vector<std::string> parseCommand(const std::string &cmd);
 };
+
+// An argv/envp block built once per session and reused for every exec.
+// The executable is resolved against PATH up front so reloads skip the
+// search as well.
+class PreparedCommand {
+private:
+  std::vector<std::string> args;
+  std::vector<std::string> env;
+  std::vector<char *> argvBlock;
+  std::vector<char *> envpBlock;
+  std::string executable;
+  std::string workingDirectory;
+  int passedFd = -1;
+  int passedTarget = -1;
+  int cpu = -1;
+
+  void buildEnvironmentBlock();
+
+public:
+  PreparedCommand() = default;
+  explicit PreparedCommand(std::vector<std::string> commandArgs);
+
+  // Moving keeps the string storage in place, so the pointer blocks stay
+  // valid; copying would not.
+  PreparedCommand(PreparedCommand &&) = default;
+  PreparedCommand &operator=(PreparedCommand &&) = default;
+  PreparedCommand(const PreparedCommand &) = delete;
+  PreparedCommand &operator=(const PreparedCommand &) = delete;
+
+  // The child changes into dir before exec
+  void setWorkingDirectory(const std::string &dir) { workingDirectory = dir; }
+  // Adds or replaces one variable in the prepared environment
+  void setEnvironment(const std::string &name, const std::string &value);
+  // The child gets fd as descriptor number target, without close-on-exec.
+  // Pass -1 to stop handing a descriptor down.
+  void passDescriptor(int fd, int target) {
+    passedFd = fd;
+    passedTarget = target;
+  }
+  // The child runs on the given CPU only; -1 leaves its affinity alone
+  void pinToCpu(int index) { cpu = index; }
+
+  bool empty() const { return args.empty(); }
+  const std::vector<std::string> &arguments() const { return args; }
+  // The executable found on PATH, or the path given, taking the working
+  // directory into account
+  std::string programPath() const;
+  std::string toString() const;
+
+  // Replaces the calling process. Only returns if the exec failed.
+  void exec() const;
+};
 } // namespace livrn
@@ -16,8 +16,33 @@ const size_t MAX_COMMAND_LENGTH = 1024;
 const size_t MAX_PATH_LENGTH = 512;
 const size_t MAX_ARG_LENGTH = 256;
 const int GRACEFUL_SHUTDOWN_TIMEOUT_MS = 3000;
-const int POLL_INTERVAL_MS = 500;
+const int POLL_HOT_INTERVAL_MS = 250;
+const int POLL_DIR_MAX_INTERVAL_MS = 5000;
+const int POLL_COLD_MAX_INTERVAL_MS = 5000;
+const int POLL_DECAY_DIVISOR = 10;
 const int SHUTDOWN_DELAY_MS = 500;
+const int DEBOUNCE_MS = 50;
+const size_t TRACE_BUFFER_CAPACITY = 1 << 16;
+const size_t DAEMON_MAX_ROOTS = 8;
+const size_t DAEMON_MAX_MESSAGE = 256 * 1024;
+const int DAEMON_CONNECT_TIMEOUT_MS = 2000;
+const int CONTROL_FD = 3;
+const int JOBSERVER_FD = 4;
+const int HOT_RELOAD_TIMEOUT_MS = 2000;
+const int METRICS_INTERVAL_MS = 5000;
+const int METRICS_REQUEST_TIMEOUT_MS = 2000;
+const size_t METRICS_MAX_REQUEST = 8192;
+const int OWN_WRITE_SLACK_MS = 20;
+const size_t OWN_WRITE_WINDOWS = 64;
+const std::string TEST_MAP_FILE = ".liverun-tests";
+const std::string RULES_FILE = ".liverun-rules";
+const size_t BULK_CHANGE_THRESHOLD = 200;
+const int BULK_WINDOW_MS = 1000;
+const int BULK_SETTLE_MS = 500;
+const int REPLAY_IDLE_CHECK_MS = 10;
+const int REPLICA_PROBE_INTERVAL_MS = 50;
+const int REPLICA_SETTLE_MS = 1000;
+const int REPLICA_READY_TIMEOUT_MS = 30000;
 } // namespace Config
 } // namespace livrn
 
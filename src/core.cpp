@@ -1,47 +1,370 @@
 #include "core.h"
+#include "daemon/client.h"
+#include "daemon/daemon.h"
 #include "logger.h"
-#include "process/manager.h"
 #include "reloader.h"
+#include "util/metrics.h"
+#include "util/tracer.h"
 #include <csignal>
 #include <iostream>
 
 namespace livrn {
 
-// Global process manager for signal handling
-ProcessManager *g_processManager = nullptr;
-livrn::Reloader hotReloader;
+std::string g_tracePath;
 
-void signalHandler(int signal) {
-  livrn::Logger::debug("Received signal ", signal, ", cleaning up...");
-  if (g_processManager) {
-    g_processManager->cleanup();
+void exportTrace() {
+  if (g_tracePath.empty())
+    return;
+
+  if (Tracer::instance().exportChromeTrace(g_tracePath)) {
+    livrn::Logger::info("Trace written to ", g_tracePath);
+  } else {
+    livrn::Logger::error("Failed to write trace to ", g_tracePath);
   }
-  exit(signal);
 }
 
 void Core::printUsage() {
-  std::cerr << "Usage: ./liverun <mode> [args...]\n";
+  std::cerr << "Usage: ./liverun [options] <mode> [args...]\n";
   std::cerr << "Modes:\n";
   std::cerr << "  interpret <interpreter> <script>\n";
   std::cerr << "  compile <binary> <compile_cmd>\n";
   std::cerr << "  command <args1> <args2> [...]\n";
+  std::cerr << "  supervise <services_file>\n";
+  std::cerr << "  swap <host> <library> <build_cmd>\n";
+  std::cerr << "  test [build_cmd...] <test_cmd>   rerun affected tests, "
+               "{} is the test\n";
+  std::cerr << "  replicate <count> [build_cmd...] <run_cmd>\n"
+               "                   run several instances, restarting them "
+               "in turn\n";
+  std::cerr << "  attach <mode> [args...]   run a mode through the daemon\n";
+  std::cerr << "  daemon [status|stop]\n";
+  std::cerr << "Options:\n";
+  std::cerr << "  --trace <file>   write reload phases as Chrome trace JSON\n";
+  std::cerr << "  --hot            let interpreted apps reload changed modules "
+               "in place\n";
+  std::cerr << "  --reload-own-writes\n"
+               "                   also reload on files written by builds "
+               "and the app\n";
+  std::cerr << "  --jobs <n>       parallel test workers (default: all "
+               "cores)\n";
+  std::cerr << "  --jobserver <n>  share n build jobs between all build steps "
+               "as a GNU make\n"
+               "                   jobserver (make 4.2+, cargo; ninja "
+               "needs fifo)\n";
+  std::cerr << "  --jobserver-style <pipe|fifo>\n"
+               "                   fifo for make 4.4+ and ninja 1.13+ "
+               "(default: pipe)\n";
+  std::cerr << "  --port <base>    replicate: replica i gets PORT=base+i and "
+               "is ready once it\n"
+               "                   accepts connections\n";
+  std::cerr << "  --rolling <k>    replicate: restart k replicas at a time "
+               "(default: 1)\n";
+  std::cerr << "  --pin-cpus       replicate: pin each replica to one core\n";
+  std::cerr << "  --bulk-threshold <n>\n"
+               "                   treat more than n changed files per second "
+               "as one bulk\n"
+               "                   change (default: 200, 0: only git "
+               "checkouts)\n";
+  std::cerr << "  --rules <file>   per-path actions (default: "
+            << Config::RULES_FILE << " if present)\n";
+  std::cerr << "  --profile        count CPU time, context switches, page "
+               "faults, cycles and\n"
+               "                   instructions of each app instance\n";
+  std::cerr << "  --profile-interval <ms>\n"
+               "                   --profile, also reporting every ms while "
+               "it runs\n";
+  std::cerr << "  --no-prefetch    do not read the app's binary and "
+               "libraries into the page\n"
+               "                   cache before each start\n";
+  std::cerr << "  --watch <dir>    also watch dir, e.g. a sibling checkout "
+               "(repeatable)\n";
+  std::cerr << "  --follow-symlinks\n"
+               "                   follow symlinks to files and directories, "
+               "watching each\n"
+               "                   file once whatever path reaches it\n";
+  std::cerr << "  --skip-noop-edits\n"
+               "                   do not reload when only comments or "
+               "whitespace changed\n";
+  std::cerr << "  --record <file>  write every change batch to file\n";
+  std::cerr << "  --replay <file>  feed recorded changes to the mode instead "
+               "of watching,\n"
+               "                   then report and exit\n";
+  std::cerr << "  --replay-speed <x>\n"
+               "                   replay x times faster (default: 1, 0: "
+               "back to back)\n";
+  std::cerr << "  --metrics <file|unix:socket>\n"
+               "                   publish Prometheus metrics while running\n";
+}
+
+bool Core::parseOptions(int argc, char *argv[], int &argi) {
+  while (argi < argc && std::strncmp(argv[argi], "--", 2) == 0) {
+    std::string opt = argv[argi++];
+
+    if (opt == "--trace") {
+      if (argi >= argc) {
+        livrn::Logger::error("--trace requires a file path");
+        return false;
+      }
+      g_tracePath = argv[argi++];
+      Tracer::instance().enable();
+      std::atexit(exportTrace);
+    } else if (opt == "--metrics") {
+      if (argi >= argc) {
+        livrn::Logger::error("--metrics requires a file or unix:<socket>");
+        return false;
+      }
+      metricsTarget = argv[argi++];
+      Metrics::instance().enable();
+    } else if (opt == "--hot") {
+      hotReload = true;
+    } else if (opt == "--jobs") {
+      char *end = nullptr;
+      long value = argi < argc ? std::strtol(argv[argi], &end, 10) : 0;
+      if (argi >= argc || *end != '\0' || value < 1) {
+        livrn::Logger::error("--jobs requires a positive number");
+        return false;
+      }
+      jobs = static_cast<size_t>(value);
+      ++argi;
+    } else if (opt == "--jobserver") {
+      char *end = nullptr;
+      long value = argi < argc ? std::strtol(argv[argi], &end, 10) : 0;
+      if (argi >= argc || *end != '\0' || value < 1) {
+        livrn::Logger::error("--jobserver requires a positive number");
+        return false;
+      }
+      jobserverTokens = static_cast<size_t>(value);
+      ++argi;
+    } else if (opt == "--jobserver-style") {
+      std::string style = argi < argc ? argv[argi] : "";
+      if (style != "fifo" && style != "pipe") {
+        livrn::Logger::error("--jobserver-style requires fifo or pipe");
+        return false;
+      }
+      jobserverStyle = style == "fifo" ? Jobserver::Style::Fifo
+                                       : Jobserver::Style::Pipe;
+      ++argi;
+    } else if (opt == "--port") {
+      char *end = nullptr;
+      long value = argi < argc ? std::strtol(argv[argi], &end, 10) : 0;
+      if (argi >= argc || *end != '\0' || value < 1 || value > 65535) {
+        livrn::Logger::error("--port requires a port number");
+        return false;
+      }
+      basePort = static_cast<int>(value);
+      ++argi;
+    } else if (opt == "--rolling") {
+      char *end = nullptr;
+      long value = argi < argc ? std::strtol(argv[argi], &end, 10) : 0;
+      if (argi >= argc || *end != '\0' || value < 1) {
+        livrn::Logger::error("--rolling requires a positive number");
+        return false;
+      }
+      rollingBatch = static_cast<size_t>(value);
+      ++argi;
+    } else if (opt == "--bulk-threshold") {
+      char *end = nullptr;
+      long value = argi < argc ? std::strtol(argv[argi], &end, 10) : -1;
+      if (argi >= argc || *end != '\0' || value < 0) {
+        livrn::Logger::error("--bulk-threshold requires a number");
+        return false;
+      }
+      bulkThreshold = value;
+      ++argi;
+    } else if (opt == "--rules") {
+      if (argi >= argc) {
+        livrn::Logger::error("--rules requires a file path");
+        return false;
+      }
+      rulesFile = argv[argi++];
+    } else if (opt == "--record" || opt == "--replay") {
+      if (argi >= argc) {
+        livrn::Logger::error(opt, " requires a file path");
+        return false;
+      }
+      (opt == "--record" ? recordFile : replayFile) = argv[argi++];
+    } else if (opt == "--replay-speed") {
+      char *end = nullptr;
+      double value = argi < argc ? std::strtod(argv[argi], &end) : -1;
+      if (argi >= argc || *end != '\0' || value < 0) {
+        livrn::Logger::error("--replay-speed requires a non-negative factor");
+        return false;
+      }
+      replaySpeed = value;
+      ++argi;
+    } else if (opt == "--profile") {
+      profileIntervalMs = std::max(profileIntervalMs, 0);
+    } else if (opt == "--profile-interval") {
+      char *end = nullptr;
+      long value = argi < argc ? std::strtol(argv[argi], &end, 10) : 0;
+      if (argi >= argc || *end != '\0' || value < 1) {
+        livrn::Logger::error("--profile-interval requires milliseconds");
+        return false;
+      }
+      profileIntervalMs = static_cast<int>(value);
+      ++argi;
+    } else if (opt == "--pin-cpus") {
+      pinCpus = true;
+    } else if (opt == "--no-prefetch") {
+      prefetch = false;
+    } else if (opt == "--skip-noop-edits") {
+      skipNoopEdits = true;
+    } else if (opt == "--watch") {
+      std::error_code ec;
+      if (argi >= argc || !fs::is_directory(argv[argi], ec)) {
+        livrn::Logger::error("--watch requires a directory");
+        return false;
+      }
+      watchRoots.push_back(argv[argi++]);
+    } else if (opt == "--follow-symlinks") {
+      followSymlinks = true;
+    } else if (opt == "--reload-own-writes") {
+      reloadOwnWrites = true;
+    } else {
+      livrn::Logger::error("Unknown option: ", opt);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Core::loadRules(Reloader &hotReloader) {
+  // A file named on the command line must exist; the default is optional
+  std::string path = rulesFile.empty() ? Config::RULES_FILE : rulesFile;
+  std::error_code ec;
+  if (rulesFile.empty() && !fs::exists(path, ec))
+    return true;
+
+  ActionRules rules;
+  if (!ActionRules::load(path, rules))
+    return false;
+  livrn::Logger::debug("Loaded ", rules.all().size(), " rule(s) from ", path);
+  hotReloader.setActionRules(std::move(rules));
+  return true;
+}
+
+bool Core::setUpRecording(Reloader &hotReloader) {
+  if (!recordFile.empty() && !hotReloader.recordChanges(recordFile))
+    return false;
+  if (replayFile.empty())
+    return true;
+
+  std::vector<RecordedBatch> batches;
+  if (!ChangeRecording::load(replayFile, batches))
+    return false;
+  hotReloader.setReplay(std::move(batches), replaySpeed);
+  return true;
 }
 
 void Core::setupSignalHandlers() {
-  signal(SIGINT, signalHandler);
-  signal(SIGTERM, signalHandler);
+  // Block termination signals before anything else runs; the reloader's
+  // event loop picks them up through a signalfd instead of a handler
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &mask, nullptr);
 }
 
 int Core::run(int argc, char *argv[]) {
+  int argi = 1;
+  if (!parseOptions(argc, argv, argi)) {
+    printUsage();
+    return 1;
+  }
+
+  std::vector<std::string> options(argv + 1, argv + argi);
+  // Remaining arguments are addressed relative to the mode name
+  argc -= argi - 1;
+  argv += argi - 1;
+
   if (argc < 2) {
     printUsage();
     return 1;
   }
 
+  std::string mode = argv[1];
+
+  if (mode == "daemon") {
+    if (argc >= 3) {
+      std::string action = argv[2];
+      if (action == "status")
+        return DaemonClient::status();
+      if (action == "stop")
+        return DaemonClient::shutdown();
+      livrn::Logger::error("Usage: ./liverun daemon [status|stop]");
+      return 1;
+    }
+
+    setupSignalHandlers();
+    Daemon daemon([this](Reloader &reloader, int modeArgc, char *modeArgv[]) {
+      // Options forwarded by the client precede the mode
+      int modeArgi = 1;
+      if (!parseOptions(modeArgc, modeArgv, modeArgi))
+        return 1;
+      modeArgc -= modeArgi - 1;
+      modeArgv += modeArgi - 1;
+      if (modeArgc < 2) {
+        printUsage();
+        return 1;
+      }
+      if (!loadRules(reloader) || !setUpRecording(reloader))
+        return 1;
+      setUpIndex(reloader);
+      int code = runMode(reloader, modeArgc, modeArgv);
+      // Sessions end with _exit, which skips the atexit export
+      exportTrace();
+      return code;
+    });
+    return daemon.run(DaemonSocket::path());
+  }
+
+  if (mode == "attach") {
+    if (argc < 3) {
+      livrn::Logger::error("Usage: ./liverun attach <mode> [args...]");
+      return 1;
+    }
+    // The session parses the same options in the daemon, so they are
+    // passed on as given. It also writes the trace; the client's would
+    // only overwrite it.
+    std::vector<std::string> args(options);
+    args.insert(args.end(), argv + 2, argv + argc);
+    g_tracePath.clear();
+
+    setupSignalHandlers();
+    return DaemonClient::attach(args);
+  }
+
   setupSignalHandlers();
-  hotReloader.initialize();
+  livrn::Reloader hotReloader;
+  if (!loadRules(hotReloader) || !setUpRecording(hotReloader))
+    return 1;
+  setUpIndex(hotReloader);
+  // A replay stands in for the file monitor
+  if (replayFile.empty())
+    hotReloader.initialize();
+  return runMode(hotReloader, argc, argv);
+}
+
+void Core::setUpIndex(Reloader &hotReloader) {
+  hotReloader.setWatchRoots(watchRoots);
+  hotReloader.setFollowSymlinks(followSymlinks);
+  hotReloader.setSkipNoopEdits(skipNoopEdits);
+}
 
+int Core::runMode(Reloader &hotReloader, int argc, char *argv[]) {
   std::string mode = argv[1];
+  hotReloader.setHotReload(hotReload);
+  hotReloader.setMetricsTarget(metricsTarget);
+  hotReloader.setIgnoreOwnWrites(!reloadOwnWrites);
+  hotReloader.setJobs(jobs);
+  hotReloader.setProfiling(profileIntervalMs);
+  hotReloader.setPrefetch(prefetch);
+  if (jobserverTokens > 0 &&
+      !hotReloader.setJobserver(jobserverTokens, jobserverStyle))
+    return 1;
+  if (bulkThreshold >= 0)
+    hotReloader.setBulkThreshold(static_cast<size_t>(bulkThreshold));
 
   try {
     if (mode == "interpret") {
@@ -72,6 +395,46 @@ int Core::run(int argc, char *argv[]) {
 
       return hotReloader.runCommandMode(commands);
 
+    } else if (mode == "test") {
+      if (argc < 3) {
+        livrn::Logger::error(
+            "Usage: ./liverun test [build_cmd...] <test_cmd>");
+        return 1;
+      }
+      return hotReloader.runTestMode(
+          std::vector<std::string>(argv + 2, argv + argc));
+
+    } else if (mode == "replicate") {
+      char *end = nullptr;
+      long count = argc >= 4 ? std::strtol(argv[2], &end, 10) : 0;
+      if (argc < 4 || *end != '\0' || count < 1) {
+        livrn::Logger::error(
+            "Usage: ./liverun replicate <count> [build_cmd...] <run_cmd>");
+        return 1;
+      }
+      ReplicaSet::Options options;
+      options.count = static_cast<size_t>(count);
+      options.batch = rollingBatch;
+      options.basePort = basePort;
+      options.pinCpus = pinCpus;
+      return hotReloader.runReplicateMode(
+          options, std::vector<std::string>(argv + 3, argv + argc));
+
+    } else if (mode == "swap") {
+      if (argc < 5) {
+        livrn::Logger::error(
+            "Usage: ./liverun swap <host> <library> <build_cmd>");
+        return 1;
+      }
+      return hotReloader.runSwapMode(argv[2], argv[3], argv[4]);
+
+    } else if (mode == "supervise") {
+      if (argc < 3) {
+        livrn::Logger::error("Usage: ./liverun supervise <services_file>");
+        return 1;
+      }
+      return hotReloader.runSupervisorMode(argv[2]);
+
     } else {
       std::cerr << "Unknown mode: " << mode << "\n";
       printUsage();
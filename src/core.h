@@ -1,5 +1,6 @@
 #pragma once
 #include "liverun.h"
+#include "reloader.h"
 
 namespace livrn {
 
@@ -8,8 +9,33 @@ public:
   int run(int argc, char *argv[]);
 
 private:
+  bool hotReload = false;
+  bool reloadOwnWrites = false;
+  std::string metricsTarget;
+  size_t jobs = 0;
+  size_t jobserverTokens = 0;
+  Jobserver::Style jobserverStyle = Jobserver::Style::Pipe;
+  int basePort = 0;
+  size_t rollingBatch = 1;
+  bool pinCpus = false;
+  long bulkThreshold = -1;
+  std::string rulesFile;
+  std::string recordFile;
+  std::string replayFile;
+  double replaySpeed = 1;
+  int profileIntervalMs = -1;
+  bool prefetch = true;
+  bool skipNoopEdits = false;
+  std::vector<std::string> watchRoots;
+  bool followSymlinks = false;
+
   void printUsage();
   void setupSignalHandlers();
+  bool parseOptions(int argc, char *argv[], int &argi);
+  bool loadRules(Reloader &hotReloader);
+  bool setUpRecording(Reloader &hotReloader);
+  void setUpIndex(Reloader &hotReloader);
+  int runMode(Reloader &hotReloader, int argc, char *argv[]);
 };
 
 } // namespace livrn
@@ -0,0 +1,162 @@
+#include "client.h"
+#include "../config.h"
+#include "../event/loop.h"
+#include "../logger.h"
+#include "../util/tracer.h"
+#include <fcntl.h>
+#include <sys/epoll.h>
+
+namespace livrn {
+
+int DaemonClient::connect(bool startDaemon) {
+  std::string path = DaemonSocket::path();
+  int fd = DaemonSocket::connect(path);
+  if (fd >= 0)
+    return fd;
+
+  if (!startDaemon) {
+    livrn::Logger::error("No daemon listening on ", path);
+    return -1;
+  }
+  if (!spawnDaemon(path))
+    return -1;
+
+  uint64_t deadline =
+      Tracer::nowNs() + uint64_t(Config::DAEMON_CONNECT_TIMEOUT_MS) * 1000000;
+  while (Tracer::nowNs() < deadline) {
+    fd = DaemonSocket::connect(path);
+    if (fd >= 0)
+      return fd;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  livrn::Logger::error("Daemon did not come up on ", path);
+  return -1;
+}
+
+bool DaemonClient::spawnDaemon(const std::string &socketPath) {
+  pid_t pid = fork();
+  if (pid < 0) {
+    livrn::Logger::error("fork failed: ", std::strerror(errno));
+    return false;
+  }
+
+  if (pid == 0) {
+    // Detach twice so the daemon is neither our child nor in our session
+    setsid();
+    if (fork() != 0)
+      _exit(0);
+
+    int nullFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    std::string logPath = socketPath + ".log";
+    int logFd = open(logPath.c_str(),
+                     O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (nullFd >= 0)
+      dup2(nullFd, STDIN_FILENO);
+    if (logFd >= 0) {
+      dup2(logFd, STDOUT_FILENO);
+      dup2(logFd, STDERR_FILENO);
+    }
+
+    setenv("LIVERUN_SOCKET", socketPath.c_str(), 1);
+    execl("/proc/self/exe", "liverun", "daemon", nullptr);
+    _exit(127);
+  }
+
+  int status;
+  waitpid(pid, &status, 0);
+  livrn::Logger::info("Started daemon, logging to ", socketPath, ".log");
+  return true;
+}
+
+bool DaemonClient::request(const DaemonSocket::Message &message,
+                           DaemonSocket::Message &reply) {
+  int fd = connect(false);
+  if (fd < 0)
+    return false;
+
+  bool ok = DaemonSocket::send(fd, message) && DaemonSocket::receive(fd, reply);
+  close(fd);
+
+  if (ok && reply[0] == "error") {
+    livrn::Logger::error("Daemon: ", reply.size() > 1 ? reply[1] : "");
+    return false;
+  }
+  return ok;
+}
+
+int DaemonClient::attach(const std::vector<std::string> &args) {
+  int fd = connect(true);
+  if (fd < 0)
+    return 1;
+
+  std::error_code ec;
+  std::string cwd = fs::current_path(ec).string();
+  if (ec) {
+    livrn::Logger::error("Cannot resolve working directory: ", ec.message());
+    close(fd);
+    return 1;
+  }
+
+  DaemonSocket::Message message = {"attach", cwd,
+                                   std::to_string(args.size() + 1), "liverun"};
+  message.insert(message.end(), args.begin(), args.end());
+  for (char **entry = environ; entry && *entry; ++entry)
+    message.emplace_back(*entry);
+
+  if (!DaemonSocket::send(fd, message,
+                          {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO})) {
+    livrn::Logger::error("Failed to send attach request");
+    close(fd);
+    return 1;
+  }
+
+  EventLoop loop;
+  int interrupts = 0;
+  auto forward = [&](int) {
+    DaemonSocket::send(fd, {++interrupts == 1 ? "stop" : "kill"});
+  };
+  loop.onSignal(SIGINT, forward);
+  loop.onSignal(SIGTERM, forward);
+
+  loop.add(fd, EPOLLIN, [&](uint32_t) {
+    DaemonSocket::Message reply;
+    if (!DaemonSocket::receive(fd, reply)) {
+      livrn::Logger::error("Lost connection to the session");
+      loop.stop(1);
+    } else if (reply[0] == "exit" && reply.size() > 1) {
+      loop.stop(std::atoi(reply[1].c_str()));
+    } else if (reply[0] == "error") {
+      livrn::Logger::error("Daemon: ", reply.size() > 1 ? reply[1] : "");
+      loop.stop(1);
+    }
+  });
+
+  int code = loop.run();
+  loop.remove(fd);
+  close(fd);
+  return code;
+}
+
+int DaemonClient::status() {
+  DaemonSocket::Message reply;
+  if (!request({"status"}, reply))
+    return 1;
+
+  if (reply.size() < 3)
+    std::cout << "No warm roots\n";
+  for (size_t i = 1; i + 1 < reply.size(); i += 2)
+    std::cout << reply[i] << "  " << reply[i + 1] << " files\n";
+  return 0;
+}
+
+int DaemonClient::shutdown() {
+  DaemonSocket::Message reply;
+  if (!request({"shutdown"}, reply))
+    return 1;
+
+  livrn::Logger::info("Daemon stopped");
+  return 0;
+}
+
+} // namespace livrn
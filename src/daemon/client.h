@@ -0,0 +1,29 @@
+#pragma once
+#include "../liverun.h"
+#include "socket.h"
+
+namespace livrn {
+
+// Thin front end for the daemon. Attaching hands the terminal's stdin,
+// stdout and stderr to the session, so its output streams straight to the
+// caller; Ctrl-C stops the session, a second Ctrl-C kills it.
+class DaemonClient {
+public:
+  // Runs "liverun <args...>" in the current directory through the daemon,
+  // starting the daemon first if nobody is listening. Returns the
+  // session's exit code.
+  static int attach(const std::vector<std::string> &args);
+
+  static int status();
+  static int shutdown();
+
+  // Sends one request and waits for the reply
+  static bool request(const DaemonSocket::Message &message,
+                      DaemonSocket::Message &reply);
+
+private:
+  static int connect(bool startDaemon);
+  static bool spawnDaemon(const std::string &socketPath);
+};
+
+} // namespace livrn
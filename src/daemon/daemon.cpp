@@ -0,0 +1,415 @@
+#include "daemon.h"
+#include "../config.h"
+#include "../logger.h"
+#include "../util/tracer.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+namespace livrn {
+
+namespace {
+// A forked session must not keep the daemon's listening socket, other
+// clients or other roots' watches alive. Closing is safe; touching the
+// shared epoll instance through the inherited loop would not be.
+void closeInheritedDescriptors(const std::unordered_set<int> &keep) {
+  DIR *dir = opendir("/proc/self/fd");
+  if (!dir)
+    return;
+
+  int self = dirfd(dir);
+  std::vector<int> inherited;
+  while (dirent *entry = readdir(dir)) {
+    if (entry->d_name[0] == '.')
+      continue;
+    int fd = std::atoi(entry->d_name);
+    if (fd > 2 && fd != self && keep.count(fd) == 0)
+      inherited.push_back(fd);
+  }
+  closedir(dir);
+
+  for (int fd : inherited)
+    close(fd);
+}
+
+void leaveRoot() {
+  if (chdir("/") != 0)
+    livrn::Logger::warn("chdir / failed: ", std::strerror(errno));
+}
+} // namespace
+
+Daemon::Daemon(ModeRunner runner) : runner(std::move(runner)) {}
+
+Daemon::~Daemon() {
+  for (auto &entry : roots) {
+    cancelRescan(*entry.second);
+    unwatchRoot(*entry.second);
+    close(entry.second->dirFd);
+  }
+  for (int fd : clients) {
+    loop.remove(fd);
+    close(fd);
+  }
+  if (listenFd >= 0) {
+    loop.remove(listenFd);
+    close(listenFd);
+  }
+}
+
+int Daemon::run(const std::string &socketPath) {
+  listenFd = DaemonSocket::listen(socketPath);
+  if (listenFd < 0)
+    return 1;
+
+  // Roots are entered with fchdir only while they are scanned
+  if (chdir("/") != 0) {
+    livrn::Logger::error("chdir failed: ", std::strerror(errno));
+    return 1;
+  }
+
+  loop.onSignal(SIGINT, [this](int) { loop.stop(0); });
+  loop.onSignal(SIGTERM, [this](int) { loop.stop(0); });
+  loop.add(listenFd, EPOLLIN, [this](uint32_t) { onAccept(); });
+
+  livrn::Logger::info("Daemon listening on ", socketPath);
+  int code = loop.run();
+
+  unlink(socketPath.c_str());
+  livrn::Logger::info("Daemon stopped");
+  return code;
+}
+
+void Daemon::onAccept() {
+  while (true) {
+    int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        livrn::Logger::warn("accept failed: ", std::strerror(errno));
+      return;
+    }
+
+    // The socket is mode 0600, but root could still connect on our behalf
+    ucred peer{};
+    socklen_t length = sizeof(peer);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &length) != 0 ||
+        peer.uid != getuid()) {
+      livrn::Logger::warn("Rejected client with uid ", peer.uid);
+      close(fd);
+      continue;
+    }
+
+    clients.insert(fd);
+    loop.add(fd, EPOLLIN, [this, fd](uint32_t) { onRequest(fd); });
+  }
+}
+
+void Daemon::closeClient(int fd) {
+  loop.remove(fd);
+  clients.erase(fd);
+  close(fd);
+}
+
+void Daemon::onRequest(int fd) {
+  DaemonSocket::Message request;
+  std::vector<int> fds;
+  if (!DaemonSocket::receive(fd, request, &fds)) {
+    closeClient(fd);
+    return;
+  }
+
+  if (request[0] == "attach") {
+    attach(fd, request, fds);
+    return;
+  }
+
+  for (int extra : fds)
+    close(extra);
+
+  if (request[0] == "status") {
+    reportStatus(fd);
+  } else if (request[0] == "shutdown") {
+    livrn::Logger::info("Shutdown requested");
+    DaemonSocket::send(fd, {"ok"});
+    loop.stop(0);
+  } else {
+    DaemonSocket::send(fd, {"error", "unknown request: " + request[0]});
+  }
+  closeClient(fd);
+}
+
+void Daemon::attach(int fd, DaemonSocket::Message &request,
+                    std::vector<int> &fds) {
+  size_t argCount = 0;
+  if (request.size() >= 3)
+    argCount = std::strtoul(request[2].c_str(), nullptr, 10);
+
+  auto reject = [&](const std::string &reason) {
+    DaemonSocket::send(fd, {"error", reason});
+    for (int stdioFd : fds)
+      close(stdioFd);
+    closeClient(fd);
+  };
+
+  if (fds.size() != 3 || argCount < 2 || request.size() < 3 + argCount) {
+    reject("malformed attach request");
+    return;
+  }
+
+  const std::string rootPath = request[1];
+  WarmRoot *root = warm(rootPath);
+  if (!root) {
+    reject("cannot open " + rootPath);
+    return;
+  }
+
+  std::vector<std::string> args(request.begin() + 3,
+                                request.begin() + 3 + argCount);
+  std::vector<std::string> env(request.begin() + 3 + argCount, request.end());
+
+  // Bring the index up to date so the session starts from the current tree.
+  // An attach right after the last one waits for its rescan.
+  if (root->scanThread.joinable())
+    finishRescan(*root);
+  refreshRoot(*root);
+  size_t warmFiles = root->monitor.fileCount();
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    reject(std::string("fork failed: ") + std::strerror(errno));
+    return;
+  }
+  if (pid == 0)
+    runSession(*root, fd, fds, std::move(args), env);
+
+  for (int stdioFd : fds)
+    close(stdioFd);
+  closeClient(fd);
+
+  livrn::Logger::info("Session ", pid, " attached to ", rootPath, " (",
+                      warmFiles, " files warm)");
+  loop.watchChild(pid, [pid](int status) {
+    livrn::Logger::info("Session ", pid, " ended with status ", status);
+  });
+
+  // The session took the notification descriptor along with the index.
+  // Start the root over so the next attach is warm as well.
+  rescanInBackground(*root);
+}
+
+void Daemon::reportStatus(int fd) {
+  DaemonSocket::Message reply = {"status"};
+  for (const auto &entry : roots) {
+    reply.push_back(entry.first);
+    reply.push_back(std::to_string(entry.second->files));
+  }
+  DaemonSocket::send(fd, reply);
+}
+
+Daemon::WarmRoot *Daemon::warm(const std::string &path) {
+  auto it = roots.find(path);
+  if (it != roots.end()) {
+    it->second->lastUsedNs = Tracer::nowNs();
+    return it->second.get();
+  }
+
+  int dirFd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dirFd < 0)
+    return nullptr;
+
+  if (roots.size() >= Config::DAEMON_MAX_ROOTS)
+    evictLeastRecentlyUsed();
+
+  auto root = std::make_unique<WarmRoot>();
+  root->path = path;
+  root->dirFd = dirFd;
+  root->lastUsedNs = Tracer::nowNs();
+  WarmRoot *raw = root.get();
+  root->pollTimer =
+      std::make_unique<Timer>(loop, [this, raw]() { refreshRoot(*raw); });
+
+  scanRoot(*raw);
+  livrn::Logger::info("Indexed ", path, ": ", raw->files, " files");
+  roots.emplace(path, std::move(root));
+  return raw;
+}
+
+void Daemon::scanRoot(WarmRoot &root) {
+  // Monitor paths are relative to the working directory ("./src/a.cpp"),
+  // exactly as a session started in the root would see them
+  if (fchdir(root.dirFd) != 0) {
+    livrn::Logger::error("Cannot enter ", root.path, ": ",
+                         std::strerror(errno));
+    return;
+  }
+  indexRoot(root.monitor);
+  leaveRoot();
+  watchRoot(root);
+}
+
+void Daemon::indexRoot(ProcessMonitor &monitor) {
+  if (ProcessMonitor::supportsNotifications("."))
+    monitor.enableNotifications();
+  monitor.scanDirectory(".");
+}
+
+void Daemon::watchRoot(WarmRoot &root) {
+  root.files = root.monitor.fileCount();
+  int notifyFd = root.monitor.notificationFd();
+  if (notifyFd >= 0) {
+    WarmRoot *raw = &root;
+    loop.add(notifyFd, EPOLLIN, [this, raw](uint32_t) { refreshRoot(*raw); });
+  } else {
+    root.pollTimer->start(root.monitor.nextPollDelayMs());
+  }
+}
+
+void Daemon::rescanInBackground(WarmRoot &root) {
+  unwatchRoot(root);
+  root.monitor = ProcessMonitor();
+
+  root.scanDoneFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (root.scanDoneFd >= 0) {
+    WarmRoot *raw = &root;
+    try {
+      root.scanned = false;
+      root.scanThread = std::thread([raw]() {
+        // The scan thread gets a working directory of its own, so the loop
+        // can keep entering other roots meanwhile
+        raw->scanned = unshare(CLONE_FS) == 0 && fchdir(raw->dirFd) == 0;
+        if (raw->scanned)
+          indexRoot(raw->monitor);
+        uint64_t done = 1;
+        if (write(raw->scanDoneFd, &done, sizeof(done)) < 0)
+          livrn::Logger::error("Cannot signal the end of the scan");
+      });
+      loop.add(root.scanDoneFd, EPOLLIN,
+               [this, raw](uint32_t) { finishRescan(*raw); });
+      return;
+    } catch (const std::system_error &e) {
+      livrn::Logger::debug("Scanning in the foreground: ", e.what());
+      close(root.scanDoneFd);
+      root.scanDoneFd = -1;
+    }
+  }
+  scanRoot(root);
+}
+
+void Daemon::finishRescan(WarmRoot &root) {
+  loop.remove(root.scanDoneFd);
+  root.scanThread.join();
+  close(root.scanDoneFd);
+  root.scanDoneFd = -1;
+
+  if (!root.scanned) {
+    root.monitor = ProcessMonitor();
+    scanRoot(root);
+    return;
+  }
+  watchRoot(root);
+  livrn::Logger::debug("Re-indexed ", root.path, ": ", root.files, " files");
+}
+
+void Daemon::cancelRescan(WarmRoot &root) {
+  if (!root.scanThread.joinable())
+    return;
+  root.monitor.cancelScan();
+  loop.remove(root.scanDoneFd);
+  root.scanThread.join();
+  close(root.scanDoneFd);
+  root.scanDoneFd = -1;
+}
+
+void Daemon::refreshRoot(WarmRoot &root) {
+  int notifyFd = root.monitor.notificationFd();
+  if (fchdir(root.dirFd) != 0)
+    return;
+  root.monitor.collectChanges();
+  leaveRoot();
+
+  // The backend may have degraded to polling while reading events
+  if (notifyFd >= 0 && root.monitor.notificationFd() < 0)
+    loop.remove(notifyFd);
+  root.files = root.monitor.fileCount();
+  if (root.monitor.notificationFd() < 0)
+    root.pollTimer->start(root.monitor.nextPollDelayMs());
+}
+
+void Daemon::unwatchRoot(WarmRoot &root) {
+  int notifyFd = root.monitor.notificationFd();
+  if (notifyFd >= 0)
+    loop.remove(notifyFd);
+  root.pollTimer->cancel();
+}
+
+void Daemon::evictLeastRecentlyUsed() {
+  auto oldest = roots.begin();
+  for (auto it = roots.begin(); it != roots.end(); ++it) {
+    if (it->second->lastUsedNs < oldest->second->lastUsedNs)
+      oldest = it;
+  }
+  if (oldest == roots.end())
+    return;
+
+  livrn::Logger::debug("Evicting ", oldest->first);
+  cancelRescan(*oldest->second);
+  unwatchRoot(*oldest->second);
+  close(oldest->second->dirFd);
+  roots.erase(oldest);
+}
+
+void Daemon::runSession(WarmRoot &root, int clientFd,
+                        const std::vector<int> &stdio,
+                        std::vector<std::string> args,
+                        const std::vector<std::string> &env) {
+  std::unordered_set<int> keep = {clientFd, root.dirFd,
+                                  root.monitor.notificationFd()};
+  keep.insert(stdio.begin(), stdio.end());
+  closeInheritedDescriptors(keep);
+
+  // From here on the session behaves as if started from the client's shell
+  for (int i = 0; i < 3; ++i) {
+    dup2(stdio[i], i);
+    close(stdio[i]);
+  }
+  if (fchdir(root.dirFd) != 0)
+    _exit(1);
+  close(root.dirFd);
+
+  clearenv();
+  for (const auto &entry : env) {
+    size_t eq = entry.find('=');
+    if (eq != std::string::npos && eq > 0)
+      setenv(entry.substr(0, eq).c_str(), entry.c_str() + eq + 1, 1);
+  }
+
+  int code;
+  {
+    Reloader reloader;
+    reloader.adoptMonitor(std::move(root.monitor));
+    reloader.setControlSocket(clientFd);
+
+    std::vector<char *> argv;
+    for (auto &arg : args)
+      argv.push_back(arg.data());
+    argv.push_back(nullptr);
+
+    try {
+      code = runner(reloader, static_cast<int>(args.size()), argv.data());
+    } catch (const std::exception &e) {
+      livrn::Logger::error("Unhandled exception: ", e.what());
+      code = 1;
+    }
+  }
+
+  std::cout.flush();
+  std::cerr.flush();
+  DaemonSocket::send(clientFd, {"exit", std::to_string(code)});
+  _exit(code);
+}
+
+} // namespace livrn
@@ -0,0 +1,75 @@
+#pragma once
+#include "../event/loop.h"
+#include "../liverun.h"
+#include "../process/monitor.h"
+#include "../reloader.h"
+#include "socket.h"
+#include <map>
+#include <thread>
+
+namespace livrn {
+
+// Per-user background process that keeps file indexes warm for recently
+// used project roots. Each attach forks a session process that inherits the
+// root's index and notification descriptor as they are, so it starts its
+// first build without scanning; the daemon then re-warms that root for the
+// next attach on a background thread while the session runs.
+class Daemon {
+public:
+  // Runs a mode ("liverun <mode> args...") on the reloader handed to it
+  using ModeRunner = std::function<int(Reloader &, int argc, char *argv[])>;
+
+  explicit Daemon(ModeRunner runner);
+  ~Daemon();
+
+  Daemon(const Daemon &) = delete;
+  Daemon &operator=(const Daemon &) = delete;
+
+  int run(const std::string &socketPath);
+
+private:
+  struct WarmRoot {
+    std::string path;
+    int dirFd = -1;
+    ProcessMonitor monitor;
+    std::unique_ptr<Timer> pollTimer;
+    uint64_t lastUsedNs = 0;
+    // As of the last scan or refresh; the monitor is off limits while
+    // scanThread runs
+    size_t files = 0;
+    std::thread scanThread;
+    int scanDoneFd = -1;
+    bool scanned = false;
+  };
+
+  EventLoop loop;
+  ModeRunner runner;
+  int listenFd = -1;
+  std::unordered_set<int> clients;
+  std::map<std::string, std::unique_ptr<WarmRoot>> roots;
+
+  void onAccept();
+  void onRequest(int fd);
+  void closeClient(int fd);
+
+  void attach(int fd, DaemonSocket::Message &request, std::vector<int> &fds);
+  void reportStatus(int fd);
+
+  WarmRoot *warm(const std::string &path);
+  void scanRoot(WarmRoot &root);
+  static void indexRoot(ProcessMonitor &monitor);
+  void watchRoot(WarmRoot &root);
+  void rescanInBackground(WarmRoot &root);
+  void finishRescan(WarmRoot &root);
+  void cancelRescan(WarmRoot &root);
+  void refreshRoot(WarmRoot &root);
+  void unwatchRoot(WarmRoot &root);
+  void evictLeastRecentlyUsed();
+
+  [[noreturn]] void runSession(WarmRoot &root, int clientFd,
+                               const std::vector<int> &stdio,
+                               std::vector<std::string> args,
+                               const std::vector<std::string> &env);
+};
+
+} // namespace livrn
@@ -0,0 +1,182 @@
+#include "socket.h"
+#include "../config.h"
+#include "../logger.h"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+namespace livrn {
+
+namespace {
+bool fillAddress(const std::string &path, sockaddr_un &addr) {
+  if (path.size() >= sizeof(addr.sun_path)) {
+    livrn::Logger::error("Socket path too long: ", path);
+    return false;
+  }
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+} // namespace
+
+std::string DaemonSocket::path() {
+  if (const char *explicitPath = std::getenv("LIVERUN_SOCKET"))
+    return explicitPath;
+  if (const char *runtimeDir = std::getenv("XDG_RUNTIME_DIR"))
+    return std::string(runtimeDir) + "/liverun.sock";
+  return "/tmp/liverun-" + std::to_string(getuid()) + ".sock";
+}
+
+int DaemonSocket::listen(const std::string &path) {
+  sockaddr_un addr;
+  if (!fillAddress(path, addr))
+    return -1;
+
+  struct stat st;
+  if (lstat(path.c_str(), &st) == 0) {
+    // Never unlink something that is not our own socket; /tmp is shared
+    if (!S_ISSOCK(st.st_mode) || st.st_uid != getuid()) {
+      livrn::Logger::error("Refusing to replace ", path);
+      return -1;
+    }
+    int probe = connect(path);
+    if (probe >= 0) {
+      close(probe);
+      livrn::Logger::error("A daemon is already listening on ", path);
+      return -1;
+    }
+    unlink(path.c_str());
+  }
+
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (fd < 0) {
+    livrn::Logger::error("socket failed: ", std::strerror(errno));
+    return -1;
+  }
+
+  // Only the owning user may connect
+  mode_t previous = umask(0177);
+  int bound = bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+  umask(previous);
+
+  if (bound < 0 || ::listen(fd, SOMAXCONN) < 0) {
+    livrn::Logger::error("Cannot listen on ", path, ": ", std::strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int DaemonSocket::connect(const std::string &path) {
+  sockaddr_un addr;
+  if (!fillAddress(path, addr))
+    return -1;
+
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+
+  if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+bool DaemonSocket::send(int fd, const Message &message,
+                        const std::vector<int> &fds) {
+  std::string payload;
+  for (const auto &field : message) {
+    payload += field;
+    payload += '\0';
+  }
+  if (payload.size() > Config::DAEMON_MAX_MESSAGE) {
+    livrn::Logger::error("Daemon message too large (", payload.size(),
+                         " bytes)");
+    return false;
+  }
+
+  iovec iov{payload.data(), payload.size()};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  std::vector<char> control;
+  if (!fds.empty()) {
+    control.resize(CMSG_SPACE(sizeof(int) * fds.size()));
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+  }
+
+  ssize_t n;
+  do {
+    n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+  } while (n < 0 && errno == EINTR);
+  return n == static_cast<ssize_t>(payload.size());
+}
+
+bool DaemonSocket::receive(int fd, Message &message, std::vector<int> *fds) {
+  std::vector<char> buffer(Config::DAEMON_MAX_MESSAGE);
+  iovec iov{buffer.data(), buffer.size()};
+
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * 8)];
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t n;
+  do {
+    n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+  } while (n < 0 && errno == EINTR);
+
+  std::vector<int> received;
+  for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); n > 0 && cmsg;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+      continue;
+    size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    const unsigned char *data = CMSG_DATA(cmsg);
+    for (size_t i = 0; i < count; ++i) {
+      int receivedFd;
+      std::memcpy(&receivedFd, data + i * sizeof(int), sizeof(int));
+      received.push_back(receivedFd);
+    }
+  }
+
+  if (n <= 0 || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+    for (int receivedFd : received)
+      close(receivedFd);
+    return false;
+  }
+
+  message.clear();
+  const char *cursor = buffer.data();
+  const char *end = cursor + n;
+  while (cursor < end) {
+    const char *terminator =
+        static_cast<const char *>(std::memchr(cursor, '\0', end - cursor));
+    if (!terminator)
+      terminator = end;
+    message.emplace_back(cursor, terminator);
+    cursor = terminator + 1;
+  }
+
+  if (fds) {
+    *fds = std::move(received);
+  } else {
+    for (int receivedFd : received)
+      close(receivedFd);
+  }
+  return !message.empty();
+}
+
+} // namespace livrn
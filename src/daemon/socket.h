@@ -0,0 +1,36 @@
+#pragma once
+#include "../liverun.h"
+
+namespace livrn {
+
+// Daemon and clients talk over a SOCK_SEQPACKET Unix socket. Every message
+// is a list of NUL-terminated fields whose first field names it; file
+// descriptors ride along as SCM_RIGHTS ancillary data.
+//
+//   client -> daemon   attach <cwd> <argc> <args...> <env...>  + stdio fds
+//                      status | shutdown
+//   daemon -> client   status (<root> <files>)... | ok | error <reason>
+//   session -> client  exit <code>
+//   client -> session  stop | kill
+class DaemonSocket {
+public:
+  using Message = std::vector<std::string>;
+
+  // $LIVERUN_SOCKET, else $XDG_RUNTIME_DIR/liverun.sock, else
+  // /tmp/liverun-<uid>.sock
+  static std::string path();
+
+  // Binds a fresh listening socket, replacing a stale one left by a daemon
+  // that died. Fails if another daemon is still accepting on path.
+  static int listen(const std::string &path);
+  static int connect(const std::string &path);
+
+  static bool send(int fd, const Message &message,
+                   const std::vector<int> &fds = {});
+  // Returns false on EOF or error. Received descriptors are close-on-exec
+  // and owned by the caller.
+  static bool receive(int fd, Message &message,
+                      std::vector<int> *fds = nullptr);
+};
+
+} // namespace livrn
@@ -0,0 +1,217 @@
+#include "exporter.h"
+#include "../logger.h"
+#include "../util/metrics.h"
+#include "../util/tracer.h"
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+namespace livrn {
+
+MetricsExporter::MetricsExporter(EventLoop &loop, std::string target)
+    : loop(loop), target(std::move(target)),
+      writeTimer(loop, [this]() { writeFile(); }),
+      requestTimer(loop, [this]() { dropExpiredClients(); }) {
+  if (this->target.compare(0, 5, "unix:") == 0)
+    socketPath = this->target.substr(5);
+}
+
+MetricsExporter::~MetricsExporter() { stop(); }
+
+bool MetricsExporter::start() {
+  if (!socketPath.empty())
+    return listen();
+
+  if (!writeFile()) {
+    livrn::Logger::error("Cannot write metrics to ", target, ": ",
+                         std::strerror(errno));
+    return false;
+  }
+  writeTimer.start(Config::METRICS_INTERVAL_MS, Config::METRICS_INTERVAL_MS);
+  return true;
+}
+
+void MetricsExporter::stop() {
+  if (writeTimer.isArmed()) {
+    writeTimer.cancel();
+    writeFile();
+  }
+  while (!clients.empty()) {
+    closeClient(clients.begin()->first);
+  }
+  requestTimer.cancel();
+  if (listenFd >= 0) {
+    loop.remove(listenFd);
+    close(listenFd);
+    listenFd = -1;
+    unlink(socketPath.c_str());
+  }
+}
+
+bool MetricsExporter::writeFile() const {
+  // Scrapers must never see a half-written file
+  std::string temp = target + ".tmp";
+  int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return false;
+
+  std::string text = Metrics::instance().render();
+  size_t written = 0;
+  while (written < text.size()) {
+    ssize_t n = write(fd, text.data() + written, text.size() - written);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    written += n;
+  }
+  bool ok = close(fd) == 0 && written == text.size();
+  if (!ok || rename(temp.c_str(), target.c_str()) != 0) {
+    unlink(temp.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool MetricsExporter::listen() {
+  sockaddr_un addr{};
+  if (socketPath.size() >= sizeof(addr.sun_path)) {
+    livrn::Logger::error("Metrics socket path too long: ", socketPath);
+    return false;
+  }
+
+  struct stat st;
+  if (lstat(socketPath.c_str(), &st) == 0) {
+    // Same rule as the daemon socket: only replace our own stale socket
+    if (!S_ISSOCK(st.st_mode) || st.st_uid != getuid()) {
+      livrn::Logger::error("Refusing to replace ", socketPath);
+      return false;
+    }
+    unlink(socketPath.c_str());
+  }
+
+  listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (listenFd < 0) {
+    livrn::Logger::error("socket failed: ", std::strerror(errno));
+    return false;
+  }
+
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, socketPath.c_str(), socketPath.size() + 1);
+  if (bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      ::listen(listenFd, 16) != 0) {
+    livrn::Logger::error("Cannot serve metrics on ", socketPath, ": ",
+                         std::strerror(errno));
+    close(listenFd);
+    listenFd = -1;
+    return false;
+  }
+
+  loop.add(listenFd, EPOLLIN, [this](uint32_t) { onConnection(); });
+  livrn::Logger::debug("Serving metrics on ", socketPath);
+  return true;
+}
+
+void MetricsExporter::onConnection() {
+  int fd;
+  while ((fd = accept4(listenFd, nullptr, nullptr,
+                       SOCK_CLOEXEC | SOCK_NONBLOCK)) >= 0) {
+    // The request may not have arrived yet; answering before it does and
+    // closing would reset the connection under the client
+    Client &client = clients[fd];
+    client.deadlineNs = Tracer::nowNs() +
+                        Config::METRICS_REQUEST_TIMEOUT_MS * 1000000ULL;
+    if (!requestTimer.isArmed())
+      requestTimer.start(Config::METRICS_REQUEST_TIMEOUT_MS);
+    loop.add(fd, EPOLLIN, [this, fd](uint32_t) { onReadable(fd); });
+    onReadable(fd);
+  }
+}
+
+void MetricsExporter::onReadable(int fd) {
+  auto it = clients.find(fd);
+  if (it == clients.end())
+    return;
+
+  // The request itself does not matter beyond where its headers end
+  char buffer[1024];
+  while (true) {
+    ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n > 0) {
+      it->second.request.append(buffer, n);
+      if (it->second.request.find("\r\n\r\n") != std::string::npos) {
+        respond(fd);
+        return;
+      }
+      if (it->second.request.size() > Config::METRICS_MAX_REQUEST) {
+        closeClient(fd);
+        return;
+      }
+    } else if (n == 0) {
+      // Sent everything and shut down its side; answer what came
+      respond(fd);
+      return;
+    } else if (errno == EINTR) {
+      continue;
+    } else {
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        closeClient(fd);
+      return;
+    }
+  }
+}
+
+void MetricsExporter::respond(int fd) {
+  // Blocking with a send timeout: a scraper that stops reading must not
+  // stall the event loop for long
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+  timeval timeout{0, 100 * 1000};
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  std::string body = Metrics::instance().render();
+  std::string response =
+      "HTTP/1.0 200 OK\r\n"
+      "Content-Type: text/plain; version=0.0.4\r\n"
+      "Content-Length: " +
+      std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+
+  size_t sent = 0;
+  while (sent < response.size()) {
+    ssize_t n = send(fd, response.data() + sent, response.size() - sent,
+                     MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    sent += n;
+  }
+  closeClient(fd);
+}
+
+void MetricsExporter::closeClient(int fd) {
+  loop.remove(fd);
+  close(fd);
+  clients.erase(fd);
+}
+
+void MetricsExporter::dropExpiredClients() {
+  uint64_t now = Tracer::nowNs();
+  uint64_t next = 0;
+  for (auto it = clients.begin(); it != clients.end();) {
+    if (it->second.deadlineNs <= now) {
+      loop.remove(it->first);
+      close(it->first);
+      it = clients.erase(it);
+    } else {
+      if (next == 0 || it->second.deadlineNs < next)
+        next = it->second.deadlineNs;
+      ++it;
+    }
+  }
+  if (next > 0)
+    requestTimer.start(static_cast<int>((next - now) / 1000000) + 1);
+}
+
+} // namespace livrn
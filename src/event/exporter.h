@@ -0,0 +1,52 @@
+#pragma once
+#include "loop.h"
+
+namespace livrn {
+
+// Publishes Metrics::render() while a mode runs. A target of "unix:<path>"
+// answers every HTTP request on that socket once its headers are in, e.g.
+//
+//   curl --unix-socket /run/user/1000/liverun.metrics http://localhost/
+//
+// Any other target is a file rewritten atomically every
+// METRICS_INTERVAL_MS, for node_exporter's textfile collector.
+class MetricsExporter {
+public:
+  MetricsExporter(EventLoop &loop, std::string target);
+  ~MetricsExporter();
+
+  MetricsExporter(const MetricsExporter &) = delete;
+  MetricsExporter &operator=(const MetricsExporter &) = delete;
+
+  bool start();
+  // Writes a final snapshot to a textfile target, or removes the socket
+  void stop();
+
+  // Writes the textfile now; false if the write failed
+  bool writeFile() const;
+
+private:
+  EventLoop &loop;
+  std::string target;
+  std::string socketPath;
+  Timer writeTimer;
+  int listenFd = -1;
+
+  // Connections still sending their request, dropped once
+  // METRICS_REQUEST_TIMEOUT_MS passes without the end of the headers
+  struct Client {
+    std::string request;
+    uint64_t deadlineNs = 0;
+  };
+  std::unordered_map<int, Client> clients;
+  Timer requestTimer;
+
+  bool listen();
+  void onConnection();
+  void onReadable(int fd);
+  void respond(int fd);
+  void closeClient(int fd);
+  void dropExpiredClients();
+};
+
+} // namespace livrn
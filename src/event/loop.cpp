@@ -0,0 +1,242 @@
+#include "loop.h"
+#include "../logger.h"
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+
+namespace livrn {
+
+namespace {
+int openPidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+  return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+  (void)pid;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+} // namespace
+
+EventLoop::EventLoop() {
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd < 0) {
+    throw std::runtime_error(std::string("epoll_create1 failed: ") +
+                             std::strerror(errno));
+  }
+  sigemptyset(&signalMask);
+}
+
+EventLoop::~EventLoop() {
+  for (auto &[pid, watch] : children) {
+    if (watch.pidfd >= 0)
+      close(watch.pidfd);
+  }
+  if (signalFd >= 0)
+    close(signalFd);
+  close(epollFd);
+}
+
+bool EventLoop::add(int fd, uint32_t events, Handler handler) {
+  if (fd < 0)
+    return false;
+
+  uint64_t id = nextId++;
+  epoll_event ev{};
+  ev.events = events;
+  ev.data.u64 = id;
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    livrn::Logger::error("epoll_ctl failed: ", std::strerror(errno));
+    return false;
+  }
+
+  sources[id] = std::make_shared<Source>(Source{fd, std::move(handler)});
+  idsByFd[fd] = id;
+  return true;
+}
+
+void EventLoop::remove(int fd) {
+  auto it = idsByFd.find(fd);
+  if (it == idsByFd.end())
+    return;
+
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+  sources.erase(it->second);
+  idsByFd.erase(it);
+}
+
+bool EventLoop::onSignal(int signo, SignalHandler handler) {
+  sigaddset(&signalMask, signo);
+  if (pthread_sigmask(SIG_BLOCK, &signalMask, nullptr) != 0)
+    return false;
+
+  int fd = signalfd(signalFd, &signalMask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (fd < 0) {
+    livrn::Logger::error("signalfd failed: ", std::strerror(errno));
+    return false;
+  }
+
+  if (signalFd < 0) {
+    signalFd = fd;
+    add(signalFd, EPOLLIN, [this](uint32_t) { dispatchSignals(); });
+  }
+
+  signalHandlers[signo] = std::move(handler);
+  return true;
+}
+
+void EventLoop::dispatchSignals() {
+  signalfd_siginfo info;
+  while (read(signalFd, &info, sizeof(info)) == sizeof(info)) {
+    auto it = signalHandlers.find(static_cast<int>(info.ssi_signo));
+    if (it != signalHandlers.end()) {
+      // Copy: the handler may replace itself
+      SignalHandler handler = it->second;
+      handler(static_cast<int>(info.ssi_signo));
+    }
+  }
+}
+
+bool EventLoop::watchChild(pid_t pid, ExitHandler handler) {
+  if (pid <= 0)
+    return false;
+
+  int pidfd = pidfdSupported ? openPidfd(pid) : -1;
+  if (pidfd < 0 && pidfdSupported && errno == ENOSYS) {
+    livrn::Logger::debug("pidfd unavailable, falling back to SIGCHLD");
+    pidfdSupported = false;
+    onSignal(SIGCHLD, [this](int) { reapChildren(); });
+  }
+  if (pidfd < 0 && pidfdSupported) {
+    return false;
+  }
+
+  children[pid] = ChildWatch{pidfd, std::move(handler)};
+  if (pidfd >= 0) {
+    add(pidfd, EPOLLIN, [this, pid](uint32_t) { reapChild(pid); });
+  } else {
+    // The child may have exited before SIGCHLD was routed to the signalfd
+    reapChild(pid);
+  }
+  return true;
+}
+
+void EventLoop::unwatchChild(pid_t pid) {
+  auto it = children.find(pid);
+  if (it == children.end())
+    return;
+
+  if (it->second.pidfd >= 0) {
+    remove(it->second.pidfd);
+    close(it->second.pidfd);
+  }
+  children.erase(it);
+}
+
+void EventLoop::reapChild(pid_t pid) {
+  auto it = children.find(pid);
+  if (it == children.end())
+    return;
+
+  int status = 0;
+  pid_t result = waitpid(pid, &status, WNOHANG);
+  if (result == 0)
+    return;
+  if (result < 0)
+    status = -1;
+
+  ExitHandler handler = std::move(it->second.handler);
+  unwatchChild(pid);
+  handler(status);
+}
+
+void EventLoop::reapChildren() {
+  std::vector<pid_t> pids;
+  for (const auto &[pid, watch] : children) {
+    pids.push_back(pid);
+  }
+  for (pid_t pid : pids) {
+    reapChild(pid);
+  }
+}
+
+int EventLoop::run() {
+  running = true;
+  exitCode = 0;
+
+  epoll_event events[64];
+  while (running) {
+    int n = epoll_wait(epollFd, events, 64, -1);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      livrn::Logger::error("epoll_wait failed: ", std::strerror(errno));
+      return 1;
+    }
+
+    for (int i = 0; i < n && running; ++i) {
+      auto it = sources.find(events[i].data.u64);
+      if (it == sources.end())
+        continue; // Removed by an earlier handler in this batch
+
+      std::shared_ptr<Source> source = it->second;
+      source->handler(events[i].events);
+    }
+  }
+  return exitCode;
+}
+
+void EventLoop::stop(int code) {
+  exitCode = code;
+  running = false;
+}
+
+Timer::Timer(EventLoop &loop, std::function<void()> callback)
+    : loop(loop), callback(std::move(callback)) {
+  fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) {
+    throw std::runtime_error(std::string("timerfd_create failed: ") +
+                             std::strerror(errno));
+  }
+
+  loop.add(fd, EPOLLIN, [this](uint32_t) {
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+      return;
+    if (!periodic)
+      armed = false;
+    this->callback();
+  });
+}
+
+Timer::~Timer() {
+  loop.remove(fd);
+  close(fd);
+}
+
+void Timer::start(int delayMs, int intervalMs) {
+  // A zero it_value disarms a timerfd, so clamp immediate timers to 1ns
+  itimerspec spec{};
+  spec.it_value.tv_sec = delayMs / 1000;
+  spec.it_value.tv_nsec = (delayMs % 1000) * 1000000L;
+  if (delayMs <= 0) {
+    spec.it_value.tv_sec = 0;
+    spec.it_value.tv_nsec = 1;
+  }
+  spec.it_interval.tv_sec = intervalMs / 1000;
+  spec.it_interval.tv_nsec = (intervalMs % 1000) * 1000000L;
+
+  timerfd_settime(fd, 0, &spec, nullptr);
+  armed = true;
+  periodic = intervalMs > 0;
+}
+
+void Timer::cancel() {
+  itimerspec spec{};
+  timerfd_settime(fd, 0, &spec, nullptr);
+  armed = false;
+  periodic = false;
+}
+
+} // namespace livrn
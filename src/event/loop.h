@@ -0,0 +1,88 @@
+#pragma once
+#include "../liverun.h"
+#include <functional>
+#include <memory>
+#include <signal.h>
+
+namespace livrn {
+
+// Single-threaded epoll reactor. Every wake-up source (watch backends,
+// timers, signals and child processes) is a file descriptor, so the loop
+// sleeps until something actually happens.
+class EventLoop {
+public:
+  using Handler = std::function<void(uint32_t events)>;
+  using SignalHandler = std::function<void(int signo)>;
+  using ExitHandler = std::function<void(int status)>;
+
+  EventLoop();
+  ~EventLoop();
+
+  EventLoop(const EventLoop &) = delete;
+  EventLoop &operator=(const EventLoop &) = delete;
+
+  bool add(int fd, uint32_t events, Handler handler);
+  void remove(int fd);
+
+  // Blocks signo for the process and delivers it through a signalfd
+  bool onSignal(int signo, SignalHandler handler);
+
+  // Reaps pid and calls handler with its wait status once it exits. Uses a
+  // pidfd where the kernel supports it, SIGCHLD otherwise.
+  bool watchChild(pid_t pid, ExitHandler handler);
+  void unwatchChild(pid_t pid);
+
+  int run();
+  void stop(int code = 0);
+  bool isRunning() const { return running; }
+
+private:
+  struct Source {
+    int fd;
+    Handler handler;
+  };
+
+  struct ChildWatch {
+    int pidfd;
+    ExitHandler handler;
+  };
+
+  int epollFd = -1;
+  int signalFd = -1;
+  sigset_t signalMask;
+  uint64_t nextId = 1;
+  std::unordered_map<uint64_t, std::shared_ptr<Source>> sources;
+  std::unordered_map<int, uint64_t> idsByFd;
+  std::unordered_map<int, SignalHandler> signalHandlers;
+  std::unordered_map<pid_t, ChildWatch> children;
+  bool pidfdSupported = true;
+  bool running = false;
+  int exitCode = 0;
+
+  void dispatchSignals();
+  void reapChild(pid_t pid);
+  void reapChildren();
+};
+
+// One-shot or periodic timer backed by a timerfd registered on a loop
+class Timer {
+public:
+  Timer(EventLoop &loop, std::function<void()> callback);
+  ~Timer();
+
+  Timer(const Timer &) = delete;
+  Timer &operator=(const Timer &) = delete;
+
+  void start(int delayMs, int intervalMs = 0);
+  void cancel();
+  bool isArmed() const { return armed; }
+
+private:
+  EventLoop &loop;
+  std::function<void()> callback;
+  int fd = -1;
+  bool armed = false;
+  bool periodic = false;
+};
+
+} // namespace livrn
@@ -0,0 +1,273 @@
+#include "attribution.h"
+#include "../util/clock.h"
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+namespace livrn {
+namespace {
+
+// Parent pid from /proc/<pid>/stat, or -1
+pid_t parentOf(pid_t pid) {
+  std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+  std::string line;
+  if (!std::getline(stat, line))
+    return -1;
+
+  // The command name may contain spaces and parentheses; fields resume
+  // after the last ')'
+  size_t close = line.rfind(')');
+  if (close == std::string::npos)
+    return -1;
+  std::istringstream fields(line.substr(close + 1));
+  char state;
+  pid_t ppid;
+  if (!(fields >> state >> ppid))
+    return -1;
+  return ppid;
+}
+
+template <typename Fn> void forEachProcess(Fn fn) {
+  DIR *proc = opendir("/proc");
+  if (!proc)
+    return;
+  while (dirent *entry = readdir(proc)) {
+    char *end;
+    long pid = std::strtol(entry->d_name, &end, 10);
+    if (*end == '\0' && pid > 0)
+      fn(static_cast<pid_t>(pid));
+  }
+  closedir(proc);
+}
+
+// /proc/<pid>/task/<tid>/children needs CONFIG_PROC_CHILDREN
+bool kernelListsChildren() {
+  static const bool lists =
+      access(("/proc/self/task/" + std::to_string(getpid()) + "/children")
+                 .c_str(),
+             R_OK) == 0;
+  return lists;
+}
+
+} // namespace
+
+void WriteAttribution::begin(pid_t pid, Kind kind) {
+  if (pid <= 0)
+    return;
+
+  // Filesystem timestamps come from a coarse clock and may trail ours
+  int64_t start = realtimeNs() - Config::OWN_WRITE_SLACK_MS * 1000000ll;
+  windows.push_back({pid, kind, start, 0});
+
+  // Old windows only matter to changes the poller has not reached yet
+  while (windows.size() > Config::OWN_WRITE_WINDOWS) {
+    auto ended = std::find_if(windows.begin(), windows.end(),
+                              [](const Window &w) { return w.endNs != 0; });
+    if (ended == windows.end())
+      break;
+    windows.erase(ended);
+  }
+}
+
+void WriteAttribution::end(pid_t pid) {
+  for (auto &window : windows) {
+    if (window.pid == pid && window.endNs == 0)
+      window.endNs = realtimeNs();
+  }
+}
+
+bool WriteAttribution::insideWindow(int64_t mtimeNs, bool buildsOnly) const {
+  for (const auto &window : windows) {
+    if (buildsOnly && window.kind != Kind::Build)
+      continue;
+    if (mtimeNs >= window.startNs &&
+        (window.endNs == 0 || mtimeNs <= window.endNs)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool WriteAttribution::createdByBuild(int64_t mtimeNs, int64_t addedNs) const {
+  if (addedNs <= 0)
+    return false;
+  for (const auto &window : windows) {
+    if (window.kind == Kind::Build && addedNs >= window.startNs &&
+        mtimeNs >= window.startNs &&
+        (window.endNs == 0 || mtimeNs <= window.endNs)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool WriteAttribution::anyRunning() const {
+  for (const auto &window : windows) {
+    if (window.endNs == 0)
+      return true;
+  }
+  return false;
+}
+
+bool WriteAttribution::isOwnWrite(const std::string &path, int64_t addedNs,
+                                  bool ownWriter) {
+  if (windows.empty())
+    return false;
+
+  struct stat st;
+  if (lstat(path.c_str(), &st) != 0) {
+    // Deleted: only outputs we attributed before are ours to drop
+    return outputs.count(path) > 0 && anyRunning();
+  }
+
+  int64_t mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+                    st.st_mtim.tv_nsec;
+  bool building = insideWindow(mtimeNs, true);
+  bool own = ownWriter || (building && (outputs.count(path) > 0 ||
+                                        rewritten.count(path) > 0));
+  if (!own && !edited.count(path))
+    own = createdByBuild(mtimeNs, addedNs);
+  if (!own && anyRunning()) {
+    std::error_code ec;
+    std::string absolute = fs::absolute(path, ec).lexically_normal().string();
+    own = !ec && filesOpenForWrite().count(absolute) > 0;
+  }
+
+  if (own) {
+    outputs.insert(path);
+    rewritten.erase(path);
+  } else if (building) {
+    // Maybe a generated file the build rewrites every time; the next
+    // build window that rewrites it again tells
+    outputs.erase(path);
+    rewritten.insert(path);
+  } else {
+    noteEdit(path);
+  }
+  return own;
+}
+
+void WriteAttribution::noteEdit(const std::string &path) {
+  edited.insert(path);
+  outputs.erase(path);
+  rewritten.erase(path);
+}
+
+bool WriteAttribution::ownsProcess(pid_t pid) const {
+  std::unordered_set<pid_t> roots;
+  for (const auto &window : windows) {
+    if (window.endNs == 0)
+      roots.insert(window.pid);
+  }
+  if (roots.empty())
+    return false;
+
+  // Walk up towards init; orphans reparented away are no longer ours
+  for (int depth = 0; pid > 1 && depth < 64; ++depth) {
+    if (roots.count(pid))
+      return true;
+    pid = parentOf(pid);
+  }
+  return false;
+}
+
+std::vector<pid_t> WriteAttribution::childrenOf(pid_t pid) {
+  // Every thread lists the children it forked
+  std::vector<pid_t> children;
+  std::string taskDir = "/proc/" + std::to_string(pid) + "/task";
+  DIR *tasks = opendir(taskDir.c_str());
+  if (!tasks)
+    return children;
+  while (dirent *entry = readdir(tasks)) {
+    if (entry->d_name[0] == '.')
+      continue;
+    std::ifstream list(taskDir + "/" + entry->d_name + "/children");
+    pid_t child;
+    while (list >> child)
+      children.push_back(child);
+  }
+  closedir(tasks);
+  return children;
+}
+
+std::unordered_set<pid_t> WriteAttribution::runningProcesses() const {
+  std::unordered_set<pid_t> tracked;
+  for (const auto &window : windows) {
+    if (window.endNs == 0)
+      tracked.insert(window.pid);
+  }
+
+  // Only the tracked trees are walked where the kernel lists children;
+  // otherwise every process's parent is looked up once
+  std::unordered_map<pid_t, std::vector<pid_t>> children;
+  bool listed = kernelListsChildren();
+  if (!listed) {
+    forEachProcess([&](pid_t pid) {
+      pid_t ppid = parentOf(pid);
+      if (ppid > 0)
+        children[ppid].push_back(pid);
+    });
+  }
+
+  std::vector<pid_t> pending(tracked.begin(), tracked.end());
+  while (!pending.empty()) {
+    pid_t pid = pending.back();
+    pending.pop_back();
+    for (pid_t child : listed ? childrenOf(pid) : children[pid]) {
+      if (tracked.insert(child).second)
+        pending.push_back(child);
+    }
+  }
+  return tracked;
+}
+
+const std::unordered_set<std::string> &WriteAttribution::filesOpenForWrite() {
+  // A change batch, and a checkout's thousands of paths above all, is
+  // checked against one look at /proc rather than one per path
+  int64_t now = realtimeNs();
+  if (now - openFilesNs > Config::OWN_WRITE_SLACK_MS * 1000000ll) {
+    openFiles = openForWrite(runningProcesses());
+    openFilesNs = now;
+  }
+  return openFiles;
+}
+
+std::unordered_set<std::string>
+WriteAttribution::openForWrite(const std::unordered_set<pid_t> &pids) {
+  std::unordered_set<std::string> files;
+  char target[Config::MAX_PATH_LENGTH + 1];
+  for (pid_t pid : pids) {
+    std::string fdDir = "/proc/" + std::to_string(pid) + "/fd";
+    DIR *dir = opendir(fdDir.c_str());
+    if (!dir)
+      continue;
+
+    while (dirent *entry = readdir(dir)) {
+      if (entry->d_name[0] == '.')
+        continue;
+      std::string link = fdDir + "/" + entry->d_name;
+      ssize_t n = readlink(link.c_str(), target, sizeof(target) - 1);
+      // Sockets, pipes and the like are not paths
+      if (n <= 0 || target[0] != '/')
+        continue;
+
+      std::ifstream info("/proc/" + std::to_string(pid) + "/fdinfo/" +
+                         entry->d_name);
+      std::string key;
+      while (info >> key) {
+        if (key == "flags:") {
+          unsigned long flags = 0;
+          info >> std::oct >> flags;
+          if ((flags & O_ACCMODE) != O_RDONLY)
+            files.emplace(target, n);
+          break;
+        }
+      }
+    }
+    closedir(dir);
+  }
+  return files;
+}
+
+} // namespace livrn
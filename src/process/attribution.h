@@ -0,0 +1,71 @@
+#pragma once
+#include "../config.h"
+#include "../liverun.h"
+#include <deque>
+
+namespace livrn {
+
+// Tells changes written by liverun's own process trees (build steps and the
+// application) apart from edits made by people, so generated headers, build
+// outputs and files the app writes do not trigger another reload.
+//
+// Every tree is tracked over its run window. A changed path is an own
+// write when
+//   - fanotify reports a tracked process as the writer;
+//   - a tracked process holds it open for writing;
+//   - the build created it: the file appeared during a build window and
+//     was never edited by hand;
+//   - it was attributed before and changed again during a build window; or
+//   - an earlier build window already rewrote it, with no change outside
+//     a build since. That covers generated files checked into the tree,
+//     at the cost of one reload for the first rewrite.
+// A path that changes outside a build window is taken as an edit from
+// then on.
+class WriteAttribution {
+public:
+  enum class Kind { Build, App };
+
+  void begin(pid_t pid, Kind kind);
+  void end(pid_t pid);
+
+  // addedNs is when path joined the watched set, 0 if it existed before;
+  // ownWriter that fanotify saw a tracked process write it
+  bool isOwnWrite(const std::string &path, int64_t addedNs = 0,
+                  bool ownWriter = false);
+  // Records a hand edit of path
+  void noteEdit(const std::string &path);
+
+  // True if pid is a tracked process or one of its descendants, for
+  // backends that report the writing process
+  bool ownsProcess(pid_t pid) const;
+
+private:
+  struct Window {
+    pid_t pid;
+    Kind kind;
+    int64_t startNs;
+    // 0 while the tree is running
+    int64_t endNs;
+  };
+
+  std::deque<Window> windows;
+  std::unordered_set<std::string> outputs;
+  std::unordered_set<std::string> edited;
+  // Changed during a build window without other evidence
+  std::unordered_set<std::string> rewritten;
+  // Files the running trees hold open for writing, reused for every path
+  // of a batch
+  std::unordered_set<std::string> openFiles;
+  int64_t openFilesNs = 0;
+
+  bool insideWindow(int64_t mtimeNs, bool buildsOnly) const;
+  bool createdByBuild(int64_t mtimeNs, int64_t addedNs) const;
+  bool anyRunning() const;
+  std::unordered_set<pid_t> runningProcesses() const;
+  static std::vector<pid_t> childrenOf(pid_t pid);
+  const std::unordered_set<std::string> &filesOpenForWrite();
+  static std::unordered_set<std::string>
+  openForWrite(const std::unordered_set<pid_t> &pids);
+};
+
+} // namespace livrn
@@ -2,43 +2,45 @@
 #include "../cmd/command.h"
 #include "../logger.h"
 #include "../util/parser.h"
+#include "../util/tracer.h"
 #include "manager.h"
 
 namespace livrn {
-ProcessBuilder::ProcessBuilder(ProcessManager &pm) { (void)pm; }
+ProcessBuilder::ProcessBuilder(ProcessManager &pm) : processManager(pm) {}
 
 bool ProcessBuilder::compileSync(const std::string &cmd) {
-  if (!livrn::Parser::isCommandSafe(cmd)) {
-    livrn::Logger::warn("Unsafe command");
-    ProcessManager pm;
-    if (!pm.authenticatedUser()) {
-      livrn::Logger::error("User authentication failed. Aborting.");
-      return false;
-    }
-  }
+  PreparedCommand prepared;
+  if (!processManager.prepareCommand(cmd, prepared))
+    return false;
 
-  livrn::Logger::info("Compiling");
-  auto args = livrn::Command::parseCommand(cmd);
-  if (args.empty())
+  return compileSync(prepared);
+}
+
+bool ProcessBuilder::compileSync(const PreparedCommand &cmd) {
+  TraceSpan span("build", "compile step");
+
+  pid_t pid = compileAsync(cmd);
+  if (pid <= 0)
     return false;
 
+  int status;
+  waitpid(pid, &status, 0);
+  span.setArg("status", status);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+pid_t ProcessBuilder::compileAsync(const PreparedCommand &cmd) {
+  if (cmd.empty())
+    return -1;
+
+  livrn::Logger::info("Compiling");
   pid_t pid = fork();
   if (pid == 0) {
-    std::vector<char *> argv;
-    for (const auto &arg : args) {
-      argv.push_back(const_cast<char *>(arg.c_str()));
-    }
-    argv.push_back(nullptr);
-
-    execvp(argv[0], argv.data());
-    exit(1);
-  } else if (pid > 0) {
-    int status;
-    waitpid(pid, &status, 0);
-    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    cmd.exec();
+    _exit(1);
   }
 
-  return false;
+  return pid;
 }
 
 } // namespace livrn
@@ -4,8 +4,15 @@
 
 namespace livrn {
 class ProcessBuilder {
+private:
+  ProcessManager &processManager;
+
 public:
   explicit ProcessBuilder(ProcessManager &pm);
   bool compileSync(const std::string &cmd);
+  bool compileSync(const PreparedCommand &cmd);
+
+  // Forks the build step and returns its pid without waiting for it
+  pid_t compileAsync(const PreparedCommand &cmd);
 };
 } // namespace livrn
@@ -0,0 +1,97 @@
+#include "bulk.h"
+#include "../logger.h"
+#include "../util/clock.h"
+#include <sys/stat.h>
+
+namespace livrn {
+
+void BulkChangeDetector::initialize() {
+  gitDir.clear();
+  std::error_code ec;
+  fs::path dir = fs::current_path(ec);
+  if (ec)
+    return;
+
+  // liverun may run in a subdirectory of the repository
+  for (; !dir.empty(); dir = dir.parent_path()) {
+    fs::path dotGit = dir / ".git";
+    if (fs::is_directory(dotGit, ec)) {
+      gitDir = dotGit.string();
+      break;
+    }
+    if (fs::is_regular_file(dotGit, ec)) {
+      // Worktrees and submodules point at their git directory
+      std::ifstream file(dotGit);
+      std::string line;
+      if (std::getline(file, line) && line.compare(0, 8, "gitdir: ") == 0) {
+        fs::path target = line.substr(8);
+        gitDir = (target.is_absolute() ? target : dir / target).string();
+      }
+      break;
+    }
+    if (dir == dir.root_path())
+      break;
+  }
+
+  if (!gitDir.empty())
+    livrn::Logger::debug("Watching ", gitDir, " for checkouts");
+  handledMarkerNs = markerMtimeNs();
+}
+
+bool BulkChangeDetector::gitBusy() const {
+  struct stat st;
+  return !gitDir.empty() && stat((gitDir + "/index.lock").c_str(), &st) == 0;
+}
+
+int64_t BulkChangeDetector::markerMtimeNs() const {
+  int64_t latest = 0;
+  // The index alone is also rewritten by git add, git status and editors
+  // refreshing it, none of which touch the tree
+  for (const char *name : {"/HEAD", "/ORIG_HEAD"}) {
+    struct stat st;
+    if (gitDir.empty() || stat((gitDir + name).c_str(), &st) != 0)
+      continue;
+    latest = std::max(latest,
+                      static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+                          st.st_mtim.tv_nsec);
+  }
+  return latest;
+}
+
+bool BulkChangeDetector::gitRewrote(int64_t nowNs) const {
+  // A checkout long ago also rewrote HEAD; only a fresh write means this
+  // batch belongs to one
+  int64_t mtimeNs = markerMtimeNs();
+  return mtimeNs > handledMarkerNs &&
+         nowNs - mtimeNs < Config::BULK_WINDOW_MS * 1000000LL;
+}
+
+void BulkChangeDetector::reset() {
+  recent.clear();
+  handledMarkerNs = markerMtimeNs();
+}
+
+std::string BulkChangeDetector::observe(size_t changedFiles) {
+  int64_t now = realtimeNs();
+  if (gitBusy() || gitRewrote(now))
+    return "git is rewriting the tree";
+
+  recent.emplace_back(now, changedFiles);
+  while (!recent.empty() &&
+         now - recent.front().first > Config::BULK_WINDOW_MS * 1000000LL) {
+    recent.pop_front();
+  }
+  if (threshold == 0)
+    return "";
+
+  size_t total = 0;
+  for (const auto &batch : recent) {
+    total += batch.second;
+  }
+  if (total <= threshold)
+    return "";
+  return std::to_string(total) + " files changed within " +
+         std::to_string(Config::BULK_WINDOW_MS) + " ms";
+}
+
+} // namespace livrn
@@ -0,0 +1,46 @@
+#pragma once
+#include "../config.h"
+#include "../liverun.h"
+#include <deque>
+
+namespace livrn {
+
+// Recognises branch switches, rebases and large checkouts, which rewrite
+// thousands of files in a burst that would otherwise arrive as a stream of
+// small change batches. A burst is recognised when
+//   - git holds .git/index.lock, or HEAD or ORIG_HEAD (left by reset,
+//     rebase and merge) were rewritten within the last BULK_WINDOW_MS; or
+//   - more than the threshold of files changed within BULK_WINDOW_MS.
+class BulkChangeDetector {
+public:
+  // 0 disables the rate check
+  explicit BulkChangeDetector(size_t threshold = Config::BULK_CHANGE_THRESHOLD)
+      : threshold(threshold) {}
+
+  // Finds the git directory of the working directory, if any, following a
+  // worktree's ".git" file
+  void initialize();
+
+  // Records one change batch. Returns why it starts a burst, or an empty
+  // string for an ordinary edit.
+  std::string observe(size_t changedFiles);
+  // True while git is still writing the tree
+  bool gitBusy() const;
+  // Called once a burst has been handled; git's writes so far belong to it
+  void reset();
+
+  void setThreshold(size_t files) { threshold = files; }
+  const std::string &gitDirectory() const { return gitDir; }
+
+private:
+  size_t threshold;
+  std::string gitDir;
+  // (time, files) per batch inside the rate window
+  std::deque<std::pair<int64_t, size_t>> recent;
+  int64_t handledMarkerNs = 0;
+
+  int64_t markerMtimeNs() const;
+  bool gitRewrote(int64_t nowNs) const;
+};
+
+} // namespace livrn
@@ -0,0 +1,83 @@
+#include "control.h"
+#include "../logger.h"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+namespace livrn {
+
+ControlChannel::ControlChannel(EventLoop &loop, Handler handler)
+    : loop(loop), handler(std::move(handler)) {}
+
+ControlChannel::~ControlChannel() { close(); }
+
+int ControlChannel::open() {
+  close();
+
+  int pair[2];
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair) != 0) {
+    livrn::Logger::error("socketpair failed: ", std::strerror(errno));
+    return -1;
+  }
+  fd = pair[0];
+  childFd = pair[1];
+  loop.add(fd, EPOLLIN, [this](uint32_t) { onReadable(); });
+  return childFd;
+}
+
+void ControlChannel::releaseChildEnd() {
+  if (childFd >= 0) {
+    ::close(childFd);
+    childFd = -1;
+  }
+}
+
+void ControlChannel::close() {
+  releaseChildEnd();
+  if (fd >= 0) {
+    loop.remove(fd);
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+bool ControlChannel::send(const Message &message) {
+  if (fd < 0)
+    return false;
+
+  std::string payload;
+  for (const auto &line : message) {
+    payload += line;
+    payload += '\n';
+  }
+  ssize_t n;
+  do {
+    n = ::send(fd, payload.data(), payload.size(), MSG_NOSIGNAL);
+  } while (n < 0 && errno == EINTR);
+  return n == static_cast<ssize_t>(payload.size());
+}
+
+void ControlChannel::onReadable() {
+  char buffer[4096];
+  ssize_t n;
+  do {
+    n = recv(fd, buffer, sizeof(buffer), 0);
+  } while (n < 0 && errno == EINTR);
+
+  if (n <= 0) {
+    close();
+    handler({});
+    return;
+  }
+
+  Message message;
+  std::istringstream lines(std::string(buffer, n));
+  std::string line;
+  while (std::getline(lines, line)) {
+    message.push_back(line);
+  }
+  if (message.empty())
+    return;
+  handler(message);
+}
+
+} // namespace livrn
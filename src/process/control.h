@@ -0,0 +1,46 @@
+#pragma once
+#include "../event/loop.h"
+#include "../liverun.h"
+
+namespace livrn {
+
+// Message channel to a cooperating application, handed to it as descriptor
+// $LIVERUN_CONTROL_FD. Each message is one SOCK_SEQPACKET datagram of
+// newline-separated lines, the first naming the message:
+//
+//   app -> liverun   hello                    accepts in-process reloads
+//   liverun -> app   reload <path>...         absolute paths, one per line
+//   app -> liverun   ack | nack <reason>
+class ControlChannel {
+public:
+  using Message = std::vector<std::string>;
+  using Handler = std::function<void(const Message &message)>;
+
+  // handler receives every message from the app, and an empty message once
+  // the app closes its end
+  ControlChannel(EventLoop &loop, Handler handler);
+  ~ControlChannel();
+
+  ControlChannel(const ControlChannel &) = delete;
+  ControlChannel &operator=(const ControlChannel &) = delete;
+
+  // Replaces any previous channel with a fresh socket pair and returns the
+  // end for the child, or -1 on failure
+  int open();
+  // Drops the parent's copy of the child's end once the child has forked
+  void releaseChildEnd();
+  void close();
+
+  bool isOpen() const { return fd >= 0; }
+  bool send(const Message &message);
+
+private:
+  EventLoop &loop;
+  Handler handler;
+  int fd = -1;
+  int childFd = -1;
+
+  void onReadable();
+};
+
+} // namespace livrn
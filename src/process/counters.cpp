@@ -0,0 +1,173 @@
+#include "counters.h"
+#include "../logger.h"
+#include "../util/tracer.h"
+#include <iomanip>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+
+namespace livrn {
+
+namespace {
+
+struct EventSpec {
+  uint32_t type;
+  uint64_t config;
+  const char *name;
+};
+
+const std::array<EventSpec, PERF_EVENT_COUNT> EVENTS = {{
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, "task-clock"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, "context-switches"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, "page-faults"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MAJ, "major-faults"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions"},
+}};
+
+int openCounter(const EventSpec &spec, pid_t pid, bool userOnly) {
+  perf_event_attr attr{};
+  attr.size = sizeof(attr);
+  attr.type = spec.type;
+  attr.config = spec.config;
+  attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  attr.disabled = 1;
+  attr.enable_on_exec = 1;
+  attr.inherit = 1;
+  attr.exclude_kernel = userOnly;
+  attr.exclude_hv = 1;
+  return static_cast<int>(
+      syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+
+std::string humanCount(uint64_t value) {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(2);
+  if (value >= 1000000000ull) {
+    out << static_cast<double>(value) / 1e9 << "G";
+  } else if (value >= 1000000ull) {
+    out << static_cast<double>(value) / 1e6 << "M";
+  } else if (value >= 10000ull) {
+    out << static_cast<double>(value) / 1e3 << "k";
+  } else {
+    out << value;
+  }
+  return out.str();
+}
+
+} // namespace
+
+PerfSample PerfSample::since(const PerfSample &earlier) const {
+  PerfSample delta = *this;
+  for (size_t i = 0; i < PERF_EVENT_COUNT; ++i) {
+    delta.values[i] =
+        values[i] > earlier.values[i] ? values[i] - earlier.values[i] : 0;
+  }
+  delta.wallNs = wallNs > earlier.wallNs ? wallNs - earlier.wallNs : 0;
+  return delta;
+}
+
+bool PerfCounters::attach(pid_t pid) {
+  detach();
+
+  // Kernel time is only countable with perf_event_paranoid < 2 or
+  // CAP_PERFMON; settle that on the first counter
+  bool userOnly = false;
+  fds[0] = openCounter(EVENTS[0], pid, false);
+  if (fds[0] < 0 && (errno == EACCES || errno == EPERM)) {
+    userOnly = true;
+    fds[0] = openCounter(EVENTS[0], pid, true);
+  }
+  if (fds[0] < 0) {
+    livrn::Logger::warn("Cannot count events for PID ", pid, ": ",
+                        std::strerror(errno));
+    return false;
+  }
+  if (userOnly)
+    livrn::Logger::debug("perf_event_paranoid allows user space counts only");
+
+  for (size_t i = 1; i < PERF_EVENT_COUNT; ++i) {
+    fds[i] = openCounter(EVENTS[i], pid, userOnly);
+  }
+  attached = true;
+  attachNs = Tracer::nowNs();
+  return true;
+}
+
+void PerfCounters::detach() {
+  for (int &fd : fds) {
+    if (fd >= 0)
+      close(fd);
+    fd = -1;
+  }
+  attached = false;
+}
+
+PerfSample PerfCounters::read() const {
+  PerfSample sample;
+  if (!attached)
+    return sample;
+
+  sample.wallNs = Tracer::nowNs() - attachNs;
+  for (size_t i = 0; i < PERF_EVENT_COUNT; ++i) {
+    uint64_t data[3] = {};
+    if (fds[i] < 0 || ::read(fds[i], data, sizeof(data)) != sizeof(data))
+      continue;
+
+    // data: value, time enabled, time running. A multiplexed hardware
+    // counter only ran part of the time and is scaled up to all of it.
+    uint64_t value = data[0];
+    if (data[2] > 0 && data[2] < data[1]) {
+      value = static_cast<uint64_t>(static_cast<double>(value) *
+                                    static_cast<double>(data[1]) /
+                                    static_cast<double>(data[2]));
+    }
+    sample.values[i] = value;
+    // A hardware counter that never got scheduled tells nothing
+    sample.available[i] = data[2] > 0 || EVENTS[i].type == PERF_TYPE_SOFTWARE;
+  }
+  return sample;
+}
+
+std::string PerfCounters::describe(const PerfSample &sample,
+                                   const PerfSample *previous) {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(1);
+
+  bool first = true;
+  for (size_t i = 0; i < PERF_EVENT_COUNT; ++i) {
+    if (!sample.available[i])
+      continue;
+    if (!first)
+      out << ", ";
+    first = false;
+
+    uint64_t value = sample.values[i];
+    if (static_cast<PerfEvent>(i) == PerfEvent::TaskClock) {
+      out << EVENTS[i].name << " " << static_cast<double>(value) / 1e6
+          << " ms";
+    } else {
+      out << humanCount(value) << " " << EVENTS[i].name;
+    }
+
+    if (previous && previous->available[i] && previous->values[i] > 0) {
+      double change = (static_cast<double>(value) -
+                       static_cast<double>(previous->values[i])) *
+                      100.0 / static_cast<double>(previous->values[i]);
+      out << " (" << std::showpos << change << std::noshowpos << "%)";
+    }
+  }
+
+  if (sample.has(PerfEvent::Cycles) && sample.has(PerfEvent::Instructions) &&
+      sample.value(PerfEvent::Cycles) > 0) {
+    out << std::setprecision(2) << ", "
+        << static_cast<double>(sample.value(PerfEvent::Instructions)) /
+               static_cast<double>(sample.value(PerfEvent::Cycles))
+        << " IPC";
+  }
+  out << std::setprecision(2) << " over "
+      << static_cast<double>(sample.wallNs) / 1e9 << " s";
+  return out.str();
+}
+
+} // namespace livrn
@@ -0,0 +1,66 @@
+#pragma once
+#include "../liverun.h"
+#include <array>
+
+namespace livrn {
+
+enum class PerfEvent {
+  TaskClock,
+  ContextSwitches,
+  PageFaults,
+  MajorFaults,
+  Cycles,
+  Instructions,
+  Count
+};
+
+constexpr size_t PERF_EVENT_COUNT = static_cast<size_t>(PerfEvent::Count);
+
+struct PerfSample {
+  // Scaled for multiplexing; task-clock is in nanoseconds
+  std::array<uint64_t, PERF_EVENT_COUNT> values{};
+  // Cycles and instructions are missing in most VMs
+  std::array<bool, PERF_EVENT_COUNT> available{};
+  uint64_t wallNs = 0;
+
+  uint64_t value(PerfEvent event) const {
+    return values[static_cast<size_t>(event)];
+  }
+  bool has(PerfEvent event) const {
+    return available[static_cast<size_t>(event)];
+  }
+  // The counts between earlier and this sample of the same process
+  PerfSample since(const PerfSample &earlier) const;
+};
+
+// perf_event_open counters for one process and everything it forks. Where
+// perf_event_paranoid keeps kernel activity from unprivileged users, only
+// user space is counted.
+class PerfCounters {
+public:
+  PerfCounters() { fds.fill(-1); }
+  ~PerfCounters() { detach(); }
+
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  // Opens every counter on pid, counting from its next exec. Returns false
+  // if not even the software counters could be opened.
+  bool attach(pid_t pid);
+  void detach();
+  bool isAttached() const { return attached; }
+
+  // Totals so far; still readable after the process has exited
+  PerfSample read() const;
+
+  // "task-clock 812.4 ms (-12.3%), 1204 context-switches (+3.0%), ..."
+  static std::string describe(const PerfSample &sample,
+                              const PerfSample *previous);
+
+private:
+  std::array<int, PERF_EVENT_COUNT> fds;
+  bool attached = false;
+  uint64_t attachNs = 0;
+};
+
+} // namespace livrn
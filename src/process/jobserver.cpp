@@ -0,0 +1,171 @@
+#include "jobserver.h"
+#include "../logger.h"
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+
+namespace livrn {
+
+Jobserver::Jobserver(EventLoop &loop) : loop(loop) {}
+
+Jobserver::~Jobserver() { stop(); }
+
+bool Jobserver::start(size_t count, Style mode) {
+  stop();
+  if (count == 0)
+    count = 1;
+
+  std::error_code ec;
+  std::string pattern =
+      (fs::temp_directory_path(ec) / "liverun-jobs.XXXXXX").string();
+  if (ec || !mkdtemp(pattern.data())) {
+    livrn::Logger::error("Cannot create jobserver directory: ",
+                         std::strerror(errno));
+    return false;
+  }
+  directory = pattern;
+  fifoPath = directory + "/fifo";
+
+  // Non-blocking so taking a token never stalls the loop; makes open the
+  // path themselves and get their own blocking descriptor
+  if (mkfifo(fifoPath.c_str(), 0600) != 0 ||
+      (fd = open(fifoPath.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC)) < 0) {
+    livrn::Logger::error("Cannot create jobserver fifo: ",
+                         std::strerror(errno));
+    stop();
+    return false;
+  }
+
+  std::string initial(count - 1, '+');
+  if (!initial.empty() &&
+      write(fd, initial.data(), initial.size()) !=
+          static_cast<ssize_t>(initial.size())) {
+    livrn::Logger::error("Cannot fill jobserver fifo: ", std::strerror(errno));
+    stop();
+    return false;
+  }
+
+  if (mode == Style::Pipe &&
+      (clientFd = open(fifoPath.c_str(), O_RDWR | O_CLOEXEC)) < 0) {
+    livrn::Logger::error("Cannot open jobserver fifo: ", std::strerror(errno));
+    stop();
+    return false;
+  }
+
+  tokens = count;
+  style = mode;
+  implicitFree = true;
+  livrn::Logger::debug("Jobserver with ", tokens, " tokens at ", fifoPath);
+  return true;
+}
+
+void Jobserver::stop() {
+  waiters.clear();
+  held.clear();
+  if (fd >= 0) {
+    if (watching)
+      loop.remove(fd);
+    close(fd);
+  }
+  fd = -1;
+  if (clientFd >= 0)
+    close(clientFd);
+  clientFd = -1;
+  watching = false;
+  if (!fifoPath.empty())
+    unlink(fifoPath.c_str());
+  if (!directory.empty())
+    rmdir(directory.c_str());
+  fifoPath.clear();
+  directory.clear();
+  tokens = 0;
+}
+
+void Jobserver::exportTo(PreparedCommand &command) const {
+  if (!isActive())
+    return;
+
+  // Keep whatever flags the user passes to make already
+  std::string flags;
+  if (const char *current = std::getenv("MAKEFLAGS"))
+    flags = current;
+  flags += " -j" + std::to_string(tokens) + " --jobserver-auth=";
+  if (style == Style::Pipe) {
+    std::string jobFd = std::to_string(Config::JOBSERVER_FD);
+    flags += jobFd + "," + jobFd;
+    command.passDescriptor(clientFd, Config::JOBSERVER_FD);
+  } else {
+    flags += "fifo:" + fifoPath;
+  }
+  command.setEnvironment("MAKEFLAGS", flags);
+}
+
+bool Jobserver::takeToken() {
+  if (implicitFree) {
+    implicitFree = false;
+    return true;
+  }
+
+  char token;
+  if (fd < 0 || read(fd, &token, 1) != 1)
+    return false;
+  held.push_back(token);
+  return true;
+}
+
+void Jobserver::acquire(const void *owner, std::function<void()> granted) {
+  if (waiters.empty() && takeToken()) {
+    granted();
+    return;
+  }
+
+  waiters.push_back(Waiter{owner, std::move(granted)});
+  if (!watching && fd >= 0) {
+    watching = loop.add(fd, EPOLLIN, [this](uint32_t) { onReadable(); });
+  }
+}
+
+void Jobserver::release() {
+  if (!held.empty()) {
+    // Back to the fifo, where a waiting make may take it before we do
+    char token = held.back();
+    held.pop_back();
+    if (write(fd, &token, 1) != 1)
+      livrn::Logger::warn("Lost a jobserver token: ", std::strerror(errno));
+    return;
+  }
+  if (implicitFree)
+    return;
+
+  if (waiters.empty()) {
+    implicitFree = true;
+    return;
+  }
+  // Hand the implicit token straight to the next waiter
+  Waiter next = std::move(waiters.front());
+  waiters.pop_front();
+  next.granted();
+}
+
+void Jobserver::cancel(const void *owner) {
+  for (auto it = waiters.begin(); it != waiters.end();) {
+    it = it->owner == owner ? waiters.erase(it) : std::next(it);
+  }
+}
+
+void Jobserver::onReadable() {
+  while (!waiters.empty() && takeToken()) {
+    Waiter next = std::move(waiters.front());
+    waiters.pop_front();
+    next.granted();
+  }
+
+  // Level-triggered: stop listening while nobody waits, or every token a
+  // make returns would wake the loop
+  if (waiters.empty() && watching) {
+    loop.remove(fd);
+    watching = false;
+  }
+}
+
+} // namespace livrn
@@ -0,0 +1,75 @@
+#pragma once
+#include "../cmd/command.h"
+#include "../event/loop.h"
+#include "../liverun.h"
+#include <deque>
+#include <functional>
+
+namespace livrn {
+
+// A GNU make jobserver shared by every build step. Steps find it through
+// MAKEFLAGS. Each job beyond a step's first takes a token from the fifo.
+// The first job is implicit, so liverun takes a token before it starts
+// the step. That way all the steps together never run more than the
+// configured number of jobs.
+class Jobserver {
+public:
+  // Pipe, where each step inherits the fifo as JOBSERVER_FD, is understood
+  // by make 4.2 and later and by cargo. Fifo is the style of make 4.4 and
+  // the only one ninja 1.13 speaks; make 4.3 rejects it.
+  enum class Style { Fifo, Pipe };
+
+private:
+  struct Waiter {
+    const void *owner;
+    std::function<void()> granted;
+  };
+
+  EventLoop &loop;
+  size_t tokens = 0;
+  Style style = Style::Pipe;
+  std::string directory;
+  std::string fifoPath;
+  int fd = -1;
+  // Blocking, for Style::Pipe children
+  int clientFd = -1;
+  bool watching = false;
+  // The token that is never in the fifo
+  bool implicitFree = true;
+  // Bytes read from the fifo, written back as they were on release
+  std::vector<char> held;
+  std::deque<Waiter> waiters;
+
+  bool takeToken();
+  void onReadable();
+
+public:
+  explicit Jobserver(EventLoop &loop);
+  ~Jobserver();
+
+  Jobserver(const Jobserver &) = delete;
+  Jobserver &operator=(const Jobserver &) = delete;
+
+  // Creates the fifo with tokens - 1 tokens in it
+  bool start(size_t tokens, Style style = Style::Pipe);
+  void stop();
+  bool isActive() const { return fd >= 0; }
+
+  // Adds " -j<tokens> --jobserver-auth=fifo:<path>" (or "=<fd>,<fd>") to
+  // the MAKEFLAGS that command runs with
+  void exportTo(PreparedCommand &command) const;
+
+  // Same contract as BuildPool: granted runs at once if a token is free,
+  // otherwise once one is released or a make returns one to the fifo
+  void acquire(const void *owner, std::function<void()> granted);
+  void release();
+  void cancel(const void *owner);
+  void cancelAll() { waiters.clear(); }
+
+  size_t capacity() const { return tokens; }
+  size_t busy() const { return held.size() + (implicitFree ? 0 : 1); }
+  size_t queued() const { return waiters.size(); }
+  const std::string &path() const { return fifoPath; }
+};
+
+} // namespace livrn
@@ -1,5 +1,6 @@
 #include "manager.h"
 #include "../logger.h"
+#include "../util/tracer.h"
 #include <fcntl.h>
 #include <unistd.h> // for geteuid on Linux/macOS
 
@@ -15,6 +16,8 @@ void ProcessManager::killProcessGracefully(pid_t &pid,
     return;
 
   livrn::Logger::warn("Stopping ", processName, " (PID: ", pid, ")...");
+  TraceSpan span("process", "kill");
+  span.setArg("pid", pid);
 
   int status;
   pid_t result = waitpid(pid, &status, WNOHANG);
@@ -24,6 +27,7 @@ void ProcessManager::killProcessGracefully(pid_t &pid,
   }
 
   if (kill(pid, SIGTERM) == 0) {
+    TraceSpan waitSpan("process", "graceful wait");
     for (int i = 0; i < livrn::Config::GRACEFUL_SHUTDOWN_TIMEOUT_MS / 100;
          ++i) {
       result = waitpid(pid, &status, WNOHANG);
@@ -58,6 +62,7 @@ void ProcessManager::killChild() {
   if (childPid > 0) {
     killProcessGracefully(childPid, "application");
     if (childPid == -1) {
+      TraceSpan span("process", "shutdown delay");
       std::this_thread::sleep_for(
           std::chrono::milliseconds(Config::SHUTDOWN_DELAY_MS));
     }
@@ -72,27 +77,54 @@ void ProcessManager::killCompileProcess() {
   }
 }
 bool ProcessManager::startProcess(const std::vector<std::string> &args) {
-  if (args.empty())
+  return startProcess(PreparedCommand(args));
+}
+
+bool ProcessManager::startProcess(const PreparedCommand &command) {
+  if (command.empty())
     return false;
 
+  TraceSpan span("process", "spawn");
+
+  // With counters, the child waits for them to be attached before exec,
+  // so each generation is counted from its first instruction
+  int ready[2] = {-1, -1};
+  if (perf && pipe2(ready, O_CLOEXEC) != 0) {
+    livrn::Logger::warn("Starting without counters: ", std::strerror(errno));
+    ready[0] = ready[1] = -1;
+  }
+
   childPid = fork();
   if (childPid == 0) {
     setpgid(0, 0);
-
-    std::vector<char *> argv;
-    for (const auto &arg : args) {
-      argv.push_back(const_cast<char *>(arg.c_str()));
+    if (ready[0] >= 0) {
+      char go;
+      close(ready[1]);
+      while (read(ready[0], &go, 1) < 0 && errno == EINTR) {
+      }
     }
-    argv.push_back(nullptr);
 
-    execvp(argv[0], argv.data());
+    command.exec();
     livrn::Logger::error("Failed to start process");
-    exit(1);
+    _exit(1);
   }
 
+  if (ready[0] >= 0) {
+    close(ready[0]);
+    if (childPid > 0)
+      perf->attach(childPid);
+    // Closing the pipe releases the child even if attaching failed
+    close(ready[1]);
+  }
+  span.setArg("pid", childPid);
   return childPid > 0;
 }
 
+void ProcessManager::enableCounters() {
+  if (!perf)
+    perf = std::make_unique<PerfCounters>();
+}
+
 bool ProcessManager::startInterpreter(const std::string &interpreter,
                                       const std::string &script) {
   return startProcess({interpreter, script});
@@ -102,17 +134,27 @@ bool ProcessManager::startBinary(const std::string &binary) {
   return startProcess({binary});
 }
 
-bool ProcessManager::startCommand(const std::string &cmd) {
+bool ProcessManager::prepareCommand(const std::string &cmd,
+                                    PreparedCommand &prepared) {
   if (!livrn::Parser::isCommandSafe(cmd)) {
     livrn::Logger::warn("Unsafe command");
-    if (!authenticatedUser()) {
+    if (!sessionAuthorised && !authenticatedUser()) {
       livrn::Logger::error("User authentication failed. Aborting.");
       return false;
     }
+    sessionAuthorised = true;
   }
 
-  auto args = livrn::Command::parseCommand(cmd);
-  return startProcess(args);
+  prepared = PreparedCommand(livrn::Command::parseCommand(cmd));
+  return !prepared.empty();
+}
+
+bool ProcessManager::startCommand(const std::string &cmd) {
+  PreparedCommand prepared;
+  if (!prepareCommand(cmd, prepared))
+    return false;
+
+  return startProcess(prepared);
 }
 
 bool ProcessManager::isChildRunning() const {
@@ -4,12 +4,16 @@
 #include "../config.h"
 #include "../liverun.h"
 #include "../util/parser.h"
+#include "counters.h"
+#include <memory>
 
 namespace livrn {
 class ProcessManager {
 private:
   pid_t childPid = -1;
   pid_t compilePid = -1;
+  bool sessionAuthorised = false;
+  std::unique_ptr<PerfCounters> perf;
 
   void killProcessGracefully(pid_t &pid, const std::string &processName);
 
@@ -20,14 +24,28 @@ public:
   void killChild();
   void killCompileProcess();
 
+  // Validates, authorises and tokenizes cmd once. Authentication for a
+  // command outside ALLOWED_COMMANDS is asked for at most once per session.
+  bool prepareCommand(const std::string &cmd, PreparedCommand &prepared);
+
   bool startProcess(const std::vector<std::string> &args);
+  bool startProcess(const PreparedCommand &command);
   bool startInterpreter(const std::string &interpreter,
                         const std::string &script);
   bool startBinary(const std::string &binary);
   bool startCommand(const std::string &cmd);
   bool authenticatedUser();
 
+  // Every child started from here on gets PerfCounters, counting from its
+  // exec
+  void enableCounters();
+  PerfCounters *counters() { return perf.get(); }
+
   bool isChildRunning() const;
+  pid_t childProcess() const { return childPid; }
+
+  // Forgets the child once it has been reaped elsewhere (e.g. by the loop)
+  void releaseChild() { childPid = -1; }
 };
 
 } // namespace livrn
@@ -1,48 +1,1084 @@
 #include "monitor.h"
 #include "../logger.h"
+#include "../util/clock.h"
+#include "../util/rules.h"
+#include "../util/tracer.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/fanotify.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <utility>
 
 namespace livrn {
 
-void ProcessMonitor::scanDirectory(const fs::path &dir) {
-  try {
-    for (const auto &entry : fs::recursive_directory_iterator(dir)) {
-      if (!entry.is_regular_file())
+namespace {
+constexpr uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+                                IN_CREATE | IN_DELETE | IN_ATTRIB;
+// Mount marks cannot report directory entry events, so only filesystem
+// marks are used
+constexpr uint64_t FANOTIFY_MASK = FAN_CLOSE_WRITE | FAN_MOVED_TO |
+                                   FAN_MOVED_FROM | FAN_CREATE | FAN_DELETE |
+                                   FAN_ATTRIB | FAN_ONDIR;
+
+// fsid + handle type + handle bytes, as both name_to_handle_at() and a
+// fanotify event describe a directory
+std::string handleKey(const std::string &fsid, const file_handle *handle) {
+  std::string key = fsid;
+  key.append(reinterpret_cast<const char *>(&handle->handle_type),
+             sizeof(handle->handle_type));
+  key.append(reinterpret_cast<const char *>(handle->f_handle),
+             handle->handle_bytes);
+  return key;
+}
+
+bool hasAllowedExtension(const char *name) {
+  const char *dot = std::strrchr(name, '.');
+  if (!dot || dot == name)
+    return false;
+  return Config::ALLOWED_EXTENSIONS.count(dot) > 0;
+}
+
+// Opens a single path component below dirFd. The name never contains a
+// separator and "." / ".." are filtered by the caller, so together with
+// O_NOFOLLOW the result is always inside the directory dirFd refers to.
+int openBeneath(int dirFd, const char *name, int flags) {
+  return openat(dirFd, name, flags | O_NOFOLLOW | O_CLOEXEC);
+}
+
+int64_t lastActivityNs(const FileStamp &stamp) {
+  return std::max(stamp.mtimeNs, stamp.accessNs);
+}
+
+void traceChange(uint64_t sweepStart, int64_t mtimeNs) {
+  Tracer &tracer = Tracer::instance();
+  if (!tracer.isEnabled())
+    return;
+
+  tracer.complete("monitor", "poll", sweepStart, Tracer::nowNs());
+  tracer.instant("monitor", "change detected", "lag_us",
+                 (realtimeNs() - mtimeNs) / 1000);
+}
+
+// f_type values of filesystems whose remote changes inotify cannot see
+constexpr long NFS_MAGIC = 0x6969;
+constexpr long SMB_MAGIC = 0x517B;
+constexpr long CIFS_MAGIC = 0xFF534D42;
+constexpr long SMB2_MAGIC = 0xFE534D42;
+constexpr long FUSE_MAGIC = 0x65735546;
+constexpr long CODA_MAGIC = 0x73757245;
+constexpr long AFS_MAGIC = 0x5346414F;
+constexpr long V9FS_MAGIC = 0x01021997;
+constexpr long CEPH_MAGIC = 0x00C36400;
+} // namespace
+
+FileStamp FileStamp::fromStat(const struct stat &st) {
+  FileStamp stamp;
+  stamp.mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+                  st.st_mtim.tv_nsec;
+  stamp.size = st.st_size;
+  stamp.accessNs = static_cast<int64_t>(st.st_atim.tv_sec) * 1000000000 +
+                   st.st_atim.tv_nsec;
+  return stamp;
+}
+
+bool ProcessMonitor::supportsNotifications(const fs::path &dir) {
+  struct statfs info;
+  if (statfs(dir.c_str(), &info) != 0)
+    return true;
+
+  switch (static_cast<long>(info.f_type)) {
+  case NFS_MAGIC:
+  case SMB_MAGIC:
+  case CIFS_MAGIC:
+  case SMB2_MAGIC:
+  case FUSE_MAGIC:
+  case CODA_MAGIC:
+  case AFS_MAGIC:
+  case V9FS_MAGIC:
+  case CEPH_MAGIC:
+    return false;
+  default:
+    return true;
+  }
+}
+
+int64_t ProcessMonitor::filesystemNowNs(const fs::path &dir) {
+  if (supportsNotifications(dir))
+    return coarseRealtimeNs();
+
+  std::string name = (dir / ".liverun-clock-XXXXXX").string();
+  int fd = mkostemp(&name[0], O_CLOEXEC);
+  if (fd < 0)
+    return realtimeNs();
+
+  struct stat st;
+  bool stamped = fstat(fd, &st) == 0;
+  close(fd);
+  unlink(name.c_str());
+  if (!stamped)
+    return realtimeNs();
+  return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+         st.st_mtim.tv_nsec;
+}
+
+ProcessMonitor::~ProcessMonitor() {
+  if (notifyFd >= 0)
+    close(notifyFd);
+}
+
+ProcessMonitor::ProcessMonitor(ProcessMonitor &&other) noexcept {
+  *this = std::move(other);
+}
+
+ProcessMonitor &ProcessMonitor::operator=(ProcessMonitor &&other) noexcept {
+  if (this == &other)
+    return *this;
+
+  disableNotifications();
+  fileTimestamps = std::move(other.fileTimestamps);
+  watchedDirs = std::move(other.watchedDirs);
+  directories = std::move(other.directories);
+  scheduler = std::move(other.scheduler);
+  notifyFd = std::exchange(other.notifyFd, -1);
+  fanotify = std::exchange(other.fanotify, false);
+  dirHandles = std::move(other.dirHandles);
+  fsidByMount = std::move(other.fsidByMount);
+  scanChanges = std::move(other.scanChanges);
+  root = std::move(other.root);
+  extraRoots = std::move(other.extraRoots);
+  followLinks = other.followLinks;
+  fileIds = std::move(other.fileIds);
+  dirIds = std::move(other.dirIds);
+  linkTargets = std::move(other.linkTargets);
+  linkOnlyDirs = std::move(other.linkOnlyDirs);
+  addedAt = std::move(other.addedAt);
+  ownWrites = std::move(other.ownWrites);
+  extraPatterns = std::move(other.extraPatterns);
+  return *this;
+}
+
+bool ProcessMonitor::enableNotifications(bool filesystemWide) {
+  if (notifyFd >= 0)
+    return true;
+
+  if (filesystemWide) {
+    // The queue is drained on every wakeup; a bounded one would overflow
+    // into a full rescan whenever anything else on the filesystem is busy
+    notifyFd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME |
+                                 FAN_UNLIMITED_QUEUE | FAN_NONBLOCK |
+                                 FAN_CLOEXEC,
+                             O_RDONLY);
+    if (notifyFd >= 0) {
+      fanotify = true;
+      return true;
+    }
+  }
+
+  notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (notifyFd < 0) {
+    livrn::Logger::warn("inotify unavailable (", std::strerror(errno),
+                        "), falling back to polling");
+    return false;
+  }
+  return true;
+}
+
+void ProcessMonitor::disableNotifications() {
+  if (notifyFd < 0)
+    return;
+
+  close(notifyFd);
+  notifyFd = -1;
+  watchedDirs.clear();
+  fanotify = false;
+  dirHandles.clear();
+  fsidByMount.clear();
+}
+
+WatchBackend ProcessMonitor::backend() const {
+  if (notifyFd < 0)
+    return WatchBackend::Poll;
+  return fanotify ? WatchBackend::Fanotify : WatchBackend::Inotify;
+}
+
+bool ProcessMonitor::watchByHandle(int dirFd, const std::string &prefix) {
+  alignas(file_handle) char buffer[sizeof(file_handle) + MAX_HANDLE_SZ];
+  auto *handle = reinterpret_cast<file_handle *>(buffer);
+  handle->handle_bytes = MAX_HANDLE_SZ;
+  int mountId;
+  if (name_to_handle_at(dirFd, "", handle, &mountId, AT_EMPTY_PATH) != 0)
+    return false;
+
+  // Marks are per filesystem, so only a directory on a mount not seen yet
+  // (the root, or something mounted inside the tree) adds one
+  auto mount = fsidByMount.find(mountId);
+  if (mount == fsidByMount.end()) {
+    struct statfs info;
+    if (fstatfs(dirFd, &info) != 0 ||
+        fanotify_mark(notifyFd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM,
+                      FANOTIFY_MASK, dirFd, nullptr) != 0) {
+      return false;
+    }
+    livrn::Logger::debug("Watching the filesystem of ", prefix,
+                         " with one fanotify mark");
+    std::string fsid(reinterpret_cast<const char *>(&info.f_fsid),
+                     sizeof(info.f_fsid));
+    mount = fsidByMount.emplace(mountId, std::move(fsid)).first;
+  }
+
+  dirHandles[handleKey(mount->second, handle)] = prefix;
+  return true;
+}
+
+void ProcessMonitor::watchDirectory(int dirFd, const std::string &prefix) {
+  if (notifyFd < 0)
+    return;
+
+  if (fanotify) {
+    if (watchByHandle(dirFd, prefix))
+      return;
+
+    std::string reason = std::strerror(errno);
+    if (!dirHandles.empty()) {
+      livrn::Logger::warn("Cannot watch ", prefix, " (", reason,
+                          "), falling back to polling");
+      disableNotifications();
+      return;
+    }
+    // Filesystem marks need CAP_SYS_ADMIN. Nothing is watched yet, so
+    // per-directory watches can still take over.
+    livrn::Logger::debug("fanotify unavailable (", reason,
+                         "), watching directories with inotify");
+    disableNotifications();
+    if (!enableNotifications(false))
+      return;
+  }
+
+  // Watch through the descriptor so the watch lands on the directory the
+  // scan actually opened, even if the path was swapped in the meantime
+  std::string procPath = "/proc/self/fd/" + std::to_string(dirFd);
+  int wd = inotify_add_watch(notifyFd, procPath.c_str(), WATCH_MASK | IN_ONLYDIR);
+  if (wd < 0) {
+    livrn::Logger::warn("Cannot watch ", prefix, " (", std::strerror(errno),
+                        "), falling back to polling");
+    disableNotifications();
+    return;
+  }
+  watchedDirs[wd] = prefix;
+}
+
+namespace {
+std::string trimSlashes(std::string path) {
+  while (path.size() > 1 && path.back() == '/')
+    path.pop_back();
+  return path;
+}
+} // namespace
+
+void ProcessMonitor::watchRoots(std::vector<std::string> dirs) {
+  extraRoots.clear();
+  for (auto &dir : dirs) {
+    extraRoots.push_back(trimSlashes(std::move(dir)));
+  }
+}
+
+std::vector<std::string> ProcessMonitor::roots() const {
+  std::vector<std::string> trees = {root};
+  trees.insert(trees.end(), extraRoots.begin(), extraRoots.end());
+  return trees;
+}
+
+void ProcessMonitor::scanDirectory(const fs::path &dir,
+                                   int64_t changedSinceNs) {
+  TraceSpan span("monitor", "scan");
+  root = trimSlashes(dir.string());
+
+  watermarkNs = changedSinceNs;
+
+  std::vector<std::string> links;
+  pendingLinks = &links;
+  for (const auto &tree : roots()) {
+    scanRoot(tree);
+  }
+  pendingLinks = nullptr;
+  indexLinks(links);
+
+  watermarkNs = 0;
+  span.setArg("files", static_cast<int64_t>(fileTimestamps.size()));
+}
+
+void ProcessMonitor::scanRoot(const std::string &prefix) {
+  int dirFd = open(prefix.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dirFd < 0) {
+    std::cerr << "[error] Directory scan failed: " << prefix << ": "
+              << std::strerror(errno) << std::endl;
+    return;
+  }
+
+  // Absolute length is only needed for the MAX_PATH_LENGTH limit; derive it
+  // once for the root instead of canonicalising every file
+  std::error_code ec;
+  size_t absoluteLength =
+      fs::absolute(prefix, ec).lexically_normal().string().size();
+  scanDirectoryAt(dirFd, prefix, absoluteLength, nullptr);
+}
+
+void ProcessMonitor::scanDirectoryAt(int dirFd, const std::string &prefix,
+                                     size_t absolutePrefixLength,
+                                     std::vector<std::string> *added) {
+  struct stat dirStat;
+  bool statted = fstat(dirFd, &dirStat) == 0;
+  if (statted && !claimDirectory(dirStat, prefix)) {
+    close(dirFd);
+    return;
+  }
+  watchDirectory(dirFd, prefix);
+  directories.insert(prefix);
+
+  if (scheduler && statted) {
+    int64_t mtime = FileStamp::fromStat(dirStat).mtimeNs;
+    PollScheduler::Id id = scheduler->add(prefix, true, mtime, realtimeNs());
+    scheduler->stateNs(id) = mtime;
+  }
+
+  DIR *dir = fdopendir(dirFd);
+  if (!dir) {
+    close(dirFd);
+    return;
+  }
+
+  while (dirent *entry = readdir(dir)) {
+    if (scanCancelled.load(std::memory_order_relaxed))
+      break;
+
+    const char *name = entry->d_name;
+    if (std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0)
+      continue;
+
+    unsigned char type = entry->d_type;
+    if (type == DT_UNKNOWN) {
+      struct stat st;
+      if (fstatat(dirFd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
         continue;
+      type = S_ISDIR(st.st_mode)   ? DT_DIR
+             : S_ISREG(st.st_mode) ? DT_REG
+             : S_ISLNK(st.st_mode) ? DT_LNK
+                                   : 0;
+    }
 
-      std::string pathStr = entry.path().string();
-      if (!livrn::Parser::isPathSafe(pathStr)) {
-        livrn::Logger::warn("Skipping unsafe path: ", pathStr);
+    size_t nameLength = std::strlen(name);
+    if (absolutePrefixLength + 1 + nameLength > Config::MAX_PATH_LENGTH)
+      continue;
+
+    bool linked = false;
+    if (type == DT_LNK) {
+      struct stat st;
+      if (!followLinks || fstatat(dirFd, name, &st, 0) != 0)
         continue;
+      linked = true;
+      type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : 0;
+    }
+
+    if (type == DT_DIR) {
+      int childFd =
+          linked ? openat(dirFd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC)
+                 : openBeneath(dirFd, name, O_RDONLY | O_DIRECTORY);
+      if (childFd >= 0) {
+        scanDirectoryAt(childFd, prefix + "/" + name,
+                        absolutePrefixLength + 1 + nameLength, added);
       }
+    } else if (type == DT_REG) {
+      std::string path = prefix + "/" + name;
+      if (!isWatchedFile(name, path))
+        continue;
+      if (linked && pendingLinks) {
+        pendingLinks->push_back(path);
+      } else if (indexFileAt(dirFd, name, path, linked) && added) {
+        added->push_back(path);
+        addedAt[path] = realtimeNs();
+      }
+    }
+  }
+
+  closedir(dir);
+}
+
+bool ProcessMonitor::claimDirectory(const struct stat &st,
+                                    const std::string &prefix) {
+  FileId id = FileId::fromStat(st);
+  auto known = dirIds.find(id);
+  struct stat current;
+  if (known != dirIds.end() && known->second != prefix &&
+      directories.count(known->second) && statPath(known->second, current) &&
+      FileId::fromStat(current) == id) {
+    livrn::Logger::debug("Skipping ", prefix, ", already watched as ",
+                         known->second);
+    return false;
+  }
+  dirIds[id] = prefix;
+  return true;
+}
 
-      std::string ext = entry.path().extension().string();
-      if (Config::ALLOWED_EXTENSIONS.find(ext) ==
-          Config::ALLOWED_EXTENSIONS.end()) {
+bool ProcessMonitor::claimFile(const struct stat &st,
+                               const std::string &path) {
+  FileId id = FileId::fromStat(st);
+  auto known = fileIds.find(id);
+  struct stat current;
+  if (known != fileIds.end() && known->second != path &&
+      fileTimestamps.count(known->second) &&
+      statPath(known->second, current) && FileId::fromStat(current) == id) {
+    return false;
+  }
+  fileIds[id] = path;
+  return true;
+}
+
+bool ProcessMonitor::statPath(const std::string &path,
+                              struct stat &st) const {
+  return fstatat(AT_FDCWD, path.c_str(), &st,
+                 followLinks ? 0 : AT_SYMLINK_NOFOLLOW) == 0;
+}
+
+bool ProcessMonitor::isWatchedFile(const char *name,
+                                   const std::string &path) const {
+  if (hasAllowedExtension(name))
+    return true;
+  for (const auto &pattern : extraPatterns) {
+    if (ActionRules::matches(pattern, path))
+      return true;
+  }
+  return false;
+}
+
+bool ProcessMonitor::indexFileAt(int dirFd, const char *name,
+                                 const std::string &path, bool follow) {
+  struct stat st;
+  if (previousIndex) {
+    auto known = previousIndex->find(path);
+    if (known != previousIndex->end() &&
+        fstatat(dirFd, name, &st, follow ? 0 : AT_SYMLINK_NOFOLLOW) == 0 &&
+        S_ISREG(st.st_mode)) {
+      FileStamp stamp = FileStamp::fromStat(st);
+      if (!(stamp != known->second)) {
+        if (!claimFile(st, path))
+          return false;
+        fileTimestamps[path] = stamp;
+        return true;
+      }
+    }
+  }
+
+  // One descriptor serves both the binary sniff and the stat; O_NOFOLLOW
+  // rejects a symlink swapped in since readdir, unless links are followed
+  int fd = follow ? openat(dirFd, name, O_RDONLY | O_NONBLOCK | O_CLOEXEC)
+                  : openBeneath(dirFd, name, O_RDONLY | O_NONBLOCK);
+  if (fd < 0)
+    return false;
+
+  bool indexed = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+                 claimFile(st, path) && !livrn::Parser::isBinaryFile(fd);
+  if (indexed) {
+    FileStamp stamp = FileStamp::fromStat(st);
+    fileTimestamps[path] = stamp;
+    if (scheduler)
+      scheduler->add(path, false, lastActivityNs(stamp), realtimeNs());
+    if (watermarkNs > 0 && stamp.mtimeNs >= watermarkNs) {
+      scanChanges.push_back(path);
+      // Created since the watermark, such as by a build running next to
+      // the scan, so the file counts as added rather than as edited
+      struct statx sx;
+      if (statx(fd, "", AT_EMPTY_PATH, STATX_BTIME, &sx) == 0 &&
+          (sx.stx_mask & STATX_BTIME)) {
+        int64_t bornNs = sx.stx_btime.tv_sec * 1000000000LL +
+                         sx.stx_btime.tv_nsec;
+        if (bornNs >= watermarkNs)
+          addedAt[path] = bornNs;
+      }
+    }
+  }
+  close(fd);
+  return indexed;
+}
+
+void ProcessMonitor::indexLinks(const std::vector<std::string> &links) {
+  for (const auto &path : links) {
+    if (indexFileAt(AT_FDCWD, path.c_str(), path, true) && notifyFd >= 0)
+      watchLinkTarget(path);
+  }
+}
+
+void ProcessMonitor::watchLinkTarget(const std::string &path) {
+  // Writes to the target show up in its own directory, under its own name
+  std::error_code ec;
+  fs::path target = fs::canonical(path, ec);
+  if (ec)
+    return;
+  std::string dir = target.parent_path().string();
+  int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dirFd < 0)
+    return;
+
+  struct stat st;
+  auto known = dirIds.end();
+  if (fstat(dirFd, &st) == 0)
+    known = dirIds.find(FileId::fromStat(st));
+  if (known != dirIds.end() && directories.count(known->second)) {
+    // Already watched, under the path the scan reached it by
+    linkTargets[known->second + "/" + target.filename().string()] = path;
+  } else {
+    linkTargets[dir + "/" + target.filename().string()] = path;
+    if (linkOnlyDirs.insert(dir).second)
+      watchDirectory(dirFd, dir);
+  }
+  close(dirFd);
+}
+
+std::string ProcessMonitor::refreshFile(const std::string &path) {
+  struct stat st;
+  auto it = fileTimestamps.find(path);
+
+  if (it != fileTimestamps.end()) {
+    if (!statPath(path, st) || !S_ISREG(st.st_mode))
+      return "";
+
+    FileStamp stamp = FileStamp::fromStat(st);
+    if (!(stamp != it->second))
+      return "";
+    // A save that renames over the file brings a new inode
+    fileIds[FileId::fromStat(st)] = path;
+    it->second = stamp;
+    return path;
+  }
+
+  // New file: sniff the content before it joins the index
+  int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC |
+                                  (followLinks ? 0 : O_NOFOLLOW));
+  if (fd < 0)
+    return "";
+
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return "";
+  }
+  // Another name for a file already indexed: the change is reported under
+  // the name it was indexed with
+  if (!claimFile(st, path)) {
+    close(fd);
+    std::string known = fileIds[FileId::fromStat(st)];
+    return refreshFile(known);
+  }
+
+  bool indexed = !livrn::Parser::isBinaryFile(fd);
+  if (indexed) {
+    fileTimestamps[path] = FileStamp::fromStat(st);
+    addedAt[path] = realtimeNs();
+    if (scheduler) {
+      // Just created, so it starts in the hot set
+      int64_t now = realtimeNs();
+      scheduler->add(path, false, now, now);
+    }
+  }
+  close(fd);
+  return indexed ? path : "";
+}
+
+std::vector<std::string> ProcessMonitor::collectChanges() {
+  if (notifyFd < 0)
+    return pollAdaptive();
+
+  uint64_t sweepStart = Tracer::nowNs();
+  std::vector<std::string> changed;
+  std::unordered_set<std::string> seen;
+  bool overflowed = false;
+
+  Reporter report = [&](const std::string &path) {
+    if (seen.insert(path).second) {
+      std::cout << "[livrn] File changed: " << path << std::endl;
+      changed.push_back(path);
+    }
+  };
+
+  reportScanChanges(report);
+  if (fanotify) {
+    readFanotify(report, overflowed);
+  } else {
+    readInotify(report, overflowed);
+  }
+
+  if (overflowed) {
+    livrn::Logger::warn("Change queue overflowed, rescanning files");
+    for (const auto &path : pollChanges()) {
+      report(path);
+    }
+  }
+
+  if (!changed.empty()) {
+    auto it = fileTimestamps.find(changed.front());
+    traceChange(sweepStart,
+                it != fileTimestamps.end() ? it->second.mtimeNs : 0);
+  }
+  return changed;
+}
+
+std::vector<std::string> ProcessMonitor::rescan() {
+  TraceSpan span("monitor", "rescan");
+  drainNotifications();
+
+  std::unordered_map<std::string, FileStamp> previous;
+  previous.swap(fileTimestamps);
+  directories.clear();
+  scanChanges.clear();
+  fileIds.clear();
+  addedAt.clear();
+  ownWrites.clear();
+  dirIds.clear();
+  linkTargets.clear();
+  // Rebuilt from the new index on the next poll
+  scheduler.reset();
+
+  std::vector<std::string> links;
+  previousIndex = &previous;
+  pendingLinks = &links;
+  for (const auto &tree : roots()) {
+    scanRoot(tree);
+  }
+  pendingLinks = nullptr;
+  indexLinks(links);
+  previousIndex = nullptr;
+
+  std::vector<std::string> changed;
+  for (const auto &[path, stamp] : fileTimestamps) {
+    auto it = previous.find(path);
+    if (it == previous.end() || stamp != it->second)
+      changed.push_back(path);
+  }
+  for (const auto &entry : previous) {
+    if (!fileTimestamps.count(entry.first))
+      changed.push_back(entry.first);
+  }
+  span.setArg("changed", static_cast<int64_t>(changed.size()));
+  return changed;
+}
+
+bool ProcessMonitor::drainNotifications() {
+  if (notifyFd < 0)
+    return false;
+
+  bool drained = false;
+  char buffer[64 * 1024];
+  while (read(notifyFd, buffer, sizeof(buffer)) > 0) {
+    drained = true;
+  }
+  return drained;
+}
+
+void ProcessMonitor::reportScanChanges(const Reporter &report) {
+  for (const auto &path : scanChanges) {
+    if (fileTimestamps.count(path))
+      report(path);
+  }
+  scanChanges.clear();
+}
+
+void ProcessMonitor::readInotify(const Reporter &report, bool &overflowed) {
+  alignas(inotify_event) char buffer[64 * 1024];
+  ssize_t length;
+  while ((length = read(notifyFd, buffer, sizeof(buffer))) > 0) {
+    for (char *ptr = buffer; ptr < buffer + length;) {
+      auto *ev = reinterpret_cast<inotify_event *>(ptr);
+      ptr += sizeof(inotify_event) + ev->len;
+
+      if (ev->mask & IN_Q_OVERFLOW) {
+        overflowed = true;
         continue;
       }
 
-      if (!livrn::Parser::isBinaryFile(entry.path())) {
-        fileTimestamps[pathStr] = fs::last_write_time(entry);
+      auto dirIt = watchedDirs.find(ev->wd);
+      if (dirIt == watchedDirs.end())
+        continue;
+      if (ev->mask & IN_IGNORED) {
+        watchedDirs.erase(dirIt);
+        continue;
       }
+      if (ev->len == 0)
+        continue;
+
+      onEntryEvent(dirIt->second, ev->name, ev->mask & IN_ISDIR,
+                   ev->mask & (IN_CREATE | IN_MOVED_TO),
+                   ev->mask & (IN_DELETE | IN_MOVED_FROM), report);
     }
-  } catch (const std::exception &e) {
-    std::cerr << "[error] Directory scan failed: " << e.what() << std::endl;
+
+    // Bail out if a directory watch failed while handling the batch
+    if (notifyFd < 0)
+      break;
   }
 }
 
-bool ProcessMonitor::hasAnyFileChanged() {
-  for (auto &[path, oldTime] : fileTimestamps) {
-    if (!fs::exists(path))
+void ProcessMonitor::readFanotify(const Reporter &report, bool &overflowed) {
+  alignas(fanotify_event_metadata) char buffer[64 * 1024];
+  // A build writes many files from few processes
+  std::unordered_map<pid_t, bool> ownPids;
+  ssize_t length;
+  while ((length = read(notifyFd, buffer, sizeof(buffer))) > 0) {
+    auto *ev = reinterpret_cast<fanotify_event_metadata *>(buffer);
+    for (; FAN_EVENT_OK(ev, length); ev = FAN_EVENT_NEXT(ev, length)) {
+      if (ev->mask & FAN_Q_OVERFLOW) {
+        overflowed = true;
+        continue;
+      }
+      if (ev->event_len < sizeof(*ev) + sizeof(fanotify_event_info_fid))
+        continue;
+
+      auto *info = reinterpret_cast<fanotify_event_info_fid *>(ev + 1);
+      if (info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME)
+        continue;
+
+      // The mark covers the whole filesystem; only directories the scan
+      // indexed resolve, so everything outside the tree drops out here
+      auto *handle = reinterpret_cast<file_handle *>(info->handle);
+      std::string fsid(reinterpret_cast<const char *>(&info->fsid),
+                       sizeof(info->fsid));
+      auto dirIt = dirHandles.find(handleKey(fsid, handle));
+      if (dirIt == dirHandles.end())
+        continue;
+
+      const char *name =
+          reinterpret_cast<const char *>(handle->f_handle) +
+          handle->handle_bytes;
+      if (name[0] == '\0' || std::strcmp(name, ".") == 0)
+        continue;
+
+      bool isDir = ev->mask & FAN_ONDIR;
+      bool removed = ev->mask & (FAN_DELETE | FAN_MOVED_FROM);
+      if (ownWriter && !isDir && !removed) {
+        auto known = ownPids.find(ev->pid);
+        if (known == ownPids.end())
+          known = ownPids.emplace(ev->pid, ownWriter(ev->pid)).first;
+        ownWrites[dirIt->second + "/" + name] = known->second;
+      }
+      onEntryEvent(dirIt->second, name, isDir,
+                   ev->mask & (FAN_CREATE | FAN_MOVED_TO), removed, report);
+    }
+
+    if (notifyFd < 0)
+      break;
+  }
+}
+
+void ProcessMonitor::onEntryEvent(const std::string &dirPath,
+                                  const char *name, bool isDir, bool created,
+                                  bool removed, const Reporter &report) {
+  std::string path = dirPath + "/" + name;
+
+  if (!linkTargets.empty()) {
+    auto link = linkTargets.find(path);
+    if (link != linkTargets.end())
+      onFileEvent(link->second, removed, report);
+    // Watched for the link targets only
+    if (linkOnlyDirs.count(dirPath))
+      return;
+  }
+
+  // A new symlink to a directory is scanned like a new directory
+  struct stat st;
+  if (!isDir && created && followLinks && stat(path.c_str(), &st) == 0 &&
+      S_ISDIR(st.st_mode)) {
+    isDir = true;
+  }
+
+  if (isDir) {
+    if (created) {
+      std::vector<std::string> added;
+      int dirFd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC |
+                                         (followLinks ? 0 : O_NOFOLLOW));
+      if (dirFd >= 0) {
+        std::error_code ec;
+        size_t absoluteLength = fs::absolute(path, ec).string().size();
+        scanDirectoryAt(dirFd, path, absoluteLength, &added);
+      }
+      for (const auto &file : added) {
+        report(file);
+      }
+    }
+    return;
+  }
+
+  if (isWatchedFile(name, path))
+    onFileEvent(path, removed, report);
+}
+
+void ProcessMonitor::onFileEvent(const std::string &path, bool removed,
+                                 const Reporter &report) {
+  // Events for one name can be merged (moved away, then replaced), so a
+  // removal only counts if the file is really gone
+  struct stat st;
+  if (removed && !statPath(path, st)) {
+    if (fileTimestamps.erase(path) > 0)
+      report(path);
+    return;
+  }
+  std::string changed = refreshFile(path);
+  if (!changed.empty())
+    report(changed);
+}
+
+std::vector<std::string> ProcessMonitor::pollChanges() {
+  uint64_t sweepStart = Tracer::nowNs();
+  std::vector<std::string> changed;
+  int64_t firstMtime = 0;
+
+  for (auto &[path, oldStamp] : fileTimestamps) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
       continue;
 
-    auto currentTime = fs::last_write_time(path);
-    if (currentTime != oldTime) {
+    FileStamp currentStamp = FileStamp::fromStat(st);
+    if (currentStamp != oldStamp) {
       std::cout << "[livrn] File changed: " << path << std::endl;
-      fileTimestamps[path] = currentTime;
-      return true;
+      oldStamp = currentStamp;
+      if (changed.empty())
+        firstMtime = currentStamp.mtimeNs;
+      changed.push_back(path);
     }
   }
-  return false;
+
+  // Only sweeps that find something are traced; idle polls would
+  // otherwise flood the buffer
+  if (!changed.empty())
+    traceChange(sweepStart, firstMtime);
+  return changed;
+}
+
+bool ProcessMonitor::hasAnyFileChanged() { return !pollChanges().empty(); }
+
+void ProcessMonitor::buildScheduler(int64_t nowNs) {
+  scheduler = std::make_unique<PollScheduler>();
+
+  // Parents first, so every entry can be linked to its directory
+  std::vector<std::string> dirs(directories.begin(), directories.end());
+  std::sort(dirs.begin(), dirs.end(),
+            [](const std::string &a, const std::string &b) {
+              return a.size() < b.size();
+            });
+
+  for (const auto &dir : dirs) {
+    struct stat st;
+    if (!statPath(dir, st))
+      continue;
+    int64_t mtime = FileStamp::fromStat(st).mtimeNs;
+    PollScheduler::Id id = scheduler->add(dir, true, mtime, nowNs);
+    scheduler->stateNs(id) = mtime;
+  }
+
+  for (const auto &[path, stamp] : fileTimestamps) {
+    scheduler->add(path, false, lastActivityNs(stamp), nowNs);
+  }
+}
+
+std::vector<std::string> ProcessMonitor::pollAdaptive() {
+  int64_t now = realtimeNs();
+  if (!scheduler)
+    buildScheduler(now);
+
+  uint64_t sweepStart = Tracer::nowNs();
+  std::vector<std::string> changed;
+  std::unordered_set<std::string> seen;
+  Reporter report = [&](const std::string &path) {
+    if (seen.insert(path).second) {
+      std::cout << "[livrn] File changed: " << path << std::endl;
+      changed.push_back(path);
+    }
+  };
+
+  reportScanChanges(report);
+  std::vector<PollScheduler::Id> due;
+  scheduler->takeDue(now, due);
+
+  for (PollScheduler::Id id : due) {
+    // An earlier directory in this batch may have dropped the entry
+    if (scheduler->path(id).empty())
+      continue;
+
+    if (scheduler->isDirectory(id)) {
+      pollDirectory(id, now, report);
+      continue;
+    }
+
+    const std::string path = scheduler->path(id);
+    struct stat st;
+    if (!statPath(path, st) || !S_ISREG(st.st_mode)) {
+      forgetPath(id, report);
+      continue;
+    }
+
+    FileStamp &known = fileTimestamps[path];
+    FileStamp current = FileStamp::fromStat(st);
+    if (current != known) {
+      known = current;
+      report(path);
+      scheduler->touch(id, now, now);
+    } else if (current.accessNs > known.accessNs) {
+      known.accessNs = current.accessNs;
+      scheduler->touch(id, current.accessNs, now);
+    }
+    scheduler->reschedule(id, now);
+  }
+
+  if (!changed.empty()) {
+    auto it = fileTimestamps.find(changed.front());
+    traceChange(sweepStart,
+                it != fileTimestamps.end() ? it->second.mtimeNs : 0);
+  }
+  return changed;
+}
+
+void ProcessMonitor::pollDirectory(PollScheduler::Id id, int64_t nowNs,
+                                   const Reporter &report) {
+  const std::string dirPath = scheduler->path(id);
+  struct stat st;
+  if (!statPath(dirPath, st) || !S_ISDIR(st.st_mode)) {
+    forgetPath(id, report);
+    return;
+  }
+
+  int64_t mtime = FileStamp::fromStat(st).mtimeNs;
+  if (mtime == scheduler->stateNs(id)) {
+    scheduler->reschedule(id, nowNs);
+    return;
+  }
+  scheduler->stateNs(id) = mtime;
+  scheduler->touch(id, nowNs, nowNs);
+
+  // An entry was created, removed or renamed over. Re-read the directory:
+  // new files join the hot set, vanished ones are reported, and existing
+  // files are checked now since a rename-over save replaces them.
+  int noFollow = followLinks ? 0 : O_NOFOLLOW;
+  int dirFd =
+      open(dirPath.c_str(), O_RDONLY | O_DIRECTORY | noFollow | O_CLOEXEC);
+  if (dirFd < 0) {
+    scheduler->reschedule(id, nowNs);
+    return;
+  }
+
+  std::unordered_set<std::string> present;
+  DIR *dir = fdopendir(dirFd);
+  if (!dir) {
+    close(dirFd);
+    scheduler->reschedule(id, nowNs);
+    return;
+  }
+
+  while (dirent *entry = readdir(dir)) {
+    const char *name = entry->d_name;
+    if (std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0)
+      continue;
+
+    std::string path = dirPath + "/" + name;
+    struct stat entrySt;
+    if (fstatat(dirFd, name, &entrySt, followLinks ? 0 : AT_SYMLINK_NOFOLLOW) !=
+        0)
+      continue;
+
+    if (S_ISDIR(entrySt.st_mode)) {
+      present.insert(path);
+      if (scheduler->find(path) != PollScheduler::NONE)
+        continue;
+
+      std::vector<std::string> added;
+      int childFd =
+          openat(dirFd, name, O_RDONLY | O_DIRECTORY | noFollow | O_CLOEXEC);
+      if (childFd >= 0) {
+        std::error_code ec;
+        size_t absoluteLength = fs::absolute(path, ec).string().size();
+        scanDirectoryAt(childFd, path, absoluteLength, &added);
+      }
+      for (const auto &file : added) {
+        report(file);
+      }
+    } else if (S_ISREG(entrySt.st_mode) && isWatchedFile(name, path)) {
+      present.insert(path);
+      PollScheduler::Id child = scheduler->find(path);
+      std::string changed = refreshFile(path);
+      if (!changed.empty()) {
+        report(changed);
+        if (child != PollScheduler::NONE)
+          scheduler->touch(child, nowNs, nowNs);
+      }
+    }
+  }
+  closedir(dir);
+
+  std::vector<PollScheduler::Id> vanished;
+  for (PollScheduler::Id child : scheduler->children(id)) {
+    if (!present.count(scheduler->path(child)))
+      vanished.push_back(child);
+  }
+  for (PollScheduler::Id child : vanished) {
+    forgetPath(child, report);
+  }
+
+  scheduler->reschedule(id, nowNs);
+}
+
+void ProcessMonitor::forgetPath(PollScheduler::Id id, const Reporter &report) {
+  std::string path = scheduler->path(id);
+
+  if (scheduler->isDirectory(id)) {
+    std::vector<PollScheduler::Id> children = scheduler->children(id);
+    for (PollScheduler::Id child : children) {
+      forgetPath(child, report);
+    }
+    directories.erase(path);
+  } else if (fileTimestamps.erase(path) > 0) {
+    report(path);
+  }
+  scheduler->remove(id);
+}
+
+std::vector<std::string> ProcessMonitor::files() const {
+  std::vector<std::string> paths;
+  paths.reserve(fileTimestamps.size());
+  for (const auto &entry : fileTimestamps) {
+    paths.push_back(entry.first);
+  }
+  return paths;
+}
+
+std::vector<std::string> ProcessMonitor::settledFiles() const {
+  std::unordered_set<std::string> changed(scanChanges.begin(),
+                                          scanChanges.end());
+  std::vector<std::string> paths;
+  paths.reserve(fileTimestamps.size());
+  for (const auto &entry : fileTimestamps) {
+    if (!changed.count(entry.first))
+      paths.push_back(entry.first);
+  }
+  return paths;
+}
+
+int64_t ProcessMonitor::addedNs(const std::string &path) const {
+  auto it = addedAt.find(path);
+  return it == addedAt.end() ? 0 : it->second;
+}
+
+bool ProcessMonitor::writtenByOwnProcess(const std::string &path) const {
+  auto it = ownWrites.find(path);
+  return it != ownWrites.end() && it->second;
+}
+
+int ProcessMonitor::nextPollDelayMs() const {
+  if (!scheduler)
+    return Config::POLL_HOT_INTERVAL_MS;
+
+  int64_t next = scheduler->nextDueNs();
+  if (next == INT64_MAX)
+    return Config::POLL_DIR_MAX_INTERVAL_MS;
+
+  int64_t delayMs = (next - realtimeNs() + 999999) / 1000000;
+  return static_cast<int>(std::clamp<int64_t>(
+      delayMs, 1, Config::POLL_COLD_MAX_INTERVAL_MS));
 }
 
 } // namespace livrn
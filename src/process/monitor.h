@@ -1,14 +1,225 @@
 #pragma once
 #include "../liverun.h"
 #include "../util/parser.h"
+#include "poller.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <sys/stat.h>
 
 namespace livrn {
+
+struct FileStamp {
+  int64_t mtimeNs = 0;
+  off_t size = 0;
+  // Not part of the comparison; only hints that a file was opened recently
+  int64_t accessNs = 0;
+
+  static FileStamp fromStat(const struct stat &st);
+
+  bool operator!=(const FileStamp &other) const {
+    return mtimeNs != other.mtimeNs || size != other.size;
+  }
+};
+
+enum class WatchBackend { Poll, Inotify, Fanotify };
+
+// A physical file or directory, whatever path reaches it
+struct FileId {
+  dev_t device = 0;
+  ino_t inode = 0;
+
+  static FileId fromStat(const struct stat &st) {
+    return {st.st_dev, st.st_ino};
+  }
+  bool operator==(const FileId &other) const {
+    return device == other.device && inode == other.inode;
+  }
+};
+
+struct FileIdHash {
+  size_t operator()(const FileId &id) const {
+    return std::hash<uint64_t>()(static_cast<uint64_t>(id.device) * 31 +
+                                 static_cast<uint64_t>(id.inode));
+  }
+};
+
 class ProcessMonitor {
 private:
-  std::unordered_map<std::string, fs::file_time_type> fileTimestamps;
+  std::unordered_map<std::string, FileStamp> fileTimestamps;
+  std::unordered_map<int, std::string> watchedDirs;
+  std::unordered_set<std::string> directories;
+  std::unique_ptr<PollScheduler> scheduler;
+  int notifyFd = -1;
+
+  // fanotify: one mark per filesystem, and directories identified by the
+  // file handle events carry (fsid + handle bytes -> path)
+  bool fanotify = false;
+  std::unordered_map<std::string, std::string> dirHandles;
+  std::unordered_map<int, std::string> fsidByMount;
+
+  std::string root;
+  std::vector<std::string> extraRoots;
+  bool followLinks = false;
+
+  // The path each file and directory was indexed under. A second path to
+  // the same one (hard link, symlink, overlapping root) is skipped, so every
+  // physical file is indexed and stat'ed once. Entries are not removed;
+  // one only counts while its path still leads to the same inode.
+  std::unordered_map<FileId, std::string, FileIdHash> fileIds;
+  std::unordered_map<FileId, std::string, FileIdHash> dirIds;
+
+  // Symlinked files found by a full scan. They are indexed after it, so a
+  // path that reaches the file directly wins. A target outside every
+  // scanned directory gets its directory watched for just that name: real
+  // target path -> indexed path.
+  std::vector<std::string> *pendingLinks = nullptr;
+  std::unordered_map<std::string, std::string> linkTargets;
+  std::unordered_set<std::string> linkOnlyDirs;
+
+  // Wall-clock time files created after the scan joined the index
+  std::unordered_map<std::string, int64_t> addedAt;
+  // fanotify only: whether the last event for a path came from a process
+  // ownWriter accepts
+  std::function<bool(pid_t)> ownWriter;
+  std::unordered_map<std::string, bool> ownWrites;
+
+  // Globs of files watched whatever their extension (see ActionRules)
+  std::vector<std::string> extraPatterns;
+  // Set during rescan(): files whose stamp is unchanged skip the binary
+  // sniff
+  const std::unordered_map<std::string, FileStamp> *previousIndex = nullptr;
+
+  // Files the scan found modified at or after watermarkNs; the next
+  // collectChanges() reports them
+  int64_t watermarkNs = 0;
+  std::vector<std::string> scanChanges;
+  std::atomic<bool> scanCancelled{false};
+
+  using Reporter = std::function<void(const std::string &)>;
+
+  std::vector<std::string> roots() const;
+  void scanRoot(const std::string &prefix);
+  void scanDirectoryAt(int dirFd, const std::string &prefix,
+                       size_t absolutePrefixLength,
+                       std::vector<std::string> *added);
+  bool claimDirectory(const struct stat &st, const std::string &prefix);
+  bool claimFile(const struct stat &st, const std::string &path);
+  bool isWatchedFile(const char *name, const std::string &path) const;
+  bool indexFileAt(int dirFd, const char *name, const std::string &path,
+                   bool follow = false);
+  void indexLinks(const std::vector<std::string> &links);
+  void watchLinkTarget(const std::string &path);
+  void watchDirectory(int dirFd, const std::string &prefix);
+  bool watchByHandle(int dirFd, const std::string &prefix);
+  bool statPath(const std::string &path, struct stat &st) const;
+  std::string refreshFile(const std::string &path);
+  void disableNotifications();
+
+  void readInotify(const Reporter &report, bool &overflowed);
+  void readFanotify(const Reporter &report, bool &overflowed);
+  void reportScanChanges(const Reporter &report);
+  void onEntryEvent(const std::string &dirPath, const char *name, bool isDir,
+                    bool created, bool removed, const Reporter &report);
+  void onFileEvent(const std::string &path, bool removed,
+                   const Reporter &report);
+
+  void buildScheduler(int64_t nowNs);
+  std::vector<std::string> pollAdaptive();
+  void pollDirectory(PollScheduler::Id id, int64_t nowNs,
+                     const Reporter &report);
+  void forgetPath(PollScheduler::Id id, const Reporter &report);
 
 public:
-  void scanDirectory(const fs::path &dir);
+  ProcessMonitor() = default;
+  ~ProcessMonitor();
+
+  // Moving hands over the index and the notification descriptor, so a warm
+  // monitor can be passed to whoever runs the session
+  ProcessMonitor(ProcessMonitor &&other) noexcept;
+  ProcessMonitor &operator=(ProcessMonitor &&other) noexcept;
+  ProcessMonitor(const ProcessMonitor &) = delete;
+  ProcessMonitor &operator=(const ProcessMonitor &) = delete;
+
+  // Network and FUSE filesystems do not deliver notifications for changes
+  // made by other clients, so they are polled instead
+  static bool supportsNotifications(const fs::path &dir);
+  // The current time by dir's filesystem clock, to compare mtimes with.
+  // Local filesystems stamp them from the coarse kernel clock, which is
+  // read directly. Network and FUSE filesystems use the server's clock, so
+  // there it is the mtime of a file created and removed in dir, or the
+  // wall clock if dir is not writable.
+  static int64_t filesystemNowNs(const fs::path &dir);
+
+  // Switches change detection from mtime polling to notifications, so
+  // nothing written during the scan is missed. With filesystemWide, and
+  // the privilege for it, a single fanotify mark covers each filesystem the
+  // tree spans; otherwise every directory gets an inotify watch as
+  // scanDirectory() opens it, which counts against
+  // fs.inotify.max_user_watches. Returns false if neither is available.
+  bool enableNotifications(bool filesystemWide = true);
+  int notificationFd() const { return notifyFd; }
+  WatchBackend backend() const;
+
+  // Indexes every file below dir, and below every root from watchRoots().
+  // A scan may run on another thread while the caller builds, as long as
+  // nothing else touches the monitor until it returns; files modified at
+  // or after changedSinceNs (see filesystemNowNs()) are then reported by
+  // the first collectChanges(), since the build may have read them before
+  // the change.
+  void scanDirectory(const fs::path &dir, int64_t changedSinceNs = 0);
+  // Makes a running scanDirectory() return early; safe from any thread
+  void cancelScan() { scanCancelled = true; }
+
+  // Also watches files matching these globs (see ActionRules::matches),
+  // whatever their extension. Set before scanDirectory().
+  void watchPatterns(std::vector<std::string> patterns) {
+    extraPatterns = std::move(patterns);
+  }
+
+  // Further trees indexed next to the one given to scanDirectory(), such as
+  // sibling checkouts. A directory reached through more than one root is
+  // indexed once. Set before scanDirectory() or followed by rescan().
+  void watchRoots(std::vector<std::string> dirs);
+
+  // Follows symlinks to files and directories, in and out of the tree.
+  // Loops end at the first directory seen again. Set before scanDirectory()
+  // or followed by rescan().
+  void followSymlinks(bool enabled) { followLinks = enabled; }
+
+  // Returns every path changed since the last call. Reads the notification
+  // backend when enabled; otherwise stats only the paths the adaptive poll
+  // schedule says are due.
+  std::vector<std::string> collectChanges();
+  int nextPollDelayMs() const;
+
+  // Re-walks the tree in one pass and returns every path added, changed
+  // or removed since the last look. Queued notifications are discarded,
+  // since the walk sees their result; for bursts such as branch switches.
+  std::vector<std::string> rescan();
+  // Reads and drops queued notifications. Returns false if there were none.
+  bool drainNotifications();
+
+  // Full sweep over every indexed file
+  std::vector<std::string> pollChanges();
   bool hasAnyFileChanged();
+
+  size_t fileCount() const { return fileTimestamps.size(); }
+  // When path joined the index (wall clock), 0 if the scan found it and
+  // it existed before the scan's watermark
+  int64_t addedNs(const std::string &path) const;
+  // With the fanotify backend, events carry the writing process; isOwn
+  // decides for each whether it is one of the caller's. Kept across
+  // moves of the monitor.
+  void attributeWriters(std::function<bool(pid_t)> isOwn) {
+    ownWriter = std::move(isOwn);
+  }
+  // Whether the last event for path came from a process attributeWriters()
+  // accepted; always false without fanotify
+  bool writtenByOwnProcess(const std::string &path) const;
+  std::vector<std::string> files() const;
+  // files() less those the scan found modified after its watermark, whose
+  // contents the build may not have seen
+  std::vector<std::string> settledFiles() const;
 };
 } // namespace livrn
@@ -0,0 +1,126 @@
+#include "poller.h"
+#include "../config.h"
+
+namespace livrn {
+
+namespace {
+std::string parentPath(const std::string &path) {
+  size_t slash = path.rfind('/');
+  return slash == std::string::npos ? std::string() : path.substr(0, slash);
+}
+} // namespace
+
+int64_t PollScheduler::intervalNs(bool directory, int64_t idleNs) {
+  const int64_t hot = Config::POLL_HOT_INTERVAL_MS * 1000000LL;
+  const int64_t cold = (directory ? Config::POLL_DIR_MAX_INTERVAL_MS
+                                  : Config::POLL_COLD_MAX_INTERVAL_MS) *
+                       1000000LL;
+
+  int64_t interval = idleNs / Config::POLL_DECAY_DIVISOR;
+  return std::clamp(interval, hot, cold);
+}
+
+PollScheduler::Id PollScheduler::add(const std::string &path, bool directory,
+                                     int64_t lastActivityNs, int64_t nowNs) {
+  Id existing = find(path);
+  if (existing != NONE) {
+    touch(existing, lastActivityNs, nowNs);
+    return existing;
+  }
+
+  Id id;
+  if (!freeIds.empty()) {
+    id = freeIds.back();
+    freeIds.pop_back();
+  } else {
+    id = static_cast<Id>(entries.size());
+    entries.emplace_back();
+  }
+
+  Entry &entry = entries[id];
+  entry.path = path;
+  entry.directory = directory;
+  entry.alive = true;
+  entry.lastActivityNs = lastActivityNs;
+  entry.stateNs = 0;
+  entry.children.clear();
+  entry.parent = find(parentPath(path));
+  if (entry.parent != NONE) {
+    entries[entry.parent].children.push_back(id);
+  }
+  index[path] = id;
+
+  reschedule(id, nowNs);
+  return id;
+}
+
+void PollScheduler::remove(Id id) {
+  Entry &entry = entries[id];
+  if (!entry.alive)
+    return;
+
+  if (entry.parent != NONE) {
+    auto &siblings = entries[entry.parent].children;
+    siblings.erase(std::remove(siblings.begin(), siblings.end(), id),
+                   siblings.end());
+  }
+  for (Id child : entry.children) {
+    entries[child].parent = NONE;
+  }
+
+  index.erase(entry.path);
+  entry.alive = false;
+  entry.generation++;
+  entry.path.clear();
+  entry.children.clear();
+  freeIds.push_back(id);
+}
+
+PollScheduler::Id PollScheduler::find(const std::string &path) const {
+  auto it = index.find(path);
+  return it == index.end() ? NONE : it->second;
+}
+
+void PollScheduler::touch(Id id, int64_t activityNs, int64_t nowNs) {
+  Entry &entry = entries[id];
+  if (activityNs <= entry.lastActivityNs)
+    return;
+
+  entry.lastActivityNs = activityNs;
+  int64_t due = nowNs + intervalNs(entry.directory, nowNs - activityNs);
+  if (due < entry.dueNs) {
+    schedule(id, due);
+  }
+}
+
+void PollScheduler::reschedule(Id id, int64_t nowNs) {
+  Entry &entry = entries[id];
+  schedule(id, nowNs + intervalNs(entry.directory,
+                                  nowNs - entry.lastActivityNs));
+}
+
+void PollScheduler::schedule(Id id, int64_t dueNs) {
+  Entry &entry = entries[id];
+  entry.generation++;
+  entry.dueNs = dueNs;
+  queue.push(Slot{dueNs, id, entry.generation});
+}
+
+void PollScheduler::takeDue(int64_t nowNs, std::vector<Id> &due) {
+  while (!queue.empty() && queue.top().dueNs <= nowNs) {
+    Slot slot = queue.top();
+    queue.pop();
+
+    // Skip slots superseded by a later schedule() or a removal
+    const Entry &entry = entries[slot.id];
+    if (entry.alive && entry.generation == slot.generation) {
+      due.push_back(slot.id);
+    }
+  }
+}
+
+int64_t PollScheduler::nextDueNs() const {
+  return queue.empty() ? INT64_MAX : queue.top().dueNs;
+}
+
+} // namespace livrn
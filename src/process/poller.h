@@ -0,0 +1,69 @@
+#pragma once
+#include "../liverun.h"
+#include <algorithm>
+#include <queue>
+
+namespace livrn {
+
+// Decides when each indexed path is next stat'ed when change notifications
+// are unavailable. A path's poll interval grows with the time since it was
+// last seen changing or being opened, so the handful of files under active
+// edit are polled quickly while the cold bulk of the tree is visited rarely.
+// Directories act as sentinels for creates, deletes and rename-over saves,
+// so their interval is capped lower than that of files.
+class PollScheduler {
+public:
+  using Id = uint32_t;
+  static constexpr Id NONE = UINT32_MAX;
+
+  Id add(const std::string &path, bool directory, int64_t lastActivityNs,
+         int64_t nowNs);
+  void remove(Id id);
+  Id find(const std::string &path) const;
+
+  // Records activity (a change, or an access newer than the last one) and
+  // pulls the next poll forward accordingly
+  void touch(Id id, int64_t activityNs, int64_t nowNs);
+  void reschedule(Id id, int64_t nowNs);
+
+  void takeDue(int64_t nowNs, std::vector<Id> &due);
+  int64_t nextDueNs() const;
+
+  const std::string &path(Id id) const { return entries[id].path; }
+  bool isDirectory(Id id) const { return entries[id].directory; }
+  const std::vector<Id> &children(Id id) const { return entries[id].children; }
+  int64_t &stateNs(Id id) { return entries[id].stateNs; }
+  size_t size() const { return index.size(); }
+
+  static int64_t intervalNs(bool directory, int64_t idleNs);
+
+private:
+  struct Entry {
+    std::string path;
+    Id parent = NONE;
+    bool directory = false;
+    bool alive = false;
+    uint32_t generation = 0;
+    int64_t lastActivityNs = 0;
+    int64_t dueNs = 0;
+    // Caller-owned extra state, e.g. a directory's last seen mtime
+    int64_t stateNs = 0;
+    std::vector<Id> children;
+  };
+
+  struct Slot {
+    int64_t dueNs;
+    Id id;
+    uint32_t generation;
+    bool operator>(const Slot &other) const { return dueNs > other.dueNs; }
+  };
+
+  std::vector<Entry> entries;
+  std::vector<Id> freeIds;
+  std::unordered_map<std::string, Id> index;
+  std::priority_queue<Slot, std::vector<Slot>, std::greater<Slot>> queue;
+
+  void schedule(Id id, int64_t dueNs);
+};
+
+} // namespace livrn
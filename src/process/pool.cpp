@@ -0,0 +1,37 @@
+#include "pool.h"
+
+namespace livrn {
+
+BuildPool::BuildPool(size_t slots) : slots(slots > 0 ? slots : 1) {}
+
+void BuildPool::acquire(const void *owner, std::function<void()> granted) {
+  if (inUse < slots) {
+    ++inUse;
+    granted();
+    return;
+  }
+  waiters.push_back(Waiter{owner, std::move(granted)});
+}
+
+void BuildPool::release() {
+  if (inUse == 0)
+    return;
+
+  if (waiters.empty()) {
+    --inUse;
+    return;
+  }
+
+  // Hand the slot straight to the next waiter
+  Waiter next = std::move(waiters.front());
+  waiters.pop_front();
+  next.granted();
+}
+
+void BuildPool::cancel(const void *owner) {
+  for (auto it = waiters.begin(); it != waiters.end();) {
+    it = it->owner == owner ? waiters.erase(it) : std::next(it);
+  }
+}
+
+} // namespace livrn
@@ -0,0 +1,37 @@
+#pragma once
+#include "../liverun.h"
+#include <deque>
+#include <functional>
+
+namespace livrn {
+
+// Caps how many build steps run at once across all sessions. Waiters are
+// granted slots in FIFO order so one busy service cannot starve the rest.
+class BuildPool {
+private:
+  struct Waiter {
+    const void *owner;
+    std::function<void()> granted;
+  };
+
+  size_t slots;
+  size_t inUse = 0;
+  std::deque<Waiter> waiters;
+
+public:
+  explicit BuildPool(size_t slots);
+
+  // Calls granted immediately if a slot is free, otherwise once one is
+  // released. owner identifies the request for cancel().
+  void acquire(const void *owner, std::function<void()> granted);
+  void release();
+  void cancel(const void *owner);
+  // Drops every waiter, so slots released during teardown start nothing
+  void cancelAll() { waiters.clear(); }
+
+  size_t capacity() const { return slots; }
+  size_t busy() const { return inUse; }
+  size_t queued() const { return waiters.size(); }
+};
+
+} // namespace livrn
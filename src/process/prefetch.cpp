@@ -0,0 +1,87 @@
+#include "prefetch.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace livrn {
+
+std::vector<std::string> PageCache::mappedFiles(pid_t pid) {
+  std::vector<std::string> files;
+  std::ifstream maps("/proc/" + std::to_string(pid) + "/maps");
+  std::unordered_set<std::string> seen;
+  std::string line;
+
+  // address perms offset dev inode [path]
+  while (std::getline(maps, line)) {
+    std::istringstream fields(line);
+    std::string address, perms, offset, device;
+    unsigned long inode = 0;
+    if (!(fields >> address >> perms >> offset >> device >> inode) ||
+        inode == 0)
+      continue;
+
+    size_t start = line.find('/');
+    if (start == std::string::npos)
+      continue;
+    std::string path = line.substr(start);
+    const std::string deleted = " (deleted)";
+    if (path.size() > deleted.size() &&
+        path.compare(path.size() - deleted.size(), deleted.size(),
+                     deleted) == 0)
+      continue;
+    if (path.compare(0, 5, "/dev/") == 0)
+      continue;
+
+    if (seen.insert(path).second)
+      files.push_back(path);
+  }
+  return files;
+}
+
+uint64_t PageCache::prefetch(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return 0;
+
+  // WILLNEED queues readahead of the whole file and returns without
+  // waiting for the reads, unlike readahead(2) on most kernels
+  struct stat st;
+  uint64_t bytes = 0;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+      posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED) == 0) {
+    bytes = static_cast<uint64_t>(st.st_size);
+  }
+  close(fd);
+  return bytes;
+}
+
+uint64_t PageCache::residentBytes(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return 0;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+    close(fd);
+    return 0;
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  void *map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return 0;
+
+  size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  std::vector<unsigned char> pages((size + page - 1) / page);
+  uint64_t resident = 0;
+  if (mincore(map, size, pages.data()) == 0) {
+    for (unsigned char flags : pages) {
+      if (flags & 1)
+        resident += page;
+    }
+  }
+  munmap(map, size);
+  return std::min<uint64_t>(resident, size);
+}
+
+} // namespace livrn
@@ -0,0 +1,23 @@
+#pragma once
+#include "../liverun.h"
+
+namespace livrn {
+
+// Pulls the files an app instance maps into the page cache before it
+// starts. Its startup then takes minor faults on cached pages instead of
+// major faults that wait for the disk.
+class PageCache {
+public:
+  // Files pid has mapped (its binary, shared libraries, locale archives),
+  // in order of first mapping. Devices and deleted files are left out.
+  static std::vector<std::string> mappedFiles(pid_t pid);
+
+  // Starts reading the whole of path in the background. Returns the
+  // bytes requested, 0 if path is not a readable regular file.
+  static uint64_t prefetch(const std::string &path);
+
+  // Bytes of path currently in the page cache
+  static uint64_t residentBytes(const std::string &path);
+};
+
+} // namespace livrn
@@ -0,0 +1,185 @@
+#include "sequence.h"
+#include "../logger.h"
+#include "../util/metrics.h"
+#include "../util/tracer.h"
+
+namespace livrn {
+
+BuildSequence::BuildSequence(EventLoop &loop,
+                             std::vector<PreparedCommand> buildSteps)
+    : loop(loop), compiler(processManager), steps(std::move(buildSteps)) {}
+
+BuildSequence::~BuildSequence() { kill(); }
+
+void BuildSequence::setJobserver(Jobserver *server) {
+  jobserver = server;
+  if (!jobserver)
+    return;
+  for (auto &step : steps) {
+    jobserver->exportTo(step);
+  }
+}
+
+void BuildSequence::run(std::function<void(Outcome)> finished) {
+  onFinished = std::move(finished);
+  active = true;
+  stopping = false;
+  restartPending = false;
+  currentStep = 0;
+  if (steps.empty()) {
+    finish(Outcome::Succeeded);
+    return;
+  }
+  runStep();
+}
+
+void BuildSequence::restart() {
+  if (active)
+    restartPending = true;
+}
+
+void BuildSequence::runStep() {
+  auto launch = [this]() {
+    waitingForToken = false;
+    if (restartPending) {
+      restartPending = false;
+      currentStep = 0;
+    }
+    launchStep();
+  };
+  // A pool slot first, then the step's jobserver token
+  auto takeToken = [this, launch]() {
+    waitingForSlot = false;
+    holdingSlot = buildPool != nullptr;
+    if (jobserver) {
+      waitingForToken = true;
+      jobserver->acquire(this, launch);
+    } else {
+      launch();
+    }
+  };
+
+  if (buildPool) {
+    waitingForSlot = true;
+    buildPool->acquire(this, takeToken);
+  } else {
+    takeToken();
+  }
+}
+
+void BuildSequence::launchStep() {
+  const PreparedCommand &step = steps[currentStep];
+  stepStartNs = Tracer::nowNs();
+  stepPid = compiler.compileAsync(step);
+  if (stepPid <= 0 || !loop.watchChild(stepPid, [this](int status) {
+        onStepExited(status);
+      })) {
+    livrn::Logger::error(label, "Failed to run ", step.toString());
+    if (stepPid > 0) {
+      ::kill(stepPid, SIGKILL);
+      waitpid(stepPid, nullptr, 0);
+    }
+    stepPid = -1;
+    onStepExited(-1);
+    return;
+  }
+  if (attribution)
+    attribution->begin(stepPid, WriteAttribution::Kind::Build);
+}
+
+void BuildSequence::onStepExited(int status) {
+  if (attribution && stepPid > 0)
+    attribution->end(stepPid);
+  stepPid = -1;
+  releaseSlot();
+  Tracer::instance().complete("build", "compile step", stepStartNs,
+                              Tracer::nowNs(), "status", status);
+
+  if (stopping) {
+    finish(Outcome::Stopped);
+    return;
+  }
+  if (restartPending) {
+    restartPending = false;
+    livrn::Logger::info(label, "Sources changed during build, rebuilding");
+    currentStep = 0;
+    runStep();
+    return;
+  }
+
+  bool success = status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  if (!success) {
+    Metrics::instance().add(Counter::BuildFailures);
+    livrn::Logger::error(label, "Build step failed: ",
+                         steps[currentStep].toString());
+    finish(Outcome::Failed);
+    return;
+  }
+
+  if (++currentStep < steps.size()) {
+    runStep();
+  } else {
+    finish(Outcome::Succeeded);
+  }
+}
+
+void BuildSequence::releaseSlot() {
+  if (jobserver)
+    jobserver->release();
+  if (holdingSlot)
+    buildPool->release();
+  holdingSlot = false;
+}
+
+void BuildSequence::cancelWait() {
+  if (waitingForSlot) {
+    buildPool->cancel(this);
+    waitingForSlot = false;
+  }
+  if (waitingForToken) {
+    jobserver->cancel(this);
+    waitingForToken = false;
+    if (holdingSlot)
+      buildPool->release();
+    holdingSlot = false;
+  }
+}
+
+void BuildSequence::stop() {
+  if (!active)
+    return;
+  stopping = true;
+  if (stepPid > 0) {
+    ::kill(stepPid, SIGTERM);
+    return;
+  }
+  cancelWait();
+  finish(Outcome::Stopped);
+}
+
+void BuildSequence::kill() {
+  cancelWait();
+  if (stepPid > 0) {
+    loop.unwatchChild(stepPid);
+    ::kill(stepPid, SIGKILL);
+    waitpid(stepPid, nullptr, 0);
+    if (attribution)
+      attribution->end(stepPid);
+    stepPid = -1;
+    releaseSlot();
+  }
+  active = false;
+  onFinished = nullptr;
+}
+
+void BuildSequence::finish(Outcome outcome) {
+  active = false;
+  stopping = false;
+  restartPending = false;
+  auto finished = std::move(onFinished);
+  onFinished = nullptr;
+  if (finished)
+    finished(outcome);
+}
+
+} // namespace livrn
@@ -0,0 +1,82 @@
+#pragma once
+#include "../event/loop.h"
+#include "../liverun.h"
+#include "attribution.h"
+#include "builder.h"
+#include "jobserver.h"
+#include "manager.h"
+#include "pool.h"
+
+namespace livrn {
+
+// Runs build steps one after another, each a child process watched on the
+// loop. A step first waits for a pool slot, if there is a pool, and then
+// for a jobserver token, if there is a jobserver; both are given back when
+// it exits. While a step runs, attribution counts it as a build.
+class BuildSequence {
+public:
+  enum class Outcome { Succeeded, Failed, Stopped };
+
+  BuildSequence(EventLoop &loop, std::vector<PreparedCommand> steps);
+  ~BuildSequence();
+
+  BuildSequence(const BuildSequence &) = delete;
+  BuildSequence &operator=(const BuildSequence &) = delete;
+
+  // Prefixes log lines, e.g. "[api] "
+  void setLabel(std::string prefix) { label = std::move(prefix); }
+  void setBuildPool(BuildPool *pool) { buildPool = pool; }
+  // Adds the jobserver to every step's MAKEFLAGS
+  void setJobserver(Jobserver *server);
+  void setWriteAttribution(WriteAttribution *tracker) {
+    attribution = tracker;
+  }
+
+  bool empty() const { return steps.empty(); }
+  bool isRunning() const { return active; }
+  pid_t pid() const { return stepPid; }
+
+  // Runs the steps from the first. finished is called once: Succeeded
+  // after the last step exits with 0, Failed when one does not or cannot
+  // be started, Stopped after stop().
+  void run(std::function<void(Outcome)> finished);
+  // The running step is left to finish; the steps then start over from
+  // the first, whatever its status
+  void restart();
+  // Gives up a pending slot or token and sends SIGTERM to the running
+  // step. finished gets Stopped once nothing is left running.
+  void stop();
+  // Kills and reaps the running step without calling finished
+  void kill();
+
+private:
+  EventLoop &loop;
+  ProcessManager processManager;
+  ProcessBuilder compiler;
+  std::vector<PreparedCommand> steps;
+  BuildPool *buildPool = nullptr;
+  Jobserver *jobserver = nullptr;
+  WriteAttribution *attribution = nullptr;
+  std::string label;
+
+  bool active = false;
+  bool restartPending = false;
+  bool stopping = false;
+  size_t currentStep = 0;
+  pid_t stepPid = -1;
+  uint64_t stepStartNs = 0;
+  bool waitingForSlot = false;
+  bool waitingForToken = false;
+  // A pool slot is held; a cancel while waiting for a token returns it
+  bool holdingSlot = false;
+  std::function<void(Outcome)> onFinished;
+
+  void runStep();
+  void launchStep();
+  void onStepExited(int status);
+  void releaseSlot();
+  void cancelWait();
+  void finish(Outcome outcome);
+};
+
+} // namespace livrn
@@ -1,39 +1,810 @@
 #include "reloader.h"
+#include "daemon/socket.h"
 #include "logger.h"
-#include <chrono>
-#include <cstdlib>
-#include <iostream>
-#include <thread>
+#include "util/metrics.h"
+#include "util/tracer.h"
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/eventfd.h>
 
 namespace livrn {
 
-Reloader::Reloader() : compiler(processManager) {}
+Reloader::Reloader()
+    : pollTimer(loop, [this]() { pollFiles(); }),
+      debounceTimer(loop, [this]() { dispatchChanges(); }),
+      settleTimer(loop, [this]() { onTreeSettled(); }),
+      stepBuilder(processManager),
+      replayTimer(loop, [this]() { onReplayTimer(); }) {
+  monitor.attributeWriters([this](pid_t pid) {
+    return ignoreOwnWrites && attribution.ownsProcess(pid);
+  });
+}
 
-Reloader::~Reloader() { processManager.cleanup(); }
+Reloader::~Reloader() {
+  if (scanThread.joinable()) {
+    monitor.cancelScan();
+    scanThread.join();
+  }
+  if (scanDoneFd >= 0)
+    close(scanDoneFd);
+  cancelBuildWaiters();
+  sessions.clear();
+  testRunner.reset();
+  replicaSet.reset();
+  processManager.cleanup();
+}
 
-void Reloader::initialize() { monitor.scanDirectory("."); }
+void Reloader::initialize() {
+  // The scan below covers the roots and links as set
+  reindex = false;
+  // Anything modified from here on may be missed by the first build, so
+  // the scan reports it as changed. Taken before notifications are on, so
+  // a probe file on a network filesystem is never seen as a change.
+  int64_t startedNs = ProcessMonitor::filesystemNowNs(".");
 
-int Reloader::runInterpretMode(const std::string &interpreter,
-                               const std::string &script) {
-  try {
-    if (!processManager.startInterpreter(interpreter, script)) {
-      livrn::Logger::warn("Failed to start interpreter");
-      return 1;
+  bool notifications = ProcessMonitor::supportsNotifications(".");
+  for (const auto &dir : watchRoots) {
+    notifications = notifications && ProcessMonitor::supportsNotifications(dir);
+  }
+  if (notifications) {
+    monitor.enableNotifications();
+  } else {
+    livrn::Logger::info("Network or FUSE filesystem, using adaptive polling");
+  }
+
+  scanDoneFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (scanDoneFd >= 0) {
+    try {
+      scanThread = std::thread([this, startedNs]() {
+        monitor.scanDirectory(".", startedNs);
+        // Files changed since startup have no reference version yet, so
+        // the first report of them always counts
+        if (skipNoopEdits)
+          fingerprints.index(monitor.settledFiles());
+        uint64_t done = 1;
+        if (write(scanDoneFd, &done, sizeof(done)) < 0)
+          livrn::Logger::error("Cannot signal the end of the scan");
+      });
+      return;
+    } catch (const std::system_error &e) {
+      livrn::Logger::debug("Scanning in the foreground: ", e.what());
+    }
+  }
+  monitor.scanDirectory(".");
+  if (skipNoopEdits) {
+    fingerprints.index(monitor.files());
+    fingerprintsReady = true;
+  }
+}
+
+void Reloader::finishScan() {
+  loop.remove(scanDoneFd);
+  scanThread.join();
+  fingerprintsReady = skipNoopEdits;
+  livrn::Logger::debug("Indexed ", monitor.fileCount(), " files");
+  if (shuttingDown)
+    return;
+
+  watchFiles();
+  // Changes made while the scan ran
+  onFilesChanged(sweepChanges());
+}
+
+void Reloader::adoptMonitor(ProcessMonitor &&warm) {
+  monitor = std::move(warm);
+}
+
+void Reloader::setWatchRoots(std::vector<std::string> dirs) {
+  reindex = reindex || !dirs.empty();
+  watchRoots = dirs;
+  monitor.watchRoots(std::move(dirs));
+}
+
+void Reloader::setFollowSymlinks(bool enabled) {
+  reindex = reindex || enabled;
+  monitor.followSymlinks(enabled);
+}
+
+void Reloader::setActionRules(ActionRules rules) {
+  actionRules = std::move(rules);
+  monitor.watchPatterns(actionRules.watchedPatterns());
+}
+
+bool Reloader::setJobserver(size_t tokens, Jobserver::Style style) {
+  jobserver = std::make_unique<Jobserver>(loop);
+  if (!jobserver->start(tokens, style)) {
+    jobserver.reset();
+    return false;
+  }
+  livrn::Logger::info("Sharing ", tokens, " build jobs through ",
+                      jobserver->path());
+  return true;
+}
+
+void Reloader::setReplay(std::vector<RecordedBatch> batches, double speed) {
+  replayBatches = std::move(batches);
+  replaySpeed = speed;
+  replaying = true;
+}
+
+void Reloader::startReplay() {
+  // The report is read off the pipeline's own counters
+  Metrics::instance().enable();
+  if (testRunner)
+    testRunner->start({}, [this](int code) { loop.stop(code); });
+
+  std::ostringstream pace;
+  if (replaySpeed > 0) {
+    pace << " at " << replaySpeed << "x speed";
+  } else {
+    pace << " back to back";
+  }
+  livrn::Logger::info("Replaying ", replayBatches.size(), " change batches",
+                      pace.str());
+  replayStartNs = Tracer::nowNs();
+  replayNext = 0;
+  scheduleReplay();
+}
+
+void Reloader::scheduleReplay() {
+  if (replayNext == replayBatches.size()) {
+    // Wait for the last reload to play out before reporting
+    replayTimer.start(Config::REPLAY_IDLE_CHECK_MS,
+                      Config::REPLAY_IDLE_CHECK_MS);
+    return;
+  }
+
+  // Due times count from the start, so timer slack does not add up
+  int64_t dueNs = 0;
+  if (replaySpeed > 0) {
+    dueNs = static_cast<int64_t>(
+        static_cast<double>(replayBatches[replayNext].offsetUs) * 1000 /
+        replaySpeed);
+  }
+  int64_t elapsedNs = static_cast<int64_t>(Tracer::nowNs() - replayStartNs);
+  replayTimer.start(static_cast<int>(std::max<int64_t>(
+      0, (dueNs - elapsedNs) / 1000000)));
+}
+
+void Reloader::onReplayTimer() {
+  if (replayNext < replayBatches.size()) {
+    onFilesChanged(replayBatches[replayNext++].paths);
+    scheduleReplay();
+    return;
+  }
+  if (!pipelineIdle())
+    return;
+
+  replayTimer.cancel();
+  reportReplay();
+  beginShutdown(0);
+}
+
+bool Reloader::pipelineIdle() const {
+  if (!pendingChanges.empty() || debounceTimer.isArmed() || stepActive())
+    return false;
+  for (const auto &managed : sessions) {
+    SessionState state = managed.session->currentState();
+    if (state != SessionState::Running && state != SessionState::Idle)
+      return false;
+  }
+  if (replicaSet && replicaSet->isRolling())
+    return false;
+  return !testRunner || testRunner->isIdle();
+}
+
+void Reloader::reportReplay() {
+  size_t files = 0;
+  for (const auto &batch : replayBatches) {
+    files += batch.paths.size();
+  }
+  uint64_t elapsedMs = (Tracer::nowNs() - replayStartNs) / 1000000;
+
+  Metrics &metrics = Metrics::instance();
+  const Histogram &reloads = metrics.histogram(Phase::Reload);
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  int64_t cpuMs = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000 +
+                  (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+
+  livrn::Logger::info("Replayed ", replayBatches.size(), " batches (", files,
+                      " files) in ", elapsedMs, " ms");
+  livrn::Logger::info(
+      "  ", metrics.value(Counter::Reloads), " reloads dispatched, ",
+      reloads.count(), " completed",
+      reloads.count() > 0
+          ? " (mean " +
+                std::to_string(reloads.sumNs() / reloads.count() / 1000000) +
+                " ms)"
+          : "");
+  livrn::Logger::info("  ", metrics.value(Counter::OwnWrites),
+                      " own writes ignored, ",
+                      metrics.value(Counter::NoopEdits),
+                      " comment or whitespace edits skipped, ",
+                      metrics.value(Counter::BuildFailures),
+                      " failed builds, ", metrics.value(Counter::AppExits),
+                      " app exits");
+  livrn::Logger::info("  liverun itself used ", cpuMs, " ms of CPU");
+}
+
+std::vector<std::string> Reloader::sweepChanges() {
+  uint64_t startNs = Tracer::nowNs();
+  std::vector<std::string> changes = monitor.collectChanges();
+
+  Metrics &metrics = Metrics::instance();
+  metrics.observe(Phase::PollSweep, Tracer::nowNs() - startNs);
+  metrics.setWatchedFiles(monitor.fileCount());
+  return changes;
+}
+
+void Reloader::pollFiles() {
+  // Nothing is polled until the tree settles; the rescan covers it
+  if (bulkActive)
+    return;
+
+  onFilesChanged(sweepChanges());
+
+  // Sleep until the next path is due rather than on a fixed cadence
+  if (monitor.notificationFd() < 0)
+    pollTimer.start(monitor.nextPollDelayMs());
+}
+
+void Reloader::onNotification() {
+  if (!bulkActive) {
+    onFilesChanged(sweepChanges());
+    return;
+  }
+  // Every further event only pushes the settle point back
+  if (monitor.drainNotifications())
+    settleTimer.start(Config::BULK_SETTLE_MS);
+}
+
+void Reloader::onFilesChanged(std::vector<std::string> changes) {
+  if (changes.empty())
+    return;
+
+  recorder.record(changes);
+
+  // A replayed burst has no tree behind it to rescan
+  std::string burst = replaying ? "" : bulkDetector.observe(changes.size());
+  if (!burst.empty()) {
+    beginBulkChange(burst);
+    return;
+  }
+
+  pendingChanges.insert(pendingChanges.end(),
+                        std::make_move_iterator(changes.begin()),
+                        std::make_move_iterator(changes.end()));
+
+  // Editors often save in several writes; wait for the burst to settle
+  debounceTimer.start(Config::DEBOUNCE_MS);
+}
+
+void Reloader::beginBulkChange(const std::string &reason) {
+  livrn::Logger::info("Bulk change detected (", reason,
+                      "), pausing reloads until the tree settles");
+  bulkActive = true;
+  bulkStartNs = Tracer::nowNs();
+  // The rescan afterwards reports these again, along with the rest
+  pendingChanges.clear();
+  debounceTimer.cancel();
+  pollTimer.cancel();
+  settleTimer.start(Config::BULK_SETTLE_MS);
+}
+
+void Reloader::onTreeSettled() {
+  if (bulkDetector.gitBusy()) {
+    settleTimer.start(Config::BULK_SETTLE_MS);
+    return;
+  }
+
+  bulkActive = false;
+  std::vector<std::string> changes = monitor.rescan();
+  bulkDetector.reset();
+  Metrics::instance().setWatchedFiles(monitor.fileCount());
+  Tracer::instance().complete("monitor", "bulk change", bulkStartNs,
+                              Tracer::nowNs(), "files",
+                              static_cast<int64_t>(changes.size()));
+  livrn::Logger::info("Tree settled after ",
+                      (Tracer::nowNs() - bulkStartNs) / 1000000, " ms, ",
+                      changes.size(), " file(s) changed");
+
+  if (monitor.notificationFd() < 0)
+    pollTimer.start(monitor.nextPollDelayMs());
+  if (changes.empty())
+    return;
+
+  // One reload for the whole burst, without another debounce
+  recorder.record(changes);
+  pendingChanges = std::move(changes);
+  dispatchChanges();
+}
+
+std::string Reloader::watchPrefix(const std::string &path) {
+  // Monitor paths are relative to the scan root ("./src/main.cpp"), or to
+  // the working directory for roots outside it ("../shared/lib.py")
+  fs::path relative = fs::path(path);
+  if (relative.is_absolute()) {
+    std::error_code ec;
+    relative = fs::relative(relative, fs::current_path(ec), ec);
+    if (ec)
+      relative = fs::path(path);
+  }
+  std::string prefix = relative.lexically_normal().string();
+  while (prefix.size() > 1 && prefix.back() == '/')
+    prefix.pop_back();
+  if (prefix.empty() || prefix == ".")
+    return ".";
+  if (prefix == ".." || prefix.compare(0, 3, "../") == 0 || prefix[0] == '/')
+    return prefix;
+  return "./" + prefix;
+}
+
+bool Reloader::isWatchedBy(const ManagedSession &managed,
+                           const std::string &path) {
+  if (managed.watchPrefixes.empty())
+    return true;
+
+  for (const auto &prefix : managed.watchPrefixes) {
+    if (path.compare(0, prefix.size(), prefix) == 0 &&
+        (path.size() == prefix.size() || path[prefix.size()] == '/')) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Reloader::dropOwnWrites() {
+  size_t before = pendingChanges.size();
+  auto own = std::remove_if(pendingChanges.begin(), pendingChanges.end(),
+                            [this](const std::string &path) {
+                              if (!attribution.isOwnWrite(
+                                      path, monitor.addedNs(path),
+                                      monitor.writtenByOwnProcess(path)))
+                                return false;
+                              livrn::Logger::debug("Ignoring own write to ",
+                                                   path);
+                              return true;
+                            });
+  pendingChanges.erase(own, pendingChanges.end());
+
+  size_t dropped = before - pendingChanges.size();
+  if (dropped > 0) {
+    livrn::Logger::info("Ignored ", dropped,
+                        " file(s) written by the build or application");
+    Metrics::instance().add(Counter::OwnWrites, dropped);
+  }
+}
+
+void Reloader::dropNoopEdits() {
+  size_t before = pendingChanges.size();
+  auto noop = std::remove_if(pendingChanges.begin(), pendingChanges.end(),
+                             [this](const std::string &path) {
+                               if (!fingerprints.unchanged(path))
+                                 return false;
+                               livrn::Logger::debug(
+                                   "Only comments or whitespace changed in ",
+                                   path);
+                               return true;
+                             });
+  pendingChanges.erase(noop, pendingChanges.end());
+
+  size_t dropped = before - pendingChanges.size();
+  if (dropped > 0) {
+    livrn::Logger::info("Skipped ", dropped,
+                        " file(s) with only comment or whitespace edits");
+    Metrics::instance().add(Counter::NoopEdits, dropped);
+  }
+}
+
+void Reloader::dispatchChanges() {
+  if (ignoreOwnWrites)
+    dropOwnWrites();
+  // A batch arriving while rule steps run follows once they are done
+  if (pendingChanges.empty() || shuttingDown || stepActive())
+    return;
+  // Checking records the new fingerprint, so a batch held back above must
+  // not be checked twice
+  if (fingerprintsReady) {
+    dropNoopEdits();
+    if (pendingChanges.empty())
+      return;
+  }
+
+  Tracer::instance().instant("reload", "change batch", "files",
+                             static_cast<int64_t>(pendingChanges.size()));
+  Metrics::instance().add(Counter::ChangedFiles, pendingChanges.size());
+  std::vector<std::string> changes = std::move(pendingChanges);
+  pendingChanges.clear();
+
+  if (!actionRules.empty()) {
+    ChangePlan plan = actionRules.plan(changes);
+    if (plan.steps.empty() && plan.paths.size() < changes.size()) {
+      livrn::Logger::debug("Ignoring ", changes.size() - plan.paths.size(),
+                           " change(s) by rule");
+    }
+    if (!plan.steps.empty()) {
+      queuedSteps.assign(plan.steps.begin(), plan.steps.end());
+      afterSteps = std::move(plan.paths);
+      runNextStep();
+      return;
+    }
+    changes = std::move(plan.paths);
+  }
+  applyChanges(changes);
+}
+
+void Reloader::applyChanges(const std::vector<std::string> &changes) {
+  if (changes.empty())
+    return;
+
+  for (auto &managed : sessions) {
+    std::vector<std::string> affected;
+    for (const auto &path : changes) {
+      if (isWatchedBy(managed, path))
+        affected.push_back(path);
     }
+    if (affected.empty())
+      continue;
 
-    while (true) {
-      std::this_thread::sleep_for(
-          std::chrono::milliseconds(Config::POLL_INTERVAL_MS));
+    ChangePlan plan;
+    plan.action = ChangeAction::Rebuild;
+    if (!actionRules.empty())
+      plan = actionRules.plan(affected);
 
-      if (monitor.hasAnyFileChanged()) {
-        livrn::Logger::info("Change detected. Restarting...");
-        processManager.killChild();
-        processManager.startInterpreter(interpreter, script);
+    std::string prefix = managed.name.empty() ? "" : "[" + managed.name + "] ";
+    switch (plan.action) {
+    case ChangeAction::Ignore:
+    case ChangeAction::Step:
+      break;
+    case ChangeAction::Signal:
+      for (int signo : plan.signals) {
+        managed.session->signal(signo);
       }
+      break;
+    case ChangeAction::Restart:
+      livrn::Logger::info(prefix, "Change detected. Restarting without a "
+                                  "rebuild...");
+      Metrics::instance().add(Counter::Reloads);
+      managed.session->restart();
+      break;
+    case ChangeAction::Rebuild:
+      // The session says whether it restarts or reloads in process
+      Metrics::instance().add(Counter::Reloads);
+      managed.session->reload(affected);
+      break;
+    }
+  }
+  if (!replicaSet && !testRunner)
+    return;
+
+  ChangePlan plan;
+  plan.action = ChangeAction::Rebuild;
+  plan.paths = changes;
+  if (!actionRules.empty())
+    plan = actionRules.plan(changes);
+
+  if (replicaSet) {
+    switch (plan.action) {
+    case ChangeAction::Ignore:
+    case ChangeAction::Step:
+      break;
+    case ChangeAction::Signal:
+      for (int signo : plan.signals) {
+        replicaSet->signal(signo);
+      }
+      break;
+    case ChangeAction::Restart:
+      livrn::Logger::info("Change detected. Rolling out without a "
+                          "rebuild...");
+      Metrics::instance().add(Counter::Reloads);
+      replicaSet->restart();
+      break;
+    case ChangeAction::Rebuild:
+      livrn::Logger::info("Change detected. Rolling out...");
+      Metrics::instance().add(Counter::Reloads);
+      replicaSet->reload();
+      break;
+    }
+  }
+  // Tests have no running app to signal or restart; they run again on the
+  // files as they are, and build first only for changes that need it
+  if (testRunner && !plan.paths.empty())
+    testRunner->run(plan.paths, plan.action == ChangeAction::Rebuild);
+}
+
+bool Reloader::prepareRuleSteps() {
+  // Parsed and authorised once, like every other step
+  for (const auto &rule : actionRules.all()) {
+    if (rule.action != ChangeAction::Step || ruleSteps.count(rule.command))
+      continue;
+    PreparedCommand step;
+    if (!processManager.prepareCommand(rule.command, step)) {
+      livrn::Logger::error("Invalid step command: ", rule.command);
+      return false;
+    }
+    if (jobserver)
+      jobserver->exportTo(step);
+    ruleSteps.emplace(rule.command, std::move(step));
+  }
+  return true;
+}
+
+void Reloader::runNextStep() {
+  if (queuedSteps.empty()) {
+    std::vector<std::string> changes = std::move(afterSteps);
+    afterSteps.clear();
+    applyChanges(changes);
+    // Whatever changed while the steps ran
+    dispatchChanges();
+    return;
+  }
+
+  std::string command = queuedSteps.front();
+  queuedSteps.pop_front();
+  if (!jobserver) {
+    launchRuleStep(command);
+    return;
+  }
+  stepWaitingForToken = true;
+  jobserver->acquire(this, [this, command]() {
+    stepWaitingForToken = false;
+    launchRuleStep(command);
+  });
+}
+
+void Reloader::launchRuleStep(const std::string &command) {
+  const PreparedCommand &step = ruleSteps.at(command);
+  livrn::Logger::info("Running ", step.toString());
+  stepStartNs = Tracer::nowNs();
+  stepPid = stepBuilder.compileAsync(step);
+  if (stepPid <= 0 || !loop.watchChild(stepPid, [this](int status) {
+        onStepExited(status);
+      })) {
+    livrn::Logger::error("Failed to run ", step.toString());
+    if (stepPid > 0) {
+      ::kill(stepPid, SIGKILL);
+      waitpid(stepPid, nullptr, 0);
+    }
+    stepPid = -1;
+    onStepExited(-1);
+    return;
+  }
+  // Generated files are the step's own writes, not edits
+  attribution.begin(stepPid, WriteAttribution::Kind::Build);
+}
+
+void Reloader::onStepExited(int status) {
+  if (stepPid > 0)
+    attribution.end(stepPid);
+  stepPid = -1;
+  if (jobserver)
+    jobserver->release();
+  Tracer::instance().complete("build", "rule step", stepStartNs,
+                              Tracer::nowNs(), "status", status);
+  if (shuttingDown)
+    return;
+
+  if (status < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    Metrics::instance().add(Counter::BuildFailures);
+    livrn::Logger::error("Step failed, keeping the running version");
+    queuedSteps.clear();
+    afterSteps.clear();
+    dispatchChanges();
+    return;
+  }
+  runNextStep();
+}
+
+void Reloader::onSignal(int signo) {
+  if (shuttingDown) {
+    livrn::Logger::warn("Received signal ", signo, " again, killing now");
+    cancelBuildWaiters();
+    for (auto &managed : sessions) {
+      managed.session->kill();
+    }
+    if (testRunner)
+      testRunner->kill();
+    if (replicaSet)
+      replicaSet->kill();
+    loop.stop(signo);
+    return;
+  }
+
+  livrn::Logger::debug("Received signal ", signo, ", cleaning up...");
+  beginShutdown(signo);
+}
+
+void Reloader::beginShutdown(int code) {
+  shuttingDown = true;
+  shutdownCode = code;
+  replayTimer.cancel();
+  // A slot a stopping build gives back must not start another one
+  cancelBuildWaiters();
+  if (stepPid > 0)
+    ::kill(stepPid, SIGTERM);
+  if (stepWaitingForToken) {
+    jobserver->cancel(this);
+    stepWaitingForToken = false;
+  }
+  for (auto &managed : sessions) {
+    managed.session->shutdown(code);
+  }
+  if (testRunner) {
+    // Tests only start once the index is built
+    if (scanThread.joinable()) {
+      loop.stop(code);
+    } else {
+      testRunner->shutdown(code);
+    }
+  }
+  if (replicaSet)
+    replicaSet->shutdown(code);
+}
+
+void Reloader::cancelBuildWaiters() {
+  if (buildPool)
+    buildPool->cancelAll();
+  if (jobserver)
+    jobserver->cancelAll();
+}
+
+void Reloader::onControlMessage() {
+  DaemonSocket::Message message;
+  if (!DaemonSocket::receive(controlFd, message)) {
+    // Nobody is left to show the output to
+    livrn::Logger::debug("Client detached");
+    loop.remove(controlFd);
+    onSignal(SIGHUP);
+    return;
+  }
+
+  if (message[0] == "stop" || message[0] == "kill")
+    onSignal(SIGINT);
+}
+
+void Reloader::onSessionFinished(size_t index, int code) {
+  if (shuttingDown) {
+    if (++finishedSessions == sessions.size())
+      loop.stop(shutdownCode);
+    return;
+  }
+
+  // A lone session that cannot start ends liverun; a supervised service
+  // just waits for the next change
+  if (sessions.size() == 1) {
+    loop.stop(code);
+    return;
+  }
+  livrn::Logger::error("[", sessions[index].name,
+                       "] Failed to start, waiting for changes");
+}
+
+void Reloader::addSession(const std::string &name,
+                          std::vector<PreparedCommand> steps,
+                          PreparedCommand app,
+                          const std::vector<std::string> &watchPaths) {
+  ManagedSession managed;
+  managed.name = name;
+  for (const auto &path : watchPaths) {
+    managed.watchPrefixes.push_back(watchPrefix(path));
+  }
+
+  managed.session =
+      std::make_unique<Session>(loop, std::move(steps), std::move(app));
+  managed.session->setName(name);
+  managed.session->setBuildPool(buildPool.get());
+  managed.session->setJobserver(jobserver.get());
+  managed.session->setWriteAttribution(&attribution);
+  if (profileIntervalMs >= 0)
+    managed.session->enableProfiling(profileIntervalMs);
+  managed.session->setPrefetch(prefetch);
+  sessions.push_back(std::move(managed));
+}
+
+int Reloader::runSessions() {
+  if (!prepareRuleSteps())
+    return 1;
+
+  loop.onSignal(SIGINT, [this](int signo) { onSignal(signo); });
+  loop.onSignal(SIGTERM, [this](int signo) { onSignal(signo); });
+  if (controlFd >= 0)
+    loop.add(controlFd, EPOLLIN, [this](uint32_t) { onControlMessage(); });
+
+  std::unique_ptr<MetricsExporter> exporter;
+  if (!metricsTarget.empty()) {
+    exporter = std::make_unique<MetricsExporter>(loop, metricsTarget);
+    if (!exporter->start())
+      exporter.reset();
+  }
+
+  // Sessions start right away; watching waits for the index
+  if (replaying) {
+    startReplay();
+  } else if (scanThread.joinable()) {
+    loop.add(scanDoneFd, EPOLLIN, [this](uint32_t) { finishScan(); });
+  } else {
+    if (reindex) {
+      monitor.rescan();
+      reindex = false;
+      livrn::Logger::debug("Indexed ", monitor.fileCount(), " files");
+    }
+    // An adopted index comes without fingerprints
+    if (skipNoopEdits && !fingerprintsReady) {
+      fingerprints.index(monitor.files());
+      fingerprintsReady = true;
     }
+    watchFiles();
+  }
+
+  for (size_t i = 0; i < sessions.size(); ++i) {
+    sessions[i].session->start(
+        [this, i](int code) { onSessionFinished(i, code); });
+  }
+  if (replicaSet)
+    replicaSet->start([this](int code) { loop.stop(code); });
+  int code = loop.run();
+
+  if (scanThread.joinable()) {
+    loop.remove(scanDoneFd);
+    monitor.cancelScan();
+    scanThread.join();
+  }
+  if (stepPid > 0) {
+    loop.unwatchChild(stepPid);
+    ::kill(stepPid, SIGKILL);
+    waitpid(stepPid, nullptr, 0);
+    attribution.end(stepPid);
+    stepPid = -1;
+    if (jobserver)
+      jobserver->release();
+  }
+  loop.remove(monitor.notificationFd());
+  if (controlFd >= 0)
+    loop.remove(controlFd);
+  pollTimer.cancel();
+  debounceTimer.cancel();
+  settleTimer.cancel();
+  if (exporter)
+    exporter->stop();
+  return code;
+}
+
+void Reloader::watchFiles() {
+  Metrics::instance().setWatchedFiles(monitor.fileCount());
+  bulkDetector.initialize();
+
+  int notifyFd = monitor.notificationFd();
+  if (notifyFd >= 0) {
+    loop.add(notifyFd, EPOLLIN, [this, notifyFd](uint32_t) {
+      onNotification();
+
+      // The backend may have degraded to polling while reading events
+      if (monitor.notificationFd() < 0) {
+        loop.remove(notifyFd);
+        pollTimer.start(monitor.nextPollDelayMs());
+      }
+    });
+  } else {
+    pollTimer.start(monitor.nextPollDelayMs());
+  }
+
+  // Tests are found through the index
+  if (testRunner) {
+    testRunner->start(monitor.files(),
+                      [this](int code) { loop.stop(code); });
+  }
+}
+
+int Reloader::runInterpretMode(const std::string &interpreter,
+                               const std::string &script) {
+  try {
+    addSession("", {}, PreparedCommand({interpreter, script}));
+    if (hotReload)
+      sessions.back().session->enableControlChannel();
+    return runSessions();
   } catch (const std::exception &e) {
     livrn::Logger::error("Expection in interpreter mode: ", e.what());
-    processManager.cleanup();
     return 1;
   }
 }
@@ -41,34 +812,16 @@ int Reloader::runInterpretMode(const std::string &interpreter,
 int Reloader::runCompileMode(const std::string &binary,
                              const std::string &compileCmd) {
   try {
-    if (!compiler.compileSync(compileCmd)) {
-      livrn::Logger::error("Initial compilation failed");
-      return 1;
-    }
-
-    if (!processManager.startBinary(binary)) {
-      livrn::Logger::error("Failed to start binary");
+    std::vector<PreparedCommand> steps(1);
+    if (!processManager.prepareCommand(compileCmd, steps[0])) {
+      livrn::Logger::error("Invalid compile command: ", compileCmd);
       return 1;
     }
 
-    while (true) {
-      std::this_thread::sleep_for(
-          std::chrono::milliseconds(Config::POLL_INTERVAL_MS));
-
-      if (monitor.hasAnyFileChanged()) {
-        livrn::Logger::info("Source change detected");
-        processManager.killChild();
-
-        if (compiler.compileSync(compileCmd)) {
-          processManager.startBinary(binary);
-        } else {
-          livrn::Logger::error("Compilation failed");
-        }
-      }
-    }
+    addSession("", std::move(steps), PreparedCommand({binary}));
+    return runSessions();
   } catch (const std::exception &e) {
     livrn::Logger::error("Exception in compile mode: ", e.what());
-    processManager.cleanup();
     return 1;
   }
 }
@@ -79,50 +832,144 @@ int Reloader::runCommandMode(const std::vector<std::string> &commands) {
     return 1;
   }
 
-  const size_t lastIdx = commands.size() - 1;
-  const std::string &runCmd = commands[lastIdx];
-
   try {
-    for (size_t i = 0; i < lastIdx; ++i) {
-      livrn::Logger::info("Running setup: ", commands[i]);
-      if (!compiler.compileSync(commands[i])) {
-        livrn::Logger::error("Setup command failed: ", commands[i]);
+    // Parse and authorise every step once; reloads only reuse the blocks
+    std::vector<PreparedCommand> steps(commands.size());
+    for (size_t i = 0; i < commands.size(); ++i) {
+      if (!processManager.prepareCommand(commands[i], steps[i])) {
+        livrn::Logger::error("Invalid command: ", commands[i]);
         return 1;
       }
     }
 
-    livrn::Logger::info("Starting application... ", runCmd);
-    if (!processManager.startCommand(runCmd)) {
-      livrn::Logger::error("Failed to start application");
-      return 1;
-    }
+    PreparedCommand app = std::move(steps.back());
+    steps.pop_back();
+    addSession("", std::move(steps), std::move(app));
+    return runSessions();
+  } catch (const std::exception &e) {
+    livrn::Logger::error("Exception in custom mode: ", e.what());
+    return 1;
+  }
+}
 
-    while (true) {
-      std::this_thread::sleep_for(
-          std::chrono::milliseconds(Config::POLL_INTERVAL_MS));
+int Reloader::runSupervisorMode(const std::string &servicesFile) {
+  ServiceConfig config;
+  if (!ServiceFile::load(servicesFile, config))
+    return 1;
 
-      bool failCompile = false;
-      if (monitor.hasAnyFileChanged()) {
-        livrn::Logger::info("Change detected. Restarting...");
-        processManager.killChild();
+  try {
+    size_t jobs = config.jobs;
+    if (jobs == 0)
+      jobs = std::max(1u, std::thread::hardware_concurrency() / 2);
+    buildPool = std::make_unique<BuildPool>(jobs);
 
-        for (size_t i = 0; i < lastIdx; ++i) {
-          if (!compiler.compileSync(commands[i])) {
-            livrn::Logger::error("Setup command failed: ", commands[i]);
-            failCompile = true;
-            break;
-          }
+    for (const auto &service : config.services) {
+      std::vector<PreparedCommand> steps(service.buildCommands.size());
+      for (size_t i = 0; i < steps.size(); ++i) {
+        if (!processManager.prepareCommand(service.buildCommands[i],
+                                           steps[i])) {
+          livrn::Logger::error("[", service.name, "] Invalid command: ",
+                               service.buildCommands[i]);
+          return 1;
         }
+        steps[i].setWorkingDirectory(service.workingDirectory);
+      }
+
+      PreparedCommand app;
+      if (!processManager.prepareCommand(service.runCommand, app)) {
+        livrn::Logger::error("[", service.name, "] Invalid command: ",
+                             service.runCommand);
+        return 1;
+      }
+      app.setWorkingDirectory(service.workingDirectory);
+
+      addSession(service.name, std::move(steps), std::move(app),
+                 service.watchPaths);
+    }
 
-        if (failCompile)
-          continue;
+    livrn::Logger::info("Supervising ", sessions.size(), " services, ", jobs,
+                        " parallel builds");
+    return runSessions();
+  } catch (const std::exception &e) {
+    livrn::Logger::error("Exception in supervisor mode: ", e.what());
+    return 1;
+  }
+}
 
-        processManager.startCommand(runCmd);
+int Reloader::runTestMode(const std::vector<std::string> &commands) {
+  try {
+    std::vector<PreparedCommand> steps(commands.size());
+    for (size_t i = 0; i < commands.size(); ++i) {
+      if (!processManager.prepareCommand(commands[i], steps[i])) {
+        livrn::Logger::error("Invalid command: ", commands[i]);
+        return 1;
       }
     }
+    // The test command is expanded once per test, from its words
+    std::vector<std::string> testCommand = steps.back().arguments();
+    steps.pop_back();
+
+    size_t workers = jobs;
+    if (workers == 0)
+      workers = std::max(1u, std::thread::hardware_concurrency());
+    buildPool = std::make_unique<BuildPool>(workers);
+
+    testRunner = std::make_unique<TestRunner>(loop, std::move(steps),
+                                              std::move(testCommand),
+                                              *buildPool);
+    testRunner->setWriteAttribution(&attribution);
+    testRunner->setJobserver(jobserver.get());
+    return runSessions();
   } catch (const std::exception &e) {
-    livrn::Logger::error("Exception in custom mode: ", e.what());
-    processManager.cleanup();
+    livrn::Logger::error("Exception in test mode: ", e.what());
+    return 1;
+  }
+}
+
+int Reloader::runReplicateMode(const ReplicaSet::Options &options,
+                               const std::vector<std::string> &commands) {
+  try {
+    std::vector<PreparedCommand> steps(commands.size());
+    for (size_t i = 0; i < commands.size(); ++i) {
+      if (!processManager.prepareCommand(commands[i], steps[i])) {
+        livrn::Logger::error("Invalid command: ", commands[i]);
+        return 1;
+      }
+    }
+    // Every replica gets its own environment, so each is built from words
+    std::vector<std::string> app = steps.back().arguments();
+    steps.pop_back();
+
+    replicaSet = std::make_unique<ReplicaSet>(loop, std::move(steps),
+                                              std::move(app), options);
+    replicaSet->setWriteAttribution(&attribution);
+    replicaSet->setJobserver(jobserver.get());
+    for (size_t i = 0; i < replicaSet->size(); ++i) {
+      if (profileIntervalMs >= 0)
+        replicaSet->replica(i).enableProfiling(profileIntervalMs);
+      replicaSet->replica(i).setPrefetch(prefetch);
+    }
+    return runSessions();
+  } catch (const std::exception &e) {
+    livrn::Logger::error("Exception in replicate mode: ", e.what());
+    return 1;
+  }
+}
+
+int Reloader::runSwapMode(const std::string &host, const std::string &library,
+                          const std::string &buildCmd) {
+  try {
+    std::vector<PreparedCommand> steps(1);
+    if (!processManager.prepareCommand(buildCmd, steps[0])) {
+      livrn::Logger::error("Invalid build command: ", buildCmd);
+      return 1;
+    }
+
+    addSession("", std::move(steps), PreparedCommand({host}));
+    sessions.back().session->setSwapLibrary(library);
+    return runSessions();
+  } catch (const std::exception &e) {
+    livrn::Logger::error("Exception in swap mode: ", e.what());
     return 1;
   }
 }
@@ -1,27 +1,227 @@
 #pragma once
+#include "event/exporter.h"
+#include "event/loop.h"
 #include "liverun.h"
-#include "process/builder.h"
-#include "process/manager.h"
+#include "process/bulk.h"
+#include "process/jobserver.h"
 #include "process/monitor.h"
+#include "process/pool.h"
+#include "replicaset.h"
+#include "session.h"
+#include "testrunner.h"
+#include "util/fingerprint.h"
+#include "util/recording.h"
+#include "util/rules.h"
+#include "util/services.h"
+#include <deque>
+#include <memory>
 
 namespace livrn {
 
 class Reloader {
 private:
+  struct ManagedSession {
+    std::string name;
+    // Changes outside these prefixes are ignored; empty means everything
+    std::vector<std::string> watchPrefixes;
+    std::unique_ptr<Session> session;
+  };
+
+  EventLoop loop;
   ProcessMonitor monitor;
   ProcessManager processManager;
-  ProcessBuilder compiler;
+  std::unique_ptr<BuildPool> buildPool;
+  // Outlives the sessions, which hand their tokens back on destruction
+  std::unique_ptr<Jobserver> jobserver;
+  WriteAttribution attribution;
+  std::vector<ManagedSession> sessions;
+  std::unique_ptr<TestRunner> testRunner;
+  std::unique_ptr<ReplicaSet> replicaSet;
+
+  // The initial scan runs here while the first build and launch proceed;
+  // scanDoneFd becomes readable once it is done
+  std::thread scanThread;
+  int scanDoneFd = -1;
+
+  Timer pollTimer;
+  Timer debounceTimer;
+
+  // Branch switches and other bursts pause reloads until the tree has
+  // been quiet for BULK_SETTLE_MS, then rescan and reload once
+  BulkChangeDetector bulkDetector;
+  Timer settleTimer;
+  bool bulkActive = false;
+  uint64_t bulkStartNs = 0;
+
+  // Changes map to the cheapest action their rules allow; step rules run
+  // their commands first and hold later batches back until they are done
+  ActionRules actionRules;
+  ProcessBuilder stepBuilder;
+  std::unordered_map<std::string, PreparedCommand> ruleSteps;
+  std::deque<std::string> queuedSteps;
+  std::vector<std::string> afterSteps;
+  pid_t stepPid = -1;
+  bool stepWaitingForToken = false;
+  uint64_t stepStartNs = 0;
+
+  // --record writes every batch the pipeline receives; --replay feeds a
+  // recording to it in place of the monitor
+  ChangeRecorder recorder;
+  std::vector<RecordedBatch> replayBatches;
+  size_t replayNext = 0;
+  double replaySpeed = 1;
+  bool replaying = false;
+  uint64_t replayStartNs = 0;
+  Timer replayTimer;
+
+  // With skipNoopEdits, a change that leaves a source file's fingerprint
+  // as it was is dropped. The scan thread records the fingerprints; they
+  // are only read once fingerprintsReady.
+  SourceFingerprints fingerprints;
+  bool skipNoopEdits = false;
+  bool fingerprintsReady = false;
+
+  // Roots and symlink following set on an adopted index, which was
+  // scanned without them, call for a rescan before watching
+  std::vector<std::string> watchRoots;
+  bool reindex = false;
+
+  std::vector<std::string> pendingChanges;
+  std::string metricsTarget;
+  int controlFd = -1;
+  bool hotReload = false;
+  bool ignoreOwnWrites = true;
+  size_t jobs = 0;
+  int profileIntervalMs = -1;
+  bool prefetch = true;
+  bool shuttingDown = false;
+  int shutdownCode = 0;
+  size_t finishedSessions = 0;
+
+  void finishScan();
+  void watchFiles();
+  std::vector<std::string> sweepChanges();
+  void onFilesChanged(std::vector<std::string> changes);
+  void onNotification();
+  void beginBulkChange(const std::string &reason);
+  void onTreeSettled();
+  void pollFiles();
+  void dispatchChanges();
+  void applyChanges(const std::vector<std::string> &changes);
+  bool prepareRuleSteps();
+  void runNextStep();
+  void launchRuleStep(const std::string &command);
+  bool stepActive() const { return stepPid > 0 || stepWaitingForToken; }
+  void onStepExited(int status);
+  void dropOwnWrites();
+  void dropNoopEdits();
+  void startReplay();
+  void scheduleReplay();
+  void onReplayTimer();
+  bool pipelineIdle() const;
+  void reportReplay();
+  void onSignal(int signo);
+  void beginShutdown(int code);
+  void cancelBuildWaiters();
+  void onControlMessage();
+  void onSessionFinished(size_t index, int code);
+
+  void addSession(const std::string &name, std::vector<PreparedCommand> steps,
+                  PreparedCommand app,
+                  const std::vector<std::string> &watchPaths = {});
+  int runSessions();
+
+  static bool isWatchedBy(const ManagedSession &managed,
+                          const std::string &path);
 
 public:
   Reloader();
   ~Reloader();
 
+  // The prefix of monitor paths below a service's watch path, which may be
+  // relative or absolute: "src/" and "$PWD/src" both become "./src"
+  static std::string watchPrefix(const std::string &path);
+
+  // Enables notifications and starts indexing the working directory in
+  // the background; modes start their app without waiting for it
   void initialize();
 
+  // Takes over an index that is already scanned and watched, in place of
+  // initialize()
+  void adoptMonitor(ProcessMonitor &&warm);
+
+  // Attached sessions are stopped by their client rather than by a signal.
+  // The socket is not owned; it is only read while a mode runs.
+  void setControlSocket(int fd) { controlFd = fd; }
+
+  // Interpreted apps that speak the control protocol reload changed
+  // modules in place instead of restarting
+  void setHotReload(bool enabled) { hotReload = enabled; }
+
+  // By default changes written by liverun's own builds and apps are
+  // ignored (see WriteAttribution); false reloads on them too
+  void setIgnoreOwnWrites(bool enabled) { ignoreOwnWrites = enabled; }
+
+  // Changes to C/C++, Go, Rust, JS/TS and Python sources that only touch
+  // comments or whitespace do not reload (see SourceFingerprints). Set
+  // before initialize(), so the scan records the fingerprints.
+  void setSkipNoopEdits(bool enabled) { skipNoopEdits = enabled; }
+
+  // Also watches these directories, next to the working directory (see
+  // ProcessMonitor::watchRoots). Set before initialize().
+  void setWatchRoots(std::vector<std::string> dirs);
+  // Follows symlinks while indexing (see ProcessMonitor::followSymlinks).
+  // Set before initialize().
+  void setFollowSymlinks(bool enabled);
+
+  // Files changed within BULK_WINDOW_MS that count as a bulk change; 0
+  // leaves detection to git's own markers
+  void setBulkThreshold(size_t files) { bulkDetector.setThreshold(files); }
+
+  // Per-path actions in place of a rebuild on every change. Set before
+  // initialize(), so the scan indexes the files the rules name.
+  void setActionRules(ActionRules rules);
+
+  // Appends every change batch to path as it is observed
+  bool recordChanges(const std::string &path) { return recorder.open(path); }
+  // Feeds batches to the pipeline in place of watching files, speed times
+  // faster than recorded (0: back to back). Once the last batch has been
+  // handled it reports what the pipeline did and stops. Replaces
+  // initialize().
+  void setReplay(std::vector<RecordedBatch> batches, double speed);
+
+  // Counts each app instance with PerfCounters (see
+  // Session::enableProfiling); -1 turns it off
+  void setProfiling(int intervalMs) { profileIntervalMs = intervalMs; }
+
+  // Reads each app's binary and libraries ahead of its start (see
+  // Session::setPrefetch); on by default
+  void setPrefetch(bool enabled) { prefetch = enabled; }
+
+  // Runs a jobserver with tokens tokens (see Jobserver) that every build
+  // step in the modes started afterwards shares
+  bool setJobserver(size_t tokens,
+                    Jobserver::Style style = Jobserver::Style::Pipe);
+
+  // Parallel workers for test mode; 0 uses every core
+  void setJobs(size_t count) { jobs = count; }
+
+  // Publishes metrics to a textfile or "unix:<socket>" while a mode runs
+  void setMetricsTarget(const std::string &target) { metricsTarget = target; }
+
   int runInterpretMode(const std::string &interpreter,
                        const std::string &script);
   int runCompileMode(const std::string &binary, const std::string &compileCmd);
   int runCommandMode(const std::vector<std::string> &commands);
+  int runSupervisorMode(const std::string &servicesFile);
+  // The last command runs one test; any before it build once per batch
+  int runTestMode(const std::vector<std::string> &commands);
+  // Runs options.count copies of the last command; any before it build
+  // once per change, followed by a rolling restart
+  int runReplicateMode(const ReplicaSet::Options &options,
+                       const std::vector<std::string> &commands);
+  int runSwapMode(const std::string &host, const std::string &library,
+                  const std::string &buildCmd);
 };
 
 } // namespace livrn
@@ -0,0 +1,353 @@
+#include "replicaset.h"
+#include "logger.h"
+#include "util/tracer.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+namespace livrn {
+namespace {
+
+bool connects(int family, const sockaddr *addr, socklen_t length) {
+  int fd = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return false;
+
+  bool connected = connect(fd, addr, length) == 0;
+  if (!connected && errno == EINPROGRESS) {
+    pollfd pfd = {fd, POLLOUT, 0};
+    int error = 0;
+    socklen_t size = sizeof(error);
+    connected = poll(&pfd, 1, Config::REPLICA_PROBE_INTERVAL_MS) == 1 &&
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &size) == 0 &&
+                error == 0;
+  }
+  close(fd);
+  return connected;
+}
+
+// True once something listens on port on either loopback address
+bool acceptsConnections(int port) {
+  sockaddr_in v4{};
+  v4.sin_family = AF_INET;
+  v4.sin_port = htons(static_cast<uint16_t>(port));
+  v4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connects(AF_INET, reinterpret_cast<sockaddr *>(&v4), sizeof(v4)))
+    return true;
+
+  sockaddr_in6 v6{};
+  v6.sin6_family = AF_INET6;
+  v6.sin6_port = htons(static_cast<uint16_t>(port));
+  v6.sin6_addr = in6addr_loopback;
+  return connects(AF_INET6, reinterpret_cast<sockaddr *>(&v6), sizeof(v6));
+}
+
+} // namespace
+
+ReplicaSet::ReplicaSet(EventLoop &loop, std::vector<PreparedCommand> steps,
+                       std::vector<std::string> appCommand, Options opts)
+    : loop(loop), build(loop, std::move(steps)), options(opts),
+      probeTimer(loop, [this]() { probe(); }) {
+  unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+
+  for (size_t i = 0; i < options.count; ++i) {
+    PreparedCommand app(appCommand);
+    app.setEnvironment("LIVERUN_REPLICA", std::to_string(i));
+    app.setEnvironment("LIVERUN_REPLICAS", std::to_string(options.count));
+
+    Replica replica;
+    if (options.basePort > 0) {
+      replica.port = options.basePort + static_cast<int>(i);
+      app.setEnvironment("PORT", std::to_string(replica.port));
+    }
+    if (options.pinCpus)
+      app.pinToCpu(static_cast<int>(i % cores));
+
+    replica.session = std::make_unique<Session>(
+        loop, std::vector<PreparedCommand>{}, std::move(app));
+    replica.session->setName("replica " + std::to_string(i));
+    replicas.push_back(std::move(replica));
+  }
+}
+
+ReplicaSet::~ReplicaSet() { kill(); }
+
+void ReplicaSet::setWriteAttribution(WriteAttribution *tracker) {
+  build.setWriteAttribution(tracker);
+  for (auto &replica : replicas) {
+    replica.session->setWriteAttribution(tracker);
+  }
+}
+
+void ReplicaSet::start(std::function<void(int)> finished) {
+  onFinished = std::move(finished);
+  if (build.empty()) {
+    startReplicas();
+    return;
+  }
+  beginBuild();
+}
+
+void ReplicaSet::reload() {
+  if (shuttingDown)
+    return;
+
+  if (building || rolling) {
+    // Replicas not restarted yet would only get the outdated build; the
+    // next rollout covers them after a fresh one
+    reloadPending = true;
+    rolloutQueue.clear();
+    return;
+  }
+  beginBuild();
+}
+
+void ReplicaSet::restart() {
+  if (shuttingDown || !started)
+    return;
+
+  // The build's own rollout restarts every replica anyway
+  if (building)
+    return;
+  if (rolling) {
+    restartPending = true;
+    return;
+  }
+  beginRollout();
+}
+
+void ReplicaSet::signal(int signo) {
+  for (auto &replica : replicas) {
+    replica.session->signal(signo);
+  }
+}
+
+void ReplicaSet::beginBuild() {
+  building = true;
+  reloadPending = false;
+  build.run([this](BuildSequence::Outcome outcome) {
+    onBuildFinished(outcome);
+  });
+}
+
+void ReplicaSet::onBuildFinished(BuildSequence::Outcome outcome) {
+  bool success = outcome == BuildSequence::Outcome::Succeeded;
+  building = false;
+
+  if (shuttingDown) {
+    if (!started || finishedReplicas == replicas.size())
+      finish(shutdownCode);
+    return;
+  }
+  if (!started) {
+    if (success) {
+      startReplicas();
+    } else {
+      finish(1);
+    }
+    return;
+  }
+  if (reloadPending) {
+    livrn::Logger::info("Sources changed during build, rebuilding");
+    beginBuild();
+    return;
+  }
+  if (!success) {
+    livrn::Logger::warn("Keeping ", replicas.size(),
+                        " replicas on the previous version");
+    return;
+  }
+  beginRollout();
+}
+
+void ReplicaSet::startReplicas() {
+  started = true;
+  livrn::Logger::info("Starting ", replicas.size(), " replicas");
+  for (size_t i = 0; i < replicas.size(); ++i) {
+    replicas[i].session->start(
+        [this, i](int code) { onReplicaFinished(i, code); });
+  }
+}
+
+void ReplicaSet::onReplicaFinished(size_t index, int code) {
+  if (shuttingDown) {
+    if (++finishedReplicas == replicas.size() && !build.isRunning())
+      finish(shutdownCode);
+    return;
+  }
+
+  // Only the first launch of a replica ends its session; the others keep
+  // serving and it is retried on the next change
+  livrn::Logger::error("[replica ", index, "] Failed to start");
+  if (++failedReplicas == replicas.size())
+    finish(code);
+}
+
+void ReplicaSet::beginRollout() {
+  rolling = true;
+  restartPending = false;
+  rolloutStartNs = Tracer::nowNs();
+  for (size_t i = 0; i < replicas.size(); ++i) {
+    rolloutQueue.push_back(i);
+  }
+
+  livrn::Logger::info("Rolling restart across ", replicas.size(),
+                      " replicas, ", batchSize(), " at a time");
+  restartNext();
+}
+
+size_t ReplicaSet::batchSize() const {
+  // At least one replica keeps serving unless there is only one
+  return std::max<size_t>(1, std::min(options.batch, replicas.size() - 1));
+}
+
+void ReplicaSet::restartNext() {
+  size_t limit = batchSize();
+  size_t restarting = 0;
+  for (const auto &replica : replicas) {
+    if (replica.restarting)
+      ++restarting;
+  }
+
+  while (restarting < limit && !rolloutQueue.empty()) {
+    Replica &replica = replicas[rolloutQueue.front()];
+    rolloutQueue.pop_front();
+    replica.restarting = true;
+    replica.previousPid = replica.session->processes().childProcess();
+    replica.restartNs = Tracer::nowNs();
+    replica.runningSinceNs = 0;
+    replica.session->reload();
+    ++restarting;
+  }
+
+  if (restarting == 0) {
+    finishRollout();
+    return;
+  }
+  probeTimer.start(Config::REPLICA_PROBE_INTERVAL_MS,
+                   Config::REPLICA_PROBE_INTERVAL_MS);
+}
+
+void ReplicaSet::probe() {
+  bool waiting = false;
+  for (size_t i = 0; i < replicas.size(); ++i) {
+    Replica &replica = replicas[i];
+    if (!replica.restarting)
+      continue;
+
+    Session &session = *replica.session;
+    if (session.currentState() == SessionState::Idle) {
+      abortRollout(i, "exited");
+      return;
+    }
+
+    pid_t pid = session.processes().childProcess();
+    bool running = session.currentState() == SessionState::Running &&
+                   pid > 0 && pid != replica.previousPid;
+    if (running && replica.runningSinceNs == 0)
+      replica.runningSinceNs = Tracer::nowNs();
+
+    if (running && isReady(replica)) {
+      replica.restarting = false;
+      livrn::Logger::info("[replica ", i, "] Ready after ",
+                          Tracer::msSince(replica.restartNs), " ms");
+      Tracer::instance().complete("reload", "replica restart",
+                                  replica.restartNs, Tracer::nowNs(),
+                                  "replica", static_cast<int64_t>(i));
+      continue;
+    }
+    if (Tracer::msSince(replica.restartNs) > Config::REPLICA_READY_TIMEOUT_MS) {
+      abortRollout(i, "not ready within " +
+                          std::to_string(Config::REPLICA_READY_TIMEOUT_MS) +
+                          " ms");
+      return;
+    }
+    waiting = true;
+  }
+
+  if (!waiting)
+    restartNext();
+}
+
+bool ReplicaSet::isReady(Replica &replica) {
+  if (replica.port > 0)
+    return acceptsConnections(replica.port);
+  return Tracer::msSince(replica.runningSinceNs) >= options.settleMs;
+}
+
+void ReplicaSet::abortRollout(size_t index, const std::string &reason) {
+  probeTimer.cancel();
+  size_t untouched = rolloutQueue.size();
+  rolloutQueue.clear();
+  for (auto &replica : replicas) {
+    replica.restarting = false;
+  }
+  rolling = false;
+  restartPending = false;
+
+  livrn::Logger::error("[replica ", index, "] New version ", reason,
+                       ", stopping the rollout");
+  if (untouched > 0) {
+    livrn::Logger::warn(untouched, " replicas keep the previous version");
+  }
+  Tracer::instance().complete("reload", "rollout", rolloutStartNs,
+                              Tracer::nowNs(), "aborted", 1);
+
+  if (reloadPending)
+    beginBuild();
+}
+
+void ReplicaSet::finishRollout() {
+  probeTimer.cancel();
+  rolling = false;
+  Tracer::instance().complete("reload", "rollout", rolloutStartNs,
+                              Tracer::nowNs(), "aborted", 0);
+
+  if (reloadPending) {
+    livrn::Logger::info("Sources changed during the rollout, rebuilding");
+    beginBuild();
+    return;
+  }
+  livrn::Logger::info("All ", replicas.size(), " replicas restarted in ",
+                      Tracer::msSince(rolloutStartNs), " ms");
+  if (restartPending) {
+    livrn::Logger::info("Files changed during the rollout, restarting again");
+    beginRollout();
+  }
+}
+
+void ReplicaSet::shutdown(int code) {
+  shuttingDown = true;
+  shutdownCode = code;
+  probeTimer.cancel();
+  rolloutQueue.clear();
+
+  build.stop();
+  if (started) {
+    for (auto &replica : replicas) {
+      replica.session->shutdown(code);
+    }
+  } else if (!build.isRunning()) {
+    finish(code);
+  }
+}
+
+void ReplicaSet::kill() {
+  probeTimer.cancel();
+  build.kill();
+  for (auto &replica : replicas) {
+    replica.session->kill();
+  }
+}
+
+void ReplicaSet::finish(int code) {
+  if (!onFinished)
+    return;
+  auto finished = std::move(onFinished);
+  onFinished = nullptr;
+  finished(code);
+}
+
+} // namespace livrn
@@ -0,0 +1,106 @@
+#pragma once
+#include "event/loop.h"
+#include "liverun.h"
+#include "process/sequence.h"
+#include "session.h"
+#include <deque>
+#include <memory>
+
+namespace livrn {
+
+// Replicate mode: runs count instances of one app and rolls every rebuild
+// through them a batch at a time, so some replicas keep serving while the
+// rest restart. Each replica sees LIVERUN_REPLICA (its index) and
+// LIVERUN_REPLICAS, plus PORT when a base port is set.
+//
+// A restarted replica is ready once its port accepts connections or, without
+// a port, once it has stayed up for settleMs. The next batch waits for that;
+// a replica that exits or is not ready within REPLICA_READY_TIMEOUT_MS halts
+// the rollout and leaves the others on the previous version.
+class ReplicaSet {
+public:
+  struct Options {
+    size_t count = 1;
+    // Replicas restarted at once, capped so at least one keeps running
+    size_t batch = 1;
+    // Replica i gets PORT=basePort+i; 0 sets no port
+    int basePort = 0;
+    // Replica i runs on CPU i modulo the core count
+    bool pinCpus = false;
+    int settleMs = Config::REPLICA_SETTLE_MS;
+  };
+
+  ReplicaSet(EventLoop &loop, std::vector<PreparedCommand> buildSteps,
+             std::vector<std::string> appCommand, Options options);
+  ~ReplicaSet();
+
+  ReplicaSet(const ReplicaSet &) = delete;
+  ReplicaSet &operator=(const ReplicaSet &) = delete;
+
+  void setWriteAttribution(WriteAttribution *tracker);
+  void setJobserver(Jobserver *server) { build.setJobserver(server); }
+
+  // Builds once, then starts every replica. finished receives 1 if the
+  // build or every replica fails to start, or the code after shutdown().
+  void start(std::function<void(int)> finished);
+  void reload();
+  // Rolls a restart through the replicas without building first
+  void restart();
+  // Forwards signo to every running replica
+  void signal(int signo);
+  void shutdown(int code);
+  void kill();
+
+  size_t size() const { return replicas.size(); }
+  Session &replica(size_t index) { return *replicas[index].session; }
+  bool isRolling() const { return rolling; }
+
+private:
+  struct Replica {
+    std::unique_ptr<Session> session;
+    int port = 0;
+    bool restarting = false;
+    pid_t previousPid = -1;
+    uint64_t restartNs = 0;
+    uint64_t runningSinceNs = 0;
+  };
+
+  EventLoop &loop;
+  BuildSequence build;
+  Options options;
+  std::vector<Replica> replicas;
+
+  bool building = false;
+  bool rolling = false;
+  bool reloadPending = false;
+  // A restart arrived after the rollout under way had begun
+  bool restartPending = false;
+  bool started = false;
+  std::deque<size_t> rolloutQueue;
+  uint64_t rolloutStartNs = 0;
+  Timer probeTimer;
+
+  bool shuttingDown = false;
+  int shutdownCode = 0;
+  size_t finishedReplicas = 0;
+  size_t failedReplicas = 0;
+  std::function<void(int)> onFinished;
+
+  void beginBuild();
+  void onBuildFinished(BuildSequence::Outcome outcome);
+
+  void startReplicas();
+  void onReplicaFinished(size_t index, int code);
+
+  size_t batchSize() const;
+  void beginRollout();
+  void restartNext();
+  void probe();
+  bool isReady(Replica &replica);
+  void abortRollout(size_t index, const std::string &reason);
+  void finishRollout();
+
+  void finish(int code);
+};
+
+} // namespace livrn
@@ -0,0 +1,624 @@
+#include "session.h"
+#include "logger.h"
+#include "util/metrics.h"
+#include "util/tracer.h"
+
+namespace livrn {
+
+const char *toString(SessionState state) {
+  switch (state) {
+  case SessionState::Idle:
+    return "idle";
+  case SessionState::Building:
+    return "building";
+  case SessionState::Starting:
+    return "starting";
+  case SessionState::Running:
+    return "running";
+  case SessionState::Stopping:
+    return "stopping";
+  }
+  return "unknown";
+}
+
+Session::Session(EventLoop &loop, std::vector<PreparedCommand> steps,
+                 PreparedCommand app)
+    : loop(loop), build(loop, std::move(steps)), app(std::move(app)),
+      graceTimer(loop, [this]() { forceStop(); }),
+      startTimer(loop, [this]() { spawnApp(); }),
+      hotReloadTimer(loop, [this]() {
+        abandonHotReload("no reply within " +
+                         std::to_string(Config::HOT_RELOAD_TIMEOUT_MS) + " ms");
+      }),
+      profileTimer(loop, [this]() { reportInterval(); }) {}
+
+Session::~Session() {
+  kill();
+  if (!swapDirectory.empty()) {
+    std::error_code ec;
+    fs::remove_all(swapDirectory, ec);
+  }
+}
+
+void Session::setName(const std::string &name) {
+  label = name.empty() ? "" : "[" + name + "] ";
+  build.setLabel(label);
+}
+
+void Session::enableControlChannel() {
+  control = std::make_unique<ControlChannel>(
+      loop, [this](const ControlChannel::Message &message) {
+        onControlMessage(message);
+      });
+  app.setEnvironment("LIVERUN_CONTROL_FD", std::to_string(Config::CONTROL_FD));
+}
+
+void Session::setSwapLibrary(const std::string &library) {
+  swapLibrary = library;
+  enableControlChannel();
+}
+
+void Session::enableProfiling(int intervalMs) {
+  profiling = true;
+  profileIntervalMs = intervalMs;
+  processManager.enableCounters();
+}
+
+void Session::transition(SessionState next) {
+  state = next;
+  phaseStartNs = Tracer::nowNs();
+}
+
+void Session::finish(int code) {
+  transition(SessionState::Idle);
+  if (onFinished)
+    onFinished(code);
+}
+
+void Session::start(std::function<void(int)> finished) {
+  onFinished = std::move(finished);
+  initialRun = true;
+  beginBuild();
+}
+
+void Session::reload(const std::vector<std::string> &changed) {
+  if (shuttingDown)
+    return;
+
+  if (reloadStartNs == 0)
+    reloadStartNs = Tracer::nowNs();
+
+  // An in-process reload that fails later logs its own fallback
+  switch (state) {
+  case SessionState::Running:
+    if (!swapLibrary.empty() && appListening) {
+      livrn::Logger::info(label, "Change detected. Reloading in process...");
+      beginLiveBuild();
+    } else if (offerHotReload(changed)) {
+      livrn::Logger::info(label, "Change detected. Reloading in process...");
+    } else {
+      livrn::Logger::info(label, "Change detected. Restarting...");
+      beginStop();
+    }
+    break;
+  case SessionState::Idle:
+  case SessionState::Starting:
+    // Nothing is running yet to restart
+    livrn::Logger::info(label, build.empty() ? "Change detected. Starting..."
+                                             : "Change detected. Building...");
+    startTimer.cancel();
+    beginBuild();
+    break;
+  case SessionState::Building:
+    // Let the running step finish, then restart the build from the top
+    livrn::Logger::info(label, "Change detected. Building again...");
+    build.restart();
+    break;
+  case SessionState::Stopping:
+    // A rebuild follows the stop, even if only a restart was due
+    livrn::Logger::info(label, "Change detected. Restarting...");
+    restartWithoutBuild = false;
+    break;
+  }
+}
+
+void Session::restart() {
+  if (shuttingDown)
+    return;
+
+  switch (state) {
+  case SessionState::Running:
+    if (reloadStartNs == 0)
+      reloadStartNs = Tracer::nowNs();
+    restartWithoutBuild = true;
+    beginStop();
+    break;
+  case SessionState::Idle:
+    // The last build may have failed; only a full one brings the app back
+    reload();
+    break;
+  case SessionState::Building:
+  case SessionState::Starting:
+  case SessionState::Stopping:
+    // A fresh instance starts once this cycle is done
+    break;
+  }
+}
+
+void Session::signal(int signo) {
+  pid_t pid = processManager.childProcess();
+  if (shuttingDown || state != SessionState::Running || pid <= 0)
+    return;
+
+  livrn::Logger::info(label, "Sending ", strsignal(signo),
+                      " to application (PID: ", pid, ")");
+  Tracer::instance().instant("reload", "signal", "signal", signo);
+  ::kill(pid, signo);
+}
+
+void Session::shutdown(int code) {
+  shuttingDown = true;
+  shutdownCode = code;
+
+  switch (state) {
+  case SessionState::Running:
+    beginStop();
+    break;
+  case SessionState::Building:
+    // onBuildFinished() stops the app, if one is running, and finishes
+    build.stop();
+    break;
+  case SessionState::Stopping:
+    break;
+  case SessionState::Idle:
+  case SessionState::Starting:
+    startTimer.cancel();
+    finish(code);
+    break;
+  }
+}
+
+void Session::kill() {
+  graceTimer.cancel();
+  startTimer.cancel();
+  hotReloadTimer.cancel();
+  profileTimer.cancel();
+  if (control)
+    control->close();
+
+  build.kill();
+
+  pid_t pid = processManager.childProcess();
+  if (pid > 0) {
+    loop.unwatchChild(pid);
+    ::kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    if (attribution)
+      attribution->end(pid);
+    processManager.releaseChild();
+  }
+}
+
+void Session::beginStop() {
+  pid_t pid = processManager.childProcess();
+  transition(SessionState::Stopping);
+  hotReloadTimer.cancel();
+  hotReloadInFlight = false;
+  hotReloadBatch.clear();
+
+  // Its maps are gone once it exits
+  if (prefetching)
+    mappedFiles = PageCache::mappedFiles(pid);
+
+  livrn::Logger::warn(label, "Stopping application (PID: ", pid, ")...");
+  forceKilled = false;
+  if (::kill(pid, SIGTERM) != 0) {
+    // Already gone; the exit watch still fires and reaps it
+    return;
+  }
+  termSentNs = Tracer::nowNs();
+  graceTimer.start(Config::GRACEFUL_SHUTDOWN_TIMEOUT_MS);
+}
+
+void Session::endGracefulWait() {
+  if (termSentNs == 0)
+    return;
+  Tracer::instance().complete("process", "graceful wait", termSentNs,
+                              Tracer::nowNs());
+  termSentNs = 0;
+}
+
+void Session::forceStop() {
+  pid_t pid = processManager.childProcess();
+  if (state != SessionState::Stopping || pid <= 0)
+    return;
+
+  livrn::Logger::error(label, "Force killing application");
+  endGracefulWait();
+  forceKilled = true;
+  ::kill(pid, SIGKILL);
+}
+
+void Session::onAppExited(int status) {
+  if (profiling)
+    reportGeneration();
+  if (attribution)
+    attribution->end(processManager.childProcess());
+  processManager.releaseChild();
+  graceTimer.cancel();
+  hotReloadTimer.cancel();
+  hotReloadInFlight = false;
+  appListening = false;
+  if (control)
+    control->close();
+
+  if (state == SessionState::Stopping) {
+    endGracefulWait();
+    Tracer::instance().complete("process", "kill", phaseStartNs,
+                                Tracer::nowNs(), "status", status);
+    if (!forceKilled)
+      livrn::Logger::info(label, "application stopped gracefully");
+    stoppedAtNs = Tracer::nowNs();
+
+    if (shuttingDown) {
+      finish(shutdownCode);
+    } else if (restartWithoutBuild) {
+      // The library was just built; only the app needs to start over
+      restartWithoutBuild = false;
+      beginStart();
+    } else {
+      beginBuild();
+    }
+    return;
+  }
+
+  if (liveBuild) {
+    // The build carries on and starts a fresh instance when it is done
+    livrn::Logger::warn(label, "Application exited during rebuild");
+    liveBuild = false;
+    return;
+  }
+
+  Metrics::instance().add(Counter::AppExits);
+  if (WIFEXITED(status)) {
+    livrn::Logger::warn(label, "Application exited with status ",
+                        WEXITSTATUS(status), ", waiting for changes");
+  } else {
+    livrn::Logger::warn(label, "Application terminated, waiting for changes");
+  }
+  transition(SessionState::Idle);
+}
+
+void Session::beginBuild() {
+  if (build.empty()) {
+    beginStart();
+    return;
+  }
+
+  transition(SessionState::Building);
+  // Libraries rarely change with the build; reading them meanwhile takes
+  // the I/O off the restart
+  warmPageCache(false);
+  build.run([this](BuildSequence::Outcome outcome) {
+    onBuildFinished(outcome);
+  });
+}
+
+void Session::onBuildFinished(BuildSequence::Outcome outcome) {
+  if (shuttingDown) {
+    if (processManager.childProcess() > 0) {
+      beginStop();
+    } else {
+      finish(shutdownCode);
+    }
+    return;
+  }
+
+  if (outcome != BuildSequence::Outcome::Succeeded) {
+    reloadStartNs = 0;
+    if (liveBuild) {
+      livrn::Logger::warn(label, "Keeping the running version");
+      liveBuild = false;
+      transition(SessionState::Running);
+    } else if (initialRun) {
+      finish(1);
+    } else {
+      transition(SessionState::Idle);
+    }
+    return;
+  }
+
+  if (liveBuild) {
+    finishLiveBuild();
+  } else {
+    beginStart();
+  }
+}
+
+void Session::beginStart() {
+  transition(SessionState::Starting);
+  warmPageCache(true);
+
+  // The restart delay counts from the moment the old instance stopped, so a
+  // build that already took that long does not wait again
+  int64_t remainingMs = 0;
+  if (stoppedAtNs > 0) {
+    remainingMs = Config::SHUTDOWN_DELAY_MS - Tracer::msSince(stoppedAtNs);
+  }
+
+  if (remainingMs > 0) {
+    startTimer.start(static_cast<int>(remainingMs));
+  } else {
+    spawnApp();
+  }
+}
+
+void Session::spawnApp() {
+  if (stoppedAtNs > 0) {
+    Tracer::instance().complete("process", "shutdown delay", phaseStartNs,
+                                Tracer::nowNs());
+  }
+
+  livrn::Logger::info(label, "Starting application... ", app.toString());
+  if (!swapLibrary.empty()) {
+    std::string copy = copyLibrary();
+    if (!copy.empty())
+      app.setEnvironment("LIVERUN_LIBRARY", copy);
+    stat(app.arguments()[0].c_str(), &hostStat);
+  }
+  if (control) {
+    app.passDescriptor(control->open(), Config::CONTROL_FD);
+    appListening = false;
+  }
+  bool started = processManager.startProcess(app);
+  if (control)
+    control->releaseChildEnd();
+
+  if (!started) {
+    livrn::Logger::error(label, "Failed to start application");
+    reloadStartNs = 0;
+    if (initialRun) {
+      finish(1);
+    } else {
+      transition(SessionState::Idle);
+    }
+    return;
+  }
+
+  pid_t pid = processManager.childProcess();
+  loop.watchChild(pid, [this](int status) { onAppExited(status); });
+  if (attribution)
+    attribution->begin(pid, WriteAttribution::Kind::App);
+  pruneLibraryCopies();
+  transition(SessionState::Running);
+  initialRun = false;
+
+  if (profiling) {
+    ++generation;
+    windowStart = PerfSample();
+    if (profileIntervalMs > 0)
+      profileTimer.start(profileIntervalMs, profileIntervalMs);
+  }
+
+  if (reloadStartNs > 0) {
+    Tracer::instance().complete("reload", "reload", reloadStartNs,
+                                Tracer::nowNs());
+    reloadStartNs = 0;
+  }
+}
+
+void Session::warmPageCache(bool includeApp) {
+  if (!prefetching)
+    return;
+
+  std::error_code ec;
+  std::string program = app.programPath();
+  if (!program.empty())
+    program = fs::weakly_canonical(program, ec).string();
+
+  // Until the build is done, the binary is still the old one
+  std::vector<std::string> files;
+  if (includeApp && !program.empty())
+    files.push_back(program);
+  for (const auto &file : mappedFiles) {
+    if (file != program)
+      files.push_back(file);
+  }
+  if (files.empty())
+    return;
+
+  uint64_t startNs = Tracer::nowNs();
+  uint64_t bytes = 0;
+  for (const auto &file : files) {
+    bytes += PageCache::prefetch(file);
+  }
+  Metrics::instance().add(Counter::PrefetchedBytes, bytes);
+  Tracer::instance().complete("process", "prefetch", startNs, Tracer::nowNs(),
+                              "bytes", static_cast<int64_t>(bytes));
+  livrn::Logger::debug(label, "Reading ahead ", files.size(), " files, ",
+                       bytes / (1024 * 1024), " MB");
+}
+
+void Session::reportGeneration() {
+  profileTimer.cancel();
+  PerfCounters *counters = processManager.counters();
+  if (!counters || !counters->isAttached())
+    return;
+
+  // The counters stay readable after the exit and hold the final counts
+  PerfSample sample = counters->read();
+  counters->detach();
+  livrn::Logger::info(
+      label, "Generation ", generation, ": ",
+      PerfCounters::describe(sample, hasPreviousGeneration ? &previousGeneration
+                                                           : nullptr));
+  previousGeneration = sample;
+  hasPreviousGeneration = true;
+}
+
+void Session::reportInterval() {
+  PerfCounters *counters = processManager.counters();
+  if (state != SessionState::Running || !counters || !counters->isAttached())
+    return;
+
+  PerfSample total = counters->read();
+  PerfSample interval = total.since(windowStart);
+  windowStart = total;
+  livrn::Logger::info(
+      label, "Generation ", generation, ", last ", profileIntervalMs, " ms: ",
+      PerfCounters::describe(interval,
+                             hasPreviousWindow ? &previousWindow : nullptr));
+  previousWindow = interval;
+  hasPreviousWindow = true;
+}
+
+bool Session::offerHotReload(const std::vector<std::string> &changed) {
+  if (!appListening || changed.empty())
+    return false;
+
+  for (const auto &path : changed) {
+    hotReloadBatch.push_back(fs::absolute(path).lexically_normal().string());
+  }
+  // Changes arriving while the app is still reloading go out once it acks
+  return hotReloadInFlight || sendHotReload();
+}
+
+bool Session::sendHotReload() {
+  ControlChannel::Message message = {"reload"};
+  message.insert(message.end(), hotReloadBatch.begin(), hotReloadBatch.end());
+  hotReloadBatch.clear();
+
+  if (!control->send(message))
+    return false;
+  hotReloadInFlight = true;
+  hotReloadTimer.start(Config::HOT_RELOAD_TIMEOUT_MS);
+  return true;
+}
+
+void Session::onControlMessage(const ControlChannel::Message &message) {
+  if (message.empty()) {
+    appListening = false;
+    if (hotReloadInFlight)
+      abandonHotReload("control channel closed");
+    return;
+  }
+
+  const std::string &reply = message[0];
+  if (reply == "hello") {
+    appListening = true;
+    livrn::Logger::debug(label, "Application accepts in-process reloads");
+    return;
+  }
+  if (!hotReloadInFlight)
+    return;
+
+  if (reply == "ack") {
+    hotReloadInFlight = false;
+    hotReloadTimer.cancel();
+    if (swapLibrary.empty()) {
+      livrn::Logger::info(label, "Reloaded in place");
+    } else {
+      livrn::Logger::info(label, "Swapped in ", swapCopies.back());
+      pruneLibraryCopies();
+    }
+    if (reloadStartNs > 0) {
+      Tracer::instance().complete("reload", "in-process reload",
+                                  reloadStartNs, Tracer::nowNs());
+      reloadStartNs = 0;
+    }
+    if (!hotReloadBatch.empty() && !sendHotReload())
+      abandonHotReload("control channel closed");
+  } else if (reply.compare(0, 4, "nack") == 0) {
+    abandonHotReload(reply.size() > 5 ? reply.substr(5) : "rejected");
+  }
+}
+
+void Session::abandonHotReload(const std::string &reason) {
+  Metrics::instance().add(Counter::HotReloadFallbacks);
+  livrn::Logger::warn(label, "In-process reload failed (", reason,
+                      "), restarting");
+  hotReloadInFlight = false;
+  hotReloadTimer.cancel();
+  hotReloadBatch.clear();
+  if (state == SessionState::Running) {
+    restartWithoutBuild = !swapLibrary.empty();
+    beginStop();
+  }
+}
+
+void Session::beginLiveBuild() {
+  liveBuild = true;
+  if (build.empty()) {
+    finishLiveBuild();
+    return;
+  }
+  beginBuild();
+}
+
+void Session::finishLiveBuild() {
+  liveBuild = false;
+  transition(SessionState::Running);
+
+  if (hostChanged()) {
+    livrn::Logger::info(label, "Host binary changed, restarting");
+    restartWithoutBuild = true;
+    beginStop();
+    return;
+  }
+
+  std::string copy = copyLibrary();
+  if (copy.empty() || !control->send({"swap", copy})) {
+    abandonHotReload("cannot hand over " + swapLibrary);
+    return;
+  }
+  hotReloadInFlight = true;
+  hotReloadTimer.start(Config::HOT_RELOAD_TIMEOUT_MS);
+}
+
+bool Session::hostChanged() const {
+  struct stat st;
+  if (stat(app.arguments()[0].c_str(), &st) != 0)
+    return false;
+  return st.st_mtim.tv_sec != hostStat.st_mtim.tv_sec ||
+         st.st_mtim.tv_nsec != hostStat.st_mtim.tv_nsec ||
+         st.st_size != hostStat.st_size;
+}
+
+std::string Session::copyLibrary() {
+  // dlopen hands back the already loaded image for a known path, and
+  // rewriting a mapped library in place crashes the host, so every
+  // generation gets its own file
+  if (swapDirectory.empty()) {
+    std::string pattern = (fs::temp_directory_path() / "liverun-swap-XXXXXX");
+    if (!mkdtemp(pattern.data())) {
+      livrn::Logger::error(label, "mkdtemp failed: ", std::strerror(errno));
+      return "";
+    }
+    swapDirectory = pattern;
+  }
+
+  fs::path source(swapLibrary);
+  std::string target = swapDirectory + "/" + source.stem().string() + "." +
+                       std::to_string(++swapGeneration) +
+                       source.extension().string();
+  std::error_code ec;
+  fs::copy_file(source, target, fs::copy_options::overwrite_existing, ec);
+  if (ec) {
+    livrn::Logger::error(label, "Cannot copy ", swapLibrary, ": ",
+                         ec.message());
+    return "";
+  }
+  swapCopies.push_back(target);
+  return target;
+}
+
+void Session::pruneLibraryCopies() {
+  // Only the newest copy is still mapped once the app acknowledged it
+  while (swapCopies.size() > 1) {
+    std::error_code ec;
+    fs::remove(swapCopies.front(), ec);
+    swapCopies.erase(swapCopies.begin());
+  }
+}
+
+} // namespace livrn
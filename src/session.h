@@ -0,0 +1,157 @@
+#pragma once
+#include "event/loop.h"
+#include "liverun.h"
+#include "process/attribution.h"
+#include "process/control.h"
+#include "process/manager.h"
+#include "process/prefetch.h"
+#include "process/sequence.h"
+#include <sys/stat.h>
+
+namespace livrn {
+
+enum class SessionState { Idle, Building, Starting, Running, Stopping };
+
+const char *toString(SessionState state);
+
+// Drives one application through build and restart cycles on an EventLoop.
+// Every wait (build steps, graceful shutdown, restart delay) is an event
+// source on the loop, so transitions happen as soon as the event arrives.
+class Session {
+private:
+  EventLoop &loop;
+  ProcessManager processManager;
+  BuildSequence build;
+  PreparedCommand app;
+  WriteAttribution *attribution = nullptr;
+  std::string label;
+
+  SessionState state = SessionState::Idle;
+  bool initialRun = true;
+  bool shuttingDown = false;
+  bool forceKilled = false;
+  int shutdownCode = 0;
+
+  Timer graceTimer;
+  Timer startTimer;
+
+  // Set when the app may be offered changes in place of a restart
+  std::unique_ptr<ControlChannel> control;
+  Timer hotReloadTimer;
+  bool appListening = false;
+  bool hotReloadInFlight = false;
+  std::vector<std::string> hotReloadBatch;
+
+  // Set by enableProfiling(): each instance is counted and compared with
+  // the one before it, and with a period, each interval with the last
+  bool profiling = false;
+  int profileIntervalMs = 0;
+  unsigned generation = 0;
+  PerfSample previousGeneration;
+  bool hasPreviousGeneration = false;
+  PerfSample windowStart;
+  PerfSample previousWindow;
+  bool hasPreviousWindow = false;
+  Timer profileTimer;
+
+  // Swap mode: the library is rebuilt while the app keeps running, then
+  // handed over as a fresh versioned copy
+  std::string swapLibrary;
+  std::string swapDirectory;
+  std::vector<std::string> swapCopies;
+  unsigned swapGeneration = 0;
+  struct stat hostStat {};
+  bool liveBuild = false;
+  bool restartWithoutBuild = false;
+
+  // Files the last instance mapped, read ahead while the next one builds
+  // and again right before it starts
+  bool prefetching = true;
+  std::vector<std::string> mappedFiles;
+  void warmPageCache(bool includeApp);
+
+  uint64_t phaseStartNs = 0;
+  uint64_t reloadStartNs = 0;
+  uint64_t stoppedAtNs = 0;
+  // When SIGTERM went out, until the app exits or is force killed
+  uint64_t termSentNs = 0;
+  void endGracefulWait();
+
+  std::function<void(int)> onFinished;
+
+  void transition(SessionState next);
+  void finish(int code);
+
+  void beginStop();
+  void forceStop();
+  void onAppExited(int status);
+
+  void beginBuild();
+  void onBuildFinished(BuildSequence::Outcome outcome);
+
+  void beginStart();
+  void spawnApp();
+
+  bool offerHotReload(const std::vector<std::string> &changed);
+  bool sendHotReload();
+  void onControlMessage(const ControlChannel::Message &message);
+  void abandonHotReload(const std::string &reason);
+
+  void reportGeneration();
+  void reportInterval();
+
+  void beginLiveBuild();
+  void finishLiveBuild();
+  bool hostChanged() const;
+  std::string copyLibrary();
+  void pruneLibraryCopies();
+
+public:
+  Session(EventLoop &loop, std::vector<PreparedCommand> steps,
+          PreparedCommand app);
+  ~Session();
+
+  // Prefixes log lines with the service name
+  void setName(const std::string &name);
+  // Builds wait for a slot in pool before each step
+  void setBuildPool(BuildPool *pool) { build.setBuildPool(pool); }
+  void setJobserver(Jobserver *server) { build.setJobserver(server); }
+  // Build steps and app instances are reported to attribution while they
+  // run, so their writes can be told apart from edits
+  void setWriteAttribution(WriteAttribution *tracker) {
+    attribution = tracker;
+    build.setWriteAttribution(tracker);
+  }
+
+  // Starts every instance with a control channel (see ControlChannel) and
+  // offers changed files to it before falling back to a restart
+  void enableControlChannel();
+  // Swap mode: after every successful build, the running app is asked to
+  // load a copy of library instead of being restarted
+  void setSwapLibrary(const std::string &library);
+  // Counts task-clock, context switches, page faults (all and major) and,
+  // where the hardware allows, cycles and instructions for each app
+  // instance, and logs them against the previous instance when it exits.
+  // A positive intervalMs also logs every interval while it runs.
+  void enableProfiling(int intervalMs = 0);
+  // On by default: the binary and the files the last instance had mapped
+  // are read into the page cache before each start (see PageCache)
+  void setPrefetch(bool enabled) { prefetching = enabled; }
+
+  // onFinished receives the exit code once the session cannot continue
+  // (initial build or launch failed) or after shutdown() completes.
+  void start(std::function<void(int)> finished);
+  // changed lists the paths behind the reload, if known
+  void reload(const std::vector<std::string> &changed = {});
+  // Starts the app over without running the build steps
+  void restart();
+  // Forwards signo to the running app, which picks up the change itself
+  void signal(int signo);
+  void shutdown(int code);
+  void kill();
+
+  SessionState currentState() const { return state; }
+  ProcessManager &processes() { return processManager; }
+};
+
+} // namespace livrn
@@ -0,0 +1,336 @@
+#include "testrunner.h"
+#include "logger.h"
+#include "util/tracer.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+
+namespace livrn {
+namespace {
+
+// Copies a test's captured output to stdout
+void printOutput(int fd) {
+  char buffer[8192];
+  ssize_t n;
+  off_t offset = 0;
+  while ((n = pread(fd, buffer, sizeof(buffer), offset)) > 0) {
+    std::cout.write(buffer, n);
+    offset += n;
+  }
+  std::cout.flush();
+}
+
+} // namespace
+
+TestRunner::TestRunner(EventLoop &loop, std::vector<PreparedCommand> steps,
+                       std::vector<std::string> command, BuildPool &pool)
+    : loop(loop), build(loop, std::move(steps)),
+      testCommand(std::move(command)), pool(pool) {}
+
+TestRunner::~TestRunner() { kill(); }
+
+void TestRunner::start(const std::vector<std::string> &files,
+                       std::function<void(int)> finished) {
+  onFinished = std::move(finished);
+  for (const auto &path : files) {
+    if (TestMap::isTestFile(path))
+      map.addTest(path);
+  }
+  findDependencyFiles();
+
+  if (map.tests().empty()) {
+    livrn::Logger::warn("No tests found yet (test_*, *_test, *.test or "
+                        "*_spec files), waiting for changes");
+    return;
+  }
+  startBatch(map.tests(), true);
+}
+
+void TestRunner::findDependencyFiles() {
+  std::error_code ec;
+  auto it = fs::recursive_directory_iterator(
+      ".", fs::directory_options::skip_permission_denied, ec);
+  for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+    std::string name = it->path().filename().string();
+    if (it->is_directory(ec)) {
+      if (name == ".git" || name == "node_modules")
+        it.disable_recursion_pending();
+      continue;
+    }
+    if (it->path().extension() == ".d" || name == Config::TEST_MAP_FILE)
+      depFiles.emplace(it->path().string(), fs::file_time_type::min());
+  }
+  refreshDependencies();
+}
+
+void TestRunner::refreshDependencies() {
+  for (auto it = depFiles.begin(); it != depFiles.end();) {
+    std::error_code ec;
+    fs::file_time_type mtime = fs::last_write_time(it->first, ec);
+    if (ec) {
+      map.loadDependencies(it->first);
+      it = depFiles.erase(it);
+      continue;
+    }
+    if (mtime != it->second) {
+      map.loadDependencies(it->first);
+      it->second = mtime;
+    }
+    ++it;
+  }
+}
+
+void TestRunner::run(const std::vector<std::string> &changed, bool rebuild) {
+  if (shuttingDown)
+    return;
+
+  bool testsChanged = false;
+  for (const auto &path : changed) {
+    if (!TestMap::isTestFile(path))
+      continue;
+    std::error_code ec;
+    if (fs::exists(path, ec)) {
+      map.addTest(path);
+    } else {
+      map.removeTest(path);
+    }
+    testsChanged = true;
+  }
+
+  // Links to a new test are only resolved when its dependency file is read
+  if (testsChanged) {
+    for (auto &entry : depFiles) {
+      entry.second = fs::file_time_type::min();
+    }
+    dependencyScanDue = true;
+  }
+  refreshDependencies();
+
+  std::vector<std::string> unmapped;
+  std::set<std::string> selected = map.affected(changed, &unmapped);
+  if (!unmapped.empty()) {
+    // Nothing says which tests cover it, so only the full suite is safe
+    livrn::Logger::info("No test is linked to ", unmapped.front(),
+                        unmapped.size() > 1 ? " and others" : "",
+                        ", running every test");
+    selected = map.tests();
+  }
+  if (selected.empty())
+    return;
+
+  if (batchActive) {
+    pending.insert(selected.begin(), selected.end());
+    pendingRebuild = pendingRebuild || rebuild;
+    return;
+  }
+  startBatch(std::move(selected), rebuild);
+}
+
+void TestRunner::startBatch(std::set<std::string> tests, bool rebuild) {
+  batchActive = true;
+  batchStartNs = Tracer::nowNs();
+  failures.clear();
+  passed = 0;
+
+  livrn::Logger::info("Running ", tests.size(), " of ", map.tests().size(),
+                      " tests on ", pool.capacity(), " workers");
+
+  if (rebuild && !build.empty()) {
+    build.run([this, tests](BuildSequence::Outcome outcome) {
+      onBuildFinished(outcome, tests);
+    });
+    return;
+  }
+  queueTests(tests);
+}
+
+void TestRunner::queueTests(const std::set<std::string> &tests) {
+  for (const auto &test : tests) {
+    ++waiting;
+    pool.acquire(this, [this, test]() {
+      --waiting;
+      launch(test);
+    });
+  }
+}
+
+void TestRunner::onBuildFinished(BuildSequence::Outcome outcome,
+                                 const std::set<std::string> &tests) {
+  if (shuttingDown) {
+    if (running.empty())
+      finishShutdown();
+    return;
+  }
+  if (outcome != BuildSequence::Outcome::Succeeded) {
+    finishBatch();
+    return;
+  }
+
+  // The build may have written dependency files for new tests
+  if (dependencyScanDue) {
+    dependencyScanDue = false;
+    findDependencyFiles();
+  } else {
+    refreshDependencies();
+  }
+  queueTests(tests);
+}
+
+void TestRunner::launch(const std::string &test) {
+  if (shuttingDown)
+    return;
+
+  std::vector<std::string> args;
+  bool placed = false;
+  for (std::string arg : testCommand) {
+    for (const auto &[key, value] :
+         {std::pair<std::string, std::string>{"{}", test},
+          {"{name}", TestMap::nameOf(test)}}) {
+      size_t at;
+      while ((at = arg.find(key)) != std::string::npos) {
+        arg.replace(at, key.size(), value);
+        placed = true;
+      }
+    }
+    args.push_back(std::move(arg));
+  }
+  if (!placed)
+    args.push_back(test);
+  PreparedCommand command(std::move(args));
+
+  int outputFd = memfd_create("liverun-test", MFD_CLOEXEC);
+  pid_t pid = fork();
+  if (pid == 0) {
+    int input = open("/dev/null", O_RDONLY);
+    if (input >= 0)
+      dup2(input, STDIN_FILENO);
+    if (outputFd >= 0) {
+      dup2(outputFd, STDOUT_FILENO);
+      dup2(outputFd, STDERR_FILENO);
+    }
+    command.exec();
+    _exit(127);
+  }
+
+  if (pid < 0 ||
+      !loop.watchChild(pid, [this, pid](int status) {
+        onTestExited(pid, status);
+      })) {
+    livrn::Logger::error("Failed to run ", command.toString());
+    if (outputFd >= 0)
+      close(outputFd);
+    pool.release();
+    failures.push_back(test);
+    if (running.empty() && waiting == 0)
+      finishBatch();
+    return;
+  }
+
+  running[pid] = {test, outputFd, Tracer::nowNs()};
+  // Suites run long enough for edits to land meanwhile, so only files the
+  // tests hold open count as theirs
+  if (attribution)
+    attribution->begin(pid, WriteAttribution::Kind::App);
+}
+
+void TestRunner::onTestExited(pid_t pid, int status) {
+  auto it = running.find(pid);
+  if (it == running.end())
+    return;
+  Job job = std::move(it->second);
+  running.erase(it);
+  pool.release();
+  if (attribution)
+    attribution->end(pid);
+  Tracer::instance().complete("test", "test", job.startNs, Tracer::nowNs(),
+                              "status", status);
+
+  if (shuttingDown) {
+    if (job.outputFd >= 0)
+      close(job.outputFd);
+    if (running.empty() && !build.isRunning())
+      finishShutdown();
+    return;
+  }
+
+  if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+    ++passed;
+  } else {
+    failures.push_back(job.test);
+    livrn::Logger::error("FAIL ", job.test, " (", Tracer::msSince(job.startNs),
+                         " ms)");
+    if (job.outputFd >= 0)
+      printOutput(job.outputFd);
+  }
+  if (job.outputFd >= 0)
+    close(job.outputFd);
+
+  if (running.empty() && waiting == 0)
+    finishBatch();
+}
+
+void TestRunner::finishBatch() {
+  int64_t ms = Tracer::msSince(batchStartNs);
+  if (failures.empty() && passed > 0) {
+    livrn::Logger::info("All ", passed, " tests passed in ", ms, " ms");
+  } else if (!failures.empty()) {
+    std::sort(failures.begin(), failures.end());
+    livrn::Logger::error(failures.size(), " of ", failures.size() + passed,
+                         " tests failed in ", ms, " ms:");
+    for (const auto &test : failures) {
+      livrn::Logger::error("  ", test);
+    }
+  }
+  batchActive = false;
+
+  if (!pending.empty()) {
+    std::set<std::string> next;
+    next.swap(pending);
+    bool rebuild = pendingRebuild;
+    pendingRebuild = false;
+    startBatch(std::move(next), rebuild);
+  }
+}
+
+void TestRunner::shutdown(int code) {
+  shuttingDown = true;
+  shutdownCode = code;
+  pool.cancel(this);
+  waiting = 0;
+  pending.clear();
+  pendingRebuild = false;
+  build.stop();
+
+  for (const auto &entry : running) {
+    ::kill(entry.first, SIGTERM);
+  }
+  if (running.empty() && !build.isRunning())
+    finishShutdown();
+}
+
+void TestRunner::kill() {
+  pool.cancel(this);
+  waiting = 0;
+  build.kill();
+
+  for (const auto &[pid, job] : running) {
+    loop.unwatchChild(pid);
+    ::kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    if (attribution)
+      attribution->end(pid);
+    if (job.outputFd >= 0)
+      close(job.outputFd);
+    pool.release();
+  }
+  running.clear();
+}
+
+void TestRunner::finishShutdown() {
+  if (!onFinished)
+    return;
+  auto finished = std::move(onFinished);
+  onFinished = nullptr;
+  finished(shutdownCode);
+}
+
+} // namespace livrn
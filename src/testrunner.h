@@ -0,0 +1,87 @@
+#pragma once
+#include "event/loop.h"
+#include "liverun.h"
+#include "process/sequence.h"
+#include "util/testmap.h"
+#include <set>
+
+namespace livrn {
+
+// Test mode: reruns only the tests a change batch affects (see TestMap),
+// as many at a time as the pool has slots. Build steps, if any, run once
+// before each batch. Every test is one process started from the test
+// command with "{}" replaced by the test's path and "{name}" by its bare
+// file name; without either, the path is appended. Output is captured and
+// shown for failing tests only, followed by one summary per batch.
+class TestRunner {
+public:
+  TestRunner(EventLoop &loop, std::vector<PreparedCommand> buildSteps,
+             std::vector<std::string> testCommand, BuildPool &pool);
+  ~TestRunner();
+
+  TestRunner(const TestRunner &) = delete;
+  TestRunner &operator=(const TestRunner &) = delete;
+
+  void setWriteAttribution(WriteAttribution *tracker) {
+    attribution = tracker;
+    build.setWriteAttribution(tracker);
+  }
+  void setJobserver(Jobserver *server) { build.setJobserver(server); }
+
+  // Finds tests among files and the dependency files under the working
+  // directory, then runs the whole suite once. finished receives the exit
+  // code after shutdown().
+  void start(const std::vector<std::string> &files,
+             std::function<void(int)> finished);
+  // Without rebuild, the affected tests run without the build steps first
+  void run(const std::vector<std::string> &changed, bool rebuild = true);
+  void shutdown(int code);
+  void kill();
+
+  const TestMap &testMap() const { return map; }
+  bool isIdle() const { return !batchActive; }
+
+private:
+  struct Job {
+    std::string test;
+    int outputFd;
+    uint64_t startNs;
+  };
+
+  EventLoop &loop;
+  BuildSequence build;
+  std::vector<std::string> testCommand;
+  BuildPool &pool;
+  WriteAttribution *attribution = nullptr;
+  TestMap map;
+  std::unordered_map<std::string, fs::file_time_type> depFiles;
+  // Set until a build has run since tests were added
+  bool dependencyScanDue = true;
+
+  bool batchActive = false;
+  uint64_t batchStartNs = 0;
+  size_t waiting = 0;
+  std::unordered_map<pid_t, Job> running;
+  std::set<std::string> pending;
+  bool pendingRebuild = false;
+  std::vector<std::string> failures;
+  size_t passed = 0;
+
+  bool shuttingDown = false;
+  int shutdownCode = 0;
+  std::function<void(int)> onFinished;
+
+  void findDependencyFiles();
+  void refreshDependencies();
+
+  void startBatch(std::set<std::string> tests, bool rebuild);
+  void onBuildFinished(BuildSequence::Outcome outcome,
+                       const std::set<std::string> &tests);
+  void queueTests(const std::set<std::string> &tests);
+  void launch(const std::string &test);
+  void onTestExited(pid_t pid, int status);
+  void finishBatch();
+  void finishShutdown();
+};
+
+} // namespace livrn
@@ -0,0 +1,22 @@
+#pragma once
+#include <cstdint>
+#include <ctime>
+
+namespace livrn {
+
+// Wall-clock time, comparable with file mtimes and atimes
+inline int64_t realtimeNs() {
+  timespec now{};
+  clock_gettime(CLOCK_REALTIME, &now);
+  return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+// The clock local filesystems stamp mtimes from; it can trail realtimeNs()
+// by up to a tick
+inline int64_t coarseRealtimeNs() {
+  timespec now{};
+  clock_gettime(CLOCK_REALTIME_COARSE, &now);
+  return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+} // namespace livrn
@@ -0,0 +1,601 @@
+#include "fingerprint.h"
+
+namespace livrn {
+namespace {
+
+enum class Syntax { CFamily, Go, Rust, Script, Python };
+
+bool syntaxOf(const std::string &extension, Syntax &syntax) {
+  static const std::unordered_map<std::string, Syntax> syntaxes = {
+      {".c", Syntax::CFamily},  {".cpp", Syntax::CFamily},
+      {".cc", Syntax::CFamily}, {".cxx", Syntax::CFamily},
+      {".h", Syntax::CFamily},  {".hpp", Syntax::CFamily},
+      {".go", Syntax::Go},      {".rs", Syntax::Rust},
+      {".js", Syntax::Script},  {".ts", Syntax::Script},
+      {".py", Syntax::Python}};
+  auto it = syntaxes.find(extension);
+  if (it == syntaxes.end())
+    return false;
+  syntax = it->second;
+  return true;
+}
+
+bool isWord(char c) {
+  unsigned char u = static_cast<unsigned char>(c);
+  return std::isalnum(u) || c == '_' || c == '$' || u >= 0x80;
+}
+
+// Characters that may fuse with a neighbour into another token ("- -" and
+// "--"); whitespace between two of them is kept
+bool isOperator(char c) { return std::strchr("+-*/%&|^<>=!~.:?#@", c); }
+
+// Indentation markers can never be mistaken for source text
+const char INDENT = '\x01';
+const char DEDENT = '\x02';
+
+// Rewrites source text into its tokens, separated only where the
+// separation matters
+class Normalizer {
+public:
+  Normalizer(const std::string &text, Syntax syntax)
+      : text(text), syntax(syntax) {}
+
+  std::string run() {
+    if (syntax == Syntax::Python) {
+      scanPython();
+    } else {
+      scanCode(false);
+    }
+    return out;
+  }
+
+private:
+  const std::string &text;
+  Syntax syntax;
+  size_t i = 0;
+  std::string out;
+  bool space = false;
+  bool newline = false;
+  bool lineStart = true;
+  bool directive = false;
+  // Script: for each open '(', whether it follows if/while/for/with, and
+  // whether the last ')' closed such a condition
+  std::vector<bool> parens;
+  bool conditionClosed = false;
+
+  bool at(size_t pos, char c) const {
+    return pos < text.size() && text[pos] == c;
+  }
+
+  void separate(char next) {
+    if (!out.empty()) {
+      if (newline) {
+        if (out.back() != '\n')
+          out += '\n';
+      } else if (space && out.back() != '\n' &&
+                 ((isWord(out.back()) && isWord(next)) ||
+                  (isOperator(out.back()) && isOperator(next)))) {
+        out += ' ';
+      }
+    }
+    space = false;
+    newline = false;
+  }
+
+  void emit(char c) {
+    separate(c);
+    out += c;
+  }
+
+  void lineBreak() {
+    lineStart = true;
+    if (directive) {
+      directive = false;
+      newline = true;
+    } else if (syntax == Syntax::Go || syntax == Syntax::Script) {
+      newline = true;
+    } else {
+      space = true;
+    }
+  }
+
+  bool startsWith(size_t pos, const char *prefix) const {
+    return text.compare(pos, std::strlen(prefix), prefix) == 0;
+  }
+
+  size_t skipBlanks(size_t pos) const {
+    while (at(pos, ' ') || at(pos, '\t'))
+      ++pos;
+    return pos;
+  }
+
+  // Comments that tools read: Go build constraints and compiler
+  // directives, the cgo preamble, TypeScript pragmas and Python type
+  // comments. They are kept like code.
+  bool isDirectiveComment(size_t start, size_t end) const {
+    switch (syntax) {
+    case Syntax::Go:
+      return startsWith(start, "//go:") || startsWith(start, "//export ") ||
+             startsWith(start, "//line ") ||
+             (startsWith(start, "//") &&
+              startsWith(skipBlanks(start + 2), "+build")) ||
+             precedesCgoImport(end);
+    case Syntax::Script:
+      return text.find("@ts-", start) < end;
+    case Syntax::Python:
+      return startsWith(skipBlanks(start + 1), "type:");
+    default:
+      return false;
+    }
+  }
+
+  // Whether only comments and whitespace stand between pos and import "C"
+  bool precedesCgoImport(size_t pos) const {
+    while (pos < text.size()) {
+      if (std::isspace(static_cast<unsigned char>(text[pos]))) {
+        ++pos;
+      } else if (startsWith(pos, "//")) {
+        pos = text.find('\n', pos);
+      } else if (startsWith(pos, "/*")) {
+        pos = text.find("*/", pos + 2);
+        pos = pos == std::string::npos ? pos : pos + 2;
+      } else {
+        return startsWith(pos, "import") &&
+               startsWith(skipBlanks(pos + 6), "\"C\"");
+      }
+    }
+    return false;
+  }
+
+  // Drops the comment from i to end, or copies it if tools read it
+  void comment(size_t end) {
+    if (isDirectiveComment(i, end)) {
+      separate(text[i]);
+      out.append(text, i, end - i);
+    }
+    i = end;
+    space = true;
+  }
+
+  void lineComment() {
+    size_t end = i;
+    while (end < text.size() && text[end] != '\n') {
+      // A trailing backslash continues a C comment onto the next line
+      if (syntax == Syntax::CFamily && text[end] == '\\' &&
+          (at(end + 1, '\n') || (at(end + 1, '\r') && at(end + 2, '\n')))) {
+        end += at(end + 1, '\r') ? 3 : 2;
+        continue;
+      }
+      ++end;
+    }
+    comment(end);
+  }
+
+  // "#define NAME" is copied verbatim, since a space between the name and
+  // '(' decides whether the macro takes parameters
+  bool defineHeader() {
+    size_t j = i + 1;
+    while (at(j, ' ') || at(j, '\t'))
+      ++j;
+    if (text.compare(j, 6, "define") != 0)
+      return false;
+    j += 6;
+    size_t name = j;
+    while (at(j, ' ') || at(j, '\t'))
+      ++j;
+    if (j == name || j >= text.size() || !isWord(text[j]))
+      return false;
+    while (j < text.size() && isWord(text[j]))
+      ++j;
+
+    separate('#');
+    out.append(text, i, j - i);
+    i = j;
+    if (!at(i, '('))
+      out += ' ';
+    return true;
+  }
+
+  void blockComment() {
+    int nesting = 0;
+    bool lines = false;
+    size_t end = i + 2;
+    for (; end < text.size(); ++end) {
+      if (text[end] == '\n') {
+        lines = true;
+      } else if (syntax == Syntax::Rust && text[end] == '/' &&
+                 at(end + 1, '*')) {
+        ++nesting;
+        ++end;
+      } else if (text[end] == '*' && at(end + 1, '/')) {
+        ++end;
+        if (nesting-- == 0) {
+          ++end;
+          break;
+        }
+      }
+    }
+    comment(end);
+    // Go and JS treat a comment spanning lines as a line break
+    if (lines && (syntax == Syntax::Go || syntax == Syntax::Script))
+      newline = true;
+  }
+
+  // A literal closed by quote, with backslash escapes; single-line ones
+  // also end at a line break
+  void quoted(char quote, bool multiline) {
+    separate(quote);
+    out += text[i++];
+    while (i < text.size()) {
+      char c = text[i++];
+      out += c;
+      if (c == '\\' && i < text.size()) {
+        out += text[i++];
+      } else if (c == quote || (c == '\n' && !multiline)) {
+        break;
+      }
+    }
+  }
+
+  // Copied up to and including the first occurrence of closing
+  void raw(const std::string &closing) {
+    separate(text[i]);
+    size_t end = text.find(closing, i + 1);
+    end = end == std::string::npos ? text.size() : end + closing.size();
+    out.append(text, i, end - i);
+    i = end;
+  }
+
+  // "R" or "u8R" right before the quote, not part of a longer name
+  bool rawStringPrefix(const std::vector<std::string> &prefixes,
+                       size_t hashes) const {
+    if (space || newline)
+      return false;
+    for (const auto &prefix : prefixes) {
+      size_t length = prefix.size() + hashes;
+      if (out.size() < length ||
+          out.compare(out.size() - length, prefix.size(), prefix) != 0)
+        continue;
+      if (out.size() == length || !isWord(out[out.size() - length - 1]))
+        return true;
+    }
+    return false;
+  }
+
+  void stringLiteral() {
+    if (syntax == Syntax::CFamily &&
+        rawStringPrefix({"R", "u8R", "uR", "UR", "LR"}, 0)) {
+      size_t open = text.find('(', i);
+      if (open != std::string::npos && open - i <= 17) {
+        raw(")" + text.substr(i + 1, open - i - 1) + "\"");
+        return;
+      }
+    }
+    if (syntax == Syntax::Rust) {
+      size_t hashes = 0;
+      while (hashes < out.size() && out[out.size() - 1 - hashes] == '#')
+        ++hashes;
+      if (rawStringPrefix({"r", "br", "cr"}, hashes)) {
+        raw("\"" + std::string(hashes, '#'));
+        return;
+      }
+    }
+    quoted('"', true);
+  }
+
+  void singleQuote() {
+    if (syntax == Syntax::CFamily && !out.empty() && isWord(out.back()) &&
+        !space && !newline) {
+      // A digit separator (1'000) unless the word is a prefix (L'a')
+      size_t start = out.size();
+      while (start > 0 && isWord(out[start - 1]))
+        --start;
+      if (std::isdigit(static_cast<unsigned char>(out[start]))) {
+        emit(text[i++]);
+        return;
+      }
+    }
+    if (syntax == Syntax::Rust && !at(i + 1, '\\')) {
+      // 'x' is a char, 'a without a closing quote a lifetime
+      size_t length = 1;
+      unsigned char lead = static_cast<unsigned char>(
+          i + 1 < text.size() ? text[i + 1] : 0);
+      if (lead >= 0xf0) {
+        length = 4;
+      } else if (lead >= 0xe0) {
+        length = 3;
+      } else if (lead >= 0xc0) {
+        length = 2;
+      }
+      if (!at(i + 1 + length, '\'')) {
+        emit(text[i++]);
+        return;
+      }
+    }
+    quoted('\'', false);
+  }
+
+  // The word the output ends with, if any
+  std::string lastWord() const {
+    size_t end = out.size();
+    while (end > 0 && (out[end - 1] == ' ' || out[end - 1] == '\n'))
+      --end;
+    size_t start = end;
+    while (start > 0 && isWord(out[start - 1]))
+      --start;
+    return out.substr(start, end - start);
+  }
+
+  // After an operator, a keyword, a statement's condition or at the start,
+  // '/' opens a regular expression
+  bool regexAllowed() const {
+    if (out.empty())
+      return true;
+    char last = out.back() == ' ' || out.back() == '\n'
+                    ? out[out.size() - 2]
+                    : out.back();
+    if (last == ')')
+      return conditionClosed;
+    if (last == ']' || last == '}')
+      return false;
+    if (!isWord(last))
+      return true;
+
+    static const std::unordered_set<std::string> keywords = {
+        "return", "typeof", "instanceof", "in",    "of",   "new",  "delete",
+        "void",   "throw",  "case",       "do",    "else", "yield", "await"};
+    return keywords.count(lastWord()) > 0;
+  }
+
+  void trackParen(char c) {
+    static const std::unordered_set<std::string> statements = {
+        "if", "while", "for", "with"};
+    if (c == '(') {
+      parens.push_back(statements.count(lastWord()) > 0);
+    } else if (c == ')') {
+      conditionClosed = !parens.empty() && parens.back();
+      if (!parens.empty())
+        parens.pop_back();
+    }
+  }
+
+  void regex() {
+    separate('/');
+    out += text[i++];
+    bool inClass = false;
+    while (i < text.size() && text[i] != '\n') {
+      char c = text[i++];
+      out += c;
+      if (c == '\\' && i < text.size()) {
+        out += text[i++];
+      } else if (c == '[') {
+        inClass = true;
+      } else if (c == ']') {
+        inClass = false;
+      } else if (c == '/' && !inClass) {
+        break;
+      }
+    }
+  }
+
+  // `text ${code} text`, where code may hold further templates
+  void templateLiteral() {
+    separate('`');
+    out += text[i++];
+    while (i < text.size()) {
+      char c = text[i++];
+      out += c;
+      if (c == '\\' && i < text.size()) {
+        out += text[i++];
+      } else if (c == '`') {
+        break;
+      } else if (c == '$' && at(i, '{')) {
+        out += text[i++];
+        space = false;
+        newline = false;
+        scanCode(true);
+      }
+    }
+  }
+
+  // With insideTemplate, returns after the '}' closing a ${ substitution
+  void scanCode(bool insideTemplate) {
+    int braces = 0;
+    while (i < text.size()) {
+      char c = text[i];
+      if (c == '\n') {
+        lineBreak();
+        ++i;
+      } else if (c == '\\' && (at(i + 1, '\n') ||
+                               (at(i + 1, '\r') && at(i + 2, '\n')))) {
+        // A continued line, within a directive as well
+        i += at(i + 1, '\r') ? 3 : 2;
+        space = true;
+      } else if (std::isspace(static_cast<unsigned char>(c))) {
+        space = true;
+        ++i;
+      } else if (c == '/' && at(i + 1, '/')) {
+        lineComment();
+      } else if (c == '/' && at(i + 1, '*')) {
+        blockComment();
+      } else {
+        bool define = false;
+        if (c == '#' && lineStart && syntax == Syntax::CFamily) {
+          directive = true;
+          define = defineHeader();
+        }
+        lineStart = false;
+
+        if (define) {
+          continue;
+        } else if (c == '"') {
+          stringLiteral();
+        } else if (c == '\'') {
+          singleQuote();
+        } else if (c == '`' && syntax == Syntax::Go) {
+          raw("`");
+        } else if (c == '`' && syntax == Syntax::Script) {
+          templateLiteral();
+        } else if (c == '/' && syntax == Syntax::Script && regexAllowed()) {
+          regex();
+        } else {
+          if (syntax == Syntax::Script)
+            trackParen(c);
+          emit(c);
+          ++i;
+          if (insideTemplate && c == '{') {
+            ++braces;
+          } else if (insideTemplate && c == '}' && braces-- == 0) {
+            return;
+          }
+        }
+      }
+    }
+  }
+
+  void pythonString() {
+    char quote = text[i];
+    if (at(i + 1, quote) && at(i + 2, quote)) {
+      separate(quote);
+      std::string closing(3, quote);
+      out.append(closing);
+      i += 3;
+      while (i < text.size() && text.compare(i, 3, closing) != 0) {
+        if (text[i] == '\\' && i + 1 < text.size())
+          out += text[i++];
+        out += text[i++];
+      }
+      out.append(text, i, std::min<size_t>(3, text.size() - i));
+      i = std::min(text.size(), i + 3);
+      return;
+    }
+    quoted(quote, false);
+  }
+
+  void scanPython() {
+    std::vector<int> indents = {0};
+    int depth = 0;
+
+    while (i < text.size()) {
+      if (lineStart && depth == 0) {
+        int column = 0;
+        size_t j = i;
+        for (; j < text.size() && std::strchr(" \t\f\r", text[j]) &&
+               text[j] != '\0';
+             ++j) {
+          column = text[j] == '\t' ? (column / 8 + 1) * 8 : column + 1;
+        }
+        // Blank and comment-only lines do not count, but type comments do
+        if (j >= text.size() || text[j] == '\n' ||
+            (text[j] == '#' && !isDirectiveComment(j, text.find('\n', j)))) {
+          while (j < text.size() && text[j] != '\n')
+            ++j;
+          i = j + 1;
+          continue;
+        }
+        i = j;
+        lineStart = false;
+        space = false;
+        if (column > indents.back()) {
+          indents.push_back(column);
+          out += INDENT;
+        }
+        while (column < indents.back() && indents.size() > 1) {
+          indents.pop_back();
+          out += DEDENT;
+        }
+        continue;
+      }
+
+      char c = text[i];
+      if (c == '\n') {
+        if (depth > 0) {
+          space = true;
+        } else {
+          if (!out.empty() && out.back() != '\n')
+            out += '\n';
+          space = false;
+          lineStart = true;
+        }
+        ++i;
+      } else if (c == '\\' && (at(i + 1, '\n') ||
+                               (at(i + 1, '\r') && at(i + 2, '\n')))) {
+        i += at(i + 1, '\r') ? 3 : 2;
+        space = true;
+      } else if (std::isspace(static_cast<unsigned char>(c))) {
+        space = true;
+        ++i;
+      } else if (c == '#') {
+        lineComment();
+      } else if (c == '"' || c == '\'') {
+        pythonString();
+      } else {
+        if (c == '(' || c == '[' || c == '{') {
+          ++depth;
+        } else if ((c == ')' || c == ']' || c == '}') && depth > 0) {
+          --depth;
+        }
+        emit(c);
+        ++i;
+      }
+    }
+  }
+};
+
+} // namespace
+
+bool SourceFingerprints::supports(const std::string &path) {
+  Syntax syntax;
+  return syntaxOf(fs::path(path).extension().string(), syntax);
+}
+
+uint64_t SourceFingerprints::ofText(const std::string &text,
+                                    const std::string &extension) {
+  Syntax syntax = Syntax::CFamily;
+  syntaxOf(extension, syntax);
+  std::string tokens = Normalizer(text, syntax).run();
+
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ull;
+  for (char c : tokens) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+bool SourceFingerprints::ofFile(const std::string &path,
+                                uint64_t &fingerprint) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open())
+    return false;
+  std::string text((std::istreambuf_iterator<char>(file)),
+                   std::istreambuf_iterator<char>());
+  if (file.bad())
+    return false;
+  fingerprint = ofText(text, fs::path(path).extension().string());
+  return true;
+}
+
+void SourceFingerprints::index(const std::vector<std::string> &paths) {
+  for (const auto &path : paths) {
+    uint64_t fingerprint;
+    if (supports(path) && ofFile(path, fingerprint))
+      fingerprints[path] = fingerprint;
+  }
+}
+
+bool SourceFingerprints::unchanged(const std::string &path) {
+  uint64_t fingerprint;
+  if (!supports(path) || !ofFile(path, fingerprint)) {
+    fingerprints.erase(path);
+    return false;
+  }
+  auto it = fingerprints.find(path);
+  if (it != fingerprints.end() && it->second == fingerprint)
+    return true;
+  fingerprints[path] = fingerprint;
+  return false;
+}
+
+} // namespace livrn
@@ -0,0 +1,33 @@
+#pragma once
+#include "../liverun.h"
+
+namespace livrn {
+
+// Fingerprints of source files that ignore comments and the whitespace
+// between tokens, so an edit that only touches those keeps its
+// fingerprint. Whitespace is kept where it carries meaning: line breaks in
+// Go and JS/TS (semicolon insertion) and after C preprocessor directives,
+// indentation in Python, and everything inside literals. So are comments
+// that tools read, such as Go build constraints. When in doubt a
+// difference is kept, so the worst case is an unneeded rebuild.
+class SourceFingerprints {
+public:
+  // C/C++, Go, Rust, JS/TS and Python sources, by extension
+  static bool supports(const std::string &path);
+  // extension selects the language, e.g. ".cpp"
+  static uint64_t ofText(const std::string &text,
+                         const std::string &extension);
+  static bool ofFile(const std::string &path, uint64_t &fingerprint);
+
+  // Records the fingerprint of every supported file in paths
+  void index(const std::vector<std::string> &paths);
+  // Whether path still has the fingerprint on record. Records the new one
+  // if not, so the next edit is compared with this version.
+  bool unchanged(const std::string &path);
+  size_t size() const { return fingerprints.size(); }
+
+private:
+  std::unordered_map<std::string, uint64_t> fingerprints;
+};
+
+} // namespace livrn
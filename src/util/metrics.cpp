@@ -0,0 +1,209 @@
+#include "metrics.h"
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace livrn {
+namespace {
+
+struct PhaseInfo {
+  const char *label;
+  // Tracer span feeding the phase, if any
+  const char *span;
+};
+
+constexpr std::array<PhaseInfo, static_cast<size_t>(Phase::Count)> PHASES = {{
+    {"reload", "reload"},
+    {"build", "compile step"},
+    {"kill", "kill"},
+    {"kill_wait", "graceful wait"},
+    {"shutdown_delay", "shutdown delay"},
+    {"spawn", "spawn"},
+    {"in_process_reload", "in-process reload"},
+    {"scan", "scan"},
+    {"test", "test"},
+    {"poll_sweep", nullptr},
+}};
+
+struct CounterInfo {
+  const char *name;
+  const char *help;
+};
+
+constexpr std::array<CounterInfo, static_cast<size_t>(Counter::Count)>
+    COUNTERS = {{
+        {"liverun_changed_files_total", "Changed files reported by the monitor."},
+        {"liverun_reloads_total", "Reloads requested after a change batch."},
+        {"liverun_build_failures_total", "Build steps that failed."},
+        {"liverun_app_exits_total",
+         "Times the application exited on its own."},
+        {"liverun_hot_reload_fallbacks_total",
+         "In-process reloads that fell back to a restart."},
+        {"liverun_own_writes_ignored_total",
+         "Changes written by builds or the application and ignored."},
+        {"liverun_noop_edits_skipped_total",
+         "Source changes to comments or whitespace only, not reloaded."},
+        {"liverun_prefetched_bytes_total",
+         "Bytes of app binaries and libraries read ahead before a start."},
+    }};
+
+double seconds(uint64_t ns) { return static_cast<double>(ns) / 1e9; }
+
+double seconds(const timeval &tv) {
+  return static_cast<double>(tv.tv_sec) +
+         static_cast<double>(tv.tv_usec) / 1e6;
+}
+
+// Resident set size from /proc/self/statm, 0 if unavailable
+uint64_t residentBytes() {
+  FILE *statm = std::fopen("/proc/self/statm", "r");
+  if (!statm)
+    return 0;
+  unsigned long size = 0, resident = 0;
+  int fields = std::fscanf(statm, "%lu %lu", &size, &resident);
+  std::fclose(statm);
+  if (fields != 2)
+    return 0;
+  return static_cast<uint64_t>(resident) *
+         static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+}
+
+void appendf(std::string &out, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+void appendf(std::string &out, const char *format, ...) {
+  // A first pass measures, so long label sets are never cut short
+  va_list args;
+  va_start(args, format);
+  va_list again;
+  va_copy(again, args);
+  int n = std::vsnprintf(nullptr, 0, format, args);
+  va_end(args);
+  if (n > 0) {
+    size_t start = out.size();
+    out.resize(start + n + 1);
+    std::vsnprintf(&out[start], n + 1, format, again);
+    out.resize(start + n);
+  }
+  va_end(again);
+}
+
+} // namespace
+
+void Histogram::observe(uint64_t durationNs) {
+  size_t index = 0;
+  while (index < BOUNDS.size() &&
+         static_cast<double>(durationNs) > BOUNDS[index] * 1e9) {
+    ++index;
+  }
+  buckets[index].fetch_add(1, std::memory_order_relaxed);
+  totalNs.fetch_add(durationNs, std::memory_order_relaxed);
+  samples.fetch_add(1, std::memory_order_relaxed);
+}
+
+Metrics &Metrics::instance() {
+  // Never destroyed, for the same reason as the tracer
+  static Metrics *metrics = new Metrics();
+  return *metrics;
+}
+
+void Metrics::observe(Phase phase, uint64_t durationNs) {
+  if (!isEnabled())
+    return;
+  phases[static_cast<size_t>(phase)].observe(durationNs);
+}
+
+void Metrics::observeSpan(const char *name, uint64_t durationNs) {
+  if (!isEnabled())
+    return;
+  for (size_t i = 0; i < PHASES.size(); ++i) {
+    if (PHASES[i].span && std::strcmp(PHASES[i].span, name) == 0) {
+      phases[i].observe(durationNs);
+      return;
+    }
+  }
+}
+
+void Metrics::add(Counter counter, uint64_t n) {
+  if (!isEnabled())
+    return;
+  counters[static_cast<size_t>(counter)].fetch_add(n,
+                                                   std::memory_order_relaxed);
+}
+
+std::string Metrics::render() const {
+  std::string out;
+
+  out += "# HELP liverun_phase_duration_seconds Duration of reload phases.\n";
+  out += "# TYPE liverun_phase_duration_seconds histogram\n";
+  for (size_t i = 0; i < PHASES.size(); ++i) {
+    const Histogram &histogram = phases[i];
+    const char *label = PHASES[i].label;
+    uint64_t cumulative = 0;
+    for (size_t b = 0; b < Histogram::BOUNDS.size(); ++b) {
+      cumulative += histogram.bucket(b);
+      appendf(out,
+              "liverun_phase_duration_seconds_bucket{phase=\"%s\",le=\"%g\"} "
+              "%llu\n",
+              label, Histogram::BOUNDS[b],
+              static_cast<unsigned long long>(cumulative));
+    }
+    cumulative += histogram.bucket(Histogram::BOUNDS.size());
+    appendf(out,
+            "liverun_phase_duration_seconds_bucket{phase=\"%s\",le=\"+Inf\"} "
+            "%llu\n",
+            label, static_cast<unsigned long long>(cumulative));
+    appendf(out, "liverun_phase_duration_seconds_sum{phase=\"%s\"} %.9f\n",
+            label, seconds(histogram.sumNs()));
+    // Derived from the buckets so count always matches the +Inf bucket
+    appendf(out, "liverun_phase_duration_seconds_count{phase=\"%s\"} %llu\n",
+            label, static_cast<unsigned long long>(cumulative));
+  }
+
+  for (size_t i = 0; i < COUNTERS.size(); ++i) {
+    appendf(out, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+            COUNTERS[i].name, COUNTERS[i].help, COUNTERS[i].name,
+            COUNTERS[i].name,
+            static_cast<unsigned long long>(
+                counters[i].load(std::memory_order_relaxed)));
+  }
+
+  appendf(out,
+          "# HELP liverun_watched_files Files in the change index.\n"
+          "# TYPE liverun_watched_files gauge\n"
+          "liverun_watched_files %llu\n",
+          static_cast<unsigned long long>(
+              watchedFiles.load(std::memory_order_relaxed)));
+
+  appendf(out,
+          "# HELP liverun_resident_memory_bytes Resident memory of liverun.\n"
+          "# TYPE liverun_resident_memory_bytes gauge\n"
+          "liverun_resident_memory_bytes %llu\n",
+          static_cast<unsigned long long>(residentBytes()));
+
+  rusage self{};
+  getrusage(RUSAGE_SELF, &self);
+  appendf(out,
+          "# HELP liverun_cpu_seconds_total CPU time used by liverun.\n"
+          "# TYPE liverun_cpu_seconds_total counter\n"
+          "liverun_cpu_seconds_total{mode=\"user\"} %.6f\n"
+          "liverun_cpu_seconds_total{mode=\"system\"} %.6f\n",
+          seconds(self.ru_utime), seconds(self.ru_stime));
+
+  // Reaped builds and application instances
+  rusage children{};
+  getrusage(RUSAGE_CHILDREN, &children);
+  appendf(out,
+          "# HELP liverun_children_cpu_seconds_total CPU time used by "
+          "finished builds and applications.\n"
+          "# TYPE liverun_children_cpu_seconds_total counter\n"
+          "liverun_children_cpu_seconds_total %.6f\n",
+          seconds(children.ru_utime) + seconds(children.ru_stime));
+
+  return out;
+}
+
+} // namespace livrn
@@ -0,0 +1,98 @@
+#pragma once
+#include "../config.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace livrn {
+
+// Reload phases with a duration histogram, one per tracer span name
+enum class Phase {
+  Reload,
+  Build,
+  Kill,
+  KillWait,
+  ShutdownDelay,
+  Spawn,
+  InProcessReload,
+  Scan,
+  Test,
+  PollSweep,
+  Count
+};
+
+enum class Counter {
+  ChangedFiles,
+  Reloads,
+  BuildFailures,
+  AppExits,
+  HotReloadFallbacks,
+  OwnWrites,
+  NoopEdits,
+  PrefetchedBytes,
+  Count
+};
+
+// Fixed-bucket duration histogram. Every field is a separate atomic, so a
+// scrape may see a sample in a bucket before it shows up in the sum; the
+// exposition format tolerates that.
+class Histogram {
+public:
+  // Upper bounds in seconds, ending in +Inf
+  static constexpr std::array<double, 14> BOUNDS = {
+      0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1,
+      0.25,  0.5,    1,     2.5,  5,     10,   30};
+
+  void observe(uint64_t durationNs);
+
+  uint64_t bucket(size_t index) const {
+    return buckets[index].load(std::memory_order_relaxed);
+  }
+  uint64_t count() const { return samples.load(std::memory_order_relaxed); }
+  uint64_t sumNs() const { return totalNs.load(std::memory_order_relaxed); }
+
+private:
+  // Non-cumulative; the last slot holds samples above every bound
+  std::array<std::atomic<uint64_t>, BOUNDS.size() + 1> buckets{};
+  std::atomic<uint64_t> samples{0};
+  std::atomic<uint64_t> totalNs{0};
+};
+
+// Process-wide counters and histograms behind --metrics. Updates are
+// relaxed atomic increments and cost nothing until enable() is called.
+class Metrics {
+private:
+  std::array<Histogram, static_cast<size_t>(Phase::Count)> phases;
+  std::array<std::atomic<uint64_t>, static_cast<size_t>(Counter::Count)>
+      counters{};
+  std::atomic<uint64_t> watchedFiles{0};
+  std::atomic<bool> enabled{false};
+
+public:
+  static Metrics &instance();
+
+  void enable() { enabled.store(true, std::memory_order_relaxed); }
+  bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+  void observe(Phase phase, uint64_t durationNs);
+  // Maps a tracer span name onto its phase; other spans are ignored
+  void observeSpan(const char *name, uint64_t durationNs);
+  void add(Counter counter, uint64_t n = 1);
+  void setWatchedFiles(size_t files) {
+    watchedFiles.store(files, std::memory_order_relaxed);
+  }
+
+  const Histogram &histogram(Phase phase) const {
+    return phases[static_cast<size_t>(phase)];
+  }
+  uint64_t value(Counter counter) const {
+    return counters[static_cast<size_t>(counter)].load(
+        std::memory_order_relaxed);
+  }
+
+  // Prometheus text exposition format, version 0.0.4, including liverun's
+  // own memory and CPU use
+  std::string render() const;
+};
+
+} // namespace livrn
@@ -1,6 +1,18 @@
 #include "parser.h"
 
 namespace livrn {
+namespace {
+bool containsBinaryBytes(const char *buffer, std::streamsize length) {
+  for (std::streamsize i = 0; i < length; ++i) {
+    unsigned char c = buffer[i];
+    if (c < 9 || (c > 13 && c < 32) || c == 127) {
+      return true;
+    }
+  }
+  return false;
+}
+} // namespace
+
 bool Parser::isPathSafe(const std::string &path) {
   try {
     fs::path p(path);
@@ -47,14 +59,15 @@ bool Parser::isBinaryFile(const fs::path &path) {
 
   char buffer[512];
   file.read(buffer, sizeof(buffer));
-  std::streamsize bytesRead = file.gcount();
+  return containsBinaryBytes(buffer, file.gcount());
+}
 
-  for (std::streamsize i = 0; i < bytesRead; ++i) {
-    unsigned char c = buffer[i];
-    if (c < 9 || (c > 13 && c < 32) || c == 127) {
-      return true;
-    }
-  }
-  return false;
+bool Parser::isBinaryFile(int fd) {
+  char buffer[512];
+  ssize_t bytesRead = pread(fd, buffer, sizeof(buffer), 0);
+  if (bytesRead <= 0)
+    return false;
+
+  return containsBinaryBytes(buffer, bytesRead);
 }
 } // namespace livrn
@@ -7,5 +7,6 @@ public:
   static bool isPathSafe(const std::string &path);
   static bool isCommandSafe(const std::string &cmd);
   static bool isBinaryFile(const fs::path &path);
+  static bool isBinaryFile(int fd);
 };
 }; // namespace livrn
@@ -0,0 +1,87 @@
+#include "recording.h"
+#include "../logger.h"
+#include "tracer.h"
+
+namespace livrn {
+
+namespace {
+const char *HEADER = "# liverun changes v1";
+} // namespace
+
+bool ChangeRecorder::open(const std::string &path) {
+  file.open(path, std::ios::trunc);
+  if (!file.is_open()) {
+    livrn::Logger::error("Cannot write changes to ", path);
+    return false;
+  }
+  file << HEADER << '\n';
+  file.flush();
+  startNs = Tracer::nowNs();
+  lastOffsetUs = -1;
+  return true;
+}
+
+void ChangeRecorder::record(const std::vector<std::string> &paths) {
+  if (!file.is_open() || paths.empty())
+    return;
+
+  // Two batches within one microsecond must not merge on replay
+  int64_t offsetUs = static_cast<int64_t>(Tracer::nowNs() - startNs) / 1000;
+  if (offsetUs <= lastOffsetUs)
+    offsetUs = lastOffsetUs + 1;
+  lastOffsetUs = offsetUs;
+
+  for (const auto &path : paths) {
+    file << offsetUs << '\t' << path << '\n';
+  }
+  // A recording of a session that crashes is the useful one
+  file.flush();
+}
+
+bool ChangeRecording::load(const std::string &path,
+                           std::vector<RecordedBatch> &batches) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    livrn::Logger::error("Cannot open recording: ", path);
+    return false;
+  }
+  return parse(file, batches);
+}
+
+bool ChangeRecording::parse(std::istream &input,
+                            std::vector<RecordedBatch> &batches) {
+  std::string line;
+  int lineNumber = 0;
+
+  while (std::getline(input, line)) {
+    ++lineNumber;
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    size_t tab = line.find('\t');
+    int64_t offsetUs = -1;
+    if (tab != std::string::npos && tab > 0 && tab + 1 < line.size()) {
+      char *end = nullptr;
+      offsetUs = std::strtoll(line.c_str(), &end, 10);
+      if (end != line.c_str() + tab)
+        offsetUs = -1;
+    }
+    if (offsetUs < 0) {
+      livrn::Logger::error("Line ", lineNumber, ": expected offset<TAB>path");
+      return false;
+    }
+    if (!batches.empty() && offsetUs < batches.back().offsetUs) {
+      livrn::Logger::error("Line ", lineNumber, ": offsets go backwards");
+      return false;
+    }
+
+    if (batches.empty() || batches.back().offsetUs != offsetUs) {
+      batches.emplace_back();
+      batches.back().offsetUs = offsetUs;
+    }
+    batches.back().paths.push_back(line.substr(tab + 1));
+  }
+  return true;
+}
+
+} // namespace livrn
@@ -0,0 +1,41 @@
+#pragma once
+#include "../liverun.h"
+
+namespace livrn {
+
+struct RecordedBatch {
+  // From the start of the recording
+  int64_t offsetUs = 0;
+  std::vector<std::string> paths;
+};
+
+// Change batches as liverun observed them, written by --record and fed
+// back through the reload pipeline by --replay:
+//
+//   # liverun changes v1
+//   0	./src/main.cpp
+//   1520	./src/main.cpp
+//   1520	./src/util.h
+//
+// Each line holds a batch's offset in microseconds, a tab and one path;
+// consecutive lines with the same offset form one batch.
+class ChangeRecorder {
+public:
+  bool open(const std::string &path);
+  bool isOpen() const { return file.is_open(); }
+  void record(const std::vector<std::string> &paths);
+
+private:
+  std::ofstream file;
+  uint64_t startNs = 0;
+  int64_t lastOffsetUs = -1;
+};
+
+class ChangeRecording {
+public:
+  static bool load(const std::string &path,
+                   std::vector<RecordedBatch> &batches);
+  static bool parse(std::istream &input, std::vector<RecordedBatch> &batches);
+};
+
+} // namespace livrn
@@ -0,0 +1,229 @@
+#include "rules.h"
+#include "../logger.h"
+#include <algorithm>
+#include <fnmatch.h>
+
+namespace livrn {
+
+namespace {
+std::string trim(const std::string &text) {
+  size_t begin = text.find_first_not_of(" \t\r");
+  if (begin == std::string::npos)
+    return "";
+  size_t end = text.find_last_not_of(" \t\r");
+  return text.substr(begin, end - begin + 1);
+}
+
+// "HUP", "SIGHUP" or a number; 0 if unknown
+int parseSignal(std::string name) {
+  if (!name.empty() &&
+      std::all_of(name.begin(), name.end(), [](unsigned char c) {
+        return std::isdigit(c);
+      })) {
+    int signo = std::atoi(name.c_str());
+    return signo > 0 && signo < NSIG ? signo : 0;
+  }
+
+  std::transform(name.begin(), name.end(), name.begin(),
+                 [](unsigned char c) { return std::toupper(c); });
+  if (name.compare(0, 3, "SIG") == 0)
+    name = name.substr(3);
+
+  static const std::unordered_map<std::string, int> names = {
+      {"HUP", SIGHUP},   {"INT", SIGINT},   {"QUIT", SIGQUIT},
+      {"USR1", SIGUSR1}, {"USR2", SIGUSR2}, {"TERM", SIGTERM},
+      {"ALRM", SIGALRM}, {"CONT", SIGCONT}, {"WINCH", SIGWINCH}};
+  auto it = names.find(name);
+  return it == names.end() ? 0 : it->second;
+}
+
+// Position of the ']' closing the class opened at p, or nullptr
+const char *classEnd(const char *p) {
+  const char *q = p + 1;
+  if (*q == '!' || *q == '^')
+    ++q;
+  if (*q == ']')
+    ++q;
+  while (*q && *q != ']')
+    ++q;
+  return *q ? q : nullptr;
+}
+
+bool globMatch(const char *p, const char *s) {
+  for (; *p; ++p, ++s) {
+    if (*p == '*') {
+      bool deep = p[1] == '*';
+      while (*p == '*')
+        ++p;
+      // "**/" also matches no directory at all
+      if (deep && *p == '/' && globMatch(p + 1, s))
+        return true;
+      for (;; ++s) {
+        if (globMatch(p, s))
+          return true;
+        if (!*s || (!deep && *s == '/'))
+          return false;
+      }
+    }
+    if (!*s)
+      return false;
+
+    if (*p == '?') {
+      if (*s == '/')
+        return false;
+    } else if (const char *end = *p == '[' ? classEnd(p) : nullptr) {
+      std::string charClass(p, end + 1);
+      char c[2] = {*s, '\0'};
+      if (*s == '/' || fnmatch(charClass.c_str(), c, 0) != 0)
+        return false;
+      p = end;
+    } else if (*p != *s) {
+      return false;
+    }
+  }
+  return !*s;
+}
+} // namespace
+
+bool ActionRules::load(const std::string &path, ActionRules &rules) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    livrn::Logger::error("Cannot open rules file: ", path);
+    return false;
+  }
+  return parse(file, rules);
+}
+
+bool ActionRules::parse(std::istream &input, ActionRules &rules) {
+  std::string line;
+  int lineNumber = 0;
+
+  while (std::getline(input, line)) {
+    ++lineNumber;
+    line = trim(line);
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    size_t eq = line.find('=');
+    if (eq == std::string::npos) {
+      livrn::Logger::error("Line ", lineNumber, ": expected pattern = action");
+      return false;
+    }
+    ActionRule rule;
+    rule.pattern = trim(line.substr(0, eq));
+    std::string value = trim(line.substr(eq + 1));
+    size_t space = value.find_first_of(" \t");
+    std::string verb = value.substr(0, space);
+    std::string argument =
+        space == std::string::npos ? "" : trim(value.substr(space));
+
+    if (rule.pattern.empty()) {
+      livrn::Logger::error("Line ", lineNumber, ": empty pattern");
+      return false;
+    }
+    if (rule.pattern.compare(0, 2, "./") == 0)
+      rule.pattern = rule.pattern.substr(2);
+
+    if (verb == "rebuild") {
+      rule.action = ChangeAction::Rebuild;
+    } else if (verb == "restart") {
+      rule.action = ChangeAction::Restart;
+    } else if (verb == "ignore") {
+      rule.action = ChangeAction::Ignore;
+    } else if (verb == "signal") {
+      rule.action = ChangeAction::Signal;
+      rule.signo = parseSignal(argument.empty() ? "HUP" : argument);
+      if (rule.signo == 0) {
+        livrn::Logger::error("Line ", lineNumber, ": unknown signal '",
+                             argument, "'");
+        return false;
+      }
+    } else if (verb == "step") {
+      rule.action = ChangeAction::Step;
+      rule.command = argument;
+      if (rule.command.empty()) {
+        livrn::Logger::error("Line ", lineNumber, ": step needs a command");
+        return false;
+      }
+    } else {
+      livrn::Logger::error("Line ", lineNumber, ": unknown action '", verb,
+                           "'");
+      return false;
+    }
+    if (verb != "signal" && verb != "step" && !argument.empty()) {
+      livrn::Logger::error("Line ", lineNumber, ": ", verb,
+                           " takes no argument");
+      return false;
+    }
+    rules.rules.push_back(std::move(rule));
+  }
+  return true;
+}
+
+bool ActionRules::matches(const std::string &pattern,
+                          const std::string &path) {
+  const char *subject = path.c_str();
+  if (path.compare(0, 2, "./") == 0)
+    subject += 2;
+
+  if (pattern.find('/') == std::string::npos) {
+    const char *slash = std::strrchr(subject, '/');
+    if (slash)
+      subject = slash + 1;
+  }
+  return globMatch(pattern.c_str(), subject);
+}
+
+std::vector<std::string> ActionRules::watchedPatterns() const {
+  std::vector<std::string> patterns;
+  for (const auto &rule : rules) {
+    if (rule.action != ChangeAction::Ignore)
+      patterns.push_back(rule.pattern);
+  }
+  return patterns;
+}
+
+const ActionRule *ActionRules::find(const std::string &path) const {
+  for (const auto &rule : rules) {
+    if (matches(rule.pattern, path))
+      return &rule;
+  }
+  return nullptr;
+}
+
+ChangePlan ActionRules::plan(const std::vector<std::string> &paths) const {
+  ChangePlan result;
+  std::vector<bool> stepsHit(rules.size(), false);
+
+  for (const auto &path : paths) {
+    const ActionRule *rule = find(path);
+    ChangeAction action = rule ? rule->action : ChangeAction::Rebuild;
+    if (action == ChangeAction::Ignore)
+      continue;
+    if (action == ChangeAction::Step) {
+      stepsHit[rule - rules.data()] = true;
+      continue;
+    }
+
+    result.paths.push_back(path);
+    result.action = std::max(result.action, action);
+    if (action == ChangeAction::Signal &&
+        std::find(result.signals.begin(), result.signals.end(),
+                  rule->signo) == result.signals.end()) {
+      result.signals.push_back(rule->signo);
+    }
+  }
+
+  for (size_t i = 0; i < rules.size(); ++i) {
+    if (stepsHit[i] && std::find(result.steps.begin(), result.steps.end(),
+                                 rules[i].command) == result.steps.end()) {
+      result.steps.push_back(rules[i].command);
+    }
+  }
+  // A restarted app reads the change on startup anyway
+  if (result.action != ChangeAction::Signal)
+    result.signals.clear();
+  return result;
+}
+
+} // namespace livrn
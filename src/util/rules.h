@@ -0,0 +1,62 @@
+#pragma once
+#include "../liverun.h"
+
+namespace livrn {
+
+// Ordered from cheapest to most expensive
+enum class ChangeAction { Ignore, Signal, Step, Restart, Rebuild };
+
+struct ActionRule {
+  std::string pattern;
+  ChangeAction action = ChangeAction::Rebuild;
+  int signo = 0;
+  std::string command;
+};
+
+// The cheapest response that covers a change batch
+struct ChangePlan {
+  // Commands of the step rules hit, in rule order; they run first
+  std::vector<std::string> steps;
+  // Ignore, Signal, Restart or Rebuild, applied once the steps succeed
+  ChangeAction action = ChangeAction::Ignore;
+  std::vector<int> signals;
+  // The changes behind action; ignored and step-only paths are left out
+  std::vector<std::string> paths;
+};
+
+// Maps changed paths to what they require, read from RULES_FILE or
+// --rules:
+//
+//   # pattern = action
+//   config/*.yaml = signal HUP
+//   templates/** = restart
+//   static/** = ignore
+//   proto/*.proto = step make proto
+//   *.cpp = rebuild
+//
+// The first matching rule wins; paths no rule matches rebuild. Patterns
+// without a '/' match the file name in any directory, others the path from
+// the watched root. '*' and '?' stay within one directory, '**' spans any
+// number of them and [...] matches a character class. Files matched by a
+// rule other than ignore are watched whatever their extension.
+class ActionRules {
+public:
+  static bool load(const std::string &path, ActionRules &rules);
+  static bool parse(std::istream &input, ActionRules &rules);
+  // path in the monitor's form ("./config/app.yaml") or relative
+  static bool matches(const std::string &pattern, const std::string &path);
+
+  bool empty() const { return rules.empty(); }
+  const std::vector<ActionRule> &all() const { return rules; }
+  // Patterns whose files must be watched for the rules to apply
+  std::vector<std::string> watchedPatterns() const;
+
+  // First rule matching path, or nullptr for a full rebuild
+  const ActionRule *find(const std::string &path) const;
+  ChangePlan plan(const std::vector<std::string> &paths) const;
+
+private:
+  std::vector<ActionRule> rules;
+};
+
+} // namespace livrn
@@ -0,0 +1,107 @@
+#include "services.h"
+#include "../logger.h"
+
+namespace livrn {
+
+namespace {
+std::string trim(const std::string &text) {
+  size_t begin = text.find_first_not_of(" \t\r");
+  if (begin == std::string::npos)
+    return "";
+  size_t end = text.find_last_not_of(" \t\r");
+  return text.substr(begin, end - begin + 1);
+}
+} // namespace
+
+bool ServiceFile::load(const std::string &path, ServiceConfig &config) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    livrn::Logger::error("Cannot open services file: ", path);
+    return false;
+  }
+  return parse(file, config);
+}
+
+bool ServiceFile::parse(std::istream &input, ServiceConfig &config) {
+  std::string line;
+  int lineNumber = 0;
+  ServiceDefinition *current = nullptr;
+
+  while (std::getline(input, line)) {
+    ++lineNumber;
+    line = trim(line);
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    if (line.front() == '[') {
+      if (line.back() != ']' || line.size() < 3) {
+        livrn::Logger::error("Line ", lineNumber, ": bad section header");
+        return false;
+      }
+      config.services.emplace_back();
+      current = &config.services.back();
+      current->name = trim(line.substr(1, line.size() - 2));
+      continue;
+    }
+
+    size_t eq = line.find('=');
+    if (eq == std::string::npos) {
+      livrn::Logger::error("Line ", lineNumber, ": expected key = value");
+      return false;
+    }
+    std::string key = trim(line.substr(0, eq));
+    std::string value = trim(line.substr(eq + 1));
+
+    if (!current) {
+      if (key == "jobs") {
+        try {
+          config.jobs = std::stoul(value);
+        } catch (const std::exception &) {
+          livrn::Logger::error("Line ", lineNumber, ": invalid jobs value");
+          return false;
+        }
+        continue;
+      }
+      livrn::Logger::error("Line ", lineNumber, ": unknown setting '", key,
+                           "'");
+      return false;
+    }
+
+    if (key == "cwd") {
+      current->workingDirectory = value;
+    } else if (key == "watch") {
+      current->watchPaths.push_back(value);
+    } else if (key == "build") {
+      current->buildCommands.push_back(value);
+    } else if (key == "run") {
+      current->runCommand = value;
+    } else {
+      livrn::Logger::error("Line ", lineNumber, ": unknown key '", key,
+                           "' in [", current->name, "]");
+      return false;
+    }
+  }
+
+  if (config.services.empty()) {
+    livrn::Logger::error("No services defined");
+    return false;
+  }
+
+  std::unordered_set<std::string> names;
+  for (auto &service : config.services) {
+    if (service.runCommand.empty()) {
+      livrn::Logger::error("Service [", service.name, "] has no run command");
+      return false;
+    }
+    if (!names.insert(service.name).second) {
+      livrn::Logger::error("Duplicate service [", service.name, "]");
+      return false;
+    }
+    if (service.watchPaths.empty() && !service.workingDirectory.empty()) {
+      service.watchPaths.push_back(service.workingDirectory);
+    }
+  }
+  return true;
+}
+
+} // namespace livrn
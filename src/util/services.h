@@ -0,0 +1,40 @@
+#pragma once
+#include "../liverun.h"
+
+namespace livrn {
+
+struct ServiceDefinition {
+  std::string name;
+  std::string workingDirectory;
+  std::vector<std::string> watchPaths;
+  std::vector<std::string> buildCommands;
+  std::string runCommand;
+};
+
+struct ServiceConfig {
+  // Concurrent build steps across all services; 0 picks half the cores
+  size_t jobs = 0;
+  std::vector<ServiceDefinition> services;
+};
+
+// Reads a supervisor definition file:
+//
+//   jobs = 4
+//
+//   [api]
+//   cwd = services/api
+//   watch = services/api
+//   watch = lib/common
+//   build = make api
+//   run = ./bin/api
+//
+// "build" and "watch" may repeat. "watch" defaults to "cwd", or the whole
+// tree when neither is set. Blank lines and lines starting with # are
+// ignored.
+class ServiceFile {
+public:
+  static bool load(const std::string &path, ServiceConfig &config);
+  static bool parse(std::istream &input, ServiceConfig &config);
+};
+
+} // namespace livrn
@@ -0,0 +1,181 @@
+#include "testmap.h"
+
+namespace livrn {
+namespace {
+
+std::string monitorPath(const fs::path &path) {
+  if (path.is_absolute()) {
+    std::error_code ec;
+    fs::path relative = path.lexically_relative(fs::current_path(ec));
+    if (ec || relative.empty() || *relative.begin() == "..")
+      return path.lexically_normal().string();
+    return "./" + relative.lexically_normal().string();
+  }
+  return "./" + path.lexically_normal().string();
+}
+
+// Splits a make rule line into words, honouring "\ " escapes
+std::vector<std::string> splitWords(const std::string &text) {
+  std::vector<std::string> words;
+  std::string word;
+  for (size_t i = 0; i < text.size(); ++i) {
+    char c = text[i];
+    if (c == '\\' && i + 1 < text.size() && text[i + 1] == ' ') {
+      word += ' ';
+      ++i;
+    } else if (std::isspace(static_cast<unsigned char>(c))) {
+      if (!word.empty())
+        words.push_back(std::move(word));
+      word.clear();
+    } else {
+      word += c;
+    }
+  }
+  if (!word.empty())
+    words.push_back(std::move(word));
+  return words;
+}
+
+} // namespace
+
+std::string TestMap::nameOf(const std::string &path) {
+  std::string name = fs::path(path).filename().string();
+  size_t dot = name.find('.');
+  return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+bool TestMap::isTestFile(const std::string &path) {
+  return !subjectOf(path).empty();
+}
+
+std::string TestMap::subjectOf(const std::string &path) {
+  std::string name = fs::path(path).filename().string();
+  size_t dot = name.rfind('.');
+  std::string stem = dot == std::string::npos ? name : name.substr(0, dot);
+
+  if (stem.size() > 5 && stem.compare(0, 5, "test_") == 0)
+    return stem.substr(5);
+  for (const char *suffix : {"_test", ".test", "_spec", ".spec"}) {
+    size_t length = std::strlen(suffix);
+    if (stem.size() > length &&
+        stem.compare(stem.size() - length, length, suffix) == 0) {
+      return stem.substr(0, stem.size() - length);
+    }
+  }
+  return "";
+}
+
+void TestMap::addTest(const std::string &path) {
+  if (allTests.insert(path).second)
+    testsBySubject[subjectOf(path)].insert(path);
+}
+
+void TestMap::removeTest(const std::string &path) {
+  if (allTests.erase(path) == 0)
+    return;
+  auto it = testsBySubject.find(subjectOf(path));
+  if (it != testsBySubject.end()) {
+    it->second.erase(path);
+    if (it->second.empty())
+      testsBySubject.erase(it);
+  }
+}
+
+std::string TestMap::testForTarget(const std::string &target) const {
+  std::string path = monitorPath(target);
+  if (allTests.count(path))
+    return path;
+
+  std::string name = nameOf(target);
+  for (const auto &test : allTests) {
+    if (nameOf(test) == name)
+      return test;
+  }
+  return "";
+}
+
+bool TestMap::loadDependencies(const std::string &depFile) {
+  std::ifstream input(depFile);
+  if (!input.is_open()) {
+    dependencies.erase(depFile);
+    return false;
+  }
+
+  fs::path depDir = fs::path(depFile).parent_path();
+  std::map<std::string, std::vector<std::string>> links;
+  std::string rule;
+  std::string line;
+  while (std::getline(input, line)) {
+    if (!line.empty() && line.back() == '\\') {
+      line.pop_back();
+      rule += line + " ";
+      continue;
+    }
+    rule += line;
+
+    size_t colon = rule.find(':');
+    if (colon != std::string::npos && rule[0] != '#') {
+      std::vector<std::string> prerequisites =
+          splitWords(rule.substr(colon + 1));
+      for (const auto &target : splitWords(rule.substr(0, colon))) {
+        std::string test = testForTarget(target);
+        if (test.empty())
+          continue;
+
+        for (const auto &prerequisite : prerequisites) {
+          // Compilers write paths relative to where they ran, which is
+          // usually the project root and sometimes the build directory
+          fs::path source(prerequisite);
+          std::error_code ec;
+          if (source.is_relative() && !fs::exists(source, ec))
+            source = depDir / source;
+          links[test].push_back(monitorPath(source));
+        }
+      }
+    }
+    rule.clear();
+  }
+
+  dependencies[depFile] = std::move(links);
+  return true;
+}
+
+std::set<std::string>
+TestMap::affected(const std::vector<std::string> &changed,
+                  std::vector<std::string> *unmapped) const {
+  std::unordered_map<std::string, std::set<std::string>> testsBySource;
+  for (const auto &[file, links] : dependencies) {
+    for (const auto &[test, sources] : links) {
+      if (!allTests.count(test))
+        continue;
+      for (const auto &source : sources) {
+        testsBySource[source].insert(test);
+      }
+    }
+  }
+
+  std::set<std::string> selected;
+  for (const auto &path : changed) {
+    if (allTests.count(path)) {
+      selected.insert(path);
+      continue;
+    }
+
+    bool mapped = false;
+    auto bySubject = testsBySubject.find(nameOf(path));
+    if (bySubject != testsBySubject.end()) {
+      selected.insert(bySubject->second.begin(), bySubject->second.end());
+      mapped = true;
+    }
+    auto bySource = testsBySource.find(path);
+    if (bySource != testsBySource.end()) {
+      selected.insert(bySource->second.begin(), bySource->second.end());
+      mapped = true;
+    }
+    if (!mapped && unmapped)
+      unmapped->push_back(path);
+  }
+  return selected;
+}
+
+} // namespace livrn
@@ -0,0 +1,50 @@
+#pragma once
+#include "../liverun.h"
+#include <map>
+#include <set>
+
+namespace livrn {
+
+// Maps source files to the tests that exercise them. Paths use the
+// monitor's form ("./src/parser.cpp"). Links come from three places:
+//
+//   - naming: tests/test_parser.py, parser_test.go and parser.test.ts all
+//     cover any source whose stem is "parser";
+//   - make dependency files (gcc -MMD): every prerequisite of a target
+//     named after a test is linked to that test;
+//   - TEST_MAP_FILE, in the same "test: source source ..." syntax, for
+//     links exported from a coverage run.
+class TestMap {
+public:
+  static bool isTestFile(const std::string &path);
+  // File name up to its first dot, so "test_parser.cpp.o" from a build
+  // directory and "test_parser.cpp" reduce to the same name
+  static std::string nameOf(const std::string &path);
+  // "test_parser.py" -> "parser"; empty for files that are not tests
+  static std::string subjectOf(const std::string &path);
+
+  void addTest(const std::string &path);
+  void removeTest(const std::string &path);
+
+  // Replaces the links read from depFile earlier. Returns false if the
+  // file cannot be read.
+  bool loadDependencies(const std::string &depFile);
+
+  // Tests to rerun for a change batch. unmapped lists changed sources no
+  // test is linked to.
+  std::set<std::string> affected(const std::vector<std::string> &changed,
+                                 std::vector<std::string> *unmapped) const;
+
+  const std::set<std::string> &tests() const { return allTests; }
+
+private:
+  std::set<std::string> allTests;
+  std::unordered_map<std::string, std::set<std::string>> testsBySubject;
+  // Dependency file -> test -> prerequisites
+  std::map<std::string, std::map<std::string, std::vector<std::string>>>
+      dependencies;
+
+  std::string testForTarget(const std::string &target) const;
+};
+
+} // namespace livrn
@@ -0,0 +1,156 @@
+#include "tracer.h"
+#include "metrics.h"
+#include <time.h>
+
+namespace livrn {
+
+namespace {
+uint32_t currentThreadId() {
+  static std::atomic<uint32_t> nextId{1};
+  thread_local uint32_t id = nextId.fetch_add(1, std::memory_order_relaxed);
+  return id;
+}
+
+// A TraceEvent less its sequence number, copied out for export
+struct EventFields {
+  const char *category;
+  const char *name;
+  const char *argName;
+  int64_t argValue;
+  uint64_t startNs;
+  uint64_t durationNs;
+  uint32_t tid;
+  char phase;
+};
+} // namespace
+
+Tracer &Tracer::instance() {
+  // Never destroyed: spans may still be recorded from static destructors
+  // (e.g. the reloader killing its child at exit).
+  static Tracer *tracer = new Tracer();
+  return *tracer;
+}
+
+uint64_t Tracer::nowNs() {
+  timespec ts{};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull +
+         static_cast<uint64_t>(ts.tv_nsec);
+}
+
+int64_t Tracer::msSince(uint64_t startNs) {
+  return static_cast<int64_t>(nowNs() - startNs) / 1000000;
+}
+
+void Tracer::enable(size_t eventCapacity) {
+  if (isEnabled() || eventCapacity == 0)
+    return;
+
+  events = std::make_unique<TraceEvent[]>(eventCapacity);
+  capacity = eventCapacity;
+  head.store(0, std::memory_order_relaxed);
+  enabled.store(true, std::memory_order_release);
+}
+
+size_t Tracer::size() const {
+  uint64_t recorded = head.load(std::memory_order_acquire);
+  return recorded < capacity ? recorded : capacity;
+}
+
+void Tracer::record(char phase, const char *category, const char *name,
+                    uint64_t startNs, uint64_t durationNs,
+                    const char *argName, int64_t argValue) {
+  if (!enabled.load(std::memory_order_acquire))
+    return;
+
+  uint64_t index = head.fetch_add(1, std::memory_order_relaxed);
+  TraceEvent &ev = events[index % capacity];
+
+  // Invalidate the slot while it is rewritten so a concurrent export skips it
+  ev.seq.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  ev.category = category;
+  ev.name = name;
+  ev.argName = argName;
+  ev.argValue = argValue;
+  ev.startNs = startNs;
+  ev.durationNs = durationNs;
+  ev.tid = currentThreadId();
+  ev.phase = phase;
+  ev.seq.store(index + 1, std::memory_order_release);
+}
+
+void Tracer::complete(const char *category, const char *name, uint64_t startNs,
+                      uint64_t endNs, const char *argName, int64_t argValue) {
+  uint64_t durationNs = endNs > startNs ? endNs - startNs : 0;
+  Metrics::instance().observeSpan(name, durationNs);
+  record('X', category, name, startNs, durationNs, argName, argValue);
+}
+
+void Tracer::instant(const char *category, const char *name,
+                     const char *argName, int64_t argValue) {
+  record('i', category, name, nowNs(), 0, argName, argValue);
+}
+
+bool Tracer::exportChromeTrace(const std::string &path) const {
+  std::ofstream out(path, std::ios::trunc);
+  if (!out.is_open())
+    return false;
+
+  uint64_t end = head.load(std::memory_order_acquire);
+  uint64_t begin = end > capacity ? end - capacity : 0;
+  pid_t pid = getpid();
+
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  char ts[64];
+  for (uint64_t i = begin; i < end; ++i) {
+    // Seqlock read: copy the slot, then skip it if a writer claimed it
+    // meanwhile, since the copy may mix two events
+    const TraceEvent &slot = events[i % capacity];
+    if (slot.seq.load(std::memory_order_acquire) != i + 1)
+      continue;
+    EventFields ev = {slot.category, slot.name, slot.argName,
+                      slot.argValue, slot.startNs, slot.durationNs,
+                      slot.tid, slot.phase};
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) != i + 1)
+      continue;
+
+    out << (first ? "\n" : ",\n");
+    first = false;
+
+    snprintf(ts, sizeof(ts), "%.3f", ev.startNs / 1000.0);
+    out << "{\"name\":\"" << ev.name << "\",\"cat\":\"" << ev.category
+        << "\",\"ph\":\"" << ev.phase << "\",\"ts\":" << ts
+        << ",\"pid\":" << pid << ",\"tid\":" << ev.tid;
+    if (ev.phase == 'X') {
+      snprintf(ts, sizeof(ts), "%.3f", ev.durationNs / 1000.0);
+      out << ",\"dur\":" << ts;
+    } else {
+      out << ",\"s\":\"t\"";
+    }
+    if (ev.argName) {
+      out << ",\"args\":{\"" << ev.argName << "\":" << ev.argValue << "}";
+    }
+    out << "}";
+  }
+  out << "\n]}\n";
+  return out.good();
+}
+
+TraceSpan::TraceSpan(const char *category, const char *name)
+    : category(category), name(name) {
+  // Metrics are fed from the same spans
+  if (Tracer::instance().isEnabled() || Metrics::instance().isEnabled())
+    startNs = Tracer::nowNs();
+}
+
+TraceSpan::~TraceSpan() {
+  if (startNs == 0)
+    return;
+  Tracer::instance().complete(category, name, startNs, Tracer::nowNs(),
+                              argName, argValue);
+}
+
+} // namespace livrn
@@ -0,0 +1,80 @@
+#pragma once
+#include "../config.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace livrn {
+
+struct TraceEvent {
+  std::atomic<uint64_t> seq{0};
+  const char *category = nullptr;
+  const char *name = nullptr;
+  const char *argName = nullptr;
+  int64_t argValue = 0;
+  uint64_t startNs = 0;
+  uint64_t durationNs = 0;
+  uint32_t tid = 0;
+  char phase = 'X';
+};
+
+// Records reload-pipeline spans into a preallocated ring buffer. Category,
+// name and argument names must be string literals: events store the pointers
+// only, so recording never allocates.
+class Tracer {
+private:
+  std::unique_ptr<TraceEvent[]> events;
+  size_t capacity = 0;
+  std::atomic<uint64_t> head{0};
+  std::atomic<bool> enabled{false};
+
+  void record(char phase, const char *category, const char *name,
+              uint64_t startNs, uint64_t durationNs, const char *argName,
+              int64_t argValue);
+
+public:
+  static Tracer &instance();
+  static uint64_t nowNs();
+  // Whole milliseconds from startNs, a nowNs() reading, until now
+  static int64_t msSince(uint64_t startNs);
+
+  void enable(size_t eventCapacity = Config::TRACE_BUFFER_CAPACITY);
+  bool isEnabled() const {
+    return enabled.load(std::memory_order_relaxed);
+  }
+  size_t size() const;
+
+  // Completed spans also feed the matching Metrics histogram
+  void complete(const char *category, const char *name, uint64_t startNs,
+                uint64_t endNs, const char *argName = nullptr,
+                int64_t argValue = 0);
+  void instant(const char *category, const char *name,
+               const char *argName = nullptr, int64_t argValue = 0);
+
+  // Writes the buffered events as Chrome trace-event JSON, loadable in
+  // chrome://tracing and ui.perfetto.dev.
+  bool exportChromeTrace(const std::string &path) const;
+};
+
+class TraceSpan {
+private:
+  const char *category;
+  const char *name;
+  const char *argName = nullptr;
+  int64_t argValue = 0;
+  uint64_t startNs = 0;
+
+public:
+  TraceSpan(const char *category, const char *name);
+  ~TraceSpan();
+
+  TraceSpan(const TraceSpan &) = delete;
+  TraceSpan &operator=(const TraceSpan &) = delete;
+
+  void setArg(const char *key, int64_t value) {
+    argName = key;
+    argValue = value;
+  }
+};
+
+} // namespace livrn
@@ -0,0 +1,167 @@
+#include "../src/process/attribution.h"
+#include "test_helpers.h"
+#include <gtest/gtest.h>
+
+class WriteAttributionTest : public ::testing::Test {
+protected:
+  void SetUp() override { TestEnvironment::SetUpTestDirectory(); }
+
+  void TearDown() override {
+    for (pid_t pid : children) {
+      // The whole group, so no grandchild keeps ctest's output pipe open
+      ::kill(-pid, SIGKILL);
+      waitpid(pid, nullptr, 0);
+    }
+    TestEnvironment::TearDownTestDirectory();
+  }
+
+  std::vector<pid_t> children;
+
+  pid_t spawnShell(const std::string &script) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      setpgid(0, 0);
+      execl("/bin/sh", "sh", "-c", script.c_str(), nullptr);
+      _exit(127);
+    }
+    // Also from the parent, so teardown never races the child's setpgid
+    setpgid(pid, pid);
+    children.push_back(pid);
+    return pid;
+  }
+
+  static void finish(pid_t pid) { waitpid(pid, nullptr, 0); }
+
+  // When the monitor would have picked up a new file
+  static int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+  }
+};
+
+TEST_F(WriteAttributionTest, NothingIsOwnedWithoutWindows) {
+  TestEnvironment::createTestFile("main.cpp", "int main() {}");
+
+  livrn::WriteAttribution attribution;
+  EXPECT_FALSE(attribution.isOwnWrite("./main.cpp"));
+}
+
+TEST_F(WriteAttributionTest, BuildOutputsAreOwnAndEditsAreNot) {
+  TestEnvironment::createTestFile("main.cpp", "int main() {}");
+  TestEnvironment::createTestFile("edited.h", "// before\n");
+
+  livrn::WriteAttribution attribution;
+  attribution.noteEdit("./edited.h");
+
+  pid_t build = spawnShell("echo '#define GENERATED 1' > gen.h; "
+                           "echo '// regenerated' > edited.h");
+  attribution.begin(build, livrn::WriteAttribution::Kind::Build);
+  finish(build);
+  attribution.end(build);
+
+  // Created by the build
+  EXPECT_TRUE(attribution.isOwnWrite("./gen.h", nowNs()));
+  // Written before the build started
+  EXPECT_FALSE(attribution.isOwnWrite("./main.cpp"));
+  // Edited by hand earlier, so a change during a build still counts
+  EXPECT_FALSE(attribution.isOwnWrite("./edited.h"));
+
+  // A later hand edit of the output is not part of a build, even while the
+  // app runs
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  pid_t app = spawnShell("sleep 30");
+  attribution.begin(app, livrn::WriteAttribution::Kind::App);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  TestEnvironment::createTestFile("gen.h", "#define GENERATED 2\n");
+  EXPECT_FALSE(attribution.isOwnWrite("./gen.h"));
+}
+
+TEST_F(WriteAttributionTest, EditsDuringABuildOrWhileTheAppRunsAreNotOwn) {
+  TestEnvironment::createTestFile("mod.py", "x = 1\n");
+
+  livrn::WriteAttribution attribution;
+  pid_t build = spawnShell("sleep 30");
+  attribution.begin(build, livrn::WriteAttribution::Kind::Build);
+
+  // Saved by hand while the build runs: the file existed and no tracked
+  // process holds it open
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  TestEnvironment::modifyTestFile("mod.py", "x = 2\n");
+  EXPECT_FALSE(attribution.isOwnWrite("./mod.py"));
+
+  ::kill(-build, SIGKILL);
+  finish(build);
+  attribution.end(build);
+
+  pid_t app = spawnShell("sleep 30");
+  attribution.begin(app, livrn::WriteAttribution::Kind::App);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  TestEnvironment::modifyTestFile("mod.py", "x = 3\n");
+  EXPECT_FALSE(attribution.isOwnWrite("./mod.py"));
+}
+
+TEST_F(WriteAttributionTest, CheckedInOutputsReloadOnlyOnce) {
+  TestEnvironment::createTestFile("gen.h", "#define VERSION 0\n");
+  livrn::WriteAttribution attribution;
+
+  // Every build rewrites the existing header; only the first rewrite
+  // cannot be told from an edit
+  std::vector<bool> own;
+  for (int i = 1; i <= 3; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    pid_t build = spawnShell("echo '#define VERSION " + std::to_string(i) +
+                             "' > gen.h");
+    attribution.begin(build, livrn::WriteAttribution::Kind::Build);
+    finish(build);
+    attribution.end(build);
+    own.push_back(attribution.isOwnWrite("./gen.h"));
+  }
+  EXPECT_EQ(own, (std::vector<bool>{false, true, true}));
+
+  // A hand edit between builds resets it
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  TestEnvironment::modifyTestFile("gen.h", "#define VERSION 9\n");
+  EXPECT_FALSE(attribution.isOwnWrite("./gen.h"));
+}
+
+TEST_F(WriteAttributionTest, WritersReportedByTheBackendAreOwn) {
+  TestEnvironment::createTestFile("cache.py", "x = 1\n");
+  livrn::WriteAttribution attribution;
+  pid_t app = spawnShell("sleep 30");
+  attribution.begin(app, livrn::WriteAttribution::Kind::App);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  TestEnvironment::modifyTestFile("cache.py", "x = 2\n");
+  EXPECT_TRUE(attribution.isOwnWrite("./cache.py", 0, true));
+  EXPECT_FALSE(attribution.isOwnWrite("./cache.py", 0, false));
+}
+
+TEST_F(WriteAttributionTest, FilesHeldOpenByTheAppAreOwn) {
+  livrn::WriteAttribution attribution;
+
+  // The app's child keeps the file open for writing
+  pid_t app = spawnShell("(exec 3>>cache.py; echo x >&3; sleep 30) & wait");
+  attribution.begin(app, livrn::WriteAttribution::Kind::App);
+
+  for (int i = 0; i < 100 && !fs::exists("cache.py"); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_TRUE(attribution.isOwnWrite("./cache.py"));
+
+  TestEnvironment::createTestFile("app.py", "print('edited')\n");
+  EXPECT_FALSE(attribution.isOwnWrite("./app.py"));
+}
+
+TEST_F(WriteAttributionTest, OwnsDescendantsOfTrackedProcesses) {
+  livrn::WriteAttribution attribution;
+  pid_t app = spawnShell("sleep 30 & wait");
+  attribution.begin(app, livrn::WriteAttribution::Kind::App);
+
+  EXPECT_TRUE(attribution.ownsProcess(app));
+  EXPECT_FALSE(attribution.ownsProcess(getpid()));
+
+  attribution.end(app);
+  EXPECT_FALSE(attribution.ownsProcess(app));
+}
@@ -0,0 +1,94 @@
+#include "../src/process/sequence.h"
+#include "test_helpers.h"
+#include <gtest/gtest.h>
+
+using Outcome = livrn::BuildSequence::Outcome;
+
+class BuildSequenceTest : public ::testing::Test {
+protected:
+  livrn::EventLoop loop;
+
+  void SetUp() override { TestEnvironment::SetUpTestDirectory(); }
+  void TearDown() override { TestEnvironment::TearDownTestDirectory(); }
+
+  // Runs sequence until it finishes or timeoutMs passes
+  Outcome runToEnd(livrn::BuildSequence &sequence, int timeoutMs = 5000) {
+    Outcome result = Outcome::Stopped;
+    bool done = false;
+    sequence.run([&](Outcome outcome) {
+      result = outcome;
+      done = true;
+      loop.stop();
+    });
+    livrn::Timer timeout(loop, [&]() { loop.stop(); });
+    timeout.start(timeoutMs);
+    if (!done)
+      loop.run();
+    EXPECT_TRUE(done);
+    return result;
+  }
+
+  static std::vector<livrn::PreparedCommand>
+  steps(std::initializer_list<std::vector<std::string>> commands) {
+    std::vector<livrn::PreparedCommand> prepared;
+    for (const auto &cmd : commands) {
+      prepared.emplace_back(cmd);
+    }
+    return prepared;
+  }
+};
+
+TEST_F(BuildSequenceTest, StopsAtTheFirstFailingStep) {
+  livrn::BuildSequence sequence(loop, steps({{"touch", "first"},
+                                             {"false"},
+                                             {"touch", "third"}}));
+  testing::internal::CaptureStdout();
+  Outcome outcome = runToEnd(sequence);
+  std::string output = testing::internal::GetCapturedStdout();
+
+  EXPECT_EQ(outcome, Outcome::Failed);
+  EXPECT_TRUE(fs::exists("first"));
+  EXPECT_FALSE(fs::exists("third"));
+  EXPECT_NE(output.find("Build step failed: false"), std::string::npos);
+}
+
+TEST_F(BuildSequenceTest, RestartRunsEveryStepAgain) {
+  livrn::BuildSequence sequence(
+      loop, steps({{"sh", "-c", "echo a >> runs; sleep 0.2"},
+                   {"sh", "-c", "echo b >> runs"}}));
+  livrn::Timer edit(loop, [&]() { sequence.restart(); });
+  edit.start(50);
+  testing::internal::CaptureStdout();
+  Outcome outcome = runToEnd(sequence);
+  testing::internal::GetCapturedStdout();
+
+  EXPECT_EQ(outcome, Outcome::Succeeded);
+  std::ifstream runs("runs");
+  std::string all((std::istreambuf_iterator<char>(runs)),
+                  std::istreambuf_iterator<char>());
+  EXPECT_EQ(all, "a\na\nb\n");
+}
+
+TEST_F(BuildSequenceTest, StopGivesUpAWaitForTheSlot) {
+  livrn::BuildPool pool(1);
+  pool.acquire(this, []() {});
+
+  livrn::BuildSequence sequence(loop, steps({{"touch", "built"}}));
+  sequence.setBuildPool(&pool);
+  bool stopped = false;
+  sequence.run([&](Outcome outcome) {
+    stopped = outcome == Outcome::Stopped;
+  });
+  EXPECT_TRUE(sequence.isRunning());
+  EXPECT_EQ(pool.queued(), 1u);
+
+  sequence.stop();
+  EXPECT_TRUE(stopped);
+  EXPECT_FALSE(sequence.isRunning());
+  EXPECT_EQ(pool.queued(), 0u);
+
+  // The slot goes to nobody once released
+  pool.release();
+  EXPECT_EQ(pool.busy(), 0u);
+  EXPECT_FALSE(fs::exists("built"));
+}
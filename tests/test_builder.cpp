@@ -52,3 +52,20 @@ TEST_F(BuilderTest, CompileUnsafeCommand) {
   bool success = compiler.compileSync("g++ hello.cpp -o hello; rm -rf /");
   EXPECT_FALSE(success);
 }
+
+TEST_F(BuilderTest, CompileQuotedSourcePath) {
+  if (system("which g++ > /dev/null 2>&1") != 0) {
+    GTEST_SKIP() << "g++ not available in test environment";
+  }
+
+  TestEnvironment::createTestFile("my file.cpp", "int main() { return 0; }\n");
+
+  livrn::PreparedCommand build;
+  ASSERT_TRUE(
+      processManager.prepareCommand("g++ \"my file.cpp\" -o spaced", build));
+
+  // The prepared block is reused verbatim across rebuilds
+  EXPECT_TRUE(compiler.compileSync(build));
+  EXPECT_TRUE(compiler.compileSync(build));
+  EXPECT_TRUE(fs::exists("spaced"));
+}
@@ -0,0 +1,68 @@
+#include "../src/process/bulk.h"
+#include "test_helpers.h"
+#include <gtest/gtest.h>
+
+class BulkChangeTest : public ::testing::Test {
+protected:
+  void SetUp() override { TestEnvironment::SetUpTestDirectory(); }
+
+  void TearDown() override { TestEnvironment::TearDownTestDirectory(); }
+};
+
+TEST_F(BulkChangeTest, ChangeRateStartsBurst) {
+  livrn::BulkChangeDetector detector(10);
+  detector.initialize();
+
+  EXPECT_EQ(detector.observe(3), "");
+  EXPECT_EQ(detector.observe(5), "");
+  EXPECT_NE(detector.observe(4), "");
+
+  detector.reset();
+  EXPECT_EQ(detector.observe(1), "");
+}
+
+TEST_F(BulkChangeTest, GitCheckoutStartsBurst) {
+  fs::create_directory(".git");
+  TestEnvironment::createTestFile(".git/HEAD", "ref: refs/heads/main\n");
+  TestEnvironment::createTestFile(".git/index", "");
+  auto old = fs::file_time_type::clock::now() - std::chrono::hours(1);
+  fs::last_write_time(".git/HEAD", old);
+  fs::last_write_time(".git/index", old);
+
+  livrn::BulkChangeDetector detector(0);
+  detector.initialize();
+  EXPECT_EQ(fs::path(detector.gitDirectory()).filename(), ".git");
+  EXPECT_EQ(detector.observe(1000), "");
+
+  TestEnvironment::createTestFile(".git/index.lock", "");
+  EXPECT_TRUE(detector.gitBusy());
+  EXPECT_NE(detector.observe(1), "");
+
+  fs::remove(".git/index.lock");
+  EXPECT_FALSE(detector.gitBusy());
+  TestEnvironment::modifyTestFile(".git/HEAD", "ref: refs/heads/topic\n");
+  EXPECT_NE(detector.observe(1), "");
+
+  // The checkout was handled; the same HEAD write does not count again
+  detector.reset();
+  EXPECT_EQ(detector.observe(1), "");
+}
+
+TEST_F(BulkChangeTest, IndexRefreshIsNotACheckout) {
+  fs::create_directory(".git");
+  TestEnvironment::createTestFile(".git/HEAD", "ref: refs/heads/main\n");
+  TestEnvironment::createTestFile(".git/index", "");
+  auto old = fs::file_time_type::clock::now() - std::chrono::hours(1);
+  fs::last_write_time(".git/HEAD", old);
+
+  livrn::BulkChangeDetector detector(0);
+  detector.initialize();
+
+  // git add, git status and editors rewrite the index on their own
+  TestEnvironment::modifyTestFile(".git/index", "staged");
+  EXPECT_EQ(detector.observe(1), "");
+
+  // A reset leaves ORIG_HEAD behind
+  TestEnvironment::createTestFile(".git/ORIG_HEAD", "0123abcd\n");
+  EXPECT_NE(detector.observe(1), "");
+}
@@ -14,19 +14,32 @@ TEST_F(CommandTest, ParseSimpleCommand) {
   EXPECT_EQ(result[3], "main");
 }
 
-// FIXME
-//  TEST_F(CommandTest, ParseCommandWithQuotes) {
-//    auto result =
-//        livrn::Command::parseCommand("gcc \"main file.cpp\" -o \"output
-//        file\"");
-//
-//    ASSERT_EQ(result.size(), 4);
-//    EXPECT_EQ(result[0], "gcc");
-//    EXPECT_EQ(result[1], "main file.cpp");
-//    EXPECT_EQ(result[2], "-o");
-//    EXPECT_EQ(result[3], "output file");
-//  }
-//
+TEST_F(CommandTest, ParseCommandWithQuotes) {
+  auto result =
+      livrn::Command::parseCommand("gcc \"main file.cpp\" -o \"output file\"");
+
+  ASSERT_EQ(result.size(), 4);
+  EXPECT_EQ(result[0], "gcc");
+  EXPECT_EQ(result[1], "main file.cpp");
+  EXPECT_EQ(result[2], "-o");
+  EXPECT_EQ(result[3], "output file");
+}
+
+TEST_F(CommandTest, ParseCommandWithEscapesAndSingleQuotes) {
+  auto result = livrn::Command::parseCommand(
+      "go run 'my app'/main.go -msg=\"say \\\"hi\\\"\" a\\ b");
+
+  ASSERT_EQ(result.size(), 5);
+  EXPECT_EQ(result[2], "my app/main.go");
+  EXPECT_EQ(result[3], "-msg=say \"hi\"");
+  EXPECT_EQ(result[4], "a b");
+}
+
+TEST_F(CommandTest, ParseUnterminatedQuote) {
+  EXPECT_TRUE(livrn::Command::parseCommand("gcc \"main.cpp").empty());
+  EXPECT_TRUE(livrn::Command::parseCommand("gcc 'main.cpp").empty());
+}
+
 TEST_F(CommandTest, ParseCommandWithLongArgs) {
   std::string longArg(livrn::Config::MAX_ARG_LENGTH + 1, 'a');
   auto result = livrn::Command::parseCommand("gcc " + longArg + " main.cpp");
@@ -41,3 +54,13 @@ TEST_F(CommandTest, ParseEmptyCommand) {
   auto result = livrn::Command::parseCommand("");
   EXPECT_TRUE(result.empty());
 }
+
+TEST_F(CommandTest, PreparedCommandSurvivesMove) {
+  livrn::PreparedCommand first(
+      livrn::Command::parseCommand("make \"target name\" -j4"));
+  livrn::PreparedCommand moved(std::move(first));
+
+  ASSERT_FALSE(moved.empty());
+  EXPECT_EQ(moved.arguments().size(), 3u);
+  EXPECT_EQ(moved.toString(), "make target name -j4");
+}
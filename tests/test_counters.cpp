@@ -0,0 +1,58 @@
+#include "../src/process/manager.h"
+#include "test_helpers.h"
+#include <gtest/gtest.h>
+
+using livrn::PerfEvent;
+using livrn::PerfSample;
+
+class PerfCountersTest : public ::testing::Test {
+protected:
+  static PerfSample sample(uint64_t taskClockNs, uint64_t faults) {
+    PerfSample result;
+    result.values[static_cast<size_t>(PerfEvent::TaskClock)] = taskClockNs;
+    result.available[static_cast<size_t>(PerfEvent::TaskClock)] = true;
+    result.values[static_cast<size_t>(PerfEvent::PageFaults)] = faults;
+    result.available[static_cast<size_t>(PerfEvent::PageFaults)] = true;
+    result.wallNs = 2000000000;
+    return result;
+  }
+};
+
+TEST_F(PerfCountersTest, CountsChildFromExec) {
+  livrn::ProcessManager processManager;
+  processManager.enableCounters();
+  ASSERT_TRUE(processManager.startProcess(
+      {"sh", "-c", "i=0; while [ $i -lt 20000 ]; do i=$((i+1)); done"}));
+  pid_t pid = processManager.childProcess();
+  waitpid(pid, nullptr, 0);
+  processManager.releaseChild();
+
+  livrn::PerfCounters *counters = processManager.counters();
+  ASSERT_NE(counters, nullptr);
+  if (!counters->isAttached())
+    GTEST_SKIP() << "perf_event_open is not permitted here";
+
+  PerfSample totals = counters->read();
+  EXPECT_TRUE(totals.has(PerfEvent::TaskClock));
+  EXPECT_GT(totals.value(PerfEvent::TaskClock), 1000000u);
+  EXPECT_GT(totals.value(PerfEvent::PageFaults), 0u);
+
+  // Final counts do not move once the process is gone
+  EXPECT_EQ(counters->read().value(PerfEvent::TaskClock),
+            totals.value(PerfEvent::TaskClock));
+}
+
+TEST_F(PerfCountersTest, DescribesChangeAgainstPreviousRun) {
+  PerfSample previous = sample(200000000, 1000);
+  PerfSample current = sample(150000000, 1100);
+
+  EXPECT_EQ(livrn::PerfCounters::describe(current, nullptr),
+            "task-clock 150.0 ms, 1100 page-faults over 2.00 s");
+  EXPECT_EQ(livrn::PerfCounters::describe(current, &previous),
+            "task-clock 150.0 ms (-25.0%), 1100 page-faults (+10.0%) over "
+            "2.00 s");
+
+  PerfSample interval = current.since(previous);
+  EXPECT_EQ(interval.value(PerfEvent::TaskClock), 0u);
+  EXPECT_EQ(interval.value(PerfEvent::PageFaults), 100u);
+}
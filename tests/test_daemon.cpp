@@ -0,0 +1,153 @@
+#include "../src/daemon/daemon.h"
+#include "test_helpers.h"
+#include <fcntl.h>
+#include <gtest/gtest.h>
+
+class DaemonTest : public ::testing::Test {
+protected:
+  std::string root;
+  std::string socketPath;
+  pid_t daemonPid = -1;
+
+  void SetUp() override {
+    TestEnvironment::SetUpTestDirectory();
+    TestEnvironment::createTestFile("main.cpp", "int main() {}");
+    TestEnvironment::createTestFile("util.h", "#pragma once");
+    root = fs::current_path().string();
+    socketPath = root + "/daemon.sock";
+
+    daemonPid = fork();
+    ASSERT_GE(daemonPid, 0);
+    if (daemonPid == 0) {
+      // Stands in for Core: reports what the session was started with
+      livrn::Daemon daemon([](livrn::Reloader &, int argc, char *argv[]) {
+        const char *probe = std::getenv("LIVERUN_PROBE");
+        std::cout << argv[argc - 1] << " " << fs::current_path().string()
+                  << " " << (probe ? probe : "-") << std::endl;
+        return 7;
+      });
+      _exit(daemon.run(socketPath));
+    }
+  }
+
+  void TearDown() override {
+    if (daemonPid > 0) {
+      livrn::DaemonSocket::Message reply;
+      int fd = connectWithRetry();
+      if (fd >= 0) {
+        livrn::DaemonSocket::send(fd, {"shutdown"});
+        livrn::DaemonSocket::receive(fd, reply);
+        close(fd);
+      }
+      int status = 0;
+      waitpid(daemonPid, &status, 0);
+      EXPECT_TRUE(WIFEXITED(status));
+      EXPECT_EQ(WEXITSTATUS(status), 0);
+    }
+    TestEnvironment::TearDownTestDirectory();
+  }
+
+  int connectWithRetry() {
+    for (int i = 0; i < 200; ++i) {
+      int fd = livrn::DaemonSocket::connect(socketPath);
+      if (fd >= 0)
+        return fd;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return -1;
+  }
+
+  // Runs one session through the daemon and returns its exit message
+  livrn::DaemonSocket::Message attachOnce() {
+    livrn::DaemonSocket::Message reply;
+    int fd = connectWithRetry();
+    int input = open("/dev/null", O_RDONLY);
+    int output = open("/dev/null", O_WRONLY);
+    if (fd >= 0 && livrn::DaemonSocket::send(
+                       fd, {"attach", root, "2", "liverun", "probe"},
+                       {input, output, output}))
+      livrn::DaemonSocket::receive(fd, reply);
+    close(input);
+    close(output);
+    if (fd >= 0)
+      close(fd);
+    return reply;
+  }
+
+  std::string statusOf(const std::string &path) {
+    livrn::DaemonSocket::Message reply;
+    int fd = connectWithRetry();
+    if (fd >= 0 && livrn::DaemonSocket::send(fd, {"status"}))
+      livrn::DaemonSocket::receive(fd, reply);
+    if (fd >= 0)
+      close(fd);
+    for (size_t i = 1; i + 1 < reply.size(); i += 2) {
+      if (reply[i] == path)
+        return reply[i + 1];
+    }
+    return "";
+  }
+};
+
+TEST_F(DaemonTest, AttachRunsModeInClientContext) {
+  int fd = connectWithRetry();
+  ASSERT_GE(fd, 0);
+
+  int output[2];
+  ASSERT_EQ(pipe(output), 0);
+  int input = open("/dev/null", O_RDONLY);
+
+  ASSERT_TRUE(livrn::DaemonSocket::send(
+      fd, {"attach", root, "2", "liverun", "probe", "LIVERUN_PROBE=42"},
+      {input, output[1], output[1]}));
+  close(input);
+  close(output[1]);
+
+  livrn::DaemonSocket::Message reply;
+  ASSERT_TRUE(livrn::DaemonSocket::receive(fd, reply));
+  ASSERT_EQ(reply.size(), 2u);
+  EXPECT_EQ(reply[0], "exit");
+  EXPECT_EQ(reply[1], "7");
+  close(fd);
+
+  // Output went to the descriptors the client passed in
+  std::string streamed;
+  char buffer[256];
+  ssize_t n;
+  while ((n = read(output[0], buffer, sizeof(buffer))) > 0)
+    streamed.append(buffer, n);
+  close(output[0]);
+  EXPECT_EQ(streamed, "probe " + root + " 42\n");
+
+  // The root stays indexed for the next attach
+  fd = connectWithRetry();
+  ASSERT_GE(fd, 0);
+  ASSERT_TRUE(livrn::DaemonSocket::send(fd, {"status"}));
+  ASSERT_TRUE(livrn::DaemonSocket::receive(fd, reply));
+  close(fd);
+  ASSERT_EQ(reply.size(), 3u);
+  EXPECT_EQ(reply[1], root);
+  EXPECT_EQ(reply[2], "2");
+}
+
+TEST_F(DaemonTest, RejectsAttachWithoutTerminal) {
+  int fd = connectWithRetry();
+  ASSERT_GE(fd, 0);
+
+  ASSERT_TRUE(livrn::DaemonSocket::send(
+      fd, {"attach", root, "2", "liverun", "probe"}));
+
+  livrn::DaemonSocket::Message reply;
+  ASSERT_TRUE(livrn::DaemonSocket::receive(fd, reply));
+  EXPECT_EQ(reply[0], "error");
+  close(fd);
+}
+
+TEST_F(DaemonTest, RootIsRewarmedAfterEachAttach) {
+  EXPECT_EQ(attachOnce(), livrn::DaemonSocket::Message({"exit", "7"}));
+  // Lands while the root is re-indexed behind the first session
+  TestEnvironment::createTestFile("extra.h", "#pragma once");
+  EXPECT_EQ(attachOnce(), livrn::DaemonSocket::Message({"exit", "7"}));
+  EXPECT_EQ(attachOnce(), livrn::DaemonSocket::Message({"exit", "7"}));
+  EXPECT_EQ(statusOf(root), "3");
+}
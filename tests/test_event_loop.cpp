@@ -0,0 +1,67 @@
+#include "../src/event/loop.h"
+#include "test_helpers.h"
+#include <gtest/gtest.h>
+
+class EventLoopTest : public ::testing::Test {
+protected:
+  livrn::EventLoop loop;
+};
+
+TEST_F(EventLoopTest, OneShotTimerFiresOnce) {
+  int fired = 0;
+  livrn::Timer timer(loop, [&]() {
+    ++fired;
+    loop.stop(7);
+  });
+  timer.start(10);
+
+  EXPECT_EQ(loop.run(), 7);
+  EXPECT_EQ(fired, 1);
+  EXPECT_FALSE(timer.isArmed());
+}
+
+TEST_F(EventLoopTest, CancelledTimerDoesNotFire) {
+  bool cancelledFired = false;
+  livrn::Timer cancelled(loop, [&]() { cancelledFired = true; });
+  livrn::Timer stopper(loop, [&]() { loop.stop(); });
+
+  cancelled.start(5);
+  cancelled.cancel();
+  stopper.start(30);
+
+  loop.run();
+  EXPECT_FALSE(cancelledFired);
+}
+
+TEST_F(EventLoopTest, WatchChildReportsExitStatus) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    _exit(3);
+  }
+  ASSERT_GT(pid, 0);
+
+  int exitStatus = -1;
+  ASSERT_TRUE(loop.watchChild(pid, [&](int status) {
+    exitStatus = status;
+    loop.stop();
+  }));
+
+  livrn::Timer timeout(loop, [&]() { loop.stop(1); });
+  timeout.start(5000);
+
+  EXPECT_EQ(loop.run(), 0);
+  ASSERT_TRUE(WIFEXITED(exitStatus));
+  EXPECT_EQ(WEXITSTATUS(exitStatus), 3);
+}
+
+TEST_F(EventLoopTest, SignalDeliveredThroughLoop) {
+  int received = 0;
+  ASSERT_TRUE(loop.onSignal(SIGUSR1, [&](int signo) {
+    received = signo;
+    loop.stop();
+  }));
+
+  raise(SIGUSR1);
+  loop.run();
+  EXPECT_EQ(received, SIGUSR1);
+}
@@ -0,0 +1,156 @@
+#include "../src/util/fingerprint.h"
+#include "test_helpers.h"
+#include <gtest/gtest.h>
+
+using livrn::SourceFingerprints;
+
+class SourceFingerprintTest : public ::testing::Test {
+protected:
+  void SetUp() override { TestEnvironment::SetUpTestDirectory(); }
+  void TearDown() override { TestEnvironment::TearDownTestDirectory(); }
+
+  static bool same(const std::string &extension, const std::string &a,
+                   const std::string &b) {
+    return SourceFingerprints::ofText(a, extension) ==
+           SourceFingerprints::ofText(b, extension);
+  }
+};
+
+TEST_F(SourceFingerprintTest, CommentsAndSpacingDoNotCount) {
+  EXPECT_TRUE(same(".cpp", "int main() { return 0; }",
+                   "// entry point\nint main()\n{\n  return 0; /* ok */\n}\n"));
+  EXPECT_TRUE(same(".cpp", "int  x=1;", "int x = 1;"));
+  EXPECT_FALSE(same(".cpp", "int x = 1;", "int x = 2;"));
+  EXPECT_FALSE(same(".cpp", "int x;", "intx;"));
+
+  // Operators that would fuse keep their separation
+  EXPECT_FALSE(same(".cpp", "a - -b;", "a --b;"));
+  EXPECT_FALSE(same(".cpp", "x = a / *p;", "x = a /*p;*/;"));
+  EXPECT_TRUE(same(".cpp", "a - -b;", "a -  -b;"));
+}
+
+TEST_F(SourceFingerprintTest, LiteralsAreVerbatim) {
+  EXPECT_FALSE(same(".cpp", "s = \"a b\";", "s = \"a  b\";"));
+  EXPECT_FALSE(same(".cpp", "s = \"// x\";", "s = \"// y\";"));
+  EXPECT_FALSE(same(".cpp", "c = ' ';", "c = '\t';"));
+  EXPECT_FALSE(same(".cpp", "s = R\"(a \" // b)\";",
+                    "s = R\"(a \" // c)\";"));
+  EXPECT_TRUE(same(".cpp", "n = 1'000; // one\nc = 'a';",
+                   "n = 1'000;\nc = 'a'; // two"));
+  EXPECT_FALSE(same(".go", "s := `a b`", "s := `a  b`"));
+  EXPECT_FALSE(same(".rs", "let s = r#\"a \" b\"#;",
+                    "let s = r#\"a \"  b\"#;"));
+  EXPECT_TRUE(same(".rs", "fn f<'a>(x: &'a str) -> char { 'x' }",
+                   "fn f<'a>(x: &'a str) -> char {\n  'x'\n}"));
+}
+
+TEST_F(SourceFingerprintTest, LineBreaksCountWhereTheyMatter) {
+  // Semicolon insertion
+  EXPECT_FALSE(same(".go", "return\nx", "return x"));
+  EXPECT_FALSE(same(".js", "return\nx", "return x"));
+  EXPECT_FALSE(same(".js", "return /*\n*/ x", "return x"));
+  EXPECT_TRUE(same(".go", "x := 1\n\n\ny := 2 // two\n", "x := 1\ny := 2"));
+  EXPECT_TRUE(same(".rs", "fn f()\n{\n  g()\n}", "fn f() { g() }"));
+
+  // A directive ends at the line break, unless it is continued
+  EXPECT_FALSE(same(".c", "#define X 1\nint y;", "#define X 1 int y;"));
+  EXPECT_TRUE(same(".c", "#define X \\\n  1\nint y;", "#define X 1\nint y;"));
+  EXPECT_TRUE(same(".c", "int a =\n  b * c;", "int a = b * c;"));
+
+  // A line comment ending in a backslash swallows the next line
+  EXPECT_FALSE(same(".c", "// note \\\nint x = 1;\nint y;",
+                    "int x = 1;\nint y;"));
+  EXPECT_TRUE(same(".c", "// note \\\nint x = 1;\nint y;", "int y;"));
+  EXPECT_FALSE(same(".go", "// note \\\nx := 1", ""));
+}
+
+TEST_F(SourceFingerprintTest, MacroParameterListsKeepTheirSpacing) {
+  // A function-like macro and an object-like one expanding to "(x) x"
+  EXPECT_FALSE(same(".h", "#define F(x) x\n", "#define F (x) x\n"));
+  EXPECT_FALSE(same(".h", "#define F(x) x\n", "#define F\t(x) x\n"));
+  EXPECT_FALSE(same(".h", "#define F(x) x\n", "#define F/**/(x) x\n"));
+  EXPECT_TRUE(same(".h", "#define F(x) x\n", "#define F(x)  x // id\n"));
+  EXPECT_TRUE(same(".h", "#define F (x) x\n", "#define F  (x) x\n"));
+  EXPECT_TRUE(same(".h", "#define X\nint y;", "#define X \nint y;"));
+}
+
+TEST_F(SourceFingerprintTest, PythonIndentationCounts) {
+  std::string original = "def f(x):\n    if x:\n        return 1\n"
+                         "    return 2\n";
+  EXPECT_TRUE(same(".py", original,
+                   "# helper\ndef f(x):  # x is a flag\n\n  if x:\n"
+                   "    return 1\n\n  return 2\n"));
+  EXPECT_TRUE(same(".py", "call(a,\n     b)\n", "call(a, b)\n"));
+  EXPECT_FALSE(same(".py", original,
+                    "def f(x):\n    if x:\n        return 1\n"
+                    "        return 2\n"));
+  EXPECT_FALSE(same(".py", "x = '''a\n b'''\n", "x = '''a\nb'''\n"));
+  EXPECT_FALSE(same(".py", "x = 1\ny = 2\n", "x = 1 y = 2\n"));
+}
+
+TEST_F(SourceFingerprintTest, ScriptRegexAndTemplates) {
+  EXPECT_FALSE(same(".js", "r = /a b/;", "r = /a  b/;"));
+  EXPECT_FALSE(same(".js", "r = /[/]// x/;", "r = /[/]// y/;"));
+  EXPECT_TRUE(same(".js", "x = a / b / c;", "x = a/b/c; // ratio"));
+  // A regex right after a statement's condition
+  EXPECT_FALSE(same(".js", "if (x) /a b/.test(s);", "if (x) /a  b/.test(s);"));
+  EXPECT_FALSE(same(".js", "while (f(x)) /a b/.exec(s);",
+                    "while (f(x)) /a  b/.exec(s);"));
+  EXPECT_TRUE(same(".js", "y = f(x) / 2 / z;", "y = f(x)/2/z;"));
+  EXPECT_FALSE(same(".ts", "s = `a ${ b } c`;", "s = `a  ${ b } c`;"));
+  EXPECT_TRUE(same(".ts", "s = `a ${ f( b ) /* x */ } c`;",
+                   "s = `a ${f(b)} c`;"));
+  EXPECT_FALSE(same(".ts", "s = `${ `x ${y}` }`;", "s = `${ `x  ${y}` }`;"));
+}
+
+TEST_F(SourceFingerprintTest, CommentsThatToolsReadCount) {
+  // Go build constraints and directives
+  EXPECT_FALSE(same(".go", "//go:build linux\n\npackage x\n",
+                    "//go:build darwin\n\npackage x\n"));
+  EXPECT_FALSE(same(".go", "// +build linux\n\npackage x\n",
+                    "// +build darwin\n\npackage x\n"));
+  EXPECT_FALSE(same(".go", "//go:embed a.txt\nvar f string\n",
+                    "//go:embed b.txt\nvar f string\n"));
+  EXPECT_TRUE(same(".go", "// go is fun\npackage x\n", "package x\n"));
+
+  // The cgo preamble
+  EXPECT_FALSE(same(".go", "/*\n#include <a.h>\n*/\nimport \"C\"\n",
+                    "/*\n#include <b.h>\n*/\nimport \"C\"\n"));
+  EXPECT_FALSE(same(".go", "// #include <a.h>\nimport \"C\"\n",
+                    "// #include <b.h>\nimport \"C\"\n"));
+  EXPECT_TRUE(same(".go", "/* a */\nimport \"fmt\"\n",
+                   "/* b */\nimport \"fmt\"\n"));
+
+  // TypeScript pragmas
+  EXPECT_FALSE(same(".ts", "// @ts-expect-error\nf(1);\n", "f(1);\n"));
+  EXPECT_FALSE(same(".ts", "f(/* @ts-ignore */ 1);\n", "f(1);\n"));
+  EXPECT_TRUE(same(".ts", "// call f\nf(1);\n", "f(1);\n"));
+
+  // Python type comments
+  EXPECT_FALSE(same(".py", "x = f()  # type: ignore\n", "x = f()\n"));
+  EXPECT_FALSE(same(".py", "def f(a):\n    # type: (int) -> None\n    pass\n",
+                    "def f(a):\n    # type: (str) -> None\n    pass\n"));
+  EXPECT_TRUE(same(".py", "x = f()  # typed later\n", "x = f()\n"));
+}
+
+TEST_F(SourceFingerprintTest, RememberedVersionMovesWithEdits) {
+  TestEnvironment::createTestFile("main.cpp", "int main() { return 0; }\n");
+  TestEnvironment::createTestFile("notes.txt", "plain text\n");
+  SourceFingerprints fingerprints;
+  fingerprints.index({"main.cpp", "notes.txt", "missing.cpp"});
+  EXPECT_EQ(fingerprints.size(), 1u);
+
+  TestEnvironment::createTestFile("main.cpp",
+                                  "// comment\nint main() {\n  return 0;\n}\n");
+  EXPECT_TRUE(fingerprints.unchanged("main.cpp"));
+  TestEnvironment::createTestFile("main.cpp", "int main() { return 1; }\n");
+  EXPECT_FALSE(fingerprints.unchanged("main.cpp"));
+  // The edit above is the new reference
+  TestEnvironment::createTestFile("main.cpp", "int main() { return 1; } //\n");
+  EXPECT_TRUE(fingerprints.unchanged("main.cpp"));
+
+  EXPECT_FALSE(fingerprints.unchanged("notes.txt"));
+  fs::remove("main.cpp");
+  EXPECT_FALSE(fingerprints.unchanged("main.cpp"));
+  EXPECT_EQ(fingerprints.size(), 0u);
+}
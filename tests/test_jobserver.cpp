@@ -0,0 +1,147 @@
+#include "../src/process/jobserver.h"
+#include "test_helpers.h"
+#include <gtest/gtest.h>
+
+class JobserverTest : public ::testing::Test {
+protected:
+  void SetUp() override { TestEnvironment::SetUpTestDirectory(); }
+  void TearDown() override { TestEnvironment::TearDownTestDirectory(); }
+
+  // Runs loop until done() holds or timeoutMs passes
+  static void runUntil(livrn::EventLoop &loop, std::function<bool()> done,
+                       int timeoutMs) {
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(timeoutMs);
+    livrn::Timer check(loop, [&]() {
+      if (done() || std::chrono::steady_clock::now() > deadline)
+        loop.stop();
+    });
+    check.start(5, 5);
+    loop.run();
+  }
+};
+
+TEST_F(JobserverTest, TokensBeyondCapacityWait) {
+  livrn::EventLoop loop;
+  livrn::Jobserver jobserver(loop);
+  ASSERT_TRUE(jobserver.start(2, livrn::Jobserver::Style::Fifo));
+  std::string fifo = jobserver.path();
+  EXPECT_TRUE(fs::exists(fifo));
+
+  std::vector<int> granted;
+  int a, b, c, d;
+  jobserver.acquire(&a, [&]() { granted.push_back(1); });
+  jobserver.acquire(&b, [&]() { granted.push_back(2); });
+  jobserver.acquire(&c, [&]() { granted.push_back(3); });
+  jobserver.acquire(&d, [&]() { granted.push_back(4); });
+
+  // The implicit token and the one in the fifo
+  EXPECT_EQ(granted, (std::vector<int>{1, 2}));
+  EXPECT_EQ(jobserver.queued(), 2u);
+
+  // A token from the fifo goes back there and is picked up from it
+  jobserver.cancel(&c);
+  jobserver.release();
+  runUntil(loop, [&]() { return granted.size() == 3; }, 2000);
+  EXPECT_EQ(granted, (std::vector<int>{1, 2, 4}));
+  EXPECT_EQ(jobserver.busy(), 2u);
+
+  jobserver.release();
+  jobserver.release();
+  EXPECT_EQ(jobserver.busy(), 0u);
+
+  jobserver.stop();
+  EXPECT_FALSE(fs::exists(fifo));
+}
+
+TEST_F(JobserverTest, ClientsShareTheTokens) {
+  livrn::EventLoop loop;
+  livrn::Jobserver jobserver(loop);
+  ASSERT_TRUE(jobserver.start(2, livrn::Jobserver::Style::Fifo));
+
+  // A client in the style of make: it finds the fifo in MAKEFLAGS, takes
+  // the free token for a second job and returns it when done
+  std::string flags = (fs::current_path() / "makeflags").string();
+  std::string taken = (fs::current_path() / "taken").string();
+  livrn::PreparedCommand client(
+      {"sh", "-c",
+       "printf '%s' \"$MAKEFLAGS\" > " + flags +
+           "; exec 3<>\"${MAKEFLAGS##*fifo:}\"; dd bs=1 count=1 <&3 "
+           ">/dev/null 2>&1; touch " +
+           taken + "; sleep 0.3; printf + >&3"});
+  jobserver.exportTo(client);
+
+  int step, other;
+  bool stepGranted = false;
+  jobserver.acquire(&step, [&]() { stepGranted = true; });
+  ASSERT_TRUE(stepGranted);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    client.exec();
+    _exit(127);
+  }
+  ASSERT_GT(pid, 0);
+  runUntil(loop, [&]() { return fs::exists(taken); }, 5000);
+  ASSERT_TRUE(fs::exists(taken));
+
+  // Every token is in use until the client hands its one back
+  bool otherGranted = false;
+  auto start = std::chrono::steady_clock::now();
+  jobserver.acquire(&other, [&]() { otherGranted = true; });
+  EXPECT_FALSE(otherGranted);
+  runUntil(loop, [&]() { return otherGranted; }, 5000);
+  EXPECT_TRUE(otherGranted);
+  EXPECT_GE(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(100));
+
+  int status = 0;
+  waitpid(pid, &status, 0);
+  EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  std::ifstream file(flags);
+  std::string makeflags((std::istreambuf_iterator<char>(file)),
+                        std::istreambuf_iterator<char>());
+  EXPECT_NE(makeflags.find("-j2 --jobserver-auth=fifo:" + jobserver.path()),
+            std::string::npos);
+}
+
+TEST_F(JobserverTest, PipeStyleLimitsMake) {
+  if (system("make --version >/dev/null 2>&1") != 0)
+    GTEST_SKIP() << "make not installed";
+
+  TestEnvironment::createTestFile(
+      "Makefile", "all: a b\na:\n\tsleep 0.3\nb:\n\tsleep 0.3\n");
+  livrn::EventLoop loop;
+
+  // Two jobs in parallel with two tokens, one after the other with one
+  for (size_t tokens : {2u, 1u}) {
+    livrn::Jobserver jobserver(loop);
+    // The default style
+    ASSERT_TRUE(jobserver.start(tokens));
+    livrn::PreparedCommand make({"sh", "-c", "make -s 2>warnings"});
+    jobserver.exportTo(make);
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+      make.exec();
+      _exit(127);
+    }
+    ASSERT_GT(pid, 0);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    std::ifstream warnings("warnings");
+    std::string text((std::istreambuf_iterator<char>(warnings)),
+                     std::istreambuf_iterator<char>());
+    EXPECT_EQ(text, "");
+    if (tokens == 2) {
+      EXPECT_LT(elapsed, std::chrono::milliseconds(550));
+    } else {
+      EXPECT_GE(elapsed, std::chrono::milliseconds(600));
+    }
+  }
+}
@@ -0,0 +1,133 @@
+#include "../src/event/exporter.h"
+#include "../src/util/metrics.h"
+#include "test_helpers.h"
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+class MetricsTest : public ::testing::Test {
+protected:
+  void SetUp() override { TestEnvironment::SetUpTestDirectory(); }
+
+  void TearDown() override { TestEnvironment::TearDownTestDirectory(); }
+
+  static std::string readFile(const std::string &path) {
+    std::ifstream file(path);
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+  }
+};
+
+TEST_F(MetricsTest, DisabledMetricsRecordNothing) {
+  livrn::Metrics metrics;
+  metrics.observe(livrn::Phase::Reload, 1000);
+  metrics.observeSpan("compile step", 1000);
+  metrics.add(livrn::Counter::Reloads);
+
+  EXPECT_EQ(metrics.histogram(livrn::Phase::Reload).count(), 0u);
+  EXPECT_EQ(metrics.histogram(livrn::Phase::Build).count(), 0u);
+  EXPECT_EQ(metrics.value(livrn::Counter::Reloads), 0u);
+}
+
+TEST_F(MetricsTest, HistogramBucketsAreCumulativeInExposition) {
+  livrn::Metrics metrics;
+  metrics.enable();
+
+  metrics.observe(livrn::Phase::Reload, 3000000);     // 3 ms
+  metrics.observe(livrn::Phase::Reload, 3000000);     // 3 ms
+  metrics.observeSpan("reload", 200000000);           // 200 ms
+  metrics.observe(livrn::Phase::Reload, 60000000000); // 60 s, above every bound
+  metrics.observeSpan("change detected", 1000);       // not a phase
+  metrics.add(livrn::Counter::ChangedFiles, 3);
+
+  EXPECT_EQ(metrics.histogram(livrn::Phase::Reload).count(), 4u);
+  EXPECT_EQ(metrics.histogram(livrn::Phase::Reload).bucket(2), 2u);
+
+  std::string text = metrics.render();
+  EXPECT_NE(text.find("# TYPE liverun_phase_duration_seconds histogram"),
+            std::string::npos);
+  EXPECT_NE(text.find("liverun_phase_duration_seconds_bucket{phase=\"reload\","
+                      "le=\"0.0025\"} 0\n"),
+            std::string::npos);
+  EXPECT_NE(text.find("liverun_phase_duration_seconds_bucket{phase=\"reload\","
+                      "le=\"0.005\"} 2\n"),
+            std::string::npos);
+  EXPECT_NE(text.find("liverun_phase_duration_seconds_bucket{phase=\"reload\","
+                      "le=\"0.25\"} 3\n"),
+            std::string::npos);
+  EXPECT_NE(text.find("liverun_phase_duration_seconds_bucket{phase=\"reload\","
+                      "le=\"+Inf\"} 4\n"),
+            std::string::npos);
+  EXPECT_NE(
+      text.find("liverun_phase_duration_seconds_count{phase=\"reload\"} 4\n"),
+      std::string::npos);
+  EXPECT_NE(text.find("liverun_changed_files_total 3\n"), std::string::npos);
+  EXPECT_NE(text.find("liverun_resident_memory_bytes "), std::string::npos);
+}
+
+TEST_F(MetricsTest, ExporterRewritesTextfile) {
+  livrn::EventLoop loop;
+  livrn::MetricsExporter exporter(loop, "metrics.prom");
+
+  ASSERT_TRUE(exporter.start());
+  std::string text = readFile("metrics.prom");
+  EXPECT_NE(text.find("liverun_watched_files"), std::string::npos);
+  EXPECT_FALSE(fs::exists("metrics.prom.tmp"));
+
+  fs::remove("metrics.prom");
+  exporter.stop();
+  EXPECT_TRUE(fs::exists("metrics.prom"));
+}
+
+TEST_F(MetricsTest, SocketAnswersOnceTheRequestArrives) {
+  livrn::EventLoop loop;
+  livrn::MetricsExporter exporter(loop, "unix:metrics.sock");
+  ASSERT_TRUE(exporter.start());
+
+  auto connectClient = []() {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, "metrics.sock");
+    connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    return fd;
+  };
+  auto readAll = [](int fd) {
+    std::string text;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+      text.append(buffer, n);
+    }
+    return text;
+  };
+
+  // Accepted long before its request is written, in two pieces
+  std::string slowResponse, silentResponse;
+  std::thread slow([&]() {
+    int fd = connectClient();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    send(fd, "GET / HTTP/1.0\r\n", 16, MSG_NOSIGNAL);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    send(fd, "\r\n", 2, MSG_NOSIGNAL);
+    slowResponse = readAll(fd);
+    close(fd);
+  });
+  // Never sends a request and is dropped after the timeout
+  std::thread silent([&]() {
+    int fd = connectClient();
+    silentResponse = readAll(fd);
+    close(fd);
+  });
+
+  livrn::Timer stopTimer(loop, [&]() { loop.stop(); });
+  stopTimer.start(livrn::Config::METRICS_REQUEST_TIMEOUT_MS + 500);
+  loop.run();
+  slow.join();
+  silent.join();
+
+  EXPECT_EQ(slowResponse.compare(0, 15, "HTTP/1.0 200 OK"), 0);
+  EXPECT_NE(slowResponse.find("liverun_watched_files"), std::string::npos);
+  EXPECT_TRUE(silentResponse.empty());
+}
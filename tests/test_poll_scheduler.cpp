@@ -0,0 +1,117 @@
+#include "../src/process/monitor.h"
+#include "../src/process/poller.h"
+#include "test_helpers.h"
+#include <gtest/gtest.h>
+
+namespace {
+constexpr int64_t MS = 1000000;
+constexpr int64_t SECOND = 1000 * MS;
+} // namespace
+
+class PollSchedulerTest : public ::testing::Test {
+protected:
+  livrn::PollScheduler scheduler;
+  const int64_t now = 1000 * SECOND;
+};
+
+TEST_F(PollSchedulerTest, IntervalDecaysWithIdleTime) {
+  EXPECT_EQ(livrn::PollScheduler::intervalNs(false, 0),
+            livrn::Config::POLL_HOT_INTERVAL_MS * MS);
+  EXPECT_EQ(livrn::PollScheduler::intervalNs(false, 3600 * SECOND),
+            livrn::Config::POLL_COLD_MAX_INTERVAL_MS * MS);
+  EXPECT_EQ(livrn::PollScheduler::intervalNs(true, 3600 * SECOND),
+            livrn::Config::POLL_DIR_MAX_INTERVAL_MS * MS);
+
+  int64_t warm = livrn::PollScheduler::intervalNs(false, 20 * SECOND);
+  EXPECT_GT(warm, livrn::Config::POLL_HOT_INTERVAL_MS * MS);
+  EXPECT_LT(warm, livrn::Config::POLL_COLD_MAX_INTERVAL_MS * MS);
+}
+
+TEST_F(PollSchedulerTest, HotFilesAreDueBeforeColdFiles) {
+  auto hot = scheduler.add("./hot.cpp", false, now, now);
+  auto cold = scheduler.add("./cold.cpp", false, now - 3600 * SECOND, now);
+
+  std::vector<livrn::PollScheduler::Id> due;
+  scheduler.takeDue(now + livrn::Config::POLL_HOT_INTERVAL_MS * MS, due);
+  ASSERT_EQ(due.size(), 1u);
+  EXPECT_EQ(due[0], hot);
+
+  due.clear();
+  scheduler.takeDue(now + livrn::Config::POLL_COLD_MAX_INTERVAL_MS * MS, due);
+  ASSERT_EQ(due.size(), 1u);
+  EXPECT_EQ(due[0], cold);
+}
+
+TEST_F(PollSchedulerTest, TouchPullsColdFileForward) {
+  auto id = scheduler.add("./file.cpp", false, now - 3600 * SECOND, now);
+  scheduler.touch(id, now, now);
+
+  std::vector<livrn::PollScheduler::Id> due;
+  scheduler.takeDue(now + livrn::Config::POLL_HOT_INTERVAL_MS * MS, due);
+  ASSERT_EQ(due.size(), 1u);
+  EXPECT_EQ(due[0], id);
+}
+
+TEST_F(PollSchedulerTest, RemovedEntriesAreNeverDue) {
+  auto dir = scheduler.add("./src", true, now, now);
+  auto file = scheduler.add("./src/a.cpp", false, now, now);
+  ASSERT_EQ(scheduler.children(dir).size(), 1u);
+
+  scheduler.remove(file);
+  EXPECT_TRUE(scheduler.children(dir).empty());
+  EXPECT_EQ(scheduler.find("./src/a.cpp"), livrn::PollScheduler::NONE);
+
+  std::vector<livrn::PollScheduler::Id> due;
+  scheduler.takeDue(now + 3600 * SECOND, due);
+  ASSERT_EQ(due.size(), 1u);
+  EXPECT_EQ(due[0], dir);
+}
+
+class AdaptivePollingTest : public ::testing::Test {
+protected:
+  livrn::ProcessMonitor monitor;
+
+  void SetUp() override { TestEnvironment::SetUpTestDirectory(); }
+
+  void TearDown() override { TestEnvironment::TearDownTestDirectory(); }
+
+  std::vector<std::string> pollUntilChange(int attempts = 20) {
+    for (int i = 0; i < attempts; ++i) {
+      std::this_thread::sleep_for(
+          std::chrono::milliseconds(monitor.nextPollDelayMs()));
+      auto changes = monitor.collectChanges();
+      if (!changes.empty())
+        return changes;
+    }
+    return {};
+  }
+};
+
+TEST_F(AdaptivePollingTest, DetectsInPlaceWriteToHotFile) {
+  TestEnvironment::createTestFile("main.cpp", "v1");
+  monitor.scanDirectory(".");
+  EXPECT_TRUE(monitor.collectChanges().empty());
+
+  TestEnvironment::modifyTestFile("main.cpp", "version 2");
+  auto changes = pollUntilChange();
+  ASSERT_EQ(changes.size(), 1u);
+  EXPECT_EQ(changes[0], "./main.cpp");
+}
+
+TEST_F(AdaptivePollingTest, DirectorySentinelFindsNewAndDeletedFiles) {
+  fs::create_directory("src");
+  TestEnvironment::createTestFile("src/old.cpp", "old");
+  monitor.scanDirectory(".");
+  EXPECT_TRUE(monitor.collectChanges().empty());
+
+  TestEnvironment::createTestFile("src/new.cpp", "new");
+  auto changes = pollUntilChange();
+  ASSERT_EQ(changes.size(), 1u);
+  EXPECT_EQ(changes[0], "./src/new.cpp");
+
+  fs::remove("src/old.cpp");
+  changes = pollUntilChange();
+  ASSERT_EQ(changes.size(), 1u);
+  EXPECT_EQ(changes[0], "./src/old.cpp");
+  EXPECT_EQ(monitor.fileCount(), 1u);
+}
@@ -0,0 +1,76 @@
+#include "../src/process/prefetch.h"
+#include "test_helpers.h"
+#include <fcntl.h>
+#include <gtest/gtest.h>
+
+using livrn::PageCache;
+
+class PageCacheTest : public ::testing::Test {
+protected:
+  void SetUp() override { TestEnvironment::SetUpTestDirectory(); }
+  void TearDown() override { TestEnvironment::TearDownTestDirectory(); }
+};
+
+TEST_F(PageCacheTest, MappedFilesListsBinaryAndLibraries) {
+  std::string sleepBinary =
+      fs::canonical(fs::exists("/usr/bin/sleep") ? "/usr/bin/sleep"
+                                                 : "/bin/sleep")
+          .string();
+  pid_t pid = fork();
+  if (pid == 0) {
+    execl(sleepBinary.c_str(), "sleep", "5", nullptr);
+    _exit(127);
+  }
+  ASSERT_GT(pid, 0);
+
+  // Until the exec the maps are the test binary's, and libc follows once
+  // the dynamic loader gets to it
+  auto hasLibc = [](const std::vector<std::string> &files) {
+    return std::any_of(files.begin(), files.end(), [](const std::string &f) {
+      return f.find("libc") != std::string::npos;
+    });
+  };
+  std::vector<std::string> files;
+  for (int i = 0; i < 200; ++i) {
+    files = PageCache::mappedFiles(pid);
+    if (!files.empty() && files.front() == sleepBinary && hasLibc(files))
+      break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  kill(pid, SIGKILL);
+  waitpid(pid, nullptr, 0);
+
+  ASSERT_FALSE(files.empty());
+  EXPECT_EQ(files.front(), sleepBinary);
+  EXPECT_TRUE(hasLibc(files));
+  for (const auto &file : files) {
+    EXPECT_EQ(file[0], '/') << file;
+    EXPECT_EQ(std::count(files.begin(), files.end(), file), 1) << file;
+  }
+  EXPECT_TRUE(PageCache::mappedFiles(pid).empty());
+}
+
+TEST_F(PageCacheTest, PrefetchBringsFileBackIntoCache) {
+  const size_t size = 8 * 1024 * 1024;
+  TestEnvironment::createTestFile("artifact", std::string(size, 'x'));
+
+  // Written back pages can be dropped; tmpfs keeps them regardless
+  int fd = open("artifact", O_RDONLY);
+  ASSERT_GE(fd, 0);
+  fdatasync(fd);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+  if (PageCache::residentBytes("artifact") > size / 2)
+    GTEST_SKIP() << "the page cache cannot be dropped here";
+
+  EXPECT_EQ(PageCache::prefetch("artifact"), size);
+  uint64_t resident = 0;
+  for (int i = 0; i < 200 && resident < size; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    resident = PageCache::residentBytes("artifact");
+  }
+  EXPECT_EQ(resident, size);
+
+  EXPECT_EQ(PageCache::prefetch("missing"), 0u);
+  EXPECT_EQ(PageCache::prefetch("."), 0u);
+}
@@ -1,5 +1,7 @@
 #include "../src/process/monitor.h"
 #include "test_helpers.h"
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <gtest/gtest.h>
 
 class ProcessMonitorTest : public ::testing::Test {
@@ -50,3 +52,255 @@ TEST_F(ProcessMonitorTest, IgnoreUnsafeFiles) {
   TestEnvironment::modifyTestFile("safe.cpp", "new content");
   EXPECT_TRUE(monitor.hasAnyFileChanged());
 }
+
+TEST_F(ProcessMonitorTest, SkipSymlinksLeavingTree) {
+  TestEnvironment::createTestFile("../outside_target.cpp", "outside");
+  fs::create_directory("../outside_dir");
+  TestEnvironment::createTestFile("../outside_dir/nested.cpp", "outside");
+
+  fs::create_symlink("../outside_target.cpp", "link.cpp");
+  fs::create_directory_symlink("../outside_dir", "linkdir");
+  TestEnvironment::createTestFile("inside.cpp", "inside");
+
+  monitor.scanDirectory(".");
+  EXPECT_EQ(monitor.fileCount(), 1u);
+
+  TestEnvironment::modifyTestFile("../outside_target.cpp", "changed");
+  TestEnvironment::modifyTestFile("../outside_dir/nested.cpp", "changed");
+  EXPECT_FALSE(monitor.hasAnyFileChanged());
+
+  fs::remove("../outside_target.cpp");
+  fs::remove_all("../outside_dir");
+}
+
+TEST_F(ProcessMonitorTest, ScanSkipsBinaryAndForeignExtensions) {
+  TestEnvironment::createTestFile("notes.txt", "text");
+  TestEnvironment::createTestFile("Makefile", "all:");
+  std::ofstream binFile("blob.cpp", std::ios::binary);
+  binFile.write("\x00\x01\x02\x03", 4);
+  binFile.close();
+  fs::create_directory("nested");
+  TestEnvironment::createTestFile("nested/deep.rs", "fn main() {}");
+
+  monitor.scanDirectory(".");
+  EXPECT_EQ(monitor.fileCount(), 1u);
+}
+
+TEST_F(ProcessMonitorTest, NotificationsReportChangedBatch) {
+  TestEnvironment::createTestFile("a.cpp", "a");
+  TestEnvironment::createTestFile("b.cpp", "b");
+  ASSERT_TRUE(monitor.enableNotifications());
+  monitor.scanDirectory(".");
+  ASSERT_GE(monitor.notificationFd(), 0);
+
+  EXPECT_TRUE(monitor.collectChanges().empty());
+
+  TestEnvironment::modifyTestFile("a.cpp", "a2");
+  TestEnvironment::modifyTestFile("b.cpp", "b2");
+  TestEnvironment::modifyTestFile("ignored.txt", "x");
+
+  auto changes = monitor.collectChanges();
+  std::sort(changes.begin(), changes.end());
+  ASSERT_EQ(changes.size(), 2u);
+  EXPECT_EQ(changes[0], "./a.cpp");
+  EXPECT_EQ(changes[1], "./b.cpp");
+}
+
+TEST_F(ProcessMonitorTest, NotificationsPickUpNewDirectories) {
+  ASSERT_TRUE(monitor.enableNotifications());
+  monitor.scanDirectory(".");
+
+  fs::create_directory("pkg");
+  auto changes = monitor.collectChanges();
+  EXPECT_TRUE(changes.empty());
+
+  TestEnvironment::createTestFile("pkg/mod.py", "print(1)");
+  changes = monitor.collectChanges();
+  ASSERT_EQ(changes.size(), 1u);
+  EXPECT_EQ(changes[0], "./pkg/mod.py");
+  EXPECT_EQ(monitor.fileCount(), 1u);
+}
+
+TEST_F(ProcessMonitorTest, FilesystemWideWatchStaysInsideTree) {
+  fs::create_directories("tree/src");
+  TestEnvironment::createTestFile("tree/src/main.cpp", "a");
+  TestEnvironment::createTestFile("outside.cpp", "x");
+
+  fs::current_path("tree");
+  ASSERT_TRUE(monitor.enableNotifications());
+  monitor.scanDirectory(".");
+  fs::current_path("..");
+  if (monitor.backend() != livrn::WatchBackend::Fanotify)
+    GTEST_SKIP() << "filesystem-wide marks need CAP_SYS_ADMIN";
+
+  TestEnvironment::modifyTestFile("outside.cpp", "y");
+  TestEnvironment::modifyTestFile("tree/src/main.cpp", "b");
+  fs::create_directory("tree/pkg");
+  TestEnvironment::createTestFile("tree/pkg/mod.py", "print(1)");
+
+  fs::current_path("tree");
+  auto changes = monitor.collectChanges();
+  fs::current_path("..");
+  std::sort(changes.begin(), changes.end());
+  EXPECT_EQ(changes,
+            (std::vector<std::string>{"./pkg/mod.py", "./src/main.cpp"}));
+}
+
+TEST_F(ProcessMonitorTest, FanotifyReportsTheWritingProcess) {
+  TestEnvironment::createTestFile("a.cpp", "a");
+  TestEnvironment::createTestFile("b.cpp", "b");
+  pid_t self = getpid();
+  monitor.attributeWriters([self](pid_t pid) { return pid != self; });
+  ASSERT_TRUE(monitor.enableNotifications());
+  monitor.scanDirectory(".");
+  if (monitor.backend() != livrn::WatchBackend::Fanotify)
+    GTEST_SKIP() << "filesystem-wide marks need CAP_SYS_ADMIN";
+
+  ASSERT_EQ(system("echo a2 > a.cpp"), 0);
+  TestEnvironment::modifyTestFile("b.cpp", "b2");
+  auto changes = monitor.collectChanges();
+  std::sort(changes.begin(), changes.end());
+  EXPECT_EQ(changes, (std::vector<std::string>{"./a.cpp", "./b.cpp"}));
+  EXPECT_TRUE(monitor.writtenByOwnProcess("./a.cpp"));
+  EXPECT_FALSE(monitor.writtenByOwnProcess("./b.cpp"));
+}
+
+TEST_F(ProcessMonitorTest, PerDirectoryWatchesOnRequest) {
+  TestEnvironment::createTestFile("a.cpp", "a");
+  ASSERT_TRUE(monitor.enableNotifications(false));
+  monitor.scanDirectory(".");
+  EXPECT_EQ(monitor.backend(), livrn::WatchBackend::Inotify);
+
+  TestEnvironment::modifyTestFile("a.cpp", "a2");
+  EXPECT_EQ(monitor.collectChanges(), (std::vector<std::string>{"./a.cpp"}));
+}
+
+TEST_F(ProcessMonitorTest, ScanReportsFilesChangedSinceWatermark) {
+  TestEnvironment::createTestFile("old.cpp", "a");
+  fs::last_write_time("old.cpp",
+                      fs::file_time_type::clock::now() - std::chrono::hours(1));
+  // Saved just before launch, within a tick of the coarse clock
+  TestEnvironment::createTestFile("recent.cpp", "r");
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  int64_t watermark = livrn::ProcessMonitor::filesystemNowNs(".");
+  TestEnvironment::createTestFile("edited.cpp", "b");
+
+  monitor.scanDirectory(".", watermark);
+  EXPECT_EQ(monitor.fileCount(), 3u);
+  // Created after the watermark, where the filesystem records birth times
+  struct statx sx;
+  if (statx(AT_FDCWD, "edited.cpp", 0, STATX_BTIME, &sx) == 0 &&
+      (sx.stx_mask & STATX_BTIME)) {
+    EXPECT_GT(monitor.addedNs("./edited.cpp"), 0);
+  }
+  EXPECT_EQ(monitor.addedNs("./recent.cpp"), 0);
+  auto settled = monitor.settledFiles();
+  std::sort(settled.begin(), settled.end());
+  EXPECT_EQ(settled, (std::vector<std::string>{"./old.cpp", "./recent.cpp"}));
+  EXPECT_EQ(monitor.collectChanges(),
+            (std::vector<std::string>{"./edited.cpp"}));
+  EXPECT_TRUE(monitor.collectChanges().empty());
+}
+
+TEST_F(ProcessMonitorTest, RescanReportsEveryDifference) {
+  TestEnvironment::createTestFile("a.cpp", "a");
+  TestEnvironment::createTestFile("b.cpp", "b");
+  TestEnvironment::createTestFile("same.cpp", "s");
+  monitor.scanDirectory(".");
+
+  TestEnvironment::modifyTestFile("a.cpp", "a2");
+  fs::remove("b.cpp");
+  fs::create_directory("pkg");
+  TestEnvironment::createTestFile("pkg/c.py", "c");
+
+  auto changes = monitor.rescan();
+  std::sort(changes.begin(), changes.end());
+  EXPECT_EQ(changes, (std::vector<std::string>{"./a.cpp", "./b.cpp",
+                                               "./pkg/c.py"}));
+  EXPECT_EQ(monitor.fileCount(), 3u);
+  EXPECT_TRUE(monitor.rescan().empty());
+}
+
+TEST_F(ProcessMonitorTest, WatchRootsIndexEachTreeOnce) {
+  fs::create_directories("app");
+  fs::create_directories("lib/sub");
+  TestEnvironment::createTestFile("app/main.cpp", "a");
+  TestEnvironment::createTestFile("lib/util.cpp", "u");
+  TestEnvironment::createTestFile("lib/sub/deep.go", "d");
+
+  // The second and third root overlap the first
+  monitor.watchRoots({"lib/", "./lib", "lib/sub"});
+  monitor.scanDirectory("app");
+  auto files = monitor.files();
+  std::sort(files.begin(), files.end());
+  EXPECT_EQ(files, (std::vector<std::string>{"app/main.cpp", "lib/sub/deep.go",
+                                             "lib/util.cpp"}));
+
+  TestEnvironment::modifyTestFile("lib/sub/deep.go", "d2");
+  EXPECT_EQ(monitor.pollChanges(),
+            (std::vector<std::string>{"lib/sub/deep.go"}));
+  EXPECT_TRUE(monitor.rescan().empty());
+  EXPECT_EQ(monitor.fileCount(), 3u);
+}
+
+TEST_F(ProcessMonitorTest, FollowedSymlinksIndexEachFileOnce) {
+  fs::create_directories("tree");
+  fs::create_directories("shared");
+  TestEnvironment::createTestFile("tree/a.cpp", "a");
+  TestEnvironment::createTestFile("shared/s.cpp", "s");
+  TestEnvironment::createTestFile("target.cpp", "t");
+  fs::create_directory_symlink("../shared", "tree/shared");
+  fs::create_directory_symlink(".", "tree/loop");
+  fs::create_symlink("a.cpp", "tree/alias.cpp");
+  fs::create_symlink("../target.cpp", "tree/linked.cpp");
+  fs::create_hard_link("tree/a.cpp", "tree/hard.cpp");
+
+  fs::current_path("tree");
+  monitor.followSymlinks(true);
+  monitor.scanDirectory(".");
+  auto files = monitor.files();
+  std::sort(files.begin(), files.end());
+  // a.cpp and hard.cpp are one file; whichever the scan met first stays
+  ASSERT_EQ(files.size(), 3u);
+  EXPECT_TRUE(files[0] == "./a.cpp" || files[0] == "./hard.cpp");
+  EXPECT_EQ(files[1], "./linked.cpp");
+  EXPECT_EQ(files[2], "./shared/s.cpp");
+
+  TestEnvironment::modifyTestFile("../shared/s.cpp", "s2");
+  TestEnvironment::modifyTestFile("../target.cpp", "t2");
+  auto changes = monitor.pollChanges();
+  std::sort(changes.begin(), changes.end());
+  EXPECT_EQ(changes, (std::vector<std::string>{"./linked.cpp",
+                                               "./shared/s.cpp"}));
+  fs::current_path("..");
+}
+
+TEST_F(ProcessMonitorTest, NotificationsFollowLinkTargets) {
+  fs::create_directories("tree");
+  fs::create_directories("shared");
+  TestEnvironment::createTestFile("tree/a.cpp", "a");
+  TestEnvironment::createTestFile("shared/s.cpp", "s");
+  TestEnvironment::createTestFile("target.cpp", "t");
+  fs::create_directory_symlink("../shared", "tree/shared");
+  fs::create_symlink("../target.cpp", "tree/linked.cpp");
+
+  fs::current_path("tree");
+  monitor.followSymlinks(true);
+  ASSERT_TRUE(monitor.enableNotifications());
+  monitor.scanDirectory(".");
+  fs::current_path("..");
+
+  TestEnvironment::modifyTestFile("shared/s.cpp", "s2");
+  TestEnvironment::modifyTestFile("target.cpp", "t2");
+  // Neighbours of the link target are not watched
+  TestEnvironment::createTestFile("other.cpp", "o");
+  TestEnvironment::createTestFile("shared/new.cpp", "n");
+
+  fs::current_path("tree");
+  auto changes = monitor.collectChanges();
+  fs::current_path("..");
+  std::sort(changes.begin(), changes.end());
+  EXPECT_EQ(changes,
+            (std::vector<std::string>{"./linked.cpp", "./shared/new.cpp",
+                                      "./shared/s.cpp"}));
+}
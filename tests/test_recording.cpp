@@ -0,0 +1,70 @@
+#include "../src/reloader.h"
+#include "../src/util/metrics.h"
+#include "../src/util/recording.h"
+#include "test_helpers.h"
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+
+class ChangeRecordingTest : public ::testing::Test {
+protected:
+  void SetUp() override { TestEnvironment::SetUpTestDirectory(); }
+
+  void TearDown() override { TestEnvironment::TearDownTestDirectory(); }
+};
+
+TEST_F(ChangeRecordingTest, RecordedBatchesReadBack) {
+  {
+    livrn::ChangeRecorder recorder;
+    ASSERT_TRUE(recorder.open("changes.rec"));
+    recorder.record({"./src/main.cpp", "./src/util.h"});
+    recorder.record({});
+    recorder.record({"./src/main.cpp"});
+  }
+
+  std::vector<livrn::RecordedBatch> batches;
+  ASSERT_TRUE(livrn::ChangeRecording::load("changes.rec", batches));
+  ASSERT_EQ(batches.size(), 2u);
+  EXPECT_EQ(batches[0].paths,
+            (std::vector<std::string>{"./src/main.cpp", "./src/util.h"}));
+  EXPECT_EQ(batches[1].paths, (std::vector<std::string>{"./src/main.cpp"}));
+  // Batches recorded back to back still replay as two
+  EXPECT_LT(batches[0].offsetUs, batches[1].offsetUs);
+}
+
+TEST_F(ChangeRecordingTest, RejectsMalformedRecording) {
+  for (const char *bad : {"./main.cpp\n", "12 ./main.cpp\n", "x\t./main.cpp\n",
+                          "500\t./a.cpp\n100\t./b.cpp\n"}) {
+    std::vector<livrn::RecordedBatch> batches;
+    std::istringstream input(bad);
+    EXPECT_FALSE(livrn::ChangeRecording::parse(input, batches)) << bad;
+  }
+}
+
+TEST_F(ChangeRecordingTest, ReplayDrivesPipeline) {
+  TestEnvironment::createTestFile("Makefile", "all:\n\techo >> builds\n");
+  TestEnvironment::createTestFile("app", "#!/bin/sh\nexec sleep 10\n");
+  chmod("app", 0755);
+
+  // Fed back to back, all three land inside one debounce window
+  std::istringstream input("0\t./main.cpp\n"
+                           "1000\t./main.cpp\n"
+                           "1000\t./util.h\n"
+                           "250000\t./util.h\n");
+  std::vector<livrn::RecordedBatch> batches;
+  ASSERT_TRUE(livrn::ChangeRecording::parse(input, batches));
+  ASSERT_EQ(batches.size(), 3u);
+
+  livrn::Metrics &metrics = livrn::Metrics::instance();
+  uint64_t reloadsBefore = metrics.value(livrn::Counter::Reloads);
+  {
+    livrn::Reloader reloader;
+    reloader.setReplay(std::move(batches), 0);
+    EXPECT_EQ(reloader.runCompileMode("./app", "make"), 0);
+  }
+
+  EXPECT_EQ(metrics.value(livrn::Counter::Reloads) - reloadsBefore, 1u);
+  std::ifstream builds("builds");
+  std::string contents((std::istreambuf_iterator<char>(builds)),
+                       std::istreambuf_iterator<char>());
+  EXPECT_EQ(contents, "\n\n");
+}
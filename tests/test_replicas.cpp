@@ -0,0 +1,145 @@
+#include "../src/replicaset.h"
+#include "test_helpers.h"
+#include <gtest/gtest.h>
+
+class ReplicaSetTest : public ::testing::Test {
+protected:
+  livrn::EventLoop loop;
+
+  void SetUp() override { TestEnvironment::SetUpTestDirectory(); }
+
+  void TearDown() override { TestEnvironment::TearDownTestDirectory(); }
+
+  static livrn::ReplicaSet::Options options(size_t count) {
+    livrn::ReplicaSet::Options opts;
+    opts.count = count;
+    opts.settleMs = 100;
+    return opts;
+  }
+
+  static size_t running(livrn::ReplicaSet &set) {
+    size_t count = 0;
+    for (size_t i = 0; i < set.size(); ++i) {
+      if (set.replica(i).currentState() == livrn::SessionState::Running)
+        ++count;
+    }
+    return count;
+  }
+};
+
+TEST_F(ReplicaSetTest, ReplicasGetTheirOwnEnvironment) {
+  auto opts = options(3);
+  opts.basePort = 18000;
+  livrn::ReplicaSet set(
+      loop, {},
+      {"sh", "-c",
+       "echo $LIVERUN_REPLICA/$LIVERUN_REPLICAS/$PORT > "
+       "replica-$LIVERUN_REPLICA; exec sleep 10"},
+      opts);
+
+  livrn::Timer check(loop, [&]() { loop.stop(); });
+  set.start([&](int code) { loop.stop(100 + code); });
+  check.start(300);
+
+  EXPECT_EQ(loop.run(), 0);
+  EXPECT_EQ(running(set), 3u);
+  for (int i = 0; i < 3; ++i) {
+    std::ifstream file("replica-" + std::to_string(i));
+    std::string line;
+    std::getline(file, line);
+    EXPECT_EQ(line, std::to_string(i) + "/3/" + std::to_string(18000 + i));
+  }
+}
+
+TEST_F(ReplicaSetTest, RollingRestartKeepsReplicasServing) {
+  livrn::ReplicaSet set(loop, {}, {"sleep", "10"}, options(3));
+
+  std::vector<pid_t> before;
+  size_t fewestRunning = 3;
+  livrn::Timer check(loop, [&]() {
+    fewestRunning = std::min(fewestRunning, running(set));
+    if (set.isRolling())
+      return;
+    for (size_t i = 0; i < set.size(); ++i) {
+      if (set.replica(i).processes().childProcess() == before[i])
+        return;
+    }
+    loop.stop();
+  });
+  livrn::Timer trigger(loop, [&]() {
+    for (size_t i = 0; i < set.size(); ++i) {
+      before.push_back(set.replica(i).processes().childProcess());
+    }
+    set.reload();
+    check.start(10, 10);
+  });
+
+  set.start([&](int code) { loop.stop(100 + code); });
+  trigger.start(200);
+
+  EXPECT_EQ(loop.run(), 0);
+  EXPECT_GE(fewestRunning, 2u);
+  EXPECT_EQ(running(set), 3u);
+}
+
+TEST_F(ReplicaSetTest, FailingVersionStopsTheRollout) {
+  livrn::ReplicaSet set(
+      loop, {}, {"sh", "-c", "test -e broken && exit 1; exec sleep 10"},
+      options(2));
+
+  pid_t untouched = -1;
+  livrn::Timer check(loop, [&]() {
+    if (!set.isRolling())
+      loop.stop();
+  });
+  livrn::Timer trigger(loop, [&]() {
+    untouched = set.replica(1).processes().childProcess();
+    TestEnvironment::createTestFile("broken", "");
+    set.reload();
+    check.start(10, 10);
+  });
+
+  set.start([&](int code) { loop.stop(100 + code); });
+  trigger.start(200);
+
+  EXPECT_EQ(loop.run(), 0);
+  EXPECT_EQ(set.replica(0).currentState(), livrn::SessionState::Idle);
+  EXPECT_EQ(set.replica(1).currentState(), livrn::SessionState::Running);
+  EXPECT_EQ(set.replica(1).processes().childProcess(), untouched);
+}
+
+TEST_F(ReplicaSetTest, RestartRollsOutWithoutBuilding) {
+  std::vector<livrn::PreparedCommand> steps;
+  steps.emplace_back(std::vector<std::string>{"sh", "-c", "echo >> builds"});
+  livrn::ReplicaSet set(loop, std::move(steps), {"sleep", "10"}, options(2));
+
+  std::vector<pid_t> before;
+  livrn::Timer check(loop, [&]() {
+    if (set.isRolling())
+      return;
+    for (size_t i = 0; i < set.size(); ++i) {
+      if (set.replica(i).processes().childProcess() == before[i])
+        return;
+    }
+    loop.stop();
+  });
+  livrn::Timer trigger(loop, [&]() {
+    for (size_t i = 0; i < set.size(); ++i) {
+      before.push_back(set.replica(i).processes().childProcess());
+    }
+    set.restart();
+    check.start(10, 10);
+  });
+
+  set.start([&](int code) { loop.stop(100 + code); });
+  trigger.start(300);
+
+  EXPECT_EQ(loop.run(), 0);
+  EXPECT_EQ(running(set), 2u);
+  std::ifstream builds("builds");
+  std::string line;
+  size_t count = 0;
+  while (std::getline(builds, line))
+    ++count;
+  EXPECT_EQ(count, 1u);
+}
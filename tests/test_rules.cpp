@@ -0,0 +1,95 @@
+#include "../src/util/rules.h"
+#include <gtest/gtest.h>
+
+using livrn::ActionRules;
+using livrn::ChangeAction;
+
+class ActionRulesTest : public ::testing::Test {
+protected:
+  static ActionRules parse(const std::string &text) {
+    ActionRules rules;
+    std::istringstream input(text);
+    EXPECT_TRUE(ActionRules::parse(input, rules));
+    return rules;
+  }
+};
+
+TEST_F(ActionRulesTest, GlobsFollowDirectories) {
+  // No slash: the file name anywhere
+  EXPECT_TRUE(ActionRules::matches("*.yaml", "./app.yaml"));
+  EXPECT_TRUE(ActionRules::matches("*.yaml", "./config/deep/app.yaml"));
+  EXPECT_FALSE(ActionRules::matches("*.yaml", "./app.yaml.bak"));
+
+  // With a slash: the path from the root, one directory per '*'
+  EXPECT_TRUE(ActionRules::matches("config/*.yaml", "./config/app.yaml"));
+  EXPECT_FALSE(ActionRules::matches("config/*.yaml", "./config/a/app.yaml"));
+  EXPECT_FALSE(ActionRules::matches("config/*.yaml", "./x/config/app.yaml"));
+
+  // '**' spans directories, including none
+  EXPECT_TRUE(ActionRules::matches("static/**", "./static/css/site.css"));
+  EXPECT_TRUE(ActionRules::matches("**/*.html", "./index.html"));
+  EXPECT_TRUE(ActionRules::matches("**/*.html", "./web/views/index.html"));
+  EXPECT_TRUE(ActionRules::matches("src/**/gen_*.h", "./src/gen_api.h"));
+
+  EXPECT_TRUE(ActionRules::matches("v?.json", "./v1.json"));
+  EXPECT_TRUE(ActionRules::matches("[ab]*.txt", "./beta.txt"));
+  EXPECT_FALSE(ActionRules::matches("[!ab]*.txt", "./beta.txt"));
+}
+
+TEST_F(ActionRulesTest, ParsesActions) {
+  ActionRules rules = parse("# comment\n"
+                            "\n"
+                            "config/*.yaml = signal USR1\n"
+                            "*.conf = signal\n"
+                            "templates/** = restart\n"
+                            "./static/** = ignore\n"
+                            "*.proto = step make proto\n"
+                            "*.cpp = rebuild\n");
+  ASSERT_EQ(rules.all().size(), 6u);
+  EXPECT_EQ(rules.all()[0].signo, SIGUSR1);
+  EXPECT_EQ(rules.all()[1].signo, SIGHUP);
+  EXPECT_EQ(rules.all()[2].action, ChangeAction::Restart);
+  EXPECT_EQ(rules.all()[3].pattern, "static/**");
+  EXPECT_EQ(rules.all()[4].command, "make proto");
+
+  // Ignored files need no watching
+  EXPECT_EQ(rules.watchedPatterns().size(), 5u);
+
+  for (const char *bad : {"*.yaml signal HUP\n", "*.yaml = signal FOO\n",
+                          "*.yaml = reboot\n", "*.proto = step\n",
+                          "*.cpp = rebuild now\n", " = ignore\n"}) {
+    ActionRules rejected;
+    std::istringstream input(bad);
+    EXPECT_FALSE(ActionRules::parse(input, rejected)) << bad;
+  }
+}
+
+TEST_F(ActionRulesTest, PlanPicksCheapestSufficientAction) {
+  ActionRules rules = parse("config/*.yaml = signal HUP\n"
+                            "*.conf = signal USR2\n"
+                            "templates/** = restart\n"
+                            "static/** = ignore\n"
+                            "*.proto = step make proto\n");
+
+  auto plan = rules.plan({"./static/logo.svg"});
+  EXPECT_EQ(plan.action, ChangeAction::Ignore);
+  EXPECT_TRUE(plan.paths.empty());
+
+  plan = rules.plan({"./config/app.yaml", "./nginx.conf", "./static/a.css"});
+  EXPECT_EQ(plan.action, ChangeAction::Signal);
+  EXPECT_EQ(plan.signals, (std::vector<int>{SIGHUP, SIGUSR2}));
+  EXPECT_EQ(plan.paths.size(), 2u);
+
+  plan = rules.plan({"./config/app.yaml", "./templates/index.html"});
+  EXPECT_EQ(plan.action, ChangeAction::Restart);
+  EXPECT_TRUE(plan.signals.empty());
+
+  // Unmatched paths fall back to a rebuild
+  plan = rules.plan({"./templates/index.html", "./src/main.cpp"});
+  EXPECT_EQ(plan.action, ChangeAction::Rebuild);
+
+  plan = rules.plan({"./api.proto", "./user.proto"});
+  EXPECT_EQ(plan.steps, (std::vector<std::string>{"make proto"}));
+  EXPECT_EQ(plan.action, ChangeAction::Ignore);
+  EXPECT_TRUE(plan.paths.empty());
+}
@@ -0,0 +1,223 @@
+#include "../src/session.h"
+#include "../src/util/metrics.h"
+#include "test_helpers.h"
+#include <gtest/gtest.h>
+
+class SessionTest : public ::testing::Test {
+protected:
+  livrn::EventLoop loop;
+
+  void SetUp() override { TestEnvironment::SetUpTestDirectory(); }
+
+  void TearDown() override { TestEnvironment::TearDownTestDirectory(); }
+
+  static std::vector<livrn::PreparedCommand>
+  steps(std::initializer_list<std::vector<std::string>> commands) {
+    std::vector<livrn::PreparedCommand> prepared;
+    for (const auto &cmd : commands) {
+      prepared.emplace_back(cmd);
+    }
+    return prepared;
+  }
+};
+
+TEST_F(SessionTest, BuildsThenRuns) {
+  livrn::Session session(loop, steps({{"touch", "built"}}),
+                         livrn::PreparedCommand({"sleep", "10"}));
+
+  livrn::Timer check(loop, [&]() { loop.stop(); });
+  session.start([&](int code) { loop.stop(100 + code); });
+  check.start(300);
+
+  EXPECT_EQ(loop.run(), 0);
+  EXPECT_TRUE(fs::exists("built"));
+  EXPECT_EQ(session.currentState(), livrn::SessionState::Running);
+  EXPECT_GT(session.processes().childProcess(), 0);
+}
+
+TEST_F(SessionTest, InitialBuildFailureFinishes) {
+  livrn::Session session(loop, steps({{"false"}}),
+                         livrn::PreparedCommand({"sleep", "10"}));
+
+  session.start([&](int code) { loop.stop(code); });
+
+  EXPECT_EQ(loop.run(), 1);
+  EXPECT_EQ(session.currentState(), livrn::SessionState::Idle);
+  EXPECT_EQ(session.processes().childProcess(), -1);
+}
+
+TEST_F(SessionTest, ReloadRestartsApplication) {
+  livrn::Session session(loop, {}, livrn::PreparedCommand({"sleep", "10"}));
+
+  pid_t firstPid = -1;
+  livrn::Timer check(loop, [&]() {
+    if (session.currentState() == livrn::SessionState::Running &&
+        session.processes().childProcess() != firstPid) {
+      loop.stop();
+    }
+  });
+  livrn::Timer trigger(loop, [&]() {
+    firstPid = session.processes().childProcess();
+    session.reload();
+    check.start(10, 10);
+  });
+
+  session.start([&](int code) { loop.stop(100 + code); });
+  trigger.start(100);
+
+  EXPECT_EQ(loop.run(), 0);
+  EXPECT_GT(firstPid, 0);
+  EXPECT_NE(session.processes().childProcess(), firstPid);
+}
+
+TEST_F(SessionTest, RestartRecordsStopPhases) {
+  livrn::Metrics &metrics = livrn::Metrics::instance();
+  metrics.enable();
+  uint64_t waits = metrics.histogram(livrn::Phase::KillWait).count();
+  uint64_t delays = metrics.histogram(livrn::Phase::ShutdownDelay).count();
+
+  livrn::Session session(loop, {}, livrn::PreparedCommand({"sleep", "10"}));
+  pid_t firstPid = -1;
+  livrn::Timer check(loop, [&]() {
+    if (session.currentState() == livrn::SessionState::Running &&
+        session.processes().childProcess() != firstPid) {
+      loop.stop();
+    }
+  });
+  livrn::Timer trigger(loop, [&]() {
+    firstPid = session.processes().childProcess();
+    session.reload();
+    check.start(10, 10);
+  });
+
+  session.start([&](int code) { loop.stop(100 + code); });
+  trigger.start(100);
+
+  EXPECT_EQ(loop.run(), 0);
+  EXPECT_EQ(metrics.histogram(livrn::Phase::KillWait).count(), waits + 1);
+  EXPECT_EQ(metrics.histogram(livrn::Phase::ShutdownDelay).count(),
+            delays + 1);
+}
+
+TEST_F(SessionTest, ShutdownStopsApplication) {
+  livrn::Session session(loop, {}, livrn::PreparedCommand({"sleep", "10"}));
+
+  livrn::Timer trigger(loop, [&]() { session.shutdown(15); });
+  session.start([&](int code) { loop.stop(code); });
+  trigger.start(100);
+
+  EXPECT_EQ(loop.run(), 15);
+  EXPECT_EQ(session.currentState(), livrn::SessionState::Idle);
+  EXPECT_EQ(session.processes().childProcess(), -1);
+}
+
+// Speaks the control protocol and answers every reload with argv[1]
+static const char *kControlApp =
+    "import os, socket, sys\n"
+    "s = socket.socket(fileno=int(os.environ['LIVERUN_CONTROL_FD']))\n"
+    "s.send(b'hello\\n')\n"
+    "while s.recv(65536):\n"
+    "    s.send(sys.argv[1].encode() + b'\\n')\n";
+
+TEST_F(SessionTest, HotReloadAckKeepsApplication) {
+  livrn::Session session(
+      loop, {}, livrn::PreparedCommand({"python3", "-c", kControlApp, "ack"}));
+  session.enableControlChannel();
+
+  pid_t firstPid = -1;
+  livrn::Timer check(loop, [&]() { loop.stop(); });
+  livrn::Timer trigger(loop, [&]() {
+    firstPid = session.processes().childProcess();
+    session.reload({"./module.py"});
+    check.start(300);
+  });
+
+  session.start([&](int code) { loop.stop(100 + code); });
+  trigger.start(500);
+
+  EXPECT_EQ(loop.run(), 0);
+  EXPECT_GT(firstPid, 0);
+  EXPECT_EQ(session.processes().childProcess(), firstPid);
+  EXPECT_EQ(session.currentState(), livrn::SessionState::Running);
+}
+
+TEST_F(SessionTest, HotReloadNackRestarts) {
+  livrn::Session session(
+      loop, {},
+      livrn::PreparedCommand({"python3", "-c", kControlApp, "nack busy"}));
+  session.enableControlChannel();
+
+  pid_t firstPid = -1;
+  livrn::Timer check(loop, [&]() {
+    if (session.currentState() == livrn::SessionState::Running &&
+        session.processes().childProcess() != firstPid) {
+      loop.stop();
+    }
+  });
+  livrn::Timer trigger(loop, [&]() {
+    firstPid = session.processes().childProcess();
+    session.reload({"./module.py"});
+    check.start(10, 10);
+  });
+
+  session.start([&](int code) { loop.stop(100 + code); });
+  trigger.start(500);
+
+  EXPECT_EQ(loop.run(), 0);
+  EXPECT_GT(firstPid, 0);
+  EXPECT_NE(session.processes().childProcess(), firstPid);
+}
+
+TEST_F(SessionTest, RestartSkipsBuild) {
+  livrn::Session session(loop, steps({{"sh", "-c", "echo >> builds"}}),
+                         livrn::PreparedCommand({"sleep", "10"}));
+
+  pid_t firstPid = -1;
+  livrn::Timer check(loop, [&]() {
+    if (session.currentState() == livrn::SessionState::Running &&
+        session.processes().childProcess() != firstPid) {
+      loop.stop();
+    }
+  });
+  livrn::Timer trigger(loop, [&]() {
+    firstPid = session.processes().childProcess();
+    session.restart();
+    check.start(10, 10);
+  });
+
+  session.start([&](int code) { loop.stop(100 + code); });
+  trigger.start(200);
+
+  EXPECT_EQ(loop.run(), 0);
+  EXPECT_NE(session.processes().childProcess(), firstPid);
+  std::ifstream builds("builds");
+  std::string contents((std::istreambuf_iterator<char>(builds)),
+                       std::istreambuf_iterator<char>());
+  EXPECT_EQ(contents, "\n");
+}
+
+TEST_F(SessionTest, SignalReachesRunningApplication) {
+  livrn::Session session(
+      loop, {},
+      livrn::PreparedCommand(
+          {"sh", "-c",
+           "trap 'touch got-hup' HUP; while :; do sleep 0.01; done"}));
+
+  pid_t firstPid = -1;
+  livrn::Timer check(loop, [&]() {
+    if (fs::exists("got-hup"))
+      loop.stop();
+  });
+  livrn::Timer trigger(loop, [&]() {
+    firstPid = session.processes().childProcess();
+    session.signal(SIGHUP);
+    check.start(10, 10);
+  });
+
+  session.start([&](int code) { loop.stop(100 + code); });
+  trigger.start(200);
+
+  EXPECT_EQ(loop.run(), 0);
+  EXPECT_EQ(session.currentState(), livrn::SessionState::Running);
+  EXPECT_EQ(session.processes().childProcess(), firstPid);
+}
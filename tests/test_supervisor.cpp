@@ -0,0 +1,112 @@
+#include "../src/process/pool.h"
+#include "../src/reloader.h"
+#include "../src/util/services.h"
+#include "test_helpers.h"
+#include <gtest/gtest.h>
+
+class SupervisorTest : public ::testing::Test {};
+
+TEST_F(SupervisorTest, ParseServicesFile) {
+  std::istringstream input("# local stack\n"
+                           "jobs = 3\n"
+                           "\n"
+                           "[api]\n"
+                           "cwd = services/api\n"
+                           "build = make api\n"
+                           "build = make migrate\n"
+                           "run = ./bin/api --port 8080\n"
+                           "\n"
+                           "[web]\n"
+                           "watch = web\n"
+                           "watch = shared\n"
+                           "run = npm start\n");
+
+  livrn::ServiceConfig config;
+  ASSERT_TRUE(livrn::ServiceFile::parse(input, config));
+  EXPECT_EQ(config.jobs, 3u);
+  ASSERT_EQ(config.services.size(), 2u);
+
+  const auto &api = config.services[0];
+  EXPECT_EQ(api.name, "api");
+  EXPECT_EQ(api.workingDirectory, "services/api");
+  ASSERT_EQ(api.buildCommands.size(), 2u);
+  EXPECT_EQ(api.buildCommands[1], "make migrate");
+  EXPECT_EQ(api.runCommand, "./bin/api --port 8080");
+  ASSERT_EQ(api.watchPaths.size(), 1u);
+  EXPECT_EQ(api.watchPaths[0], "services/api");
+
+  const auto &web = config.services[1];
+  EXPECT_TRUE(web.buildCommands.empty());
+  ASSERT_EQ(web.watchPaths.size(), 2u);
+  EXPECT_EQ(web.watchPaths[1], "shared");
+}
+
+TEST_F(SupervisorTest, RejectInvalidServicesFile) {
+  livrn::ServiceConfig config;
+
+  std::istringstream missingRun("[api]\nbuild = make\n");
+  EXPECT_FALSE(livrn::ServiceFile::parse(missingRun, config));
+
+  config = {};
+  std::istringstream duplicate("[a]\nrun = x\n[a]\nrun = y\n");
+  EXPECT_FALSE(livrn::ServiceFile::parse(duplicate, config));
+
+  config = {};
+  std::istringstream unknownKey("[a]\nrun = x\nrestart = always\n");
+  EXPECT_FALSE(livrn::ServiceFile::parse(unknownKey, config));
+
+  config = {};
+  std::istringstream empty("# nothing\n");
+  EXPECT_FALSE(livrn::ServiceFile::parse(empty, config));
+}
+
+TEST_F(SupervisorTest, BuildPoolQueuesBeyondCapacity) {
+  livrn::BuildPool pool(2);
+  std::vector<int> granted;
+  int a, b, c, d;
+
+  pool.acquire(&a, [&]() { granted.push_back(1); });
+  pool.acquire(&b, [&]() { granted.push_back(2); });
+  pool.acquire(&c, [&]() { granted.push_back(3); });
+  pool.acquire(&d, [&]() { granted.push_back(4); });
+
+  EXPECT_EQ(granted, (std::vector<int>{1, 2}));
+  EXPECT_EQ(pool.queued(), 2u);
+
+  pool.cancel(&c);
+  pool.release();
+  EXPECT_EQ(granted, (std::vector<int>{1, 2, 4}));
+  EXPECT_EQ(pool.busy(), 2u);
+
+  pool.release();
+  pool.release();
+  EXPECT_EQ(pool.busy(), 0u);
+}
+
+TEST_F(SupervisorTest, BuildPoolGrantsNothingAfterCancelAll) {
+  livrn::BuildPool pool(1);
+  bool started = false;
+  int a, b;
+
+  pool.acquire(&a, []() {});
+  pool.acquire(&b, [&]() { started = true; });
+  pool.cancelAll();
+  pool.release();
+  EXPECT_FALSE(started);
+  EXPECT_EQ(pool.busy(), 0u);
+}
+
+TEST_F(SupervisorTest, WatchPathsMatchMonitorPaths) {
+  using livrn::Reloader;
+  std::string cwd = fs::current_path().string();
+  EXPECT_EQ(Reloader::watchPrefix("src/"), "./src");
+  EXPECT_EQ(Reloader::watchPrefix("./src/api"), "./src/api");
+  EXPECT_EQ(Reloader::watchPrefix("."), ".");
+  // Absolute paths are made relative to the working directory
+  EXPECT_EQ(Reloader::watchPrefix(cwd + "/src/api/"), "./src/api");
+  EXPECT_EQ(Reloader::watchPrefix(cwd), ".");
+  EXPECT_EQ(Reloader::watchPrefix(fs::path(cwd).parent_path().string() +
+                                  "/shared"),
+            "../shared");
+  EXPECT_EQ(Reloader::watchPrefix("../shared"), "../shared");
+}
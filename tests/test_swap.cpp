@@ -0,0 +1,127 @@
+#include "../src/session.h"
+#include "liverun/host.h"
+#include "test_helpers.h"
+#include <gtest/gtest.h>
+
+class SwapTest : public ::testing::Test {
+protected:
+  livrn::EventLoop loop;
+
+  void SetUp() override {
+    if (system("which g++ > /dev/null 2>&1") != 0) {
+      GTEST_SKIP() << "g++ not available in test environment";
+    }
+    TestEnvironment::SetUpTestDirectory();
+  }
+
+  void TearDown() override {
+    if (fs::current_path().filename() == "test_dir")
+      TestEnvironment::TearDownTestDirectory();
+  }
+
+  static bool buildLibrary(const std::string &name, int version) {
+    TestEnvironment::createTestFile(
+        "lib.cpp",
+        "extern \"C\" int version() { return " + std::to_string(version) +
+            "; }\n");
+    return system(("g++ -shared -fPIC -o " + name + " lib.cpp").c_str()) == 0;
+  }
+
+  static std::string readFile(const std::string &path) {
+    std::ifstream file(path);
+    std::string content;
+    std::getline(file, content);
+    return content;
+  }
+};
+
+TEST_F(SwapTest, HostLibrarySwapsVersions) {
+  ASSERT_TRUE(buildLibrary("libv1.so", 1));
+  ASSERT_TRUE(buildLibrary("libv2.so", 2));
+
+  int pair[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, pair), 0);
+  setenv("LIVERUN_CONTROL_FD", std::to_string(pair[1]).c_str(), 1);
+
+  char buffer[256];
+  {
+    liverun::HotLibrary lib("./libv1.so");
+    unsetenv("LIVERUN_CONTROL_FD");
+    ASSERT_TRUE(lib.loaded());
+    EXPECT_EQ(lib.symbol<int (*)()>("version")(), 1);
+
+    ssize_t n = recv(pair[0], buffer, sizeof(buffer), 0);
+    EXPECT_EQ(std::string(buffer, n), "hello\n");
+
+    int swappedTo = 0;
+    lib.onSwap([&](liverun::HotLibrary &next) {
+      swappedTo = next.symbol<int (*)()>("version")();
+      return true;
+    });
+
+    std::string request = "swap\n" + fs::absolute("libv2.so").string() + "\n";
+    send(pair[0], request.data(), request.size(), 0);
+    EXPECT_TRUE(lib.poll());
+    EXPECT_EQ(swappedTo, 2);
+    EXPECT_EQ(lib.symbol<int (*)()>("version")(), 2);
+
+    n = recv(pair[0], buffer, sizeof(buffer), 0);
+    EXPECT_EQ(std::string(buffer, n), "ack\n");
+
+    request = "swap\n" + fs::absolute("missing.so").string() + "\n";
+    send(pair[0], request.data(), request.size(), 0);
+    EXPECT_FALSE(lib.poll());
+    EXPECT_EQ(lib.symbol<int (*)()>("version")(), 2);
+
+    n = recv(pair[0], buffer, sizeof(buffer), 0);
+    EXPECT_EQ(std::string(buffer, 5), "nack ");
+  }
+  close(pair[0]);
+}
+
+TEST_F(SwapTest, SessionSwapsLibraryWithoutRestart) {
+  TestEnvironment::createTestFile(
+      "host.cpp", "#include \"liverun/host.h\"\n"
+                  "#include <fstream>\n"
+                  "int main() {\n"
+                  "  liverun::HotLibrary lib(\"./libhot.so\");\n"
+                  "  while (true) {\n"
+                  "    lib.poll();\n"
+                  "    std::ofstream(\"version.txt\")\n"
+                  "        << lib.symbol<int (*)()>(\"version\")() << '\\n';\n"
+                  "    usleep(10000);\n"
+                  "  }\n"
+                  "}\n");
+  ASSERT_EQ(system("g++ -I" LIVERUN_INCLUDE_DIR " host.cpp -o host -ldl"), 0);
+  ASSERT_TRUE(buildLibrary("libhot.so", 1));
+
+  std::vector<livrn::PreparedCommand> steps;
+  steps.emplace_back(std::vector<std::string>{"g++", "-shared", "-fPIC", "-o",
+                                              "libhot.so", "lib.cpp"});
+  livrn::Session session(loop, std::move(steps),
+                         livrn::PreparedCommand({"./host"}));
+  session.setSwapLibrary("libhot.so");
+
+  pid_t firstPid = -1;
+  livrn::Timer check(loop, [&]() {
+    if (readFile("version.txt") == "2")
+      loop.stop();
+  });
+  livrn::Timer trigger(loop, [&]() {
+    firstPid = session.processes().childProcess();
+    TestEnvironment::modifyTestFile("lib.cpp",
+                                    "extern \"C\" int version() { return 2; }\n");
+    session.reload({"./lib.cpp"});
+    check.start(20, 20);
+  });
+  livrn::Timer timeout(loop, [&]() { loop.stop(2); });
+
+  session.start([&](int code) { loop.stop(100 + code); });
+  trigger.start(1500);
+  timeout.start(20000);
+
+  EXPECT_EQ(loop.run(), 0);
+  EXPECT_GT(firstPid, 0);
+  EXPECT_EQ(session.processes().childProcess(), firstPid);
+  EXPECT_EQ(session.currentState(), livrn::SessionState::Running);
+}
@@ -0,0 +1,64 @@
+#include "../src/util/testmap.h"
+#include "test_helpers.h"
+#include <gtest/gtest.h>
+
+class TestMapTest : public ::testing::Test {
+protected:
+  void SetUp() override { TestEnvironment::SetUpTestDirectory(); }
+
+  void TearDown() override { TestEnvironment::TearDownTestDirectory(); }
+};
+
+TEST_F(TestMapTest, RecognisesTestNamingConventions) {
+  EXPECT_EQ(livrn::TestMap::subjectOf("./tests/test_parser.py"), "parser");
+  EXPECT_EQ(livrn::TestMap::subjectOf("./pkg/parser_test.go"), "parser");
+  EXPECT_EQ(livrn::TestMap::subjectOf("./web/parser.test.ts"), "parser");
+  EXPECT_EQ(livrn::TestMap::subjectOf("./web/parser.spec.js"), "parser");
+  EXPECT_FALSE(livrn::TestMap::isTestFile("./src/parser.cpp"));
+  EXPECT_FALSE(livrn::TestMap::isTestFile("./src/test_.py"));
+}
+
+TEST_F(TestMapTest, SelectsTestsByNameAndDependencies) {
+  fs::create_directories("src");
+  fs::create_directories("build");
+  TestEnvironment::createTestFile("src/parser.h", "");
+  TestEnvironment::createTestFile("src/lexer.h", "");
+  TestEnvironment::createTestFile(
+      "build/test_parser.d",
+      "build/test_parser.cpp.o: tests/test_parser.cpp src/parser.h \\\n"
+      " src/lexer.h\n"
+      "src/lexer.h:\n");
+
+  livrn::TestMap map;
+  map.addTest("./tests/test_parser.cpp");
+  map.addTest("./tests/test_lexer.cpp");
+  ASSERT_TRUE(map.loadDependencies("build/test_parser.d"));
+
+  std::vector<std::string> unmapped;
+  auto selected = map.affected({"./src/lexer.h"}, &unmapped);
+  EXPECT_EQ(selected, (std::set<std::string>{"./tests/test_lexer.cpp",
+                                             "./tests/test_parser.cpp"}));
+  EXPECT_TRUE(unmapped.empty());
+
+  selected = map.affected({"./src/parser.cpp", "./src/main.cpp"}, &unmapped);
+  EXPECT_EQ(selected, (std::set<std::string>{"./tests/test_parser.cpp"}));
+  EXPECT_EQ(unmapped, (std::vector<std::string>{"./src/main.cpp"}));
+}
+
+TEST_F(TestMapTest, MapFileLinksTestsToSources) {
+  TestEnvironment::createTestFile(
+      ".liverun-tests", "# exported from coverage\n"
+                        "tests/test_api.py: src/db.py src/http.py\n");
+
+  livrn::TestMap map;
+  map.addTest("./tests/test_api.py");
+  map.addTest("./tests/test_db.py");
+  ASSERT_TRUE(map.loadDependencies(".liverun-tests"));
+
+  auto selected = map.affected({"./src/http.py"}, nullptr);
+  EXPECT_EQ(selected, (std::set<std::string>{"./tests/test_api.py"}));
+
+  map.removeTest("./tests/test_api.py");
+  selected = map.affected({"./src/db.py"}, nullptr);
+  EXPECT_EQ(selected, (std::set<std::string>{"./tests/test_db.py"}));
+}
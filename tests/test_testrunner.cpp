@@ -0,0 +1,153 @@
+#include "../src/testrunner.h"
+#include "test_helpers.h"
+#include <gtest/gtest.h>
+
+class TestRunnerTest : public ::testing::Test {
+protected:
+  livrn::EventLoop loop;
+
+  void SetUp() override { TestEnvironment::SetUpTestDirectory(); }
+  void TearDown() override { TestEnvironment::TearDownTestDirectory(); }
+
+  // Runs loop until done() holds or timeoutMs passes
+  void runUntil(std::function<bool()> done, int timeoutMs) {
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(timeoutMs);
+    livrn::Timer check(loop, [&]() {
+      if (done() || std::chrono::steady_clock::now() > deadline)
+        loop.stop();
+    });
+    check.start(5, 5);
+    loop.run();
+  }
+
+  static std::vector<livrn::PreparedCommand>
+  steps(std::initializer_list<std::vector<std::string>> commands) {
+    std::vector<livrn::PreparedCommand> prepared;
+    for (const auto &cmd : commands) {
+      prepared.emplace_back(cmd);
+    }
+    return prepared;
+  }
+
+  static size_t linesIn(const std::string &path) {
+    std::ifstream file(path);
+    std::string line;
+    size_t lines = 0;
+    while (std::getline(file, line))
+      ++lines;
+    return lines;
+  }
+};
+
+TEST_F(TestRunnerTest, ShardsTestsAcrossThePool) {
+  // Each passes only if the other starts while it runs
+  const std::string together =
+      "touch \"$0.started\"\n"
+      "for i in $(seq 100); do\n"
+      "  [ -e ./test_a.sh.started ] && [ -e ./test_b.sh.started ] && exit 0\n"
+      "  sleep 0.02\n"
+      "done\n"
+      "exit 1\n";
+  TestEnvironment::createTestFile("test_a.sh", together);
+  TestEnvironment::createTestFile("test_b.sh", together);
+  TestEnvironment::createTestFile("test_c.sh", "echo broken; exit 3\n");
+
+  livrn::BuildPool pool(2);
+  livrn::TestRunner runner(loop, {}, {"sh"}, pool);
+  testing::internal::CaptureStdout();
+  runner.start({"./test_a.sh", "./test_b.sh", "./test_c.sh", "./main.sh"},
+               [](int) {});
+  EXPECT_FALSE(runner.isIdle());
+  runUntil([&]() { return runner.isIdle(); }, 5000);
+  std::string output = testing::internal::GetCapturedStdout();
+
+  EXPECT_TRUE(runner.isIdle());
+  EXPECT_NE(output.find("Running 3 of 3 tests on 2 workers"),
+            std::string::npos);
+  EXPECT_NE(output.find("FAIL ./test_c.sh"), std::string::npos);
+  // Output is shown for the failing test only
+  EXPECT_NE(output.find("broken"), std::string::npos);
+  EXPECT_NE(output.find("1 of 3 tests failed"), std::string::npos) << output;
+  EXPECT_EQ(output.find("FAIL ./test_a.sh"), std::string::npos);
+  EXPECT_EQ(output.find("FAIL ./test_b.sh"), std::string::npos);
+  EXPECT_EQ(pool.busy(), 0u);
+}
+
+TEST_F(TestRunnerTest, TestsWaitForTheBuildSteps) {
+  TestEnvironment::createTestFile("test_built.sh", "[ -e built ]\n");
+
+  livrn::BuildPool pool(2);
+  livrn::TestRunner runner(loop,
+                           steps({{"sh", "-c", "sleep 0.2; touch half"},
+                                  {"mv", "half", "built"}}),
+                           {"sh", "{}"}, pool);
+  testing::internal::CaptureStdout();
+  runner.start({"./test_built.sh"}, [](int) {});
+  runUntil([&]() { return runner.isIdle(); }, 5000);
+  std::string output = testing::internal::GetCapturedStdout();
+
+  EXPECT_NE(output.find("All 1 tests passed"), std::string::npos) << output;
+}
+
+TEST_F(TestRunnerTest, ChangesThatNeedNoBuildSkipIt) {
+  TestEnvironment::createTestFile("test_a.sh", "true\n");
+
+  livrn::BuildPool pool(1);
+  livrn::TestRunner runner(loop, steps({{"sh", "-c", "echo >> builds"}}),
+                           {"sh"}, pool);
+  testing::internal::CaptureStdout();
+  runner.start({"./test_a.sh"}, [](int) {});
+  runUntil([&]() { return runner.isIdle(); }, 5000);
+  runner.run({"./test_a.sh"}, false);
+  EXPECT_FALSE(runner.isIdle());
+  runUntil([&]() { return runner.isIdle(); }, 5000);
+  std::string output = testing::internal::GetCapturedStdout();
+
+  // Both batches ran, only the first built
+  EXPECT_EQ(linesIn("builds"), 1u);
+  EXPECT_NE(output.rfind("All 1 tests passed"),
+            output.find("All 1 tests passed"))
+      << output;
+}
+
+TEST_F(TestRunnerTest, ChangesDuringARunAreCoalesced) {
+  TestEnvironment::createTestFile("test_a.sh",
+                                  "echo run >> runs\nsleep 0.3\n");
+
+  livrn::BuildPool pool(1);
+  livrn::TestRunner runner(loop, {}, {"sh"}, pool);
+  testing::internal::CaptureStdout();
+  runner.start({"./test_a.sh"}, [](int) {});
+
+  // Three batches land while the first run is going
+  livrn::Timer edits(loop, [&]() {
+    for (int i = 0; i < 3; ++i) {
+      runner.run({"./test_a.sh"});
+    }
+  });
+  edits.start(100);
+  runUntil([&]() { return linesIn("runs") == 2 && runner.isIdle(); }, 5000);
+  testing::internal::GetCapturedStdout();
+
+  EXPECT_TRUE(runner.isIdle());
+  EXPECT_EQ(linesIn("runs"), 2u);
+}
+
+TEST_F(TestRunnerTest, ShutdownStopsRunningTests) {
+  TestEnvironment::createTestFile("test_slow.sh", "exec sleep 30\n");
+
+  livrn::BuildPool pool(1);
+  livrn::TestRunner runner(loop, {}, {"sh"}, pool);
+  int code = -1;
+  testing::internal::CaptureStdout();
+  runner.start({"./test_slow.sh"}, [&](int exitCode) { code = exitCode; });
+
+  livrn::Timer stop(loop, [&]() { runner.shutdown(7); });
+  stop.start(100);
+  runUntil([&]() { return code != -1; }, 5000);
+  testing::internal::GetCapturedStdout();
+
+  EXPECT_EQ(code, 7);
+  EXPECT_EQ(pool.busy(), 0u);
+}
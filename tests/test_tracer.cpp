@@ -0,0 +1,62 @@
+#include "../src/util/tracer.h"
+#include "test_helpers.h"
+#include <gtest/gtest.h>
+
+class TracerTest : public ::testing::Test {
+protected:
+  void SetUp() override { TestEnvironment::SetUpTestDirectory(); }
+
+  void TearDown() override { TestEnvironment::TearDownTestDirectory(); }
+
+  static std::string readFile(const std::string &path) {
+    std::ifstream file(path);
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+  }
+};
+
+TEST_F(TracerTest, DisabledTracerRecordsNothing) {
+  livrn::Tracer tracer;
+  tracer.complete("build", "compile step", 0, 10);
+  tracer.instant("monitor", "change detected");
+
+  EXPECT_FALSE(tracer.isEnabled());
+  EXPECT_EQ(tracer.size(), 0u);
+}
+
+TEST_F(TracerTest, ExportChromeTraceJson) {
+  livrn::Tracer tracer;
+  tracer.enable(16);
+
+  uint64_t start = livrn::Tracer::nowNs();
+  tracer.complete("build", "compile step", start, start + 2500, "status", 0);
+  tracer.instant("monitor", "change detected", "lag_us", 42);
+
+  ASSERT_EQ(tracer.size(), 2u);
+  ASSERT_TRUE(tracer.exportChromeTrace("trace.json"));
+
+  std::string json = readFile("trace.json");
+  EXPECT_NE(json.find("\"traceEvents\""), std::string::npos);
+  EXPECT_NE(json.find("\"name\":\"compile step\""), std::string::npos);
+  EXPECT_NE(json.find("\"ph\":\"X\""), std::string::npos);
+  EXPECT_NE(json.find("\"dur\":2.500"), std::string::npos);
+  EXPECT_NE(json.find("\"args\":{\"lag_us\":42}"), std::string::npos);
+}
+
+TEST_F(TracerTest, RingBufferKeepsNewestEvents) {
+  livrn::Tracer tracer;
+  tracer.enable(4);
+
+  for (int i = 0; i < 10; ++i) {
+    tracer.instant("reload", "reload", "seq", i);
+  }
+
+  EXPECT_EQ(tracer.size(), 4u);
+  ASSERT_TRUE(tracer.exportChromeTrace("trace.json"));
+
+  std::string json = readFile("trace.json");
+  EXPECT_EQ(json.find("\"seq\":5}"), std::string::npos);
+  EXPECT_NE(json.find("\"seq\":6}"), std::string::npos);
+  EXPECT_NE(json.find("\"seq\":9}"), std::string::npos);
+}